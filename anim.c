@@ -0,0 +1,493 @@
+#include "anim.h"
+
+#include <cglm/cglm.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd.h"
+
+#ifdef SIMD_DISPATCH
+/* 8-lane builds of the entry points below, from anim_avx2.c. */
+void anim_quat_nlerp_avx2(QuatStream from, QuatStream to, const float *t,
+                          QuatStream dest, int count);
+void anim_quat_slerp_avx2(QuatStream from, QuatStream to, const float *t,
+                          QuatStream dest, int count);
+void anim_quat_slerp_fast_avx2(QuatStream from, QuatStream to, const float *t,
+                               QuatStream dest, int count);
+void anim_pose_blend_avx2(const AnimPose *a, const AnimPose *b, float weight,
+                          AnimPose *dest);
+void anim_clip_sample_avx2(const AnimClip *clip, float time,
+                           AnimSampler *sampler, AnimPose *dest);
+#endif
+
+/* How quat_stream_interpolate blends each pair of quaternions. */
+enum { QUAT_NLERP, QUAT_NLERP_FAST, QUAT_SLERP };
+
+typedef struct {
+  lanef x, y, z, w;
+} QuatLanes;
+
+static QuatLanes quat_lanes_load(QuatStream q, int i) {
+  QuatLanes v = {lanef_load(q.x + i), lanef_load(q.y + i), lanef_load(q.z + i),
+                 lanef_load(q.w + i)};
+  return v;
+}
+
+static void quat_lanes_store(QuatStream q, int i, QuatLanes v) {
+  lanef_store(q.x + i, v.x);
+  lanef_store(q.y + i, v.y);
+  lanef_store(q.z + i, v.z);
+  lanef_store(q.w + i, v.w);
+}
+
+static lanef quat_lanes_dot(QuatLanes a, QuatLanes b) {
+  return lanef_add(lanef_add(lanef_mul(a.x, b.x), lanef_mul(a.y, b.y)),
+                   lanef_add(lanef_mul(a.z, b.z), lanef_mul(a.w, b.w)));
+}
+
+/**
+ * Normalized lerp along the shorter arc, matching glm_quat_nlerp. t is
+ * clamped to [0, 1]. With fast set, t is then reshaped by a cubic fitted to
+ * the slerp angle curve, which keeps the result within about 0.001 radians
+ * of an exact slerp.
+ */
+static QuatLanes quat_lanes_nlerp(QuatLanes a, QuatLanes b, lanef t, int fast) {
+  lanef zero = lanef_set1(0.0f);
+  lanef one = lanef_set1(1.0f);
+  lanef dot = quat_lanes_dot(a, b);
+  lanef flip = lanef_lt(dot, zero);
+
+  t = lanef_min(lanef_max(t, zero), one);
+
+  b.x = lanef_select(flip, lanef_neg(b.x), b.x);
+  b.y = lanef_select(flip, lanef_neg(b.y), b.y);
+  b.z = lanef_select(flip, lanef_neg(b.z), b.z);
+  b.w = lanef_select(flip, lanef_neg(b.w), b.w);
+
+  if (fast) {
+    /* Polynomial correction from "Approximating slerp" by A. Kapoulkine. */
+    lanef d = lanef_abs(dot);
+    lanef half = lanef_sub(t, lanef_set1(0.5f));
+    lanef ka =
+        lanef_sub(lanef_set1(3.55645f), lanef_mul(d, lanef_set1(1.43519f)));
+    ka = lanef_add(lanef_set1(-3.2452f), lanef_mul(d, ka));
+    ka = lanef_add(lanef_set1(1.0904f), lanef_mul(d, ka));
+    lanef kb =
+        lanef_add(lanef_set1(-1.06021f), lanef_mul(d, lanef_set1(0.215638f)));
+    kb = lanef_add(lanef_set1(0.848013f), lanef_mul(d, kb));
+    lanef k = lanef_add(lanef_mul(ka, lanef_mul(half, half)), kb);
+    t = lanef_add(t, lanef_mul(lanef_mul(t, half),
+                               lanef_mul(lanef_sub(t, one), k)));
+  }
+
+  QuatLanes r;
+  r.x = lanef_add(a.x, lanef_mul(lanef_sub(b.x, a.x), t));
+  r.y = lanef_add(a.y, lanef_mul(lanef_sub(b.y, a.y), t));
+  r.z = lanef_add(a.z, lanef_mul(lanef_sub(b.z, a.z), t));
+  r.w = lanef_add(a.w, lanef_mul(lanef_sub(b.w, a.w), t));
+
+  lanef norm2 = lanef_add(lanef_add(lanef_mul(r.x, r.x), lanef_mul(r.y, r.y)),
+                          lanef_add(lanef_mul(r.z, r.z), lanef_mul(r.w, r.w)));
+  lanef valid = lanef_gt(norm2, zero);
+  lanef inv = lanef_div(one, lanef_sqrt(lanef_max(norm2, lanef_set1(1e-30f))));
+
+  /* Degenerate results become the identity, like glm_quat_normalize. */
+  r.x = lanef_select(valid, lanef_mul(r.x, inv), zero);
+  r.y = lanef_select(valid, lanef_mul(r.y, inv), zero);
+  r.z = lanef_select(valid, lanef_mul(r.z, inv), zero);
+  r.w = lanef_select(valid, lanef_mul(r.w, inv), one);
+  return r;
+}
+
+/**
+ * acos of x in [0, 1] after Abramowitz and Stegun 4.4.46, absolute error
+ * below 2e-8.
+ */
+static lanef lanef_acos01(lanef x) {
+  static const float c[] = {-0.0012624911f, 0.0066700901f, -0.0170881256f,
+                            0.0308918810f,  -0.0501743046f, 0.0889789874f,
+                            -0.2145988016f, 1.5707963050f};
+  lanef p = lanef_set1(c[0]);
+  for (int k = 1; k < 8; k++) {
+    p = lanef_add(lanef_mul(p, x), lanef_set1(c[k]));
+  }
+  return lanef_mul(lanef_sqrt(lanef_sub(lanef_set1(1.0f), x)), p);
+}
+
+/**
+ * sin of x in [0, pi/2] by its Taylor series up to x^11, absolute error
+ * below 6e-8.
+ */
+static lanef lanef_sin_quadrant(lanef x) {
+  lanef x2 = lanef_mul(x, x);
+  lanef p = lanef_set1(-1.0f / 39916800.0f);
+  p = lanef_add(lanef_mul(p, x2), lanef_set1(1.0f / 362880.0f));
+  p = lanef_add(lanef_mul(p, x2), lanef_set1(-1.0f / 5040.0f));
+  p = lanef_add(lanef_mul(p, x2), lanef_set1(1.0f / 120.0f));
+  p = lanef_add(lanef_mul(p, x2), lanef_set1(-1.0f / 6.0f));
+  p = lanef_add(lanef_mul(p, x2), lanef_set1(1.0f));
+  return lanef_mul(p, x);
+}
+
+/**
+ * One component of a slerp with the sine weights s0 and s1, or of a plain
+ * lerp in the lanes where the inputs are nearly parallel.
+ */
+static lanef slerp_component(lanef a, lanef b, lanef s0, lanef s1, lanef t,
+                             lanef parallel) {
+  lanef lerp = lanef_add(a, lanef_mul(lanef_sub(b, a), t));
+  return lanef_select(parallel, lerp,
+                      lanef_add(lanef_mul(a, s0), lanef_mul(b, s1)));
+}
+
+/**
+ * Spherical lerp following glm_quat_slerp branch for branch, with t clamped
+ * to [0, 1] so both sine arguments stay within the first quadrant. Nearly
+ * parallel inputs fall back to a lerp from the sign-corrected start, where
+ * glm lerps from the original one.
+ */
+static QuatLanes quat_lanes_slerp(QuatLanes a, QuatLanes b, lanef t) {
+  lanef zero = lanef_set1(0.0f);
+  lanef one = lanef_set1(1.0f);
+  lanef dot = quat_lanes_dot(a, b);
+  lanef flip = lanef_lt(dot, zero);
+  lanef cosTheta = lanef_abs(dot);
+  lanef sin2 = lanef_sub(one, lanef_mul(cosTheta, cosTheta));
+  lanef sinTheta = lanef_sqrt(lanef_max(sin2, zero));
+  lanef same = lanef_ge(cosTheta, one);
+  lanef parallel = lanef_lt(sinTheta, lanef_set1(0.001f));
+
+  t = lanef_min(lanef_max(t, zero), one);
+
+  QuatLanes q = {lanef_select(flip, lanef_neg(a.x), a.x),
+                 lanef_select(flip, lanef_neg(a.y), a.y),
+                 lanef_select(flip, lanef_neg(a.z), a.z),
+                 lanef_select(flip, lanef_neg(a.w), a.w)};
+
+  lanef angle = lanef_acos01(lanef_min(cosTheta, one));
+  lanef inv = lanef_div(one, lanef_max(sinTheta, lanef_set1(0.001f)));
+  lanef s0 = lanef_mul(lanef_sin_quadrant(lanef_mul(lanef_sub(one, t), angle)),
+                       inv);
+  lanef s1 = lanef_mul(lanef_sin_quadrant(lanef_mul(t, angle)), inv);
+
+  QuatLanes r = {slerp_component(q.x, b.x, s0, s1, t, parallel),
+                 slerp_component(q.y, b.y, s0, s1, t, parallel),
+                 slerp_component(q.z, b.z, s0, s1, t, parallel),
+                 slerp_component(q.w, b.w, s0, s1, t, parallel)};
+
+  /* Identical inputs return the start unchanged. */
+  r.x = lanef_select(same, a.x, r.x);
+  r.y = lanef_select(same, a.y, r.y);
+  r.z = lanef_select(same, a.z, r.z);
+  r.w = lanef_select(same, a.w, r.w);
+  return r;
+}
+
+static QuatLanes quat_lanes_interpolate(QuatLanes a, QuatLanes b, lanef t,
+                                        int mode) {
+  if (mode == QUAT_SLERP) {
+    return quat_lanes_slerp(a, b, t);
+  }
+  return quat_lanes_nlerp(a, b, t, mode == QUAT_NLERP_FAST);
+}
+
+/**
+ * Runs one of the interpolation kernels over whole streams. t is either a
+ * per-quaternion array or, when NULL, the constant weight. The tail is
+ * padded into local buffers so the kernel always sees full lanes.
+ */
+static void quat_stream_interpolate(QuatStream from, QuatStream to,
+                                    const float *t, float weight,
+                                    QuatStream dest, int count, int mode) {
+  int i = 0;
+
+  for (; i + SIMD_LANES <= count; i += SIMD_LANES) {
+    lanef factor = t ? lanef_load(t + i) : lanef_set1(weight);
+    quat_lanes_store(dest, i,
+                     quat_lanes_interpolate(quat_lanes_load(from, i),
+                                            quat_lanes_load(to, i), factor,
+                                            mode));
+  }
+
+  if (i < count) {
+    float buffer[9][SIMD_LANES] = {{0}};
+    QuatStream a = {buffer[0], buffer[1], buffer[2], buffer[3]};
+    QuatStream b = {buffer[4], buffer[5], buffer[6], buffer[7]};
+    int rest = count - i;
+
+    for (int j = 0; j < rest; j++) {
+      a.x[j] = from.x[i + j];
+      a.y[j] = from.y[i + j];
+      a.z[j] = from.z[i + j];
+      a.w[j] = from.w[i + j];
+      b.x[j] = to.x[i + j];
+      b.y[j] = to.y[i + j];
+      b.z[j] = to.z[i + j];
+      b.w[j] = to.w[i + j];
+      buffer[8][j] = t ? t[i + j] : weight;
+    }
+
+    quat_lanes_store(a, 0,
+                     quat_lanes_interpolate(quat_lanes_load(a, 0),
+                                            quat_lanes_load(b, 0),
+                                            lanef_load(buffer[8]), mode));
+    for (int j = 0; j < rest; j++) {
+      dest.x[i + j] = a.x[j];
+      dest.y[i + j] = a.y[j];
+      dest.z[i + j] = a.z[j];
+      dest.w[i + j] = a.w[j];
+    }
+  }
+}
+
+/**
+ * Linear interpolation of plain float streams, used for translation and
+ * scale channels.
+ */
+static void float_stream_lerp(const float *from, const float *to,
+                              const float *t, float weight, float *dest,
+                              int count) {
+  int i = 0;
+
+  for (; i + SIMD_LANES <= count; i += SIMD_LANES) {
+    lanef a = lanef_load(from + i);
+    lanef factor = t ? lanef_load(t + i) : lanef_set1(weight);
+    lanef_store(dest + i,
+                lanef_add(a, lanef_mul(lanef_sub(lanef_load(to + i), a),
+                                       factor)));
+  }
+  for (; i < count; i++) {
+    float factor = t ? t[i] : weight;
+    dest[i] = from[i] + (to[i] - from[i]) * factor;
+  }
+}
+
+/**
+ * Batch version of glm_quat_nlerp with one interpolation factor per
+ * quaternion, clamped to [0, 1]. dest may alias from or to.
+ */
+void SIMD_NAME(anim_quat_nlerp)(QuatStream from, QuatStream to,
+                                const float *t, QuatStream dest, int count) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    anim_quat_nlerp_avx2(from, to, t, dest, count);
+    return;
+  }
+#endif
+  quat_stream_interpolate(from, to, t, 0.0f, dest, count, QUAT_NLERP);
+}
+
+/**
+ * Batch version of glm_quat_slerp for t in [0, 1], within 1e-6 of it per
+ * component. Prefer anim_quat_slerp_fast for playback.
+ */
+void SIMD_NAME(anim_quat_slerp)(QuatStream from, QuatStream to,
+                                const float *t, QuatStream dest, int count) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    anim_quat_slerp_avx2(from, to, t, dest, count);
+    return;
+  }
+#endif
+  quat_stream_interpolate(from, to, t, 0.0f, dest, count, QUAT_SLERP);
+}
+
+/**
+ * Vectorized slerp approximation: an nlerp with a corrected interpolation
+ * factor, staying within about 0.001 radians of glm_quat_slerp.
+ */
+void SIMD_NAME(anim_quat_slerp_fast)(QuatStream from, QuatStream to,
+                                     const float *t, QuatStream dest,
+                                     int count) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    anim_quat_slerp_fast_avx2(from, to, t, dest, count);
+    return;
+  }
+#endif
+  quat_stream_interpolate(from, to, t, 0.0f, dest, count, QUAT_NLERP_FAST);
+}
+
+#ifndef SIMD_WIDE
+
+/**
+ * Allocates a pose for count bones, initialized to the identity transform.
+ * Returns 0 on success and -1 if the allocation fails.
+ */
+int anim_pose_init(AnimPose *pose, int count) {
+  float *block = malloc((size_t)count * 10 * sizeof(float));
+  if (!block && count > 0) {
+    return -1;
+  }
+
+  pose->count = count;
+  for (int c = 0; c < 3; c++) {
+    pose->translation[c] = block + c * count;
+    pose->scale[c] = block + (3 + c) * count;
+  }
+  pose->rotation.x = block + 6 * count;
+  pose->rotation.y = block + 7 * count;
+  pose->rotation.z = block + 8 * count;
+  pose->rotation.w = block + 9 * count;
+
+  for (int i = 0; i < 10 * count; i++) {
+    block[i] = 0.0f;
+  }
+  for (int i = 0; i < count; i++) {
+    pose->scale[0][i] = pose->scale[1][i] = pose->scale[2][i] = 1.0f;
+    pose->rotation.w[i] = 1.0f;
+  }
+  return 0;
+}
+
+void anim_pose_free(AnimPose *pose) {
+  free(pose->translation[0]);
+  memset(pose, 0, sizeof(*pose));
+}
+
+#endif
+
+/**
+ * Blends two poses of the same skeleton: weight 0 yields a, weight 1 yields
+ * b. dest may alias either input.
+ */
+void SIMD_NAME(anim_pose_blend)(const AnimPose *a, const AnimPose *b,
+                                float weight, AnimPose *dest) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    anim_pose_blend_avx2(a, b, weight, dest);
+    return;
+  }
+#endif
+  int count = dest->count;
+
+  for (int c = 0; c < 3; c++) {
+    float_stream_lerp(a->translation[c], b->translation[c], NULL, weight,
+                      dest->translation[c], count);
+    float_stream_lerp(a->scale[c], b->scale[c], NULL, weight, dest->scale[c],
+                      count);
+  }
+  quat_stream_interpolate(a->rotation, b->rotation, NULL, weight,
+                          dest->rotation, count, QUAT_NLERP);
+}
+
+#ifndef SIMD_WIDE
+int anim_sampler_init(AnimSampler *sampler, int trackCount) {
+  sampler->factor = malloc((size_t)trackCount * sizeof(float));
+  if ((!sampler->factor && trackCount > 0) ||
+      anim_pose_init(&sampler->from, trackCount) != 0) {
+    free(sampler->factor);
+    return -1;
+  }
+  if (anim_pose_init(&sampler->to, trackCount) != 0) {
+    anim_pose_free(&sampler->from);
+    free(sampler->factor);
+    return -1;
+  }
+  return 0;
+}
+
+void anim_sampler_free(AnimSampler *sampler) {
+  anim_pose_free(&sampler->from);
+  anim_pose_free(&sampler->to);
+  free(sampler->factor);
+  sampler->factor = NULL;
+}
+#endif
+
+/**
+ * Returns the index of the last key at or before time, clamped so that the
+ * following key exists.
+ */
+static int find_key(const AnimTrack *track, float time) {
+  int low = 0;
+  int high = track->keyCount - 2;
+
+  while (low < high) {
+    int mid = (low + high + 1) / 2;
+    if (track->times[mid] <= time) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+  return low;
+}
+
+/**
+ * Writes the identity transform as bone i of pose, used for empty tracks.
+ */
+static void identity_key(AnimPose *pose, int i) {
+  for (int c = 0; c < 3; c++) {
+    pose->translation[c][i] = 0.0f;
+    pose->scale[c][i] = 1.0f;
+  }
+  pose->rotation.x[i] = 0.0f;
+  pose->rotation.y[i] = 0.0f;
+  pose->rotation.z[i] = 0.0f;
+  pose->rotation.w[i] = 1.0f;
+}
+
+static void gather_key(AnimPose *pose, int i, const AnimTrack *track, int key) {
+  for (int c = 0; c < 3; c++) {
+    pose->translation[c][i] = track->translations[key][c];
+    pose->scale[c][i] = track->scales[key][c];
+  }
+  pose->rotation.x[i] = track->rotations[key][0];
+  pose->rotation.y[i] = track->rotations[key][1];
+  pose->rotation.z[i] = track->rotations[key][2];
+  pose->rotation.w[i] = track->rotations[key][3];
+}
+
+/**
+ * Samples every track of a clip at time, which is clamped to each track's
+ * key range. Tracks are searched once each to gather the surrounding keys,
+ * the interpolation then runs over all bones in bulk. Tracks without keys
+ * yield the identity transform.
+ */
+void SIMD_NAME(anim_clip_sample)(const AnimClip *clip, float time,
+                                 AnimSampler *sampler, AnimPose *dest) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    anim_clip_sample_avx2(clip, time, sampler, dest);
+    return;
+  }
+#endif
+  int count = clip->trackCount;
+
+  for (int i = 0; i < count; i++) {
+    const AnimTrack *track = &clip->tracks[i];
+
+    if (track->keyCount == 0) {
+      identity_key(&sampler->from, i);
+      identity_key(&sampler->to, i);
+      sampler->factor[i] = 0.0f;
+      continue;
+    }
+    if (track->keyCount == 1) {
+      gather_key(&sampler->from, i, track, 0);
+      gather_key(&sampler->to, i, track, 0);
+      sampler->factor[i] = 0.0f;
+      continue;
+    }
+
+    int key = find_key(track, time);
+    float start = track->times[key];
+    float span = track->times[key + 1] - start;
+    float factor = span > 0.0f ? (time - start) / span : 0.0f;
+
+    gather_key(&sampler->from, i, track, key);
+    gather_key(&sampler->to, i, track, key + 1);
+    sampler->factor[i] = glm_clamp(factor, 0.0f, 1.0f);
+  }
+
+  for (int c = 0; c < 3; c++) {
+    float_stream_lerp(sampler->from.translation[c], sampler->to.translation[c],
+                      sampler->factor, 0.0f, dest->translation[c], count);
+    float_stream_lerp(sampler->from.scale[c], sampler->to.scale[c],
+                      sampler->factor, 0.0f, dest->scale[c], count);
+  }
+  quat_stream_interpolate(sampler->from.rotation, sampler->to.rotation,
+                          sampler->factor, 0.0f, dest->rotation, count,
+                          QUAT_NLERP_FAST);
+}
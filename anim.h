@@ -0,0 +1,69 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <cglm/types.h>
+
+/**
+ * Quaternions stored as structure of arrays: x[i], y[i], z[i], w[i] form
+ * quaternion i, in the same component order as cglm's versor.
+ */
+typedef struct {
+  float *x, *y, *z, *w;
+} QuatStream;
+
+/**
+ * Keyframes of one bone. Translation, rotation and scale share one sorted
+ * time array so a single search locates all three.
+ */
+typedef struct {
+  int keyCount;
+  float *times;
+  vec3 *translations;
+  versor *rotations;
+  vec3 *scales;
+} AnimTrack;
+
+typedef struct {
+  int trackCount;
+  float duration;
+  AnimTrack *tracks;
+} AnimClip;
+
+/**
+ * Local transforms of count bones as structure of arrays.
+ */
+typedef struct {
+  int count;
+  float *translation[3];
+  QuatStream rotation;
+  float *scale[3];
+} AnimPose;
+
+/**
+ * Scratch space for sampling: the two keys surrounding the sample time for
+ * every track and the interpolation factor between them.
+ */
+typedef struct {
+  AnimPose from;
+  AnimPose to;
+  float *factor;
+} AnimSampler;
+
+void anim_quat_nlerp(QuatStream from, QuatStream to, const float *t,
+                     QuatStream dest, int count);
+void anim_quat_slerp(QuatStream from, QuatStream to, const float *t,
+                     QuatStream dest, int count);
+void anim_quat_slerp_fast(QuatStream from, QuatStream to, const float *t,
+                          QuatStream dest, int count);
+
+int anim_pose_init(AnimPose *pose, int count);
+void anim_pose_free(AnimPose *pose);
+void anim_pose_blend(const AnimPose *a, const AnimPose *b, float weight,
+                     AnimPose *dest);
+
+int anim_sampler_init(AnimSampler *sampler, int trackCount);
+void anim_sampler_free(AnimSampler *sampler);
+void anim_clip_sample(const AnimClip *clip, float time, AnimSampler *sampler,
+                      AnimPose *dest);
+
+#endif
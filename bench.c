@@ -0,0 +1,1579 @@
+#include <cglm/cglm.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "anim.h"
+#include "hdr.h"
+#include "jobs.h"
+#include "meshfile.h"
+#include "meshpack.h"
+#include "noisefield.h"
+#include "raycast.h"
+#include "scene.h"
+#include "spatial.h"
+
+/* The JPEG and PNG kernels are static, so the decoder is compiled in here. */
+#define STBI_ONLY_JPEG
+#define STBI_ONLY_PNG
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+/*
+ * Microbenchmarks of the batch kernels, built with `make bench` and run from
+ * the build directory as ./bench [name...]. Each benchmark first checks its
+ * kernel against the scalar code it replaces, then times both.
+ */
+
+static double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static float random_unit(void) { return rand() / (float)RAND_MAX; }
+
+/**
+ * Packets of 8 rays against a soup of random triangles, compared with
+ * glm_ray_triangle over every triangle.
+ */
+static int bench_raycast(void) {
+  enum { VERTICES = 3000, TRIANGLES = 4096, PACKETS = 256, RAYS = 8 };
+  float *positions = malloc(VERTICES * 3 * sizeof(float));
+  unsigned int *indices = malloc(TRIANGLES * 3 * sizeof(unsigned int));
+  RayPacket *packets = malloc(PACKETS * sizeof(RayPacket));
+  RayHit *hits = malloc(PACKETS * RAYS * sizeof(RayHit));
+  TriangleSoup soup = {0};
+  if (!positions || !indices || !packets || !hits) {
+    free(positions);
+    free(indices);
+    free(packets);
+    free(hits);
+    return -1;
+  }
+  srand(1);
+  for (int i = 0; i < VERTICES * 3; i++) {
+    positions[i] = random_unit() * 2.0f - 1.0f;
+  }
+  for (int i = 0; i < TRIANGLES * 3; i++) {
+    indices[i] = rand() % VERTICES;
+  }
+  for (int p = 0; p < PACKETS; p++) {
+    packets[p].count = RAYS;
+    for (int r = 0; r < RAYS; r++) {
+      vec3 origin = {0.0f, 0.0f, -3.0f};
+      vec3 direction = {random_unit() - 0.5f, random_unit() - 0.5f, 1.0f};
+      ray_packet_set(&packets[p], r, origin, direction);
+    }
+  }
+  if (triangle_soup_build(&soup, positions, 3, indices, TRIANGLES) != 0) {
+    free(positions);
+    free(indices);
+    free(packets);
+    free(hits);
+    return -1;
+  }
+
+  double start = now();
+  for (int p = 0; p < PACKETS; p++) {
+    ray_packet_intersect(&packets[p], &soup, hits + p * RAYS);
+  }
+  double packetTime = now() - start;
+
+  int mismatches = 0;
+  start = now();
+  for (int p = 0; p < PACKETS; p++) {
+    for (int r = 0; r < RAYS; r++) {
+      vec3 origin, direction;
+      for (int axis = 0; axis < 3; axis++) {
+        origin[axis] = packets[p].origin[axis][r];
+        direction[axis] = packets[p].direction[axis][r];
+      }
+      float best = FLT_MAX;
+      int triangle = -1;
+      for (int t = 0; t < TRIANGLES; t++) {
+        float distance;
+        if (glm_ray_triangle(origin, direction,
+                             positions + indices[t * 3] * 3,
+                             positions + indices[t * 3 + 1] * 3,
+                             positions + indices[t * 3 + 2] * 3, &distance) &&
+            distance < best) {
+          best = distance;
+          triangle = t;
+        }
+      }
+      const RayHit *hit = &hits[p * RAYS + r];
+      mismatches += triangle != hit->triangle &&
+                    fabsf(best - hit->distance) > 1e-4f;
+    }
+  }
+  double scalarTime = now() - start;
+
+  double tests = (double)PACKETS * RAYS * TRIANGLES;
+  printf("raycast: %d rays x %d triangles, %d mismatches\n", PACKETS * RAYS,
+         TRIANGLES, mismatches);
+  printf("  packets  %8.1f Mtests/s\n", tests / packetTime * 1e-6);
+  printf("  scalar   %8.1f Mtests/s\n", tests / scalarTime * 1e-6);
+  triangle_soup_free(&soup);
+  free(positions);
+  free(indices);
+  free(packets);
+  free(hits);
+  return mismatches ? -1 : 0;
+}
+
+static void random_box(vec2 box[2], float worldSize, float maxSize) {
+  box[0][0] = random_unit() * worldSize;
+  box[0][1] = random_unit() * worldSize;
+  box[1][0] = box[0][0] + random_unit() * maxSize;
+  box[1][1] = box[0][1] + random_unit() * maxSize;
+}
+
+static int boxes_overlap(vec2 a[2], vec2 b[2]) {
+  return a[0][0] <= b[1][0] && a[1][0] >= b[0][0] && a[0][1] <= b[1][1] &&
+         a[1][1] >= b[0][1];
+}
+
+/**
+ * Counts the pairs of a grid of count shapes, clustered or not, and the same
+ * pairs by brute force.
+ */
+static int check_spatial_pairs(int count, int clustered) {
+  SpatialGrid grid;
+  vec2(*boxes)[2] = malloc(count * sizeof(*boxes));
+  if (!boxes || spatial_grid_init(&grid, 2.0f, count) != 0) {
+    free(boxes);
+    return -1;
+  }
+  for (int i = 0; i < count; i++) {
+    random_box(boxes[i], 200.0f, 2.0f);
+    if (clustered && i % 4 == 0) {
+      glm_vec2_copy((vec2){50.0f, 50.0f}, boxes[i][0]);
+      glm_vec2_copy((vec2){51.0f, 51.0f}, boxes[i][1]);
+    }
+    spatial_grid_insert(&grid, boxes[i]);
+  }
+  int pairs = spatial_grid_pairs(&grid, NULL, 0);
+  int expected = 0;
+  for (int a = 0; a < count; a++) {
+    for (int b = a + 1; b < count; b++) {
+      expected += boxes_overlap(boxes[a], boxes[b]);
+    }
+  }
+  spatial_grid_free(&grid);
+  free(boxes);
+  return pairs == expected ? 0 : -1;
+}
+
+/**
+ * Inserts, moves and queries a million small shapes in a loose grid, then
+ * finds all overlapping pairs with a dense cluster among them.
+ */
+static int bench_spatial(void) {
+  enum { SHAPES = 1 << 20, QUERIES = 1 << 18, CLUSTER = 2000 };
+  const float worldSize = 2048.0f;
+  vec2(*boxes)[2] = malloc(SHAPES * sizeof(*boxes));
+  int *ids = malloc(SHAPES * sizeof(int));
+  int *results = malloc(4096 * sizeof(int));
+  SpatialGrid grid;
+  if (!boxes || !ids || !results ||
+      spatial_grid_init(&grid, 2.0f, SHAPES) != 0) {
+    free(boxes);
+    free(ids);
+    free(results);
+    return -1;
+  }
+  srand(2);
+  for (int i = 0; i < SHAPES; i++) {
+    random_box(boxes[i], worldSize, 1.0f);
+  }
+
+  double start = now();
+  for (int i = 0; i < SHAPES; i++) {
+    ids[i] = spatial_grid_insert(&grid, boxes[i]);
+  }
+  double insertTime = now() - start;
+
+  /* Per-frame motion: most shapes stay in their cell, some cross over. */
+  for (int i = 0; i < SHAPES; i++) {
+    float dx = random_unit() * 0.5f - 0.25f, dy = random_unit() * 0.5f - 0.25f;
+    glm_vec2_add(boxes[i][0], (vec2){dx, dy}, boxes[i][0]);
+    glm_vec2_add(boxes[i][1], (vec2){dx, dy}, boxes[i][1]);
+  }
+  start = now();
+  spatial_grid_move_batch(&grid, ids, boxes, SHAPES);
+  double moveTime = now() - start;
+
+  int mismatches = 0;
+  long long hits = 0;
+  start = now();
+  for (int q = 0; q < QUERIES; q++) {
+    vec2 region[2];
+    random_box(region, worldSize, 4.0f);
+    hits += spatial_grid_query(&grid, region, results, 4096);
+  }
+  double queryTime = now() - start;
+  for (int q = 0; q < 16; q++) {
+    vec2 region[2];
+    random_box(region, worldSize, 16.0f);
+    int expected = 0;
+    for (int i = 0; i < SHAPES; i++) {
+      expected += boxes_overlap(boxes[i], region);
+    }
+    mismatches += spatial_grid_query(&grid, region, results, 4096) != expected;
+  }
+
+  /* Every clustered shape overlaps every other, far beyond 256 candidates. */
+  for (int i = 0; i < CLUSTER; i++) {
+    spatial_grid_move(&grid, ids[i],
+                      (vec2[2]){{100.0f, 100.0f}, {100.5f, 100.5f}});
+  }
+  start = now();
+  int pairs = spatial_grid_pairs(&grid, NULL, 0);
+  double pairTime = now() - start;
+  mismatches += pairs < CLUSTER * (CLUSTER - 1) / 2;
+  mismatches += check_spatial_pairs(4096, 0) != 0;
+  mismatches += check_spatial_pairs(4096, 1) != 0;
+
+  printf("spatial: %d shapes, %d mismatches\n", SHAPES, mismatches);
+  printf("  insert   %8.2f M/s\n", SHAPES / insertTime * 1e-6);
+  printf("  move     %8.2f M/s\n", SHAPES / moveTime * 1e-6);
+  printf("  query    %8.2f M/s (%.1f hits each)\n",
+         QUERIES / queryTime * 1e-6, (double)hits / QUERIES);
+  printf("  pairs    %8.3f s for %d pairs, %d-shape cluster\n", pairTime,
+         pairs, CLUSTER);
+  spatial_grid_free(&grid);
+  free(boxes);
+  free(ids);
+  free(results);
+  return mismatches ? -1 : 0;
+}
+
+static void random_quat(versor q) {
+  glm_quat_init(q, random_unit() * 2.0f - 1.0f, random_unit() * 2.0f - 1.0f,
+                random_unit() * 2.0f - 1.0f, random_unit() * 2.0f - 1.0f);
+  glm_quat_normalize(q);
+}
+
+/**
+ * Largest component difference between a quaternion stream and glm's
+ * interpolation of the same inputs.
+ */
+static float check_quat_stream(QuatStream from, QuatStream to, const float *t,
+                               QuatStream dest, int count, int slerp) {
+  float error = 0.0f;
+  for (int i = 0; i < count; i++) {
+    versor a = {from.x[i], from.y[i], from.z[i], from.w[i]};
+    versor b = {to.x[i], to.y[i], to.z[i], to.w[i]};
+    versor r;
+    if (slerp) {
+      glm_quat_slerp(a, b, t[i], r);
+    } else {
+      glm_quat_nlerp(a, b, t[i], r);
+    }
+    error = glm_max(error, fabsf(r[0] - dest.x[i]));
+    error = glm_max(error, fabsf(r[1] - dest.y[i]));
+    error = glm_max(error, fabsf(r[2] - dest.z[i]));
+    error = glm_max(error, fabsf(r[3] - dest.w[i]));
+  }
+  return error;
+}
+
+/**
+ * Samples a clip of many bones and interpolates quaternion streams, checking
+ * the batch nlerp and slerp against glm_quat_nlerp and glm_quat_slerp.
+ */
+static int bench_anim(void) {
+  enum { BONES = 4096, KEYS = 32, FRAMES = 256 };
+  AnimTrack *tracks = calloc(BONES, sizeof(AnimTrack));
+  float *block = malloc((size_t)BONES * KEYS * 11 * sizeof(float));
+  float *t = malloc(BONES * sizeof(float));
+  AnimClip clip = {BONES, 1.0f, tracks};
+  AnimSampler sampler;
+  AnimPose a, b, pose;
+  if (!tracks || !block || !t || anim_sampler_init(&sampler, BONES) != 0) {
+    free(tracks);
+    free(block);
+    free(t);
+    return -1;
+  }
+  if (anim_pose_init(&a, BONES) != 0 || anim_pose_init(&b, BONES) != 0 ||
+      anim_pose_init(&pose, BONES) != 0) {
+    anim_pose_free(&a);
+    anim_pose_free(&b);
+    anim_sampler_free(&sampler);
+    free(tracks);
+    free(block);
+    free(t);
+    return -1;
+  }
+
+  srand(3);
+  for (int i = 0; i < BONES; i++) {
+    float *keys = block + (size_t)i * KEYS * 11;
+    AnimTrack *track = &tracks[i];
+    /* Every 64th track is empty and must sample as the identity. */
+    track->keyCount = i % 64 == 63 ? 0 : KEYS;
+    track->times = keys;
+    track->translations = (vec3 *)(keys + KEYS);
+    track->scales = (vec3 *)(keys + KEYS * 4);
+    track->rotations = (versor *)(keys + KEYS * 7);
+    for (int k = 0; k < KEYS; k++) {
+      track->times[k] = k / (float)(KEYS - 1);
+      glm_vec3_copy((vec3){random_unit(), random_unit(), random_unit()},
+                    track->translations[k]);
+      glm_vec3_one(track->scales[k]);
+      random_quat(track->rotations[k]);
+    }
+  }
+  for (int i = 0; i < BONES; i++) {
+    versor q;
+    random_quat(q);
+    a.rotation.x[i] = q[0], a.rotation.y[i] = q[1];
+    a.rotation.z[i] = q[2], a.rotation.w[i] = q[3];
+    random_quat(q);
+    /* Some pairs are nearly parallel to reach the lerp fallback. */
+    if (i % 16 == 0) {
+      glm_quat_copy((versor){a.rotation.x[i], a.rotation.y[i],
+                             a.rotation.z[i], a.rotation.w[i] + 1e-4f},
+                    q);
+      glm_quat_normalize(q);
+    }
+    b.rotation.x[i] = q[0], b.rotation.y[i] = q[1];
+    b.rotation.z[i] = q[2], b.rotation.w[i] = q[3];
+    t[i] = random_unit();
+  }
+
+  int mismatches = 0;
+  anim_quat_nlerp(a.rotation, b.rotation, t, pose.rotation, BONES);
+  float nlerpError =
+      check_quat_stream(a.rotation, b.rotation, t, pose.rotation, BONES, 0);
+  anim_quat_slerp(a.rotation, b.rotation, t, pose.rotation, BONES);
+  float slerpError =
+      check_quat_stream(a.rotation, b.rotation, t, pose.rotation, BONES, 1);
+  mismatches += nlerpError > 1e-6f;
+  mismatches += slerpError > 1e-6f;
+
+  anim_clip_sample(&clip, 0.3f, &sampler, &pose);
+  for (int i = 63; i < BONES; i += 64) {
+    mismatches += pose.rotation.w[i] != 1.0f || pose.scale[0][i] != 1.0f ||
+                  pose.translation[0][i] != 0.0f;
+  }
+
+  double start = now();
+  for (int f = 0; f < FRAMES; f++) {
+    anim_clip_sample(&clip, f / (float)FRAMES, &sampler, &pose);
+  }
+  double sampleTime = now() - start;
+
+  start = now();
+  for (int f = 0; f < FRAMES; f++) {
+    anim_quat_slerp(a.rotation, b.rotation, t, pose.rotation, BONES);
+  }
+  double slerpTime = now() - start;
+
+  start = now();
+  for (int f = 0; f < FRAMES; f++) {
+    for (int i = 0; i < BONES; i++) {
+      versor qa = {a.rotation.x[i], a.rotation.y[i], a.rotation.z[i],
+                   a.rotation.w[i]};
+      versor qb = {b.rotation.x[i], b.rotation.y[i], b.rotation.z[i],
+                   b.rotation.w[i]};
+      versor r;
+      glm_quat_slerp(qa, qb, t[i], r);
+      pose.rotation.x[i] = r[0], pose.rotation.y[i] = r[1];
+      pose.rotation.z[i] = r[2], pose.rotation.w[i] = r[3];
+    }
+  }
+  double scalarTime = now() - start;
+
+  double bones = (double)BONES * FRAMES;
+  printf("anim: %d bones, nlerp error %.2g, slerp error %.2g, "
+         "%d mismatches\n",
+         BONES, nlerpError, slerpError, mismatches);
+  printf("  sample   %8.1f Mbones/s\n", bones / sampleTime * 1e-6);
+  printf("  slerp    %8.1f Mbones/s\n", bones / slerpTime * 1e-6);
+  printf("  scalar   %8.1f Mbones/s\n", bones / scalarTime * 1e-6);
+  anim_pose_free(&a);
+  anim_pose_free(&b);
+  anim_pose_free(&pose);
+  anim_sampler_free(&sampler);
+  free(tracks);
+  free(block);
+  free(t);
+  return mismatches ? -1 : 0;
+}
+
+/**
+ * One implementation of each JPEG kernel that has an AVX2 version.
+ */
+typedef struct {
+  const char *name;
+  void (*idct)(stbi_uc *out, int stride, short data[64]);
+  void (*ycbcr)(stbi_uc *out, const stbi_uc *y, const stbi_uc *cb,
+                const stbi_uc *cr, int count, int step);
+  stbi_uc *(*hv2)(stbi_uc *out, stbi_uc *near, stbi_uc *far, int w, int hs);
+} JpegKernels;
+
+static const JpegKernels jpegKernels[] = {
+    {"scalar", stbi__idct_block, stbi__YCbCr_to_RGB_row,
+     stbi__resample_row_hv_2},
+#ifdef STBI_SSE2
+    {"sse2", stbi__idct_simd, stbi__YCbCr_to_RGB_simd,
+     stbi__resample_row_hv_2_simd},
+#endif
+#ifdef STBI_AVX2
+    {"avx2", stbi__idct_avx2, stbi__YCbCr_to_RGB_avx2,
+     stbi__resample_row_hv_2_avx2},
+#endif
+};
+
+/**
+ * Runs the IDCT, YCbCr to RGBA conversion and 2x2 chroma upsampling of
+ * stb_image over a 1024x1024 image in every available implementation,
+ * reporting megapixels per second and bytes that differ from the scalar
+ * kernels, which the SIMD ones are meant to match exactly.
+ */
+static int bench_jpeg(void) {
+  enum { SIZE = 1024, BLOCKS = SIZE * SIZE / 64, ROUNDS = 16 };
+  int count = sizeof(jpegKernels) / sizeof(jpegKernels[0]);
+  short(*coefficients)[64] = malloc(BLOCKS * sizeof(*coefficients));
+  stbi_uc *plane = malloc(SIZE * SIZE);
+  stbi_uc *chroma = malloc(SIZE * SIZE / 4);
+  stbi_uc *rgba = malloc((size_t)SIZE * SIZE * 4);
+  stbi_uc *upsampled = malloc(SIZE * SIZE);
+  stbi_uc *expected = malloc((size_t)SIZE * SIZE * 6);
+  if (!coefficients || !plane || !chroma || !rgba || !upsampled ||
+      !expected) {
+    free(coefficients);
+    free(plane);
+    free(chroma);
+    free(rgba);
+    free(upsampled);
+    free(expected);
+    return -1;
+  }
+  srand(4);
+  /* Dequantized coefficients fall off with frequency, as in real images. */
+  for (int b = 0; b < BLOCKS; b++) {
+    for (int k = 0; k < 64; k++) {
+      int range = 1024 >> (k / 8 + k % 8) / 2;
+      coefficients[b][k] = (short)(rand() % (2 * range + 1) - range);
+    }
+  }
+  for (int i = 0; i < SIZE * SIZE / 4; i++) {
+    chroma[i] = (stbi_uc)rand();
+  }
+
+  printf("jpeg: %dx%d, megapixels/s and bytes differing from scalar\n", SIZE,
+         SIZE);
+  int mismatches = 0;
+  for (int k = 0; k < count; k++) {
+    const JpegKernels *kernels = &jpegKernels[k];
+#ifdef STBI_AVX2
+    if (kernels->idct == stbi__idct_avx2 && !stbi__avx2_available()) {
+      continue;
+    }
+#endif
+    double mpixels = (double)SIZE * SIZE * ROUNDS * 1e-6;
+
+    double start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+      for (int b = 0; b < BLOCKS; b++) {
+        int x = b % (SIZE / 8) * 8, y = b / (SIZE / 8) * 8;
+        kernels->idct(plane + y * SIZE + x, SIZE, coefficients[b]);
+      }
+    }
+    double idctTime = now() - start;
+
+    /* Chroma planes are half the size in both directions. */
+    start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+      for (int y = 0; y < SIZE; y++) {
+        stbi_uc *row = chroma + y / 2 * (SIZE / 2);
+        stbi_uc *next = chroma + (y / 2 + 1) % (SIZE / 2) * (SIZE / 2);
+        kernels->hv2(upsampled + y * SIZE, row, next, SIZE / 2, 2);
+      }
+    }
+    double hv2Time = now() - start;
+
+    /* The IDCT output serves as luma, the upsampled plane as both chromas. */
+    start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+      for (int y = 0; y < SIZE; y++) {
+        kernels->ycbcr(rgba + (size_t)y * SIZE * 4, plane + y * SIZE,
+                       upsampled + y * SIZE, upsampled + y * SIZE, SIZE, 4);
+      }
+    }
+    double ycbcrTime = now() - start;
+
+    int differing = 0;
+    if (k == 0) {
+      memcpy(expected, plane, SIZE * SIZE);
+      memcpy(expected + SIZE * SIZE, rgba, (size_t)SIZE * SIZE * 4);
+      memcpy(expected + (size_t)SIZE * SIZE * 5, upsampled, SIZE * SIZE);
+    } else {
+      for (int i = 0; i < SIZE * SIZE; i++) {
+        differing += expected[i] != plane[i];
+        differing += expected[(size_t)SIZE * SIZE * 5 + i] != upsampled[i];
+      }
+      for (size_t i = 0; i < (size_t)SIZE * SIZE * 4; i++) {
+        differing += expected[SIZE * SIZE + i] != rgba[i];
+      }
+      mismatches += differing;
+    }
+    printf("  %-6s idct %7.1f  ycbcr %7.1f  hv_2 %7.1f  %d differing\n",
+           kernels->name, mpixels / idctTime, mpixels / ycbcrTime,
+           mpixels / hv2Time, differing);
+  }
+  free(coefficients);
+  free(plane);
+  free(chroma);
+  free(rgba);
+  free(upsampled);
+  free(expected);
+  return mismatches ? -1 : 0;
+}
+
+/**
+ * Fills an image with gradients plus a little noise, which deflates to
+ * roughly the ratio of a photo once filtered.
+ */
+static void random_image(unsigned char *pixels, int width, int height,
+                         int channels) {
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      unsigned char *pixel = pixels + ((size_t)y * width + x) * channels;
+      for (int c = 0; c < channels; c++) {
+        pixel[c] = (unsigned char)((x * (c + 1) + y * (3 - c)) / 8 +
+                                   rand() % 8);
+      }
+    }
+  }
+}
+
+/**
+ * Writes the PNG scanlines of an 8-bit image, each one filter type byte
+ * followed by the filtered row. Row y uses filter y % 5 if filter is -1,
+ * as encoders mix them.
+ */
+static void png_filter_rows(const unsigned char *pixels, int width,
+                            int height, int channels, int filter,
+                            unsigned char *dest) {
+  size_t rowBytes = (size_t)width * channels;
+  for (int y = 0; y < height; y++) {
+    const unsigned char *row = pixels + y * rowBytes;
+    const unsigned char *prior = y > 0 ? row - rowBytes : NULL;
+    int type = filter < 0 ? y % 5 : filter;
+    *dest++ = (unsigned char)type;
+    for (size_t k = 0; k < rowBytes; k++) {
+      int a = k >= (size_t)channels ? row[k - channels] : 0;
+      int b = prior ? prior[k] : 0;
+      int c = prior && k >= (size_t)channels ? prior[k - channels] : 0;
+      int predicted[5] = {0, a, b, (a + b) >> 1, stbi__paeth(a, b, c)};
+      *dest++ = (unsigned char)(row[k] - predicted[type]);
+    }
+  }
+}
+
+static unsigned char *png_chunk(unsigned char *out, const char *type,
+                                const unsigned char *data, size_t size) {
+  unsigned char header[8] = {size >> 24, size >> 16, size >> 8, size};
+  memcpy(header + 4, type, 4);
+  memcpy(out, header, 8);
+  memcpy(out + 8, data, size);
+  unsigned long crc = crc32(0, out + 4, (uInt)size + 4);
+  unsigned char trailer[4] = {crc >> 24, crc >> 16, crc >> 8, crc};
+  memcpy(out + 8 + size, trailer, 4);
+  return out + 12 + size;
+}
+
+/* Origin and spacing of the seven Adam7 passes, x then y. */
+static const int adam7[7][4] = {{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8},
+                                {2, 0, 4, 4}, {0, 2, 2, 4}, {1, 0, 2, 2},
+                                {0, 1, 1, 2}};
+
+/**
+ * Writes the scanlines of every Adam7 pass of an image one after another,
+ * as an interlaced PNG stores them. Returns the bytes written, or 0 if
+ * memory ran out.
+ */
+static size_t png_interlace_rows(const unsigned char *pixels, int width,
+                                 int height, int channels, int filter,
+                                 unsigned char *dest) {
+  unsigned char *pass = malloc((size_t)width * height * channels);
+  unsigned char *start = dest;
+  if (!pass) {
+    return 0;
+  }
+  for (int p = 0; p < 7; p++) {
+    int x0 = adam7[p][0], y0 = adam7[p][1];
+    int passWidth = (width - x0 + adam7[p][2] - 1) / adam7[p][2];
+    int passHeight = (height - y0 + adam7[p][3] - 1) / adam7[p][3];
+    if (passWidth <= 0 || passHeight <= 0) {
+      continue;
+    }
+    for (int y = 0; y < passHeight; y++) {
+      for (int x = 0; x < passWidth; x++) {
+        memcpy(pass + ((size_t)y * passWidth + x) * channels,
+               pixels + ((size_t)(y0 + y * adam7[p][3]) * width + x0 +
+                         x * adam7[p][2]) *
+                            channels,
+               channels);
+      }
+    }
+    png_filter_rows(pass, passWidth, passHeight, channels, filter, dest);
+    dest += (size_t)passHeight * ((size_t)passWidth * channels + 1);
+  }
+  free(pass);
+  return dest - start;
+}
+
+/**
+ * Encodes an 8-bit image of 1 to 4 channels as PNG with zlib, Adam7
+ * interlaced if interlaced is set. Returns the file, which the caller frees,
+ * or NULL on failure.
+ */
+static unsigned char *png_encode(const unsigned char *pixels, int width,
+                                 int height, int channels, int filter,
+                                 int interlaced, size_t *size) {
+  static const unsigned char colorTypes[5] = {0, 0, 4, 2, 6};
+  /* Interlacing adds at most one filter byte per row and pass. */
+  size_t rawSize = (size_t)height * ((size_t)width * channels + 7);
+  uLongf deflatedSize = compressBound(rawSize);
+  unsigned char *raw = malloc(rawSize);
+  unsigned char *png = malloc(deflatedSize + 64);
+  if (!raw || !png) {
+    free(raw);
+    free(png);
+    return NULL;
+  }
+  if (interlaced) {
+    rawSize = png_interlace_rows(pixels, width, height, channels, filter, raw);
+  } else {
+    rawSize = (size_t)height * ((size_t)width * channels + 1);
+    png_filter_rows(pixels, width, height, channels, filter, raw);
+  }
+
+  unsigned char *out = png;
+  memcpy(out, "\x89PNG\r\n\x1a\n", 8);
+  unsigned char header[13] = {width >> 24, width >> 16, width >> 8, width,
+                              height >> 24, height >> 16, height >> 8,
+                              height, 8, colorTypes[channels], 0, 0,
+                              interlaced ? 1 : 0};
+  out = png_chunk(out + 8, "IHDR", header, sizeof(header));
+  /* Deflated straight into the IDAT chunk, whose header is written after. */
+  if (!rawSize ||
+      compress2(out + 8, &deflatedSize, raw, rawSize, 6) != Z_OK) {
+    free(raw);
+    free(png);
+    return NULL;
+  }
+  memcpy(raw, out + 8, deflatedSize);
+  out = png_chunk(out, "IDAT", raw, deflatedSize);
+  out = png_chunk(out, "IEND", NULL, 0);
+  free(raw);
+  *size = out - png;
+  return png;
+}
+
+/**
+ * Inflates the scanlines of a 2048x2048 RGBA image deflated at three zlib
+ * levels, then loads the whole image as a PNG. stb_image must return the
+ * source bytes; zlib's own inflate is timed for comparison.
+ */
+static int bench_zlib(void) {
+  enum { SIZE = 2048, CHANNELS = 4, ROUNDS = 8 };
+  static const int levels[] = {1, 6, 9};
+  size_t rawSize = (size_t)SIZE * (SIZE * CHANNELS + 1);
+  uLong boundSize = compressBound(rawSize);
+  unsigned char *pixels = malloc((size_t)SIZE * SIZE * CHANNELS);
+  unsigned char *raw = malloc(rawSize);
+  unsigned char *inflated = malloc(rawSize);
+  unsigned char *deflated = malloc(boundSize);
+  if (!pixels || !raw || !inflated || !deflated) {
+    free(pixels);
+    free(raw);
+    free(inflated);
+    free(deflated);
+    return -1;
+  }
+  srand(8);
+  random_image(pixels, SIZE, SIZE, CHANNELS);
+  png_filter_rows(pixels, SIZE, SIZE, CHANNELS, -1, raw);
+
+  printf("zlib: %dx%d RGBA scanlines, %.1f MB, output MB/s\n", SIZE, SIZE,
+         rawSize * 1e-6);
+  int mismatches = 0;
+  for (int l = 0; l < (int)(sizeof(levels) / sizeof(levels[0])); l++) {
+    uLongf deflatedSize = boundSize;
+    if (compress2(deflated, &deflatedSize, raw, rawSize, levels[l]) != Z_OK) {
+      mismatches++;
+      continue;
+    }
+
+    int inflatedSize = 0;
+    double start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+      inflatedSize = stbi_zlib_decode_buffer((char *)inflated, (int)rawSize,
+                                             (const char *)deflated,
+                                             (int)deflatedSize);
+    }
+    double stbTime = now() - start;
+    int differing = inflatedSize != (int)rawSize ||
+                    memcmp(inflated, raw, rawSize) != 0;
+
+    start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+      uLongf size = rawSize;
+      uncompress(inflated, &size, deflated, deflatedSize);
+    }
+    double zlibTime = now() - start;
+
+    double megabytes = rawSize * 1e-6 * ROUNDS;
+    printf("  level %d  %5.1f%%  stb_image %7.1f  zlib %7.1f  %s\n",
+           levels[l], deflatedSize * 100.0 / rawSize, megabytes / stbTime,
+           megabytes / zlibTime, differing ? "differing" : "identical");
+    mismatches += differing;
+  }
+
+  size_t pngSize;
+  unsigned char *png =
+      png_encode(pixels, SIZE, SIZE, CHANNELS, -1, 0, &pngSize);
+  if (!png) {
+    mismatches++;
+  } else {
+    int width, height, channels, differing = 0;
+    double start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+      unsigned char *loaded = stbi_load_from_memory(png, (int)pngSize, &width,
+                                                    &height, &channels, 0);
+      if (r == ROUNDS - 1) {
+        differing = !loaded || width != SIZE || height != SIZE ||
+                    channels != CHANNELS ||
+                    memcmp(loaded, pixels, (size_t)SIZE * SIZE * CHANNELS);
+      }
+      stbi_image_free(loaded);
+    }
+    double loadTime = now() - start;
+    printf("  png      stbi_load %7.1f MB/s of pixels, %s\n",
+           (double)SIZE * SIZE * CHANNELS * 1e-6 * ROUNDS / loadTime,
+           differing ? "differing" : "identical");
+    mismatches += differing;
+    free(png);
+  }
+  free(pixels);
+  free(raw);
+  free(inflated);
+  free(deflated);
+  return mismatches ? -1 : 0;
+}
+
+/**
+ * The scalar unfiltering loops of stbi__create_png_image_raw from byte k of
+ * the row on, which finish a row after a SIMD kernel as they do there.
+ */
+static void unfilter_scalar(int filter, stbi_uc *cur, const stbi_uc *prior,
+                            const stbi_uc *raw, int n, int nk, int k) {
+  switch (filter) {
+  case STBI__F_sub:
+    for (; k < n; k++) {
+      cur[k] = raw[k];
+    }
+    for (; k < nk; k++) {
+      cur[k] = (stbi_uc)(raw[k] + cur[k - n]);
+    }
+    break;
+  case STBI__F_up:
+    for (; k < nk; k++) {
+      cur[k] = (stbi_uc)(raw[k] + prior[k]);
+    }
+    break;
+  case STBI__F_avg:
+    for (; k < n; k++) {
+      cur[k] = (stbi_uc)(raw[k] + (prior[k] >> 1));
+    }
+    for (; k < nk; k++) {
+      cur[k] = (stbi_uc)(raw[k] + ((prior[k] + cur[k - n]) >> 1));
+    }
+    break;
+  case STBI__F_paeth:
+    for (; k < n; k++) {
+      cur[k] = (stbi_uc)(raw[k] + prior[k]);
+    }
+    for (; k < nk; k++) {
+      cur[k] = (stbi_uc)(raw[k] +
+                         stbi__paeth(cur[k - n], prior[k], prior[k - n]));
+    }
+    break;
+  }
+}
+
+/**
+ * Unfilters rows of random bytes with each filter and pixel size in every
+ * available implementation, the way stbi__create_png_image_raw does, and
+ * counts bytes that differ from the scalar loops. Then loads a 2048x2048
+ * RGBA PNG interlaced and not, which must decode to the same pixels.
+ */
+static int bench_unfilter(void) {
+  enum { WIDTH = 2048, ROWS = 256, ROUNDS = 8, SIZE = 2048 };
+  static const char *filterNames[5] = {"none", "sub", "up", "avg", "paeth"};
+  static const int pixelBytes[] = {1, 2, 3, 4, 6, 8};
+  /* SIMD level passed to stbi__png_unfilter_simd, 0 for scalar only. */
+  static const struct {
+    const char *name;
+    int simd;
+  } kernels[] = {{"scalar", 0},
+#ifdef STBI_SSE2
+                 {"sse2", 1},
+#endif
+#ifdef STBI_AVX2
+                 {"avx2", 2},
+#endif
+  };
+  int kernelCount = sizeof(kernels) / sizeof(kernels[0]);
+  size_t imageBytes = (size_t)ROWS * WIDTH * 8;
+  stbi_uc *raw = malloc(imageBytes);
+  stbi_uc *image = malloc(imageBytes);
+  stbi_uc *expected = malloc(imageBytes);
+  stbi_uc *zeros = calloc(WIDTH * 8, 1);
+  unsigned char *pixels = malloc((size_t)SIZE * SIZE * 4);
+  if (!raw || !image || !expected || !zeros || !pixels) {
+    free(raw);
+    free(image);
+    free(expected);
+    free(zeros);
+    free(pixels);
+    return -1;
+  }
+  srand(9);
+  for (size_t i = 0; i < imageBytes; i++) {
+    raw[i] = (stbi_uc)rand();
+  }
+
+  printf("unfilter: %d rows of %d pixels, MB/s and bytes differing from "
+         "scalar\n",
+         ROWS, WIDTH);
+  int mismatches = 0;
+  for (int filter = STBI__F_sub; filter <= STBI__F_paeth; filter++) {
+    for (int p = 0; p < (int)(sizeof(pixelBytes) / sizeof(int)); p++) {
+      int n = pixelBytes[p], nk = WIDTH * n, differing = 0;
+      printf("  %-5s %d byte%s", filterNames[filter], n, n > 1 ? "s" : " ");
+      for (int k = 0; k < kernelCount; k++) {
+#ifdef STBI_SSE2
+        if ((kernels[k].simd >= 1 && !stbi__sse2_available()) ||
+            (kernels[k].simd >= 2 && !stbi__avx2_available())) {
+          continue;
+        }
+#endif
+        double start = now();
+        for (int r = 0; r < ROUNDS; r++) {
+          for (int j = 0; j < ROWS; j++) {
+            stbi_uc *cur = image + (size_t)j * nk;
+            const stbi_uc *prior = j > 0 ? cur - nk : zeros;
+            const stbi_uc *in = raw + (size_t)j * nk;
+            int done = 0;
+#ifdef STBI_SSE2
+            if (kernels[k].simd) {
+              done = stbi__png_unfilter_simd(kernels[k].simd, filter, cur,
+                                             prior, in, n, nk);
+            }
+#endif
+            unfilter_scalar(filter, cur, prior, in, n, nk, done);
+          }
+        }
+        double time = now() - start;
+
+        if (k == 0) {
+          memcpy(expected, image, (size_t)ROWS * nk);
+        } else {
+          for (size_t i = 0; i < (size_t)ROWS * nk; i++) {
+            differing += expected[i] != image[i];
+          }
+        }
+        printf("  %s %7.1f", kernels[k].name,
+               (double)ROWS * nk * ROUNDS * 1e-6 / time);
+      }
+      printf("  %d differing\n", differing);
+      mismatches += differing;
+    }
+  }
+
+  /* Interlaced images unfilter each pass apart, then scatter the pixels. */
+  random_image(pixels, SIZE, SIZE, 4);
+  double loadTimes[2];
+  for (int interlaced = 0; interlaced < 2; interlaced++) {
+    size_t pngSize;
+    unsigned char *png =
+        png_encode(pixels, SIZE, SIZE, 4, -1, interlaced, &pngSize);
+    int width, height, channels, differing = !png;
+    double start = now();
+    for (int r = 0; png && r < ROUNDS; r++) {
+      unsigned char *loaded = stbi_load_from_memory(png, (int)pngSize, &width,
+                                                    &height, &channels, 0);
+      if (r == 0) {
+        differing = !loaded || width != SIZE || height != SIZE ||
+                    channels != 4 ||
+                    memcmp(loaded, pixels, (size_t)SIZE * SIZE * 4);
+      }
+      stbi_image_free(loaded);
+    }
+    loadTimes[interlaced] = now() - start;
+    mismatches += differing;
+    free(png);
+  }
+  double megabytes = (double)SIZE * SIZE * 4 * ROUNDS * 1e-6;
+  printf("  adam7 %dx%d RGBA stbi_load %7.1f MB/s, not interlaced %7.1f\n",
+         SIZE, SIZE, megabytes / loadTimes[1], megabytes / loadTimes[0]);
+
+  free(raw);
+  free(image);
+  free(expected);
+  free(zeros);
+  free(pixels);
+  return mismatches ? -1 : 0;
+}
+
+static float half_to_float(unsigned short half) {
+  float magnitude = ldexpf((float)(half & 0x3ff), -24);
+  int exponent = (half >> 10) & 0x1f;
+  if (exponent > 0) {
+    magnitude = ldexpf((float)((half & 0x3ff) | 0x400), exponent - 25);
+  }
+  return half & 0x8000 ? -magnitude : magnitude;
+}
+
+static float snorm16_to_float(short value) {
+  return glm_max(value / 32767.0f, -1.0f);
+}
+
+/**
+ * Packs a million random vertices and decodes them the way OpenGL reads
+ * the packed attributes, including the normal decode given in meshpack.c,
+ * then compares every attribute with its float source.
+ */
+static int bench_meshpack(void) {
+  enum { VERTICES = 1 << 20, STRIDE = 11 };
+  float *vertices = malloc((size_t)VERTICES * STRIDE * sizeof(float));
+  MeshSource source = {vertices, vertices + 3, vertices + 6, vertices + 8,
+                       STRIDE, VERTICES};
+  PackedMesh mesh;
+  if (!vertices) {
+    return -1;
+  }
+  srand(5);
+  for (int i = 0; i < VERTICES; i++) {
+    float *v = vertices + (size_t)i * STRIDE;
+    for (int axis = 0; axis < 3; axis++) {
+      v[axis] = random_unit() * 40.0f - 10.0f;
+      v[3 + axis] = random_unit();
+      v[8 + axis] = random_unit() * 2.0f - 1.0f;
+    }
+    v[6] = random_unit() * 4.0f;
+    v[7] = random_unit() * 4.0f - 2.0f;
+    glm_vec3_normalize(v + 8);
+  }
+
+  double start = now();
+  if (meshpack_pack(&source, &mesh) != 0) {
+    free(vertices);
+    return -1;
+  }
+  double packTime = now() - start;
+
+  vec3 extent, step;
+  glm_vec3_sub(mesh.bounds[1], mesh.bounds[0], extent);
+  glm_vec3_divs(extent, 65535.0f, step);
+  float positionError = 0.0f, colorError = 0.0f, texCoordError = 0.0f;
+  float normalError = 0.0f;
+  for (int i = 0; i < VERTICES; i++) {
+    const float *v = vertices + (size_t)i * STRIDE;
+    const unsigned char *packed =
+        (const unsigned char *)mesh.data + (size_t)i * mesh.stride;
+    unsigned short position[3], texCoord[2];
+    short normal[2];
+    memcpy(position, packed + mesh.attribs[0].offset, sizeof(position));
+    memcpy(texCoord, packed + mesh.attribs[2].offset, sizeof(texCoord));
+    memcpy(normal, packed + mesh.attribs[3].offset, sizeof(normal));
+    const unsigned char *color = packed + mesh.attribs[1].offset;
+
+    vec3 decoded = {position[0] / 65535.0f, position[1] / 65535.0f,
+                    position[2] / 65535.0f};
+    glm_mat4_mulv3(mesh.decode, decoded, 1.0f, decoded);
+    vec3 n = {snorm16_to_float(normal[0]), snorm16_to_float(normal[1]), 0.0f};
+    n[2] = 1.0f - fabsf(n[0]) - fabsf(n[1]);
+    if (n[2] < 0.0f) {
+      float x = (1.0f - fabsf(n[1])) * (n[0] >= 0.0f ? 1.0f : -1.0f);
+      float y = (1.0f - fabsf(n[0])) * (n[1] >= 0.0f ? 1.0f : -1.0f);
+      n[0] = x;
+      n[1] = y;
+    }
+    glm_vec3_normalize(n);
+
+    for (int axis = 0; axis < 3; axis++) {
+      positionError =
+          glm_max(positionError, fabsf(decoded[axis] - v[axis]) / step[axis]);
+      colorError =
+          glm_max(colorError, fabsf(color[axis] / 255.0f - v[3 + axis]));
+    }
+    for (int c = 0; c < 2; c++) {
+      /* Relative, as half floats keep 11 significant bits at any scale. */
+      float error = fabsf(half_to_float(texCoord[c]) - v[6 + c]);
+      texCoordError =
+          glm_max(texCoordError, error / glm_max(fabsf(v[6 + c]), 0x1p-14f));
+    }
+    /* acos of the dot product cannot resolve angles this small in floats. */
+    vec3 cross;
+    glm_vec3_cross(n, (float *)v + 8, cross);
+    normalError = glm_max(normalError, atan2f(glm_vec3_norm(cross),
+                                              glm_vec3_dot(n, (float *)v + 8)));
+  }
+
+  /* Half a quantization step, with a little room for float rounding. */
+  int mismatches = positionError > 0.52f;
+  mismatches += colorError > 0.51f / 255.0f;
+  mismatches += texCoordError > 0x1.01p-11f;
+  mismatches += normalError > 1e-4f;
+  printf("meshpack: %d vertices, %d bytes each against %d as floats\n",
+         VERTICES, mesh.stride, STRIDE * (int)sizeof(float));
+  printf("  position %8.3f steps   color    %8.2g\n", positionError,
+         colorError);
+  printf("  texCoord %8.2g rel.    normal   %8.2g rad\n", texCoordError,
+         normalError);
+  printf("  pack     %8.1f Mvertices/s, %d mismatches\n",
+         VERTICES / packTime * 1e-6, mismatches);
+  meshpack_free(&mesh);
+  free(vertices);
+  return mismatches ? -1 : 0;
+}
+
+/**
+ * Converts random HDR pixels spanning 2^-30 to 2^18, with NaNs, infinities
+ * and negative values mixed in, to half floats and RGB9E5. Both must match
+ * hdr_float_to_half and hdr_float3_to_rgb9e5 bit for bit.
+ */
+static int bench_hdr(void) {
+  enum { PIXELS = 1 << 20, REPEAT = 8 };
+  static const float special[] = {NAN, -NAN, INFINITY, -INFINITY, 0.0f,
+                                  -0.0f, 65504.0f, 65520.0f, 0x1p-24f,
+                                  0x1p-25f, 0x1.8p-25f, FLT_MIN};
+  int specialCount = sizeof(special) / sizeof(special[0]);
+  float *rgb = malloc((size_t)PIXELS * 3 * sizeof(float));
+  unsigned short *half = malloc((size_t)PIXELS * 3 * sizeof(unsigned short));
+  unsigned int *rgb9e5 = malloc((size_t)PIXELS * sizeof(unsigned int));
+  if (!rgb || !half || !rgb9e5) {
+    free(rgb);
+    free(half);
+    free(rgb9e5);
+    return -1;
+  }
+  srand(6);
+  for (int i = 0; i < PIXELS * 3; i++) {
+    rgb[i] = ldexpf(random_unit(), rand() % 48 - 30);
+    if (rand() % 4 == 0) {
+      rgb[i] = -rgb[i];
+    }
+    if (rand() % 64 == 0) {
+      rgb[i] = special[rand() % specialCount];
+    }
+  }
+
+  double start = now();
+  for (int r = 0; r < REPEAT; r++) {
+    hdr_to_half(rgb, half, (size_t)PIXELS * 3);
+  }
+  double halfTime = now() - start;
+  start = now();
+  for (int r = 0; r < REPEAT; r++) {
+    hdr_to_rgb9e5(rgb, rgb9e5, PIXELS);
+  }
+  double rgb9e5Time = now() - start;
+
+  int mismatches = 0;
+  for (int i = 0; i < PIXELS * 3; i++) {
+    mismatches += half[i] != hdr_float_to_half(rgb[i]);
+  }
+  for (int i = 0; i < PIXELS; i++) {
+    mismatches += rgb9e5[i] != hdr_float3_to_rgb9e5(rgb + (size_t)i * 3);
+  }
+
+  /* The scalar loops, timed on their own. volatile keeps them alive. */
+  volatile unsigned int sink = 0;
+  start = now();
+  for (int r = 0; r < REPEAT; r++) {
+    for (int i = 0; i < PIXELS * 3; i++) {
+      half[i] = hdr_float_to_half(rgb[i]);
+    }
+    sink += half[r];
+  }
+  double scalarHalfTime = now() - start;
+  start = now();
+  for (int r = 0; r < REPEAT; r++) {
+    for (int i = 0; i < PIXELS; i++) {
+      rgb9e5[i] = hdr_float3_to_rgb9e5(rgb + (size_t)i * 3);
+    }
+    sink += rgb9e5[r];
+  }
+  double scalarRgb9e5Time = now() - start;
+
+  double values = (double)PIXELS * 3 * REPEAT;
+  printf("hdr: %d pixels, %d mismatches\n", PIXELS, mismatches);
+  printf("  half     %8.1f Mfloats/s, scalar %8.1f Mfloats/s\n",
+         values / halfTime * 1e-6, values / scalarHalfTime * 1e-6);
+  printf("  rgb9e5   %8.1f Mfloats/s, scalar %8.1f Mfloats/s\n",
+         values / rgb9e5Time * 1e-6, values / scalarRgb9e5Time * 1e-6);
+  free(rgb);
+  free(half);
+  free(rgb9e5);
+  return mismatches ? -1 : 0;
+}
+
+/**
+ * Batch Perlin noise at a million random points and a 4-octave fBm field,
+ * compared with glm_perlin_vec2 and glm_perlin_vec3 one sample at a time.
+ */
+static int bench_noise(void) {
+  enum { SAMPLES = 1 << 20, SIZE = 512, OCTAVES = 4 };
+  float *x = malloc(SAMPLES * sizeof(float));
+  float *y = malloc(SAMPLES * sizeof(float));
+  float *z = malloc(SAMPLES * sizeof(float));
+  float *noise = malloc(SAMPLES * sizeof(float));
+  float *expected = malloc(SAMPLES * sizeof(float));
+  if (!x || !y || !z || !noise || !expected) {
+    free(x);
+    free(y);
+    free(z);
+    free(noise);
+    free(expected);
+    return -1;
+  }
+  srand(7);
+  for (int i = 0; i < SAMPLES; i++) {
+    x[i] = random_unit() * 512.0f - 256.0f;
+    y[i] = random_unit() * 512.0f - 256.0f;
+    z[i] = random_unit() * 512.0f - 256.0f;
+  }
+
+  double start = now();
+  noise_perlin2_batch(x, y, noise, SAMPLES);
+  double perlin2Time = now() - start;
+  start = now();
+  for (int i = 0; i < SAMPLES; i++) {
+    expected[i] = glm_perlin_vec2((vec2){x[i], y[i]});
+  }
+  double scalar2Time = now() - start;
+  float perlin2Error = 0.0f;
+  for (int i = 0; i < SAMPLES; i++) {
+    perlin2Error = glm_max(perlin2Error, fabsf(noise[i] - expected[i]));
+  }
+
+  start = now();
+  noise_perlin3_batch(x, y, z, noise, SAMPLES);
+  double perlin3Time = now() - start;
+  start = now();
+  for (int i = 0; i < SAMPLES; i++) {
+    expected[i] = glm_perlin_vec3((vec3){x[i], y[i], z[i]});
+  }
+  double scalar3Time = now() - start;
+  float perlin3Error = 0.0f;
+  for (int i = 0; i < SAMPLES; i++) {
+    perlin3Error = glm_max(perlin3Error, fabsf(noise[i] - expected[i]));
+  }
+
+  /* The field computes its coordinates the same way, in floats. */
+  NoiseFbm fbm = {OCTAVES, 0.05f, 1.0f, 2.0f, 0.5f};
+  vec2 origin = {-12.5f, 3.25f};
+  const float step = 0.37f;
+  start = now();
+  noise_field2(noise, SIZE, SIZE, origin, step, &fbm);
+  double fieldTime = now() - start;
+  float fieldError = 0.0f;
+  for (int row = 0; row < SIZE; row++) {
+    float py = origin[1] + row * step;
+    for (int column = 0; column < SIZE; column++) {
+      float px = origin[0] + (float)column * step;
+      float frequency = fbm.frequency, amplitude = fbm.amplitude, sum = 0.0f;
+      for (int o = 0; o < OCTAVES; o++) {
+        sum += glm_perlin_vec2((vec2){px * frequency, py * frequency}) *
+               amplitude;
+        frequency *= fbm.lacunarity;
+        amplitude *= fbm.gain;
+      }
+      fieldError = glm_max(fieldError,
+                           fabsf(noise[row * SIZE + column] - sum));
+    }
+  }
+
+  /* Perlin noise stays within [-1, 1], so these are absolute errors. */
+  int mismatches = perlin2Error > 1e-5f;
+  mismatches += perlin3Error > 1e-5f;
+  mismatches += fieldError > 1e-5f * OCTAVES;
+  printf("noise: %d samples, %d mismatches\n", SAMPLES, mismatches);
+  printf("  perlin2  %8.1f Msamples/s, scalar %8.1f, error %.2g\n",
+         SAMPLES / perlin2Time * 1e-6, SAMPLES / scalar2Time * 1e-6,
+         perlin2Error);
+  printf("  perlin3  %8.1f Msamples/s, scalar %8.1f, error %.2g\n",
+         SAMPLES / perlin3Time * 1e-6, SAMPLES / scalar3Time * 1e-6,
+         perlin3Error);
+  printf("  fbm2     %8.1f Msamples/s, %d octaves, error %.2g\n",
+         (double)SIZE * SIZE / fieldTime * 1e-6, OCTAVES, fieldError);
+  free(x);
+  free(y);
+  free(z);
+  free(noise);
+  free(expected);
+  return mismatches ? -1 : 0;
+}
+
+enum { MESH_GRID = 384, MESH_FLOATS = 8 };
+
+/**
+ * Writes a MESH_GRID x MESH_GRID grid of quads with the 8 floats per vertex
+ * of values to path, as OBJ, ASCII PLY or binary PLY for format 0, 1 or 2.
+ * Text files hold the values with 6 decimals. Returns the file size, or 0
+ * on failure.
+ */
+static size_t write_mesh_file(const char *path, int format,
+                              const double *values) {
+  int vertexCount = MESH_GRID * MESH_GRID;
+  int quadCount = (MESH_GRID - 1) * (MESH_GRID - 1);
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return 0;
+  }
+  if (format > 0) {
+    fprintf(file,
+            "ply\nformat %s 1.0\nelement vertex %d\n"
+            "property float x\nproperty float y\nproperty float z\n"
+            "property float nx\nproperty float ny\nproperty float nz\n"
+            "property float s\nproperty float t\nelement face %d\n"
+            "property list uchar int vertex_indices\nend_header\n",
+            format == 1 ? "ascii" : "binary_little_endian", vertexCount,
+            quadCount);
+  }
+  for (int i = 0; i < vertexCount; i++) {
+    const double *v = values + (size_t)i * MESH_FLOATS;
+    if (format == 0) {
+      fprintf(file, "v %.6f %.6f %.6f\nvn %.6f %.6f %.6f\nvt %.6f %.6f\n",
+              v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+    } else if (format == 1) {
+      fprintf(file, "%.6f %.6f %.6f %.6f %.6f %.6f %.6f %.6f\n", v[0], v[1],
+              v[2], v[3], v[4], v[5], v[6], v[7]);
+    } else {
+      float floats[MESH_FLOATS];
+      for (int k = 0; k < MESH_FLOATS; k++) {
+        floats[k] = (float)v[k];
+      }
+      fwrite(floats, sizeof(floats), 1, file);
+    }
+  }
+  for (int y = 0; y + 1 < MESH_GRID; y++) {
+    for (int x = 0; x + 1 < MESH_GRID; x++) {
+      int a = y * MESH_GRID + x;
+      int corners[4] = {a, a + 1, a + MESH_GRID + 1, a + MESH_GRID};
+      if (format == 0) {
+        fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+                corners[0] + 1, corners[0] + 1, corners[0] + 1,
+                corners[1] + 1, corners[1] + 1, corners[1] + 1,
+                corners[2] + 1, corners[2] + 1, corners[2] + 1,
+                corners[3] + 1, corners[3] + 1, corners[3] + 1);
+      } else if (format == 1) {
+        fprintf(file, "4 %d %d %d %d\n", corners[0], corners[1], corners[2],
+                corners[3]);
+      } else {
+        fputc(4, file);
+        fwrite(corners, sizeof(corners), 1, file);
+      }
+    }
+  }
+  long size = ftell(file);
+  return fclose(file) == 0 && size > 0 ? (size_t)size : 0;
+}
+
+/**
+ * Counts the triangle corners of mesh whose position, normal and texture
+ * coordinate differ from the grid of write_mesh_file. Quads are expected as
+ * fans of two triangles, in file order.
+ */
+static int check_mesh(const Mesh *mesh, const double *values) {
+  int quadCount = (MESH_GRID - 1) * (MESH_GRID - 1);
+  if (mesh->indexCount != quadCount * 6) {
+    return 1;
+  }
+  int differing = 0;
+  for (int q = 0; q < quadCount; q++) {
+    int a = q / (MESH_GRID - 1) * MESH_GRID + q % (MESH_GRID - 1);
+    int corners[6] = {a, a + 1, a + MESH_GRID + 1,
+                      a, a + MESH_GRID + 1, a + MESH_GRID};
+    for (int c = 0; c < 6; c++) {
+      uint32_t index = mesh->indices[q * 6 + c];
+      if (index >= (uint32_t)mesh->vertexCount) {
+        differing++;
+        continue;
+      }
+      /* The floats of MeshVertex up to its colors. */
+      const float *parsed = mesh->vertices[index].position;
+      const double *v = values + (size_t)corners[c] * MESH_FLOATS;
+      for (int k = 0; k < MESH_FLOATS; k++) {
+        differing += parsed[k] != (float)v[k];
+      }
+    }
+  }
+  return differing;
+}
+
+/**
+ * Parses the same 147K-vertex grid from OBJ, ASCII PLY and binary PLY
+ * files and checks every triangle corner against the values written, which
+ * text parsing must round exactly like strtod. Then writes the OBJ mesh to
+ * a cache and times mapping it back.
+ */
+static int bench_meshfile(void) {
+  enum { ROUNDS = 4 };
+  static const char *paths[3] = {"bench_mesh.obj", "bench_mesh.ply",
+                                 "bench_mesh_binary.ply"};
+  static const char *formats[3] = {"obj", "ply", "binary ply"};
+  const char *cachePath = "bench_mesh.obj.cache";
+  int vertexCount = MESH_GRID * MESH_GRID;
+  double *values = malloc((size_t)vertexCount * MESH_FLOATS * sizeof(double));
+  if (!values) {
+    return -1;
+  }
+  /* Multiples of 1e-6, so the 6 decimals written are exact, and divided
+   * as correctly rounded as strtod reads them back. */
+  srand(10);
+  for (int i = 0; i < vertexCount; i++) {
+    double *v = values + (size_t)i * MESH_FLOATS;
+    int x = i % MESH_GRID, y = i / MESH_GRID;
+    v[0] = (x * 13021 - 2500000) / 1e6;
+    v[1] = (rand() % 1000000 - 500000) / 1e6;
+    v[2] = (y * 13021 - 2500000) / 1e6;
+    for (int k = 3; k < 6; k++) {
+      v[k] = (rand() % 2000001 - 1000000) / 1e6;
+    }
+    v[6] = x * 2604 / 1e6;
+    v[7] = y * 2604 / 1e6;
+  }
+
+  printf("meshfile: %dx%d grid, %d triangles\n", MESH_GRID, MESH_GRID,
+         (MESH_GRID - 1) * (MESH_GRID - 1) * 2);
+  int mismatches = 0;
+  Mesh parsed = {0};
+  for (int f = 0; f < 3; f++) {
+    size_t size = write_mesh_file(paths[f], f, values);
+    if (size == 0) {
+      mismatches++;
+      continue;
+    }
+    /* The last round's mesh is checked, and the OBJ one kept. */
+    Mesh mesh = {0};
+    int differing = 0;
+    double start = now();
+    for (int r = 0; r < ROUNDS && !differing; r++) {
+      meshfile_free(&mesh);
+      differing = meshfile_parse(&mesh, paths[f]) != 0;
+    }
+    double parseTime = now() - start;
+    differing = differing ? 1 : check_mesh(&mesh, values);
+    if (f == 0) {
+      parsed = mesh;
+    } else {
+      meshfile_free(&mesh);
+    }
+    printf("  %-10s %7.1f MB/s, %5.1f MB, %d differing\n", formats[f],
+           size * 1e-6 * ROUNDS / parseTime, size * 1e-6, differing);
+    mismatches += differing;
+  }
+
+  /* Mapping the cache and reading every vertex once. */
+  if (!parsed.vertices ||
+      meshfile_write_cache(&parsed, paths[0], cachePath) != 0) {
+    mismatches++;
+  } else {
+    int differing = 0;
+    volatile float sink = 0.0f;
+    double start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+      Mesh cached;
+      if (meshfile_open_cache(&cached, paths[0], cachePath) != 0) {
+        differing++;
+        break;
+      }
+      float sum = 0.0f;
+      for (int i = 0; i < cached.vertexCount; i++) {
+        sum += cached.vertices[i].position[0];
+      }
+      sink += sum;
+      if (r == 0) {
+        differing = cached.vertexCount != parsed.vertexCount ||
+                    cached.indexCount != parsed.indexCount ||
+                    memcmp(cached.vertices, parsed.vertices,
+                           (size_t)parsed.vertexCount * sizeof(MeshVertex)) ||
+                    memcmp(cached.indices, parsed.indices,
+                           (size_t)parsed.indexCount * sizeof(uint32_t));
+      }
+      meshfile_free(&cached);
+    }
+    double cacheTime = (now() - start) / ROUNDS;
+    printf("  cache      %7.2f ms to map and read, %d differing\n",
+           cacheTime * 1e3, differing);
+    mismatches += differing;
+  }
+  meshfile_free(&parsed);
+  for (int f = 0; f < 3; f++) {
+    remove(paths[f]);
+  }
+  remove(cachePath);
+  free(values);
+  return mismatches ? -1 : 0;
+}
+
+/**
+ * Composes the world matrices of a scene one node at a time, parents
+ * first, the way main.c built its transforms before the scene graph.
+ * Returns the largest difference to the matrices of scene_update.
+ */
+static float check_scene(Scene *scene, const int *parents, mat4 *expected) {
+  float error = 0.0f;
+  for (int handle = 0; handle < scene->count; handle++) {
+    int index = scene->handleToIndex[handle];
+    mat4 local;
+    glm_translate_make(local, scene->position[index]);
+    glm_quat_rotate(local, scene->rotation[index], local);
+    glm_scale(local, scene->scale[index]);
+    if (parents[handle] >= 0) {
+      glm_mat4_mul(expected[parents[handle]], local, expected[handle]);
+    } else {
+      glm_mat4_copy(local, expected[handle]);
+    }
+    vec4 *world = scene_world(scene, handle);
+    for (int c = 0; c < 4; c++) {
+      for (int r = 0; r < 4; r++) {
+        error = glm_max(error, fabsf(world[c][r] - expected[handle][c][r]));
+      }
+    }
+  }
+  return error;
+}
+
+/**
+ * Updates a million-node scene of 1024 trees with 4 children per node on
+ * all job threads: once after building it, then per frame with every root
+ * moved, with 1% of the nodes moved and with nothing moved. The matrices
+ * are compared with check_scene, which is also timed.
+ */
+static int bench_scene(void) {
+  enum { NODES = 1 << 20, ROOTS = 1024, FANOUT = 4, FRAMES = 16 };
+  Scene scene;
+  int *parents = malloc(NODES * sizeof(int));
+  int *handles = malloc(NODES * sizeof(int));
+  mat4 *expected = aligned_alloc(32, NODES * sizeof(mat4));
+  if (!parents || !handles || !expected || scene_init(&scene, NODES) != 0) {
+    free(parents);
+    free(handles);
+    free(expected);
+    return -1;
+  }
+  jobs_init(0);
+  srand(11);
+  int mismatches = 0;
+  for (int i = 0; i < NODES; i++) {
+    parents[i] = i < ROOTS ? -1 : (i - ROOTS) / FANOUT;
+    handles[i] = scene_add_node(&scene, parents[i] >= 0 ? handles[parents[i]]
+                                                        : -1);
+    mismatches += handles[i] != i;
+    vec3 axis = {random_unit() - 0.5f, random_unit() - 0.5f, 1.0f};
+    versor rotation;
+    glm_quatv(rotation, random_unit() * 2.0f, axis);
+    scene_set_position(&scene, handles[i],
+                       (vec3){random_unit() - 0.5f, random_unit() - 0.5f,
+                              random_unit() - 0.5f});
+    scene_set_rotation(&scene, handles[i], rotation);
+    scene_set_scale(&scene, handles[i],
+                    (vec3){0.9f + random_unit() * 0.2f, 1.0f, 1.0f});
+  }
+
+  double start = now();
+  mismatches += scene_update(&scene) != 0;
+  double firstTime = now() - start;
+  float error = check_scene(&scene, parents, expected);
+
+  static const char *frameNames[3] = {"roots moved", "1% moved",
+                                      "none moved"};
+  double frameTimes[3];
+  for (int kind = 0; kind < 3; kind++) {
+    double total = 0.0;
+    for (int f = 0; f < FRAMES; f++) {
+      int moved = kind == 0 ? ROOTS : kind == 1 ? NODES / 100 : 0;
+      for (int m = 0; m < moved; m++) {
+        int handle = kind == 0 ? m : rand() % NODES;
+        scene_set_position(&scene, handle,
+                           (vec3){random_unit() - 0.5f, random_unit() - 0.5f,
+                                  random_unit() - 0.5f});
+      }
+      start = now();
+      mismatches += scene_update(&scene) != 0;
+      total += now() - start;
+    }
+    frameTimes[kind] = total / FRAMES;
+    error = glm_max(error, check_scene(&scene, parents, expected));
+  }
+  start = now();
+  check_scene(&scene, parents, expected);
+  double scalarTime = now() - start;
+
+  /* Matrices of up to 6 levels with translations of a few units. */
+  mismatches += error > 1e-4f;
+  printf("scene: %d nodes, %d threads, error %.2g, %d mismatches\n", NODES,
+         jobs_thread_count(), error, mismatches);
+  printf("  first update %7.2f ms, with the depth sort\n", firstTime * 1e3);
+  for (int kind = 0; kind < 3; kind++) {
+    printf("  %-12s %7.2f ms\n", frameNames[kind], frameTimes[kind] * 1e3);
+  }
+  printf("  scalar       %7.2f ms for every node, one thread\n",
+         scalarTime * 1e3);
+  jobs_shutdown();
+  scene_free(&scene);
+  free(parents);
+  free(handles);
+  free(expected);
+  return mismatches ? -1 : 0;
+}
+
+typedef struct {
+  const char *name;
+  int (*run)(void);
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"anim", bench_anim},
+    {"hdr", bench_hdr},
+    {"jpeg", bench_jpeg},
+    {"meshfile", bench_meshfile},
+    {"meshpack", bench_meshpack},
+    {"noise", bench_noise},
+    {"raycast", bench_raycast},
+    {"scene", bench_scene},
+    {"spatial", bench_spatial},
+    {"unfilter", bench_unfilter},
+    {"zlib", bench_zlib},
+};
+
+int main(int argc, char **argv) {
+  int count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+  int failed = 0;
+  for (int i = 0; i < count; i++) {
+    int selected = argc < 2;
+    for (int a = 1; a < argc; a++) {
+      selected |= strcmp(argv[a], benchmarks[i].name) == 0;
+    }
+    if (selected && benchmarks[i].run() != 0) {
+      fprintf(stderr, "%s: failed\n", benchmarks[i].name);
+      failed = 1;
+    }
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+#include "gifanim.h"
+
+#include <glad/gl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stb_image.h"
+
+/* Browsers show frames with delays of 10 ms or less for 100 ms, and GIFs
+ * that rely on it are common. */
+#define GIFANIM_MIN_DELAY 10
+#define GIFANIM_DEFAULT_DELAY 100
+
+/**
+ * Whether every frame of the animation fits the ring. Once it is resident
+ * nothing more is decoded and the file is no longer read.
+ */
+static int resident(const GifAnim *anim) {
+  return anim->frameCount > 0 && anim->frameCount <= anim->layers;
+}
+
+/**
+ * Decodes the next frame into layer decoded % layers, rewinding at the end
+ * of the file. Returns 0 on success and -1 when no frame could be decoded.
+ */
+static int decode_frame(GifAnim *anim) {
+  stbi_uc *frame;
+  int delay;
+  int result = stbi_gif_stream_next(anim->stream, &frame, &delay);
+  if (result == 0) {
+    if (anim->position == 0) {
+      return -1;
+    }
+    if (!anim->frameCount) {
+      anim->frameCount = anim->position;
+    }
+    if (resident(anim)) {
+      return 0;
+    }
+    stbi_gif_stream_rewind(anim->stream);
+    anim->position = 0;
+    result = stbi_gif_stream_next(anim->stream, &frame, &delay);
+  }
+  if (result < 0) {
+    return -1;
+  }
+
+  int layer = anim->decoded % anim->layers;
+  anim->delays[layer] =
+      delay <= GIFANIM_MIN_DELAY ? GIFANIM_DEFAULT_DELAY : delay;
+  glBindTexture(GL_TEXTURE_2D_ARRAY, anim->texture);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, anim->width,
+                  anim->height, 1, GL_RGBA, GL_UNSIGNED_BYTE, frame);
+  anim->decoded++;
+  anim->position++;
+  return 0;
+}
+
+/**
+ * Fills the layers that the shown frame no longer needs. A decode error
+ * stops decoding; the frames already in the ring keep playing.
+ */
+static void decode_ahead(GifAnim *anim) {
+  while (!anim->failed && !resident(anim) &&
+         anim->decoded < anim->shown + anim->layers) {
+    if (decode_frame(anim) != 0) {
+      anim->failed = 1;
+    }
+  }
+}
+
+/**
+ * Opens the GIF at path and decodes its first frames into a texture array
+ * of layers layers. The file stays open while the animation plays.
+ * Returns 0 on success and -1 on failure.
+ */
+int gifanim_open(GifAnim *anim, const char *path, int layers) {
+  memset(anim, 0, sizeof(*anim));
+  anim->file = fopen(path, "rb");
+  if (!anim->file) {
+    return -1;
+  }
+  anim->stream =
+      stbi_gif_stream_open_file(anim->file, &anim->width, &anim->height);
+  anim->layers = layers > 1 ? layers : 2;
+  anim->delays = calloc(anim->layers, sizeof(int));
+  if (!anim->stream || !anim->delays) {
+    gifanim_close(anim);
+    return -1;
+  }
+
+  glGenTextures(1, &anim->texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, anim->texture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, anim->width, anim->height,
+               anim->layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+  decode_ahead(anim);
+  if (anim->decoded == 0) {
+    gifanim_close(anim);
+    return -1;
+  }
+  return 0;
+}
+
+void gifanim_close(GifAnim *anim) {
+  if (anim->texture) {
+    glDeleteTextures(1, &anim->texture);
+  }
+  stbi_gif_stream_close(anim->stream);
+  if (anim->file) {
+    fclose(anim->file);
+  }
+  free(anim->delays);
+  memset(anim, 0, sizeof(*anim));
+}
+
+/**
+ * Advances the animation by seconds and decodes the frames that came into
+ * the ring. When decoding falls behind, the shown frame is held instead of
+ * skipping ahead.
+ */
+void gifanim_update(GifAnim *anim, float seconds) {
+  anim->elapsed += seconds * 1000.0f;
+  for (;;) {
+    float delay = (float)anim->delays[gifanim_layer(anim)];
+    if (anim->elapsed < delay) {
+      break;
+    }
+    if (!resident(anim) && anim->shown + 1 >= anim->decoded) {
+      anim->elapsed = delay;
+      break;
+    }
+    anim->elapsed -= delay;
+    anim->shown++;
+    if (resident(anim)) {
+      anim->shown %= anim->frameCount;
+    }
+  }
+  if (anim->shown >= anim->layers) {
+    /* Only the counters' remainders matter, so keep them small. */
+    anim->shown -= anim->layers;
+    anim->decoded -= anim->layers;
+  }
+  decode_ahead(anim);
+}
+
+/**
+ * Layer of the texture array holding the frame to draw, for sampling with a
+ * sampler2DArray.
+ */
+int gifanim_layer(const GifAnim *anim) {
+  if (resident(anim)) {
+    return anim->shown % anim->frameCount;
+  }
+  return anim->shown % anim->layers;
+}
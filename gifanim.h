@@ -0,0 +1,39 @@
+#ifndef GIFANIM_H
+#define GIFANIM_H
+
+#include <stdio.h>
+
+typedef struct stbi_gif_stream stbi_gif_stream;
+
+/**
+ * An animated GIF played from a ring of GL_TEXTURE_2D_ARRAY layers. Frames
+ * are decoded as they are needed, so memory use depends on the frame size
+ * and layer count only, not on the length of the animation.
+ *
+ * Frame counters run on across loops; frame n lives in layer n % layers.
+ */
+typedef struct {
+  FILE *file;
+  stbi_gif_stream *stream;
+  unsigned int texture;
+  int width, height;
+  int layers;
+  /** Display time of the frame in each layer, in milliseconds. */
+  int *delays;
+  /** Frames uploaded so far and the index of the frame being shown. */
+  int decoded, shown;
+  /** Frames decoded in the current pass over the file. */
+  int position;
+  /** Length of the animation once the end was reached, otherwise 0. */
+  int frameCount;
+  int failed;
+  float elapsed;
+} GifAnim;
+
+int gifanim_open(GifAnim *anim, const char *path, int layers);
+void gifanim_close(GifAnim *anim);
+
+void gifanim_update(GifAnim *anim, float seconds);
+int gifanim_layer(const GifAnim *anim);
+
+#endif
@@ -0,0 +1,308 @@
+#include "hdr.h"
+
+#include <glad/gl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobs.h"
+#include "simd.h"
+#include "stb_image.h"
+
+/* Largest finite half float. Brighter values are clamped rather than turned
+ * into infinity, which would poison filtering and tonemapping. */
+#define HDR_HALF_MAX 65504.0f
+/* Largest value RGB9E5 can hold, 511 / 512 * 2^16. */
+#define HDR_RGB9E5_MAX 65408.0f
+/* Elements per job when converting in parallel. */
+#define HDR_GRAIN 16384
+
+typedef struct {
+  const float *src;
+  void *dest;
+} ConvertJob;
+
+#ifdef SIMD_DISPATCH
+/* F16C and AVX2 builds of the kernels below, from hdr_avx2.c. */
+void hdr_half_range_avx2(void *context, int begin, int end);
+void hdr_rgb9e5_range_avx2(void *context, int begin, int end);
+#endif
+
+#ifndef SIMD_WIDE
+/**
+ * Rounds value to the nearest half float, ties to even, as F16C does, and
+ * clamps it to +-65504. NaNs stay quiet NaNs with the top of their payload,
+ * also like F16C. The reference the vector paths must match.
+ */
+unsigned short hdr_float_to_half(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  bits &= 0x7fffffff;
+  if (bits > 0x7f800000) {
+    return (unsigned short)(sign | 0x7e00 | ((bits >> 13) & 0x3ff));
+  }
+  if (bits > 0x477fe000) {
+    bits = 0x477fe000; /* HDR_HALF_MAX */
+  }
+
+  if (bits < 0x38800000) {
+    /* Below 2^-14 the result is subnormal; adding 0.5 lines the half
+     * mantissa up with the low bits of the float and rounds it. */
+    float magnitude;
+    memcpy(&magnitude, &bits, sizeof(bits));
+    magnitude += 0.5f;
+    memcpy(&bits, &magnitude, sizeof(bits));
+    return (unsigned short)(sign | (bits - 0x3f000000));
+  }
+  /* Rebias the exponent and round away the 13 extra mantissa bits. */
+  bits += 0xc8000fff + ((bits >> 13) & 1);
+  return (unsigned short)(sign | (bits >> 13));
+}
+
+static float clamp_rgb9e5(float value) {
+  /* Also maps NaN to 0. */
+  return value > 0.0f ? (value < HDR_RGB9E5_MAX ? value : HDR_RGB9E5_MAX)
+                      : 0.0f;
+}
+
+static float exponent_scale(int exponent) {
+  uint32_t bits = (uint32_t)(exponent + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return scale;
+}
+
+/**
+ * Packs an RGB triple as specified by EXT_texture_shared_exponent: the
+ * shared exponent follows the largest channel and every mantissa is rounded
+ * to nearest. The reference the vector paths must match.
+ */
+unsigned int hdr_float3_to_rgb9e5(const float *rgb) {
+  float r = clamp_rgb9e5(rgb[0]);
+  float g = clamp_rgb9e5(rgb[1]);
+  float b = clamp_rgb9e5(rgb[2]);
+  float largest = r > g ? (r > b ? r : b) : (g > b ? g : b);
+
+  uint32_t bits;
+  memcpy(&bits, &largest, sizeof(bits));
+  int exponent = (int)(bits >> 23) - 127;
+  int shared = (exponent > -16 ? exponent : -16) + 16;
+  float scale = exponent_scale(24 - shared);
+  if ((int)(largest * scale + 0.5f) == 512) {
+    shared++;
+    scale *= 0.5f;
+  }
+
+  unsigned int red = (unsigned int)(r * scale + 0.5f);
+  unsigned int green = (unsigned int)(g * scale + 0.5f);
+  unsigned int blue = (unsigned int)(b * scale + 0.5f);
+  return red | green << 9 | blue << 18 | (unsigned int)shared << 27;
+}
+#endif
+
+void SIMD_NAME(hdr_half_range)(void *context, int begin, int end) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    hdr_half_range_avx2(context, begin, end);
+    return;
+  }
+#endif
+  ConvertJob *job = context;
+  const float *src = job->src;
+  unsigned short *dest = job->dest;
+  int i = begin;
+#ifdef SIMD_AVX2
+  __m256 high = _mm256_set1_ps(HDR_HALF_MAX);
+  __m256 low = _mm256_set1_ps(-HDR_HALF_MAX);
+  for (; i + 8 <= end; i += 8) {
+    /* NaN is the second operand of both, so it passes through. */
+    __m256 value =
+        _mm256_min_ps(high, _mm256_max_ps(low, _mm256_loadu_ps(src + i)));
+    _mm_storeu_si128((__m128i *)(dest + i),
+                     _mm256_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT));
+  }
+#endif
+  for (; i < end; i++) {
+    dest[i] = hdr_float_to_half(src[i]);
+  }
+}
+
+#ifdef SIMD_AVX2
+/**
+ * hdr_float3_to_rgb9e5 for 8 pixels. The interleaved channels are split
+ * with two blends and a permute each.
+ */
+static __m256i rgb9e5_8(const float *rgb) {
+  __m256 a = _mm256_loadu_ps(rgb);
+  __m256 b = _mm256_loadu_ps(rgb + 8);
+  __m256 c = _mm256_loadu_ps(rgb + 16);
+  __m256 r = _mm256_permutevar8x32_ps(
+      _mm256_blend_ps(_mm256_blend_ps(a, b, 0x92), c, 0x24),
+      _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+  __m256 g = _mm256_permutevar8x32_ps(
+      _mm256_blend_ps(_mm256_blend_ps(a, b, 0x24), c, 0x49),
+      _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6));
+  __m256 bl = _mm256_permutevar8x32_ps(
+      _mm256_blend_ps(_mm256_blend_ps(a, b, 0x49), c, 0x92),
+      _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+
+  __m256 zero = _mm256_setzero_ps();
+  __m256 high = _mm256_set1_ps(HDR_RGB9E5_MAX);
+  r = _mm256_min_ps(_mm256_max_ps(r, zero), high);
+  g = _mm256_min_ps(_mm256_max_ps(g, zero), high);
+  bl = _mm256_min_ps(_mm256_max_ps(bl, zero), high);
+  __m256 largest = _mm256_max_ps(r, _mm256_max_ps(g, bl));
+
+  __m256i exponent = _mm256_sub_epi32(
+      _mm256_srli_epi32(_mm256_castps_si256(largest), 23),
+      _mm256_set1_epi32(127));
+  __m256i shared = _mm256_add_epi32(
+      _mm256_max_epi32(exponent, _mm256_set1_epi32(-16)),
+      _mm256_set1_epi32(16));
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(
+      _mm256_sub_epi32(_mm256_set1_epi32(24 + 127), shared), 23));
+  __m256i overflow = _mm256_cmpeq_epi32(
+      _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(largest, scale), half)),
+      _mm256_set1_epi32(512));
+  shared = _mm256_sub_epi32(shared, overflow);
+  scale = _mm256_blendv_ps(scale, _mm256_mul_ps(scale, half),
+                           _mm256_castsi256_ps(overflow));
+
+  __m256i red =
+      _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(r, scale), half));
+  __m256i green =
+      _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(g, scale), half));
+  __m256i blue =
+      _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(bl, scale), half));
+  return _mm256_or_si256(
+      _mm256_or_si256(red, _mm256_slli_epi32(green, 9)),
+      _mm256_or_si256(_mm256_slli_epi32(blue, 18),
+                      _mm256_slli_epi32(shared, 27)));
+}
+#endif
+
+void SIMD_NAME(hdr_rgb9e5_range)(void *context, int begin, int end) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    hdr_rgb9e5_range_avx2(context, begin, end);
+    return;
+  }
+#endif
+  ConvertJob *job = context;
+  const float *rgb = job->src;
+  unsigned int *dest = job->dest;
+  int i = begin;
+#ifdef SIMD_AVX2
+  for (; i + 8 <= end; i += 8) {
+    _mm256_storeu_si256((__m256i *)(dest + i), rgb9e5_8(rgb + 3 * (size_t)i));
+  }
+#endif
+  for (; i < end; i++) {
+    dest[i] = hdr_float3_to_rgb9e5(rgb + 3 * (size_t)i);
+  }
+}
+
+#ifndef SIMD_WIDE
+/**
+ * Converts count floats to half floats, clamping them to +-65504.
+ * Runs on the job threads, so it must not be called from a parallel loop.
+ */
+void hdr_to_half(const float *src, unsigned short *dest, size_t count) {
+  ConvertJob job = {src, dest};
+  jobs_parallel_for((int)count, HDR_GRAIN, hdr_half_range, &job);
+}
+
+/**
+ * Packs pixels RGB float triples into GL_RGB9_E5 texels, clamping them to
+ * [0, 65408]. Runs on the job threads, so it must not be called from a
+ * parallel loop.
+ */
+void hdr_to_rgb9e5(const float *rgb, unsigned int *dest, size_t pixels) {
+  ConvertJob job = {rgb, dest};
+  jobs_parallel_for((int)pixels, HDR_GRAIN, hdr_rgb9e5_range, &job);
+}
+
+/**
+ * Loads the image at path as floats, converts it to format and uploads it
+ * with a full mip chain. LDR files are linearised by stb_image.
+ * Returns the texture, or 0 on failure.
+ */
+unsigned int hdr_load_texture(const char *path, HdrFormat format, int *width,
+                              int *height) {
+  int channels;
+  float *pixels = stbi_loadf(path, width, height, &channels, 3);
+  if (!pixels) {
+    return 0;
+  }
+  size_t count = (size_t)*width * *height;
+  void *converted = malloc(count * (format == HDR_FORMAT_HALF ? 6 : 4));
+  if (!converted) {
+    stbi_image_free(pixels);
+    return 0;
+  }
+  if (format == HDR_FORMAT_HALF) {
+    hdr_to_half(pixels, converted, count * 3);
+  } else {
+    hdr_to_rgb9e5(pixels, converted, count);
+  }
+  stbi_image_free(pixels);
+
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  if (format == HDR_FORMAT_HALF) {
+    /* Rows of 3 half floats are only 2-byte aligned. */
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, *width, *height, 0, GL_RGB,
+                 GL_HALF_FLOAT, converted);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB9_E5, *width, *height, 0, GL_RGB,
+                 GL_UNSIGNED_INT_5_9_9_9_REV, converted);
+  }
+  glGenerateMipmap(GL_TEXTURE_2D);
+  free(converted);
+  return texture;
+}
+
+/**
+ * Draws texture over the whole viewport with the program built from
+ * shaders/tonemap.vert and shaders/tonemap.frag, scaling it by exposure
+ * before mapping it to display range. The program, vertex array, active
+ * texture unit and the texture bound to unit 0 are left as they were.
+ */
+void hdr_tonemap(unsigned int program, unsigned int texture, float exposure) {
+  /* The fullscreen triangle is generated from gl_VertexID, but core
+   * profiles still need a vertex array bound to draw. */
+  static unsigned int vertexArray = 0;
+  if (!vertexArray) {
+    glGenVertexArrays(1, &vertexArray);
+  }
+
+  GLint previousProgram, previousArray, previousUnit, previousTexture;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousArray);
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &previousUnit);
+  glActiveTexture(GL_TEXTURE0);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "hdrTexture"), 0);
+  glUniform1f(glGetUniformLocation(program, "exposure"), exposure);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glBindVertexArray(vertexArray);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  glBindTexture(GL_TEXTURE_2D, previousTexture);
+  glActiveTexture(previousUnit);
+  glBindVertexArray(previousArray);
+  glUseProgram(previousProgram);
+}
+#endif
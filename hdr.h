@@ -0,0 +1,24 @@
+#ifndef HDR_H
+#define HDR_H
+
+#include <stddef.h>
+
+/**
+ * GPU storage of HDR textures. Half floats take 6 bytes per RGB texel and
+ * keep a sign and 11 bits of precision per channel; RGB9E5 takes 4 bytes,
+ * with 9 bits of mantissa per channel and an exponent shared by all three.
+ * Both cover [0, 65504], GL_RGB32F takes 12 bytes.
+ */
+typedef enum { HDR_FORMAT_HALF, HDR_FORMAT_RGB9E5 } HdrFormat;
+
+unsigned short hdr_float_to_half(float value);
+unsigned int hdr_float3_to_rgb9e5(const float *rgb);
+
+void hdr_to_half(const float *src, unsigned short *dest, size_t count);
+void hdr_to_rgb9e5(const float *rgb, unsigned int *dest, size_t pixels);
+
+unsigned int hdr_load_texture(const char *path, HdrFormat format, int *width,
+                              int *height);
+void hdr_tonemap(unsigned int program, unsigned int texture, float exposure);
+
+#endif
@@ -0,0 +1,10 @@
+/* hdr.c compiled again for AVX2 and F16C, see simd.h. */
+#define SIMD_WIDE
+#include "simd.h"
+
+#ifdef SIMD_HAS_WIDE
+#include "hdr.c"
+#ifdef __clang__
+#pragma clang attribute pop
+#endif
+#endif
@@ -0,0 +1,414 @@
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stb_image.h"
+
+/* Size of a regular arena block; larger requests get a block of their own. */
+#define IMAGE_BLOCK_SIZE ((size_t)4 << 20)
+#define IMAGE_ALIGN 16
+
+/**
+ * Header in front of every allocation handed to stb_image. heap marks
+ * allocations made with malloc; all others live in an arena block and are
+ * reclaimed when the arena is reset.
+ */
+typedef struct {
+  _Alignas(IMAGE_ALIGN) size_t size;
+  size_t heap;
+} AllocHeader;
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  size_t capacity;
+  size_t used;
+} ArenaBlock;
+
+/**
+ * Per-thread decoder memory. The arena is only used while the thread is
+ * inside an image load and is reset after every image; other allocations,
+ * such as those of job pool workers helping with a decode, go to the heap.
+ *
+ * Blocks are kept across images. When an image needed more than one block,
+ * the arena is rebuilt as a single block of that size, so repeated loads of
+ * similar images need no heap allocations at all.
+ */
+typedef struct {
+  ArenaBlock *blocks;
+  ArenaBlock *current;
+  size_t imageBytes;
+  int active;
+
+  unsigned char *dest;
+  size_t destSize;
+  size_t outputSize;
+  int destTaken;
+
+  ImageStats stats;
+} Arena;
+
+static _Thread_local Arena arena;
+
+static size_t align_up(size_t size) {
+  return (size + IMAGE_ALIGN - 1) & ~(size_t)(IMAGE_ALIGN - 1);
+}
+
+static unsigned char *block_data(ArenaBlock *block) {
+  return (unsigned char *)block + align_up(sizeof(ArenaBlock));
+}
+
+static ArenaBlock *block_create(size_t capacity) {
+  ArenaBlock *block =
+      aligned_alloc(IMAGE_ALIGN, align_up(sizeof(ArenaBlock)) + capacity);
+  if (!block) {
+    return NULL;
+  }
+  arena.stats.heapAllocations++;
+  block->next = NULL;
+  block->capacity = capacity;
+  block->used = 0;
+  return block;
+}
+
+static void blocks_free(void) {
+  ArenaBlock *block = arena.blocks;
+  while (block) {
+    ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena.blocks = NULL;
+  arena.current = NULL;
+}
+
+/**
+ * Returns whether p is the most recent allocation of the current block.
+ */
+static int is_last(const AllocHeader *header) {
+  ArenaBlock *block = arena.current;
+  const unsigned char *end =
+      (const unsigned char *)(header + 1) + align_up(header->size);
+  return block && end == block_data(block) + block->used;
+}
+
+static void *heap_alloc(size_t size) {
+  AllocHeader *header = malloc(sizeof(AllocHeader) + size);
+  if (!header) {
+    return NULL;
+  }
+  arena.stats.heapAllocations++;
+  header->size = size;
+  header->heap = 1;
+  return header + 1;
+}
+
+static void *arena_alloc(size_t size) {
+  size_t need = sizeof(AllocHeader) + align_up(size);
+  ArenaBlock *block = arena.current;
+  while (block && block->capacity - block->used < need) {
+    block = block->next;
+  }
+  if (!block) {
+    block = block_create(need > IMAGE_BLOCK_SIZE ? need : IMAGE_BLOCK_SIZE);
+    if (!block) {
+      return NULL;
+    }
+    if (arena.current) {
+      ArenaBlock *tail = arena.current;
+      while (tail->next) {
+        tail = tail->next;
+      }
+      tail->next = block;
+    } else {
+      arena.blocks = block;
+    }
+  }
+  arena.current = block;
+  arena.imageBytes += need;
+
+  AllocHeader *header = (AllocHeader *)(block_data(block) + block->used);
+  block->used += need;
+  header->size = size;
+  header->heap = 0;
+  return header + 1;
+}
+
+/**
+ * Allocator hook for STBI_MALLOC. Inside a load with a destination, a
+ * request that fits the decoded image is served from the destination, which
+ * is where stb_image allocates its result.
+ */
+void *image_arena_alloc(size_t size) {
+  arena.stats.allocations++;
+  if (!arena.active) {
+    return heap_alloc(size);
+  }
+  if (arena.dest && !arena.destTaken && size >= arena.outputSize &&
+      size <= arena.outputSize + IMAGE_DEST_SLACK && size <= arena.destSize) {
+    arena.destTaken = 1;
+    return arena.dest;
+  }
+  return arena_alloc(size);
+}
+
+/**
+ * Allocator hook for STBI_FREE. Arena memory is reclaimed when the load
+ * ends; only the most recent allocation is handed back right away. A freed
+ * destination held an intermediate image and may take the result later.
+ */
+void image_arena_free(void *p) {
+  if (!p) {
+    return;
+  }
+  if (arena.dest && p == arena.dest) {
+    arena.destTaken = 0;
+    return;
+  }
+  AllocHeader *header = (AllocHeader *)p - 1;
+  if (header->heap) {
+    free(header);
+    return;
+  }
+  if (arena.active && is_last(header)) {
+    arena.current->used = (unsigned char *)header - block_data(arena.current);
+  }
+}
+
+/**
+ * Allocator hook for STBI_REALLOC_SIZED. Grows the most recent arena
+ * allocation in place when its block has room.
+ */
+void *image_arena_realloc(void *p, size_t oldSize, size_t newSize) {
+  if (!p) {
+    return image_arena_alloc(newSize);
+  }
+  if (!arena.dest || p != arena.dest) {
+    AllocHeader *header = (AllocHeader *)p - 1;
+    if (header->heap) {
+      arena.stats.allocations++;
+      arena.stats.heapAllocations++;
+      header = realloc(header, sizeof(AllocHeader) + newSize);
+      if (!header) {
+        return NULL;
+      }
+      header->size = newSize;
+      return header + 1;
+    }
+    oldSize = header->size;
+    if (arena.active && is_last(header)) {
+      size_t offset = (unsigned char *)p - block_data(arena.current);
+      if (arena.current->capacity - offset >= align_up(newSize)) {
+        arena.stats.allocations++;
+        arena.current->used = offset + align_up(newSize);
+        arena.imageBytes += align_up(newSize) - align_up(oldSize);
+        header->size = newSize;
+        return p;
+      }
+    }
+  }
+
+  void *q = image_arena_alloc(newSize);
+  if (!q) {
+    return NULL;
+  }
+  memcpy(q, p, oldSize < newSize ? oldSize : newSize);
+  image_arena_free(p);
+  return q;
+}
+
+static void arena_begin(void) {
+  arena.active = 1;
+  arena.dest = NULL;
+}
+
+static void arena_set_dest(unsigned char *dest, size_t destSize,
+                           size_t outputSize) {
+  arena.dest = dest;
+  arena.destSize = destSize;
+  arena.outputSize = outputSize;
+  arena.destTaken = 0;
+}
+
+static void arena_reset(void) {
+  if (arena.blocks && arena.blocks->next) {
+    size_t capacity = arena.imageBytes;
+    blocks_free();
+    arena.blocks = block_create(capacity > IMAGE_BLOCK_SIZE ? capacity
+                                                            : IMAGE_BLOCK_SIZE);
+  }
+  for (ArenaBlock *block = arena.blocks; block; block = block->next) {
+    block->used = 0;
+  }
+  arena.current = arena.blocks;
+  arena.imageBytes = 0;
+  arena.active = 0;
+  arena.dest = NULL;
+}
+
+/**
+ * Ends a load started with arena_begin. pixels is the decoded image, which
+ * is copied into the destination unless it was decoded there.
+ */
+static int arena_end(unsigned char *pixels, const ImageInfo *info, int width,
+                     int height) {
+  int ok = pixels && width == info->width && height == info->height;
+  if (ok) {
+    if (pixels == arena.dest) {
+      arena.stats.directDecodes++;
+    } else {
+      memcpy(arena.dest, pixels, image_size(info));
+    }
+    arena.stats.images++;
+  }
+  image_arena_free(pixels);
+  arena_reset();
+  return ok ? 0 : -1;
+}
+
+static void set_info(ImageInfo *info, int width, int height, int channels,
+                     int desiredChannels) {
+  info->width = width;
+  info->height = height;
+  info->channels = desiredChannels ? desiredChannels : channels;
+}
+
+/**
+ * Reads the size of the image at path without decoding it.
+ * Returns 0 on success and -1 on failure.
+ */
+int image_info(const char *path, int desiredChannels, ImageInfo *info) {
+  int width, height, channels;
+  arena_begin();
+  int ok = stbi_info(path, &width, &height, &channels);
+  arena_reset();
+  if (!ok) {
+    return -1;
+  }
+  set_info(info, width, height, channels, desiredChannels);
+  return 0;
+}
+
+int image_info_from_memory(const unsigned char *data, int length,
+                           int desiredChannels, ImageInfo *info) {
+  int width, height, channels;
+  arena_begin();
+  int ok = stbi_info_from_memory(data, length, &width, &height, &channels);
+  arena_reset();
+  if (!ok) {
+    return -1;
+  }
+  set_info(info, width, height, channels, desiredChannels);
+  return 0;
+}
+
+/**
+ * Returns the number of bytes of a decoded image.
+ */
+size_t image_size(const ImageInfo *info) {
+  return (size_t)info->width * info->height * info->channels;
+}
+
+static int file_info(FILE *file, int desiredChannels, ImageInfo *info) {
+  int width, height, channels;
+  arena_begin();
+  int ok = stbi_info_from_file(file, &width, &height, &channels);
+  arena_reset();
+  if (!ok) {
+    return -1;
+  }
+  set_info(info, width, height, channels, desiredChannels);
+  return 0;
+}
+
+static int load_file_into(FILE *file, int desiredChannels, unsigned char *dest,
+                          size_t destSize, const ImageInfo *info) {
+  int width, height, channels;
+  if (image_size(info) > destSize) {
+    return -1;
+  }
+  arena_begin();
+  arena_set_dest(dest, destSize, image_size(info));
+  unsigned char *pixels =
+      stbi_load_from_file(file, &width, &height, &channels, desiredChannels);
+  return arena_end(pixels, info, width, height);
+}
+
+/**
+ * Decodes the image at path into dest, which must hold image_size bytes.
+ * With IMAGE_DEST_SLACK spare bytes every supported format decodes straight
+ * into dest; otherwise some images are decoded elsewhere and copied. All
+ * intermediate memory comes from the calling thread's arena.
+ * Returns 0 on success and -1 on failure, see stbi_failure_reason.
+ */
+int image_load_into(const char *path, int desiredChannels, unsigned char *dest,
+                    size_t destSize, ImageInfo *info) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return -1;
+  }
+  int result = file_info(file, desiredChannels, info);
+  if (result == 0) {
+    result = load_file_into(file, desiredChannels, dest, destSize, info);
+  }
+  fclose(file);
+  return result;
+}
+
+int image_load_from_memory_into(const unsigned char *data, int length,
+                                int desiredChannels, unsigned char *dest,
+                                size_t destSize, ImageInfo *info) {
+  int width, height, channels;
+  if (image_info_from_memory(data, length, desiredChannels, info) != 0 ||
+      image_size(info) > destSize) {
+    return -1;
+  }
+  arena_begin();
+  arena_set_dest(dest, destSize, image_size(info));
+  unsigned char *pixels = stbi_load_from_memory(
+      data, length, &width, &height, &channels, desiredChannels);
+  return arena_end(pixels, info, width, height);
+}
+
+/**
+ * Decodes the image at path into a new buffer, which is released with
+ * image_free. Returns NULL on failure.
+ */
+unsigned char *image_load(const char *path, int desiredChannels,
+                          ImageInfo *info) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return NULL;
+  }
+  unsigned char *pixels = NULL;
+  if (file_info(file, desiredChannels, info) == 0) {
+    size_t size = image_size(info) + IMAGE_DEST_SLACK;
+    pixels = malloc(size);
+    if (pixels &&
+        load_file_into(file, desiredChannels, pixels, size, info) != 0) {
+      free(pixels);
+      pixels = NULL;
+    }
+  }
+  fclose(file);
+  return pixels;
+}
+
+void image_free(unsigned char *pixels) { free(pixels); }
+
+/**
+ * Copies the allocation counters of the calling thread into stats.
+ */
+void image_stats(ImageStats *stats) { *stats = arena.stats; }
+
+void image_reset_stats(void) { memset(&arena.stats, 0, sizeof(ImageStats)); }
+
+/**
+ * Frees the calling thread's arena, e.g. before the thread exits. The next
+ * load on the thread starts a new one.
+ */
+void image_release_thread(void) {
+  blocks_free();
+  arena.imageBytes = 0;
+}
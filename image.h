@@ -0,0 +1,59 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+
+/**
+ * Spare bytes a destination needs past its last pixel for JPEGs to decode
+ * straight into it; the JPEG color conversion writes one byte past the end.
+ * Smaller destinations still work, but receive a copy of the image.
+ */
+#define IMAGE_DEST_SLACK 1
+
+/**
+ * Size of a decoded image. channels is the requested channel count, or the
+ * file's own if none was requested.
+ */
+typedef struct {
+  int width;
+  int height;
+  int channels;
+} ImageInfo;
+
+/**
+ * Allocation counters of the calling thread. allocations counts every
+ * request made by the decoder, heapAllocations those that reached malloc,
+ * including new arena blocks. Allocations made by job pool workers while
+ * decoding are counted on the workers.
+ */
+typedef struct {
+  unsigned long images;
+  unsigned long allocations;
+  unsigned long heapAllocations;
+  unsigned long directDecodes;
+} ImageStats;
+
+int image_info(const char *path, int desiredChannels, ImageInfo *info);
+int image_info_from_memory(const unsigned char *data, int length,
+                           int desiredChannels, ImageInfo *info);
+size_t image_size(const ImageInfo *info);
+
+int image_load_into(const char *path, int desiredChannels, unsigned char *dest,
+                    size_t destSize, ImageInfo *info);
+int image_load_from_memory_into(const unsigned char *data, int length,
+                                int desiredChannels, unsigned char *dest,
+                                size_t destSize, ImageInfo *info);
+unsigned char *image_load(const char *path, int desiredChannels,
+                          ImageInfo *info);
+void image_free(unsigned char *pixels);
+
+void image_stats(ImageStats *stats);
+void image_reset_stats(void);
+void image_release_thread(void);
+
+/* Allocator hooks for stb_image, see stb_image.c. */
+void *image_arena_alloc(size_t size);
+void *image_arena_realloc(void *p, size_t oldSize, size_t newSize);
+void image_arena_free(void *p);
+
+#endif
@@ -0,0 +1,188 @@
+#include "jobs.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define JOBS_MAX_THREADS 64
+
+/**
+ * Parallel loop in progress, owned by the thread that started it. That thread
+ * and any workers claim chunks of grain indices until the range is
+ * exhausted.
+ */
+typedef struct Job {
+  JobFunc func;
+  void *context;
+  int count;
+  int grain;
+  atomic_int next;
+  atomic_int remaining;
+  int active;
+  struct Job *nextJob;
+} Job;
+
+static pthread_t workers[JOBS_MAX_THREADS];
+static int workerCount = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+/* Loops started from any thread and not yet finished, guarded by mutex. */
+static Job *jobs = NULL;
+static int shuttingDown = 0;
+
+/**
+ * Claims and runs one chunk of the job.
+ * Returns 0 if no chunk was left to claim.
+ */
+static int run_chunk(Job *job) {
+  int begin = atomic_fetch_add(&job->next, job->grain);
+  if (begin >= job->count) {
+    return 0;
+  }
+  int end = begin + job->grain < job->count ? begin + job->grain : job->count;
+  job->func(job->context, begin, end);
+
+  if (atomic_fetch_sub(&job->remaining, end - begin) == end - begin) {
+    pthread_mutex_lock(&mutex);
+    pthread_cond_broadcast(&done);
+    pthread_mutex_unlock(&mutex);
+  }
+  return 1;
+}
+
+/**
+ * Returns the loop with unclaimed chunks that the fewest workers help with,
+ * so loops started from different threads share the workers, or NULL if
+ * there is none. Called with mutex held.
+ */
+static Job *pick_job(void) {
+  Job *best = NULL;
+  for (Job *job = jobs; job; job = job->nextJob) {
+    if (atomic_load(&job->next) < job->count &&
+        (!best || job->active < best->active)) {
+      best = job;
+    }
+  }
+  return best;
+}
+
+/**
+ * Runs one chunk at a time, picking a loop again after each, so a long loop
+ * does not keep every worker while a short one waits.
+ */
+static void *worker_main(void *arg) {
+  pthread_mutex_lock(&mutex);
+  for (;;) {
+    Job *job;
+    while (!shuttingDown && !(job = pick_job())) {
+      pthread_cond_wait(&wake, &mutex);
+    }
+    if (shuttingDown) {
+      break;
+    }
+    /* Keeps the caller from returning while this worker touches the job. */
+    job->active++;
+    pthread_mutex_unlock(&mutex);
+
+    run_chunk(job);
+
+    pthread_mutex_lock(&mutex);
+    if (--job->active == 0) {
+      pthread_cond_broadcast(&done);
+    }
+  }
+  pthread_mutex_unlock(&mutex);
+  return NULL;
+}
+
+/**
+ * Starts the worker threads. A threadCount of 0 uses one thread per online
+ * CPU; the thread calling jobs_parallel_for always takes part as well.
+ * Returns 0 on success and -1 if no worker could be started.
+ */
+int jobs_init(int threadCount) {
+  if (threadCount <= 0) {
+    threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  /* The calling thread is one of the threads doing work. */
+  threadCount -= 1;
+  if (threadCount > JOBS_MAX_THREADS) {
+    threadCount = JOBS_MAX_THREADS;
+  }
+
+  shuttingDown = 0;
+  for (workerCount = 0; workerCount < threadCount; workerCount++) {
+    if (pthread_create(&workers[workerCount], NULL, worker_main, NULL) != 0) {
+      break;
+    }
+  }
+  return threadCount > 0 && workerCount == 0 ? -1 : 0;
+}
+
+void jobs_shutdown(void) {
+  pthread_mutex_lock(&mutex);
+  shuttingDown = 1;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&mutex);
+
+  for (int i = 0; i < workerCount; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  workerCount = 0;
+}
+
+/**
+ * Number of threads taking part in a parallel loop, including the caller.
+ */
+int jobs_thread_count(void) { return workerCount + 1; }
+
+/**
+ * Calls func over [0, count) split into chunks of grain indices and returns
+ * once every chunk has finished. Without workers, or for loops that fit into
+ * a single chunk, func runs inline on the calling thread.
+ * Loops started from several threads run at the same time and share the
+ * workers; the calling thread only runs chunks of its own loop, so it never
+ * waits for another thread's work. Parallel loops must not be nested.
+ */
+void jobs_parallel_for(int count, int grain, JobFunc func, void *context) {
+  if (count <= 0) {
+    return;
+  }
+  if (grain < 1) {
+    grain = 1;
+  }
+  if (workerCount == 0 || count <= grain) {
+    func(context, 0, count);
+    return;
+  }
+
+  Job job = {.func = func,
+             .context = context,
+             .count = count,
+             .grain = grain,
+             .active = 0};
+  atomic_init(&job.next, 0);
+  atomic_init(&job.remaining, count);
+
+  pthread_mutex_lock(&mutex);
+  job.nextJob = jobs;
+  jobs = &job;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&mutex);
+
+  while (run_chunk(&job)) {
+  }
+
+  pthread_mutex_lock(&mutex);
+  while (atomic_load(&job.remaining) > 0 || job.active > 0) {
+    pthread_cond_wait(&done, &mutex);
+  }
+  Job **link = &jobs;
+  while (*link != &job) {
+    link = &(*link)->nextJob;
+  }
+  *link = job.nextJob;
+  pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,15 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+/**
+ * Processes the index range [begin, end) of a parallel loop.
+ */
+typedef void (*JobFunc)(void *context, int begin, int end);
+
+int jobs_init(int threadCount);
+void jobs_shutdown(void);
+int jobs_thread_count(void);
+
+void jobs_parallel_for(int count, int grain, JobFunc func, void *context);
+
+#endif
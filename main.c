@@ -7,15 +7,54 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "shader.h"
-#include "stb_image.h"
+#include "jobs.h"
+#include "manifest.h"
+#include "meshfile.h"
+#include "meshpack.h"
+#include "resource.h"
+#include "scene.h"
+#include "shaderreg.h"
+#include "textable.h"
+#include "texstream.h"
+#include "uniforms.h"
 
 const uint SCR_WIDTH = 800;
 const uint SCR_HEIGHT = 600;
 
 unsigned int currentRenderingMode = GL_FILL;
-unsigned int shaderProgram;
+
+/* Uniform block bindings of shaders/simple.vert and shaders/simple.frag. */
+enum { FRAME_BINDING, MATERIAL_BINDING, OBJECT_BINDING };
+/* Storage buffer binding or texture unit of the texture table. */
+enum { TEXTURE_TABLE_BINDING = 0 };
+
+/* Objects drawn by one instanced draw, OBJECT_COUNT in simple.vert. */
+#define OBJECT_COUNT 64
+
+/**
+ * C side of the std140 blocks of the simple shaders. cglm matrices and
+ * vectors are 16-byte aligned, as std140 lays them out.
+ */
+typedef struct {
+  mat4 view;
+  mat4 projection;
+} FrameUniforms;
+
+typedef struct {
+  vec4 tint;
+} MaterialUniforms;
+
+typedef struct {
+  mat4 transform;
+  unsigned int textureSlot;
+  unsigned int padding[3];
+} ObjectData;
+
+typedef struct {
+  ObjectData objects[OBJECT_COUNT];
+} ObjectUniforms;
 
 /**
  * Callback function executed when the window is created or resized.
@@ -49,10 +88,69 @@ void processInput(GLFWwindow *window) {
   }
 }
 
-int main() {
+/**
+ * Assigns the uniform blocks and texture table of a newly built program to
+ * their bindings and checks the block layouts against the C structs.
+ */
+void prepareProgram(unsigned int program) {
+  const UniformField frameFields[] = {UNIFORM_FIELD(FrameUniforms, view),
+                                      UNIFORM_FIELD(FrameUniforms, projection)};
+  const UniformField materialFields[] = {
+      UNIFORM_FIELD(MaterialUniforms, tint)};
+  const UniformField objectFields[] = {
+      UNIFORM_FIELD(ObjectUniforms, objects[0].transform),
+      UNIFORM_FIELD(ObjectUniforms, objects[0].textureSlot),
+      UNIFORM_FIELD(ObjectUniforms, objects[1].transform)};
+
+  glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Frame"),
+                        FRAME_BINDING);
+  glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Material"),
+                        MATERIAL_BINDING);
+  glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Object"),
+                        OBJECT_BINDING);
+  uniforms_check_block(program, "Frame", sizeof(FrameUniforms), frameFields,
+                       2);
+  uniforms_check_block(program, "Material", sizeof(MaterialUniforms),
+                       materialFields, 1);
+  uniforms_check_block(program, "Object", sizeof(ObjectUniforms),
+                       objectFields, 3);
+  textable_prepare(program, TEXTURE_TABLE_BINDING);
+}
+
+/**
+ * Streams the texture name from the assets directory. When the manifest
+ * lists it and the file still has the recorded size, the texture is sized
+ * from the manifest right away. Otherwise the file is probed as usual.
+ */
+int requestTexture(const Manifest *manifest, const char *name) {
+  char path[256];
+  snprintf(path, sizeof(path), "../assets/%s", name);
+
+  const ManifestEntry *entry = manifest_find(manifest, name);
+  if (!entry) {
+    return texstream_request(path, 0, 0);
+  }
+  if (manifest_entry_current(entry, path, 0) != 1) {
+    fprintf(stderr, "Manifest entry is stale: %s\n", name);
+    return texstream_request(path, 0, 0);
+  }
+  return texstream_request(path, entry->width, entry->height);
+}
+
+int main(int argc, char **argv) {
+  if (argc == 4 && strcmp(argv[1], "--build-manifest") == 0) {
+    int count = manifest_build(argv[2], argv[3]);
+    if (count < 0) {
+      fprintf(stderr, "Error building manifest: %s\n", argv[3]);
+      return EXIT_FAILURE;
+    }
+    fprintf(stdout, "Indexed %d images in %s\n", count, argv[3]);
+    return EXIT_SUCCESS;
+  }
+
   glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
@@ -61,6 +159,13 @@ int main() {
 
   GLFWwindow *window =
       glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+  if (window == NULL) {
+    // Fall back to 3.3 where 4.6 is unavailable; features needing a newer
+    // context check the GLAD_GL_VERSION_* flags before use.
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+  }
   if (window == NULL) {
     fprintf(stderr, "Error creating window.\n");
     glfwTerminate();
@@ -74,98 +179,172 @@ int main() {
     return EXIT_FAILURE;
   }
 
-  shaderProgram =
-      generateShader("../shaders/simple.vert", "../shaders/simple.frag");
-
-  // clang-format off
-  float vertices[] = {
-      // positions          // colors           // texture coords
-      0.5f,  0.5f,  0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 1.0f, // top right
-      0.5f,  -0.5f, 0.0f,   0.0f, 1.0f, 0.0f,   1.0f, 0.0f, // bottom right
-      -0.5f, -0.5f, 0.0f,   0.0f, 0.0f, 1.0f,   0.0f, 0.0f, // bottom left
-      -0.5f, 0.5f,  0.0f,   1.0f, 1.0f, 0.0f,   0.0f, 1.0f  // top left
-  };
-
-  unsigned int indices[] = {
-      0, 1, 3, // first triangle
-      1, 2, 3  // second triangle
-  };
-  // clang-format on
-
-  unsigned int VBO, VAO, EBO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
-
-  glBindVertexArray(VAO);
-
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
-               GL_STATIC_DRAW);
-
-  // position attribute
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
-  // color attribute
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                        (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-  // texture coord attribute
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                        (void *)(6 * sizeof(float)));
-  glEnableVertexAttribArray(2);
-
-  unsigned int texture;
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                  GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  int width, height, nrChannels;
-  char *texturePath = "../assets/container.jpg";
-  unsigned char *data = stbi_load(texturePath, &width, &height, &nrChannels, 0);
-  if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
-                 GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
-    fprintf(stderr, "Error loading texture: %s\n", texturePath);
-  }
-  stbi_image_free(data);
+  // Draws index their texture in a table instead of binding it, so objects
+  // with different textures share a draw. Slot 0 is white. The table decides
+  // how shaders declare it, so it is created before them.
+  if (textable_init(16, 256, 256) != 0) {
+    fprintf(stderr, "Error creating texture table.\n");
+    return EXIT_FAILURE;
+  }
+
+  // Edited shaders are rebuilt in the background and swapped in by
+  // shaderreg_update once they link.
+  if (shaderreg_init(window) != 0) {
+    fprintf(stderr, "Error watching shaders, hot reload is disabled.\n");
+  }
+  const char *tableDefine = textable_define();
+  int simpleShader =
+      shaderreg_add("../shaders/simple.vert", "../shaders/simple.frag",
+                    &tableDefine, tableDefine ? 1 : 0);
+  if (simpleShader < 0) {
+    fprintf(stderr, "Error adding shader program.\n");
+    return EXIT_FAILURE;
+  }
+
+  if (jobs_init(0) != 0) {
+    fprintf(stderr, "Error starting job threads.\n");
+  }
+
+  Scene scene;
+  if (scene_init(&scene, 16) != 0) {
+    fprintf(stderr, "Error allocating scene.\n");
+    return EXIT_FAILURE;
+  }
+
+  int rotatedQuad = scene_add_node(&scene, -1);
+  versor rotation;
+  glm_quatv(rotation, 90.0f, (vec3){0.0, 0.0, 1.0});
+  scene_set_scale(&scene, rotatedQuad, (vec3){0.5, 0.5, 0.5});
+  scene_set_rotation(&scene, rotatedQuad, rotation);
+
+  int translatedQuad = scene_add_node(&scene, -1);
+  scene_set_position(&scene, translatedQuad, (vec3){-0.5f, 0.5f, 0.0f});
 
+  // Parsed once and cached next to the source as quad.ply.cache; later runs
+  // map the cache instead of parsing.
+  Mesh quadMesh;
+  if (meshfile_load(&quadMesh, "../assets/quad.ply") != 0) {
+    fprintf(stderr, "Error loading mesh.\n");
+    return EXIT_FAILURE;
+  }
+
+  // Quantized to 16 bytes per vertex; quad.decode maps the positions back
+  // and goes in front of each quad's world matrix.
+  const float *quadVertices = (const float *)quadMesh.vertices;
+  MeshSource quadSource = {
+      .positions = quadVertices,
+      .colors = quadVertices + offsetof(MeshVertex, color) / sizeof(float),
+      .texCoords =
+          quadVertices + offsetof(MeshVertex, texCoord) / sizeof(float),
+      .stride = sizeof(MeshVertex) / sizeof(float),
+      .vertexCount = quadMesh.vertexCount};
+  PackedMesh quad;
+  if (meshpack_pack(&quadSource, &quad) != 0) {
+    fprintf(stderr, "Error packing vertices.\n");
+    meshfile_free(&quadMesh);
+    return EXIT_FAILURE;
+  }
+
+  // Created without binding anything, so setup leaves the bound state alone.
+  unsigned int VBO = resource_buffer(quad.size, quad.data, 0);
+  unsigned int EBO = resource_buffer(
+      quadMesh.indexCount * sizeof(uint32_t), quadMesh.indices, 0);
+  unsigned int VAO = resource_vertex_array(VBO, quad.stride, quad.attribs,
+                                           quad.attribCount, EBO);
+  int quadIndexCount = quadMesh.indexCount;
+  meshpack_free(&quad);
+  meshfile_free(&quadMesh);
+
+  // Per-frame, per-material and per-object blocks are written to a ring
+  // buffer, uploaded together and bound by range for each draw.
+  if (uniforms_init(3 * 64 * 1024) != 0) {
+    fprintf(stderr, "Error creating uniform buffer.\n");
+    return EXIT_FAILURE;
+  }
+  unsigned int preparedProgram = 0;
+
+  // Textures are decoded in the background and uploaded at most 1 MiB per
+  // frame; until then draws sample a coarser mip level or a grey placeholder.
+  // On the bindless path the table shows white until the last level lands.
+  if (texstream_init(1 << 20) != 0) {
+    fprintf(stderr, "Error starting texture streaming.\n");
+    return EXIT_FAILURE;
+  }
+
+  // The manifest is built with --build-manifest ../assets
+  // ../assets/assets.manifest; without it, textures are probed on load.
+  Manifest manifest;
+  manifest_open(&manifest, "../assets/assets.manifest");
+  char *textureName = "container.jpg";
+  int texture = requestTexture(&manifest, textureName);
+  manifest_close(&manifest);
+  if (texture < 0) {
+    fprintf(stderr, "Error loading texture: %s\n", textureName);
+    return EXIT_FAILURE;
+  }
+
+  // The texture joins the table right away with whatever is resident, and
+  // its slot is refreshed whenever a finer level arrives.
+  int textureSlot = textable_add(texstream_texture(texture));
+  int tableLevel = texstream_resident_level(texture);
+  if (textureSlot < 0) {
+    textureSlot = 0;
+  }
   while (!glfwWindowShouldClose(window)) {
     processInput(window);
+    texstream_update();
+    shaderreg_update();
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    glBindTexture(GL_TEXTURE_2D, texture);
+    if (textureSlot > 0 && texstream_resident_level(texture) != tableLevel) {
+      tableLevel = texstream_resident_level(texture);
+      textable_refresh(textureSlot, texstream_texture(texture));
+    }
+
+    unsigned int shaderProgram = shaderreg_program(simpleShader);
+    if (shaderProgram != preparedProgram) {
+      prepareProgram(shaderProgram);
+      preparedProgram = shaderProgram;
+    }
     glUseProgram(shaderProgram);
 
-    mat4 trans;
-    glm_mat4_identity(trans);
-    glm_scale(trans, (vec3){0.5, 0.5, 0.5});
-    glm_rotate(trans, 90.0f, (vec3){0.0, 0.0, 1.0});
-    unsigned int transformLoc =
-        glGetUniformLocation(shaderProgram, "transform");
-    glUniformMatrix4fv(transformLoc, 1, GL_FALSE, (float *)trans);
+    if (scene_update(&scene) != 0) {
+      fprintf(stderr, "Error updating scene.\n");
+      break;
+    }
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    // Write all blocks of the frame first, so they go up in one upload.
+    uniforms_begin_frame();
+    UniformSlice frame, material, objects;
+    int quads[2] = {rotatedQuad, translatedQuad};
+    if (uniforms_alloc(sizeof(FrameUniforms), &frame) != 0 ||
+        uniforms_alloc(sizeof(MaterialUniforms), &material) != 0 ||
+        uniforms_alloc(sizeof(ObjectUniforms), &objects) != 0) {
+      break;
+    }
+    FrameUniforms *frameData = frame.data;
+    glm_mat4_identity(frameData->view);
+    glm_mat4_identity(frameData->projection);
+    glm_vec4_one(((MaterialUniforms *)material.data)->tint);
+    ObjectData *objectData = ((ObjectUniforms *)objects.data)->objects;
+    for (int i = 0; i < 2; i++) {
+      glm_mat4_mul(scene_world(&scene, quads[i]), quad.decode,
+                   objectData[i].transform);
+      objectData[i].textureSlot = textureSlot;
+    }
+    uniforms_flush();
 
-    mat4 transUni;
-    glm_mat4_identity(transUni);
-    glm_translate(transUni, (vec3){-0.5f, 0.5f, 0.0f});
-    unsigned int transformUniLoc =
-        glGetUniformLocation(shaderProgram, "transform");
-    glUniformMatrix4fv(transformUniLoc, 1, GL_FALSE, (float *)transUni);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    // One draw for all quads; each instance reads its object and texture.
+    uniforms_bind(GL_UNIFORM_BUFFER, FRAME_BINDING, &frame);
+    uniforms_bind(GL_UNIFORM_BUFFER, MATERIAL_BINDING, &material);
+    uniforms_bind(GL_UNIFORM_BUFFER, OBJECT_BINDING, &objects);
+    textable_bind(TEXTURE_TABLE_BINDING);
+    glBindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, quadIndexCount, GL_UNSIGNED_INT, 0,
+                            2);
+    uniforms_end_frame();
 
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -173,7 +352,14 @@ int main() {
 
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
-  glDeleteProgram(shaderProgram);
+  glDeleteBuffers(1, &EBO);
+
+  scene_free(&scene);
+  uniforms_shutdown();
+  textable_shutdown();
+  texstream_shutdown();
+  shaderreg_shutdown();
+  jobs_shutdown();
 
   glfwTerminate();
   return EXIT_SUCCESS;
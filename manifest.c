@@ -0,0 +1,353 @@
+#include "manifest.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.h"
+
+/**
+ * Entry collected while scanning, before the names are packed into the
+ * string table.
+ */
+typedef struct {
+  ManifestEntry entry;
+  char *name;
+} ScanEntry;
+
+static uint64_t hash_bytes(const unsigned char *data, size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/**
+ * Identifies the format of a file stb_image could read from its first bytes.
+ * TGA has no signature and is what remains.
+ */
+static ManifestFormat detect_format(const unsigned char *data, size_t size) {
+  if (size >= 4 && memcmp(data, "\x89PNG", 4) == 0) {
+    return MANIFEST_FORMAT_PNG;
+  }
+  if (size >= 3 && memcmp(data, "\xff\xd8\xff", 3) == 0) {
+    return MANIFEST_FORMAT_JPEG;
+  }
+  if (size >= 4 && memcmp(data, "GIF8", 4) == 0) {
+    return MANIFEST_FORMAT_GIF;
+  }
+  if (size >= 2 && memcmp(data, "BM", 2) == 0) {
+    return MANIFEST_FORMAT_BMP;
+  }
+  if (size >= 4 && memcmp(data, "8BPS", 4) == 0) {
+    return MANIFEST_FORMAT_PSD;
+  }
+  if (size >= 2 && memcmp(data, "#?", 2) == 0) {
+    return MANIFEST_FORMAT_HDR;
+  }
+  if (size >= 4 && memcmp(data, "\x53\x80\xf6\x34", 4) == 0) {
+    return MANIFEST_FORMAT_PIC;
+  }
+  if (size >= 2 && data[0] == 'P' && (data[1] == '5' || data[1] == '6')) {
+    return MANIFEST_FORMAT_PNM;
+  }
+  return MANIFEST_FORMAT_TGA;
+}
+
+const char *manifest_format_name(ManifestFormat format) {
+  static const char *names[] = {"unknown", "png", "jpeg", "gif", "bmp",
+                                "psd",     "hdr", "pic",  "pnm", "tga"};
+  if ((unsigned)format > MANIFEST_FORMAT_TGA) {
+    return names[0];
+  }
+  return names[format];
+}
+
+static unsigned char *read_file(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return NULL;
+  }
+  unsigned char *data = NULL;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    long length = ftell(file);
+    if (length > 0 && length <= INT32_MAX && fseek(file, 0, SEEK_SET) == 0) {
+      data = malloc(length);
+      if (data && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+      }
+      *size = length;
+    }
+  }
+  fclose(file);
+  return data;
+}
+
+/**
+ * Reads the image file name in directory and fills in its entry. Returns 0
+ * for images and -1 for files stb_image cannot read.
+ */
+static int scan_file(const char *directory, const char *name,
+                     ManifestEntry *entry) {
+  char path[4096];
+  struct stat info;
+  if (snprintf(path, sizeof(path), "%s/%s", directory, name) >=
+          (int)sizeof(path) ||
+      stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+    return -1;
+  }
+
+  size_t size;
+  unsigned char *data = read_file(path, &size);
+  if (!data) {
+    return -1;
+  }
+  ImageInfo image;
+  int result = image_info_from_memory(data, (int)size, 0, &image);
+  if (result == 0) {
+    memset(entry, 0, sizeof(ManifestEntry));
+    entry->hash = hash_bytes(data, size);
+    entry->fileSize = (uint32_t)size;
+    entry->width = image.width;
+    entry->height = image.height;
+    entry->channels = image.channels;
+    entry->format = detect_format(data, size);
+  }
+  free(data);
+  return result;
+}
+
+static int compare_scan_entries(const void *a, const void *b) {
+  return strcmp(((const ScanEntry *)a)->name, ((const ScanEntry *)b)->name);
+}
+
+static int write_manifest(const char *path, ScanEntry *scanned, int count) {
+  ManifestHeader header;
+  memcpy(header.magic, MANIFEST_MAGIC, 4);
+  header.version = MANIFEST_VERSION;
+  header.count = count;
+  header.stringsSize = 0;
+  for (int i = 0; i < count; i++) {
+    scanned[i].entry.nameOffset = header.stringsSize;
+    scanned[i].entry.nameLength = (uint32_t)strlen(scanned[i].name);
+    header.stringsSize += scanned[i].entry.nameLength + 1;
+  }
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return -1;
+  }
+  int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (int i = 0; ok && i < count; i++) {
+    ok = fwrite(&scanned[i].entry, sizeof(ManifestEntry), 1, file) == 1;
+  }
+  for (int i = 0; ok && i < count; i++) {
+    size_t length = scanned[i].entry.nameLength + 1;
+    ok = fwrite(scanned[i].name, 1, length, file) == length;
+  }
+  if (fclose(file) != 0) {
+    ok = 0;
+  }
+  return ok ? 0 : -1;
+}
+
+/**
+ * Scans the image files directly inside directory once and writes their
+ * dimensions, formats and content hashes to a manifest at path. Files
+ * stb_image cannot read are left out. The manifest is written next to path
+ * first and renamed into place, so readers never see a partial file.
+ * Returns the number of images recorded, or -1 on failure.
+ */
+int manifest_build(const char *directory, const char *path) {
+  DIR *dir = opendir(directory);
+  if (!dir) {
+    return -1;
+  }
+
+  ScanEntry *scanned = NULL;
+  int count = 0;
+  int capacity = 0;
+  int result = 0;
+  struct dirent *item;
+  while ((item = readdir(dir))) {
+    if (item->d_name[0] == '.') {
+      continue;
+    }
+    ManifestEntry entry;
+    if (scan_file(directory, item->d_name, &entry) != 0) {
+      continue;
+    }
+    if (count == capacity) {
+      int newCapacity = capacity ? capacity * 2 : 16;
+      ScanEntry *grown = realloc(scanned, newCapacity * sizeof(ScanEntry));
+      if (!grown) {
+        result = -1;
+        break;
+      }
+      scanned = grown;
+      capacity = newCapacity;
+    }
+    scanned[count].entry = entry;
+    scanned[count].name = strdup(item->d_name);
+    if (!scanned[count].name) {
+      result = -1;
+      break;
+    }
+    count++;
+  }
+  closedir(dir);
+
+  if (result == 0) {
+    qsort(scanned, count, sizeof(ScanEntry), compare_scan_entries);
+
+    char temporary[4096];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >=
+            (int)sizeof(temporary) ||
+        write_manifest(temporary, scanned, count) != 0 ||
+        rename(temporary, path) != 0) {
+      remove(temporary);
+      result = -1;
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    free(scanned[i].name);
+  }
+  free(scanned);
+  return result == 0 ? count : -1;
+}
+
+/**
+ * Checks that the header and every entry of a mapped manifest lie within the
+ * mapping, so lookups need no further bounds checks.
+ */
+static int validate(const unsigned char *data, size_t size) {
+  const ManifestHeader *header = (const ManifestHeader *)data;
+  if (size < sizeof(ManifestHeader) ||
+      memcmp(header->magic, MANIFEST_MAGIC, 4) != 0 ||
+      header->version != MANIFEST_VERSION ||
+      size != sizeof(ManifestHeader) +
+                  (size_t)header->count * sizeof(ManifestEntry) +
+                  header->stringsSize) {
+    return -1;
+  }
+  const ManifestEntry *entries =
+      (const ManifestEntry *)(data + sizeof(ManifestHeader));
+  const char *strings = (const char *)(entries + header->count);
+  for (uint32_t i = 0; i < header->count; i++) {
+    uint64_t end = (uint64_t)entries[i].nameOffset + entries[i].nameLength;
+    if (end >= header->stringsSize || strings[end] != '\0') {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Maps the manifest at path into memory. Opening it is the only file access
+ * needed to plan texture allocations at startup.
+ * Returns 0 on success and -1 on failure.
+ */
+int manifest_open(Manifest *manifest, const char *path) {
+  memset(manifest, 0, sizeof(Manifest));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat info;
+  void *mapping = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return -1;
+  }
+  if (validate(mapping, info.st_size) != 0) {
+    munmap(mapping, info.st_size);
+    return -1;
+  }
+
+  const ManifestHeader *header = mapping;
+  manifest->mapping = mapping;
+  manifest->mappingSize = info.st_size;
+  manifest->entries = (const ManifestEntry *)(header + 1);
+  manifest->strings = (const char *)(manifest->entries + header->count);
+  manifest->count = header->count;
+  return 0;
+}
+
+void manifest_close(Manifest *manifest) {
+  if (manifest->mapping) {
+    munmap(manifest->mapping, manifest->mappingSize);
+  }
+  memset(manifest, 0, sizeof(Manifest));
+}
+
+/**
+ * Checks that the file at path is still the one entry was recorded from.
+ * The size check costs a stat. If verifyContents is set, the file is also
+ * read and compared against the stored hash, which catches edits that keep
+ * the size.
+ * Returns 1 if the file matches, 0 if it changed and -1 if it cannot be read.
+ */
+int manifest_entry_current(const ManifestEntry *entry, const char *path,
+                           int verifyContents) {
+  struct stat info;
+  if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+    return -1;
+  }
+  if ((uint64_t)info.st_size != entry->fileSize) {
+    return 0;
+  }
+  if (!verifyContents) {
+    return 1;
+  }
+
+  size_t size;
+  unsigned char *data = read_file(path, &size);
+  if (!data) {
+    return -1;
+  }
+  int current =
+      size == entry->fileSize && hash_bytes(data, size) == entry->hash;
+  free(data);
+  return current;
+}
+
+const char *manifest_name(const Manifest *manifest,
+                          const ManifestEntry *entry) {
+  return manifest->strings + entry->nameOffset;
+}
+
+/**
+ * Looks up the entry of the file name with a binary search.
+ * Returns NULL if the manifest does not list it.
+ */
+const ManifestEntry *manifest_find(const Manifest *manifest,
+                                   const char *name) {
+  int low = 0;
+  int high = manifest->count - 1;
+  while (low <= high) {
+    int middle = low + (high - low) / 2;
+    const ManifestEntry *entry = &manifest->entries[middle];
+    int order = strcmp(manifest_name(manifest, entry), name);
+    if (order == 0) {
+      return entry;
+    }
+    if (order < 0) {
+      low = middle + 1;
+    } else {
+      high = middle - 1;
+    }
+  }
+  return NULL;
+}
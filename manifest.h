@@ -0,0 +1,75 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MANIFEST_MAGIC "IMGM"
+#define MANIFEST_VERSION 1
+
+typedef enum {
+  MANIFEST_FORMAT_UNKNOWN,
+  MANIFEST_FORMAT_PNG,
+  MANIFEST_FORMAT_JPEG,
+  MANIFEST_FORMAT_GIF,
+  MANIFEST_FORMAT_BMP,
+  MANIFEST_FORMAT_PSD,
+  MANIFEST_FORMAT_HDR,
+  MANIFEST_FORMAT_PIC,
+  MANIFEST_FORMAT_PNM,
+  MANIFEST_FORMAT_TGA
+} ManifestFormat;
+
+/**
+ * On-disk layout of a manifest: a header, count entries sorted by name and a
+ * string table holding the NUL-terminated names. Fields are stored in the
+ * byte order of the machine that built the manifest.
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t count;
+  uint32_t stringsSize;
+} ManifestHeader;
+
+/**
+ * Image file as recorded by manifest_build. nameOffset is the offset of the
+ * file name in the string table, hash the FNV-1a hash of the file contents
+ * and channels the channel count stored in the file. Every image is a file
+ * of its own, read from its start, so no data offset is stored.
+ */
+typedef struct {
+  uint64_t hash;
+  uint32_t nameOffset;
+  uint32_t nameLength;
+  uint32_t fileSize;
+  uint32_t width;
+  uint32_t height;
+  uint8_t channels;
+  uint8_t format;
+  uint16_t reserved;
+} ManifestEntry;
+
+/**
+ * Manifest mapped into memory by manifest_open.
+ */
+typedef struct {
+  void *mapping;
+  size_t mappingSize;
+  const ManifestEntry *entries;
+  const char *strings;
+  int count;
+} Manifest;
+
+int manifest_build(const char *directory, const char *path);
+
+int manifest_open(Manifest *manifest, const char *path);
+void manifest_close(Manifest *manifest);
+
+const ManifestEntry *manifest_find(const Manifest *manifest, const char *name);
+const char *manifest_name(const Manifest *manifest, const ManifestEntry *entry);
+const char *manifest_format_name(ManifestFormat format);
+int manifest_entry_current(const ManifestEntry *entry, const char *path,
+                           int verifyContents);
+
+#endif
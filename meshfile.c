@@ -0,0 +1,1262 @@
+#include "meshfile.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "jobs.h"
+#include "resource.h"
+
+/* Bytes of text parsed by one job. Chunks are cut at line breaks. */
+#define MESHFILE_CHUNK (1 << 20)
+/* Significant decimal digits kept when parsing a number; floats need 9. */
+#define MESHFILE_MAX_DIGITS 18
+/* Index of an OBJ corner without texture coordinate or normal. */
+#define MESHFILE_MISSING INT_MIN
+#define PLY_MAX_PROPERTIES 32
+#define PLY_MAX_ELEMENTS 16
+/* Most corners of a PLY face. */
+#define PLY_MAX_CORNERS 64
+
+static const double powersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static int is_digit(char c) { return (unsigned char)(c - '0') < 10; }
+
+static const char *skip_space(const char *s, const char *end) {
+  while (s < end && (*s == ' ' || *s == '\t' || *s == '\r')) {
+    s++;
+  }
+  return s;
+}
+
+static const char *next_line(const char *s, const char *end) {
+  const char *newline = memchr(s, '\n', end - s);
+  return newline ? newline + 1 : end;
+}
+
+/**
+ * Accumulates the digits at *s into mantissa. Digits beyond
+ * MESHFILE_MAX_DIGITS significant ones are counted in dropped instead.
+ * Returns the number of digits read. Runs are short in mesh files, so a
+ * byte loop keeps up with a SIMD scan.
+ */
+static inline int read_digits(const char **s, const char *end,
+                              uint64_t *mantissa, int *significant,
+                              int *dropped) {
+  const char *p = *s;
+  for (; p < end && is_digit(*p); p++) {
+    if (*significant < MESHFILE_MAX_DIGITS) {
+      *mantissa = *mantissa * 10 + (*p - '0');
+      *significant += *mantissa != 0;
+    } else {
+      (*dropped)++;
+    }
+  }
+  int count = (int)(p - *s);
+  *s = p;
+  return count;
+}
+
+/**
+ * Parses a decimal float with optional sign, fraction and exponent at *s
+ * and advances *s past it. Returns 0 on success and -1 if there is none.
+ */
+static int parse_float(const char **s, const char *end, float *result) {
+  const char *p = *s;
+  int negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int significant = 0, dropped = 0;
+  int digits = read_digits(&p, end, &mantissa, &significant, &dropped);
+  int exponent = dropped;
+  if (p < end && *p == '.') {
+    p++;
+    int fractionDropped = 0;
+    int fraction =
+        read_digits(&p, end, &mantissa, &significant, &fractionDropped);
+    digits += fraction;
+    exponent -= fraction - fractionDropped;
+  }
+  if (digits == 0) {
+    return -1;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    int exponentNegative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+      p++;
+    }
+    if (p == end || !is_digit(*p)) {
+      return -1;
+    }
+    int value = 0;
+    for (; p < end && is_digit(*p); p++) {
+      value = value < 10000 ? value * 10 + (*p - '0') : value;
+    }
+    exponent += exponentNegative ? -value : value;
+  }
+
+  /* Exact for mantissas up to 2^53 and powers up to 10^22; dividing keeps
+   * negative powers exact too. */
+  double value = (double)mantissa;
+  if (exponent > 22 || exponent < -22) {
+    value *= pow(10.0, exponent);
+  } else if (exponent > 0) {
+    value *= powersOfTen[exponent];
+  } else if (exponent < 0) {
+    value /= powersOfTen[-exponent];
+  }
+  *result = (float)(negative ? -value : value);
+  *s = p;
+  return 0;
+}
+
+static int parse_int(const char **s, const char *end, int *result) {
+  const char *p = *s;
+  int negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int significant = 0, dropped = 0;
+  if (read_digits(&p, end, &mantissa, &significant, &dropped) == 0 ||
+      dropped || mantissa > INT_MAX) {
+    return -1;
+  }
+  *result = negative ? -(int)mantissa : (int)mantissa;
+  *s = p;
+  return 0;
+}
+
+static int grow(void **data, int *capacity, int needed, size_t size) {
+  if (needed <= *capacity) {
+    return 0;
+  }
+  int newCapacity = *capacity ? *capacity : 1024;
+  while (newCapacity < needed) {
+    newCapacity *= 2;
+  }
+  void *grown = realloc(*data, (size_t)newCapacity * size);
+  if (!grown) {
+    return -1;
+  }
+  *data = grown;
+  *capacity = newCapacity;
+  return 0;
+}
+
+/**
+ * Cuts [begin, end) into pieces of about MESHFILE_CHUNK bytes that end at
+ * line breaks. Returns the number of pieces, whose bounds are written to
+ * *bounds, or -1 on failure.
+ */
+static int split_lines(const char *begin, const char *end,
+                       const char ***bounds) {
+  int capacity = (int)((end - begin) / MESHFILE_CHUNK) + 2;
+  *bounds = malloc(capacity * sizeof(const char *));
+  if (!*bounds) {
+    return -1;
+  }
+  int count = 0;
+  (*bounds)[0] = begin;
+  while ((*bounds)[count] < end) {
+    const char *cut = (*bounds)[count] + MESHFILE_CHUNK;
+    (*bounds)[++count] = cut < end ? next_line(cut, end) : end;
+  }
+  return count;
+}
+
+static void init_vertex(MeshVertex *vertex) {
+  memset(vertex, 0, sizeof(*vertex));
+  vertex->color[0] = vertex->color[1] = vertex->color[2] = 1.0f;
+}
+
+/**
+ * OBJ face corner. Indices are 0-based; those flagged in relative were
+ * negative in the file and count from the start of the chunk.
+ */
+typedef struct {
+  int index[3];
+  int relative;
+} ObjCorner;
+
+/**
+ * Lines of an OBJ file parsed by one job. positions holds 6 floats per
+ * vertex, the position and an RGB color, white unless the line had one.
+ */
+typedef struct {
+  const char *begin;
+  const char *end;
+  float *positions;
+  float *texCoords;
+  float *normals;
+  ObjCorner *corners;
+  int counts[3];
+  int capacities[3];
+  int cornerCount;
+  int cornerCapacity;
+  int hasColors;
+  int failed;
+} ObjChunk;
+
+static int parse_floats(const char **s, const char *end, float *values,
+                        int count) {
+  for (int i = 0; i < count; i++) {
+    *s = skip_space(*s, end);
+    if (parse_float(s, end, &values[i]) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Parses v, v/vt, v//vn or v/vt/vn at *s.
+ */
+static int parse_corner(const char **s, const char *end, const ObjChunk *chunk,
+                        ObjCorner *corner) {
+  const char *p = *s;
+  corner->relative = 0;
+  for (int k = 0; k < 3; k++) {
+    corner->index[k] = MESHFILE_MISSING;
+  }
+  for (int k = 0; k < 3; k++) {
+    if (k == 0 || (p < end && *p != '/')) {
+      int value;
+      if (parse_int(&p, end, &value) != 0 || value == 0) {
+        return -1;
+      }
+      if (value > 0) {
+        corner->index[k] = value - 1;
+      } else {
+        corner->index[k] = chunk->counts[k] + value;
+        corner->relative |= 1 << k;
+      }
+    }
+    if (k == 2 || p == end || *p != '/') {
+      break;
+    }
+    p++;
+  }
+  *s = p;
+  return 0;
+}
+
+static int parse_obj_face(ObjChunk *chunk, const char *s, const char *end) {
+  ObjCorner first, previous, corner;
+  int count = 0;
+  for (s = skip_space(s, end); s < end && *s != '\n' && *s != '#';
+       s = skip_space(s, end)) {
+    if (parse_corner(&s, end, chunk, &corner) != 0) {
+      return -1;
+    }
+    if (count >= 2) {
+      if (grow((void **)&chunk->corners, &chunk->cornerCapacity,
+               chunk->cornerCount + 3, sizeof(ObjCorner)) != 0) {
+        return -1;
+      }
+      ObjCorner *triangle = &chunk->corners[chunk->cornerCount];
+      triangle[0] = first;
+      triangle[1] = previous;
+      triangle[2] = corner;
+      chunk->cornerCount += 3;
+    }
+    if (count == 0) {
+      first = corner;
+    }
+    previous = corner;
+    count++;
+  }
+  return count >= 3 ? 0 : -1;
+}
+
+/**
+ * Parses an attribute line into array k of chunk: 3 or 6 floats of a
+ * position, 2 of a texture coordinate or 3 of a normal.
+ */
+static int parse_obj_attribute(ObjChunk *chunk, int k, const char *s,
+                               const char *end) {
+  static const int sizes[3] = {6, 2, 3};
+  float **arrays[3] = {&chunk->positions, &chunk->texCoords, &chunk->normals};
+  int index = chunk->counts[k];
+  if (grow((void **)arrays[k], &chunk->capacities[k], index + 1,
+           sizes[k] * sizeof(float)) != 0) {
+    return -1;
+  }
+  float *values = *arrays[k] + index * sizes[k];
+  if (parse_floats(&s, end, values, k == 1 ? 2 : 3) != 0) {
+    return -1;
+  }
+  if (k == 0) {
+    s = skip_space(s, end);
+    if (s < end && *s != '\n' && *s != '#') {
+      if (parse_floats(&s, end, values + 3, 3) != 0) {
+        return -1;
+      }
+      chunk->hasColors = 1;
+    } else {
+      values[3] = values[4] = values[5] = 1.0f;
+    }
+  }
+  chunk->counts[k]++;
+  return 0;
+}
+
+static int parse_obj_lines(ObjChunk *chunk) {
+  const char *end = chunk->end;
+  for (const char *line = chunk->begin; line < end;) {
+    line = skip_space(line, end);
+    const char *lineEnd = next_line(line, end);
+    int result = 0;
+    if (lineEnd - line > 2 && line[0] == 'v') {
+      if (line[1] == ' ' || line[1] == '\t') {
+        result = parse_obj_attribute(chunk, 0, line + 1, lineEnd);
+      } else if (line[1] == 't') {
+        result = parse_obj_attribute(chunk, 1, line + 2, lineEnd);
+      } else if (line[1] == 'n') {
+        result = parse_obj_attribute(chunk, 2, line + 2, lineEnd);
+      }
+    } else if (lineEnd - line > 2 && line[0] == 'f' &&
+               (line[1] == ' ' || line[1] == '\t')) {
+      result = parse_obj_face(chunk, line + 1, lineEnd);
+    }
+    if (result != 0) {
+      return -1;
+    }
+    line = lineEnd;
+  }
+  return 0;
+}
+
+static void parse_obj_chunks(void *context, int begin, int end) {
+  ObjChunk *chunks = context;
+  for (int i = begin; i < end; i++) {
+    chunks[i].failed = parse_obj_lines(&chunks[i]) != 0;
+  }
+}
+
+static uint64_t hash_corner(const int *key) {
+  uint64_t hash = (uint32_t)key[0] * 0x9e3779b97f4a7c15ull ^
+                  (uint32_t)key[1] * 0xc2b2ae3d27d4eb4full ^
+                  (uint32_t)key[2] * 0x165667b19e3779f9ull;
+  return hash ^ (hash >> 29);
+}
+
+/**
+ * Joins the parsed chunks into one indexed mesh. Corners with the same
+ * position, texture coordinate and normal share a vertex, found through an
+ * open-addressing table of vertex numbers keyed by the index triple.
+ */
+static int build_obj_mesh(ObjChunk *chunks, int chunkCount, Mesh *mesh) {
+  static const int sizes[3] = {6, 2, 3};
+  int totals[3] = {0, 0, 0};
+  int cornerCount = 0;
+  int hasColors = 0;
+  for (int i = 0; i < chunkCount; i++) {
+    for (int k = 0; k < 3; k++) {
+      totals[k] += chunks[i].counts[k];
+    }
+    cornerCount += chunks[i].cornerCount;
+    hasColors |= chunks[i].hasColors;
+  }
+
+  float *arrays[3];
+  for (int k = 0; k < 3; k++) {
+    arrays[k] = malloc(((size_t)totals[k] * sizes[k] + 1) * sizeof(float));
+  }
+  int tableSize = 16;
+  while (tableSize < cornerCount * 2) {
+    tableSize *= 2;
+  }
+  int *table = calloc(tableSize, sizeof(int));
+  int *keys = malloc(((size_t)cornerCount * 3 + 1) * sizeof(int));
+  mesh->vertices = malloc(((size_t)cornerCount + 1) * sizeof(MeshVertex));
+  mesh->indices = malloc(((size_t)cornerCount + 1) * sizeof(uint32_t));
+  int result = 0;
+  if (!arrays[0] || !arrays[1] || !arrays[2] || !table || !keys ||
+      !mesh->vertices || !mesh->indices) {
+    result = -1;
+  }
+
+  int bases[3] = {0, 0, 0};
+  for (int i = 0; i < chunkCount && result == 0; i++) {
+    ObjChunk *chunk = &chunks[i];
+    float *chunkArrays[3] = {chunk->positions, chunk->texCoords,
+                             chunk->normals};
+    for (int k = 0; k < 3; k++) {
+      if (chunk->counts[k]) {
+        memcpy(arrays[k] + (size_t)bases[k] * sizes[k], chunkArrays[k],
+               (size_t)chunk->counts[k] * sizes[k] * sizeof(float));
+      }
+    }
+
+    for (int c = 0; c < chunk->cornerCount; c++) {
+      const ObjCorner *corner = &chunk->corners[c];
+      int key[3];
+      for (int k = 0; k < 3; k++) {
+        key[k] = corner->index[k];
+        if (key[k] == MESHFILE_MISSING) {
+          key[k] = -1;
+          continue;
+        }
+        if (corner->relative & (1 << k)) {
+          key[k] += bases[k];
+        }
+        if (key[k] < 0 || key[k] >= totals[k]) {
+          result = -1;
+        }
+      }
+      if (result != 0) {
+        break;
+      }
+
+      int slot = (int)(hash_corner(key) & (tableSize - 1));
+      while (table[slot] &&
+             memcmp(&keys[(table[slot] - 1) * 3], key, sizeof(key)) != 0) {
+        slot = (slot + 1) & (tableSize - 1);
+      }
+      if (!table[slot]) {
+        int index = mesh->vertexCount++;
+        table[slot] = index + 1;
+        memcpy(&keys[index * 3], key, sizeof(key));
+        MeshVertex *vertex = &mesh->vertices[index];
+        init_vertex(vertex);
+        memcpy(vertex->position, arrays[0] + (size_t)key[0] * 6,
+               3 * sizeof(float));
+        memcpy(vertex->color, arrays[0] + (size_t)key[0] * 6 + 3,
+               3 * sizeof(float));
+        if (key[1] >= 0) {
+          memcpy(vertex->texCoord, arrays[1] + (size_t)key[1] * 2,
+                 2 * sizeof(float));
+        }
+        if (key[2] >= 0) {
+          memcpy(vertex->normal, arrays[2] + (size_t)key[2] * 3,
+                 3 * sizeof(float));
+        }
+      }
+      mesh->indices[mesh->indexCount++] = table[slot] - 1;
+    }
+    for (int k = 0; k < 3; k++) {
+      bases[k] += chunk->counts[k];
+    }
+  }
+
+  mesh->flags = (totals[2] ? MESHFILE_NORMALS : 0) |
+                (totals[1] ? MESHFILE_TEX_COORDS : 0) |
+                (hasColors ? MESHFILE_COLORS : 0);
+  for (int k = 0; k < 3; k++) {
+    free(arrays[k]);
+  }
+  free(table);
+  free(keys);
+  if (result == 0) {
+    MeshVertex *shrunk = realloc(
+        mesh->vertices, ((size_t)mesh->vertexCount + 1) * sizeof(MeshVertex));
+    mesh->vertices = shrunk ? shrunk : mesh->vertices;
+  }
+  return result;
+}
+
+static int parse_obj(Mesh *mesh, const char *data, size_t size) {
+  const char **bounds;
+  int chunkCount = split_lines(data, data + size, &bounds);
+  if (chunkCount < 0) {
+    return -1;
+  }
+  ObjChunk *chunks = calloc(chunkCount + 1, sizeof(ObjChunk));
+  if (!chunks) {
+    free(bounds);
+    return -1;
+  }
+  for (int i = 0; i < chunkCount; i++) {
+    chunks[i].begin = bounds[i];
+    chunks[i].end = bounds[i + 1];
+  }
+  free(bounds);
+
+  jobs_parallel_for(chunkCount, 1, parse_obj_chunks, chunks);
+  int result = 0;
+  for (int i = 0; i < chunkCount; i++) {
+    if (chunks[i].failed) {
+      result = -1;
+    }
+  }
+  if (result == 0) {
+    result = build_obj_mesh(chunks, chunkCount, mesh);
+  }
+  for (int i = 0; i < chunkCount; i++) {
+    free(chunks[i].positions);
+    free(chunks[i].texCoords);
+    free(chunks[i].normals);
+    free(chunks[i].corners);
+  }
+  free(chunks);
+  return result;
+}
+
+typedef enum {
+  PLY_CHAR,
+  PLY_UCHAR,
+  PLY_SHORT,
+  PLY_USHORT,
+  PLY_INT,
+  PLY_UINT,
+  PLY_FLOAT,
+  PLY_DOUBLE,
+  PLY_INVALID
+} PlyType;
+
+static const int plyTypeSizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+/**
+ * Property of a PLY element. Vertex properties go to the float at target
+ * within MeshVertex, multiplied by scale, or nowhere if target is -1. Lists
+ * have a count of countType followed by items of type.
+ */
+typedef struct {
+  PlyType type;
+  PlyType countType;
+  int isList;
+  int target;
+  float scale;
+} PlyProperty;
+
+typedef struct {
+  char name[32];
+  int count;
+  PlyProperty properties[PLY_MAX_PROPERTIES];
+  int propertyCount;
+} PlyElement;
+
+static PlyType ply_type(const char *name) {
+  static const char *const names[][2] = {
+      {"char", "int8"},   {"uchar", "uint8"}, {"short", "int16"},
+      {"ushort", "uint16"}, {"int", "int32"}, {"uint", "uint32"},
+      {"float", "float32"}, {"double", "float64"}};
+  for (int i = 0; i < PLY_INVALID; i++) {
+    if (strcmp(name, names[i][0]) == 0 || strcmp(name, names[i][1]) == 0) {
+      return (PlyType)i;
+    }
+  }
+  return PLY_INVALID;
+}
+
+/**
+ * Where a vertex property named name goes in MeshVertex, in floats, or -1.
+ */
+static int ply_target(const char *name, unsigned int *flags) {
+  static const struct {
+    const char *name;
+    int target;
+    unsigned int flag;
+  } targets[] = {
+      {"x", 0, 0},           {"y", 1, 0},
+      {"z", 2, 0},           {"nx", 3, MESHFILE_NORMALS},
+      {"ny", 4, MESHFILE_NORMALS}, {"nz", 5, MESHFILE_NORMALS},
+      {"s", 6, MESHFILE_TEX_COORDS}, {"t", 7, MESHFILE_TEX_COORDS},
+      {"u", 6, MESHFILE_TEX_COORDS}, {"v", 7, MESHFILE_TEX_COORDS},
+      {"texture_u", 6, MESHFILE_TEX_COORDS},
+      {"texture_v", 7, MESHFILE_TEX_COORDS},
+      {"red", 8, MESHFILE_COLORS}, {"green", 9, MESHFILE_COLORS},
+      {"blue", 10, MESHFILE_COLORS}};
+  for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+    if (strcmp(name, targets[i].name) == 0) {
+      *flags |= targets[i].flag;
+      return targets[i].target;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Parses the header of a PLY file into elements and returns the offset of
+ * the body, or -1 if the header is malformed or the format unsupported.
+ */
+static long parse_ply_header(const char *data, size_t size, int *binary,
+                             PlyElement *elements, int *elementCount,
+                             unsigned int *flags) {
+  const char *end = data + size;
+  if (size < 4 || memcmp(data, "ply", 3) != 0) {
+    return -1;
+  }
+  *elementCount = 0;
+  *binary = -1;
+  for (const char *line = next_line(data, end); line < end;) {
+    const char *lineEnd = next_line(line, end);
+    char text[256];
+    size_t length = lineEnd - line;
+    if (length >= sizeof(text)) {
+      return -1;
+    }
+    memcpy(text, line, length);
+    text[length] = '\0';
+    line = lineEnd;
+
+    char word[32], type[32], countType[32], name[32];
+    PlyElement *element =
+        *elementCount ? &elements[*elementCount - 1] : NULL;
+    if (sscanf(text, "%31s", word) != 1 || strcmp(word, "comment") == 0 ||
+        strcmp(word, "obj_info") == 0) {
+      continue;
+    }
+    if (strcmp(word, "end_header") == 0) {
+      return *binary < 0 ? -1 : line - data;
+    }
+    if (strcmp(word, "format") == 0) {
+      if (sscanf(text, "format %31s", type) != 1) {
+        return -1;
+      }
+      if (strcmp(type, "ascii") == 0) {
+        *binary = 0;
+      } else if (strcmp(type, "binary_little_endian") == 0) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        *binary = 1;
+#else
+        return -1;
+#endif
+      } else {
+        return -1;
+      }
+    } else if (strcmp(word, "element") == 0) {
+      if (*elementCount == PLY_MAX_ELEMENTS) {
+        return -1;
+      }
+      element = &elements[(*elementCount)++];
+      memset(element, 0, sizeof(*element));
+      if (sscanf(text, "element %31s %d", element->name, &element->count) !=
+              2 ||
+          element->count < 0) {
+        return -1;
+      }
+    } else if (strcmp(word, "property") == 0) {
+      if (!element || element->propertyCount == PLY_MAX_PROPERTIES) {
+        return -1;
+      }
+      PlyProperty *property = &element->properties[element->propertyCount++];
+      property->target = -1;
+      property->scale = 1.0f;
+      if (sscanf(text, "property list %31s %31s %31s", countType, type,
+                 name) == 3) {
+        property->isList = 1;
+        property->countType = ply_type(countType);
+        property->type = ply_type(type);
+        if (property->countType == PLY_INVALID) {
+          return -1;
+        }
+      } else if (sscanf(text, "property %31s %31s", type, name) == 2) {
+        property->type = ply_type(type);
+        if (strcmp(element->name, "vertex") == 0) {
+          property->target = ply_target(name, flags);
+        }
+      } else {
+        return -1;
+      }
+      if (property->type == PLY_INVALID) {
+        return -1;
+      }
+      /* Integer colors span the range of their type. */
+      if (property->target >= 8 && property->type == PLY_UCHAR) {
+        property->scale = 1.0f / 255.0f;
+      } else if (property->target >= 8 && property->type == PLY_USHORT) {
+        property->scale = 1.0f / 65535.0f;
+      }
+    } else {
+      return -1;
+    }
+  }
+  return -1;
+}
+
+static double read_binary(PlyType type, const unsigned char *data) {
+  switch (type) {
+  case PLY_CHAR:
+    return (signed char)data[0];
+  case PLY_UCHAR:
+    return data[0];
+  case PLY_SHORT: {
+    int16_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+  case PLY_USHORT: {
+    uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+  case PLY_INT: {
+    int32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+  case PLY_UINT: {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+  case PLY_FLOAT: {
+    float value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+  default: {
+    double value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+  }
+  }
+}
+
+/**
+ * A range of a PLY element body parsed by one job: text lines [begin, end)
+ * or, for binary vertices, records of stride bytes. Vertices and the
+ * triangle fans of faces are appended to the chunk's own arrays.
+ */
+typedef struct {
+  const char *begin;
+  const char *end;
+  const PlyElement *element;
+  int stride;
+  MeshVertex *vertices;
+  uint32_t *indices;
+  int vertexCount;
+  int vertexCapacity;
+  int indexCount;
+  int indexCapacity;
+  int failed;
+} PlyChunk;
+
+static int add_fan(PlyChunk *chunk, const int *corners, int count) {
+  if (count < 3 || grow((void **)&chunk->indices, &chunk->indexCapacity,
+                        chunk->indexCount + (count - 2) * 3,
+                        sizeof(uint32_t)) != 0) {
+    return -1;
+  }
+  for (int i = 2; i < count; i++) {
+    uint32_t *triangle = &chunk->indices[chunk->indexCount];
+    triangle[0] = corners[0];
+    triangle[1] = corners[i - 1];
+    triangle[2] = corners[i];
+    chunk->indexCount += 3;
+  }
+  return 0;
+}
+
+static int parse_ply_text_line(PlyChunk *chunk, const char *s,
+                               const char *end) {
+  const PlyElement *element = chunk->element;
+  int isVertex = strcmp(element->name, "vertex") == 0;
+  MeshVertex *vertex = NULL;
+  if (isVertex) {
+    if (grow((void **)&chunk->vertices, &chunk->vertexCapacity,
+             chunk->vertexCount + 1, sizeof(MeshVertex)) != 0) {
+      return -1;
+    }
+    vertex = &chunk->vertices[chunk->vertexCount++];
+    init_vertex(vertex);
+  }
+  int fanned = isVertex;
+  for (int i = 0; i < element->propertyCount; i++) {
+    const PlyProperty *property = &element->properties[i];
+    if (property->isList) {
+      int count;
+      s = skip_space(s, end);
+      if (parse_int(&s, end, &count) != 0 || count < 0 ||
+          count > PLY_MAX_CORNERS) {
+        return -1;
+      }
+      int corners[PLY_MAX_CORNERS];
+      for (int j = 0; j < count; j++) {
+        s = skip_space(s, end);
+        if (parse_int(&s, end, &corners[j]) != 0) {
+          return -1;
+        }
+      }
+      /* The first list of a face holds its corners. */
+      if (!fanned && add_fan(chunk, corners, count) != 0) {
+        return -1;
+      }
+      fanned = 1;
+      continue;
+    }
+    float value;
+    s = skip_space(s, end);
+    if (parse_float(&s, end, &value) != 0) {
+      return -1;
+    }
+    if (vertex && property->target >= 0) {
+      ((float *)vertex)[property->target] = value * property->scale;
+    }
+  }
+  return 0;
+}
+
+static void parse_ply_text_chunks(void *context, int begin, int end) {
+  PlyChunk *chunks = context;
+  for (int i = begin; i < end; i++) {
+    PlyChunk *chunk = &chunks[i];
+    const char *line = chunk->begin;
+    while (line < chunk->end && !chunk->failed) {
+      const char *lineEnd = next_line(line, chunk->end);
+      chunk->failed = parse_ply_text_line(chunk, line, lineEnd) != 0;
+      line = lineEnd;
+    }
+  }
+}
+
+static void convert_ply_vertices(void *context, int begin, int end) {
+  PlyChunk *chunk = context;
+  const PlyElement *element = chunk->element;
+  for (int i = begin; i < end; i++) {
+    const unsigned char *record =
+        (const unsigned char *)chunk->begin + (size_t)i * chunk->stride;
+    MeshVertex *vertex = &chunk->vertices[i];
+    init_vertex(vertex);
+    for (int j = 0; j < element->propertyCount; j++) {
+      const PlyProperty *property = &element->properties[j];
+      if (property->target >= 0) {
+        ((float *)vertex)[property->target] =
+            (float)read_binary(property->type, record) * property->scale;
+      }
+      record += plyTypeSizes[property->type];
+    }
+  }
+}
+
+/**
+ * Walks the binary records of element starting at s, appending the
+ * triangle fans of faces to chunk. Returns the end of the element or NULL
+ * if it runs past end.
+ */
+static const char *walk_ply_binary(PlyChunk *chunk, const PlyElement *element,
+                                   const char *s, const char *end) {
+  int isFace = strcmp(element->name, "face") == 0;
+  for (int i = 0; i < element->count; i++) {
+    int fanned = !isFace;
+    for (int j = 0; j < element->propertyCount; j++) {
+      const PlyProperty *property = &element->properties[j];
+      if (!property->isList) {
+        s += plyTypeSizes[property->type];
+        continue;
+      }
+      int countSize = plyTypeSizes[property->countType];
+      if (end - s < countSize) {
+        return NULL;
+      }
+      double count =
+          read_binary(property->countType, (const unsigned char *)s);
+      s += countSize;
+      int itemSize = plyTypeSizes[property->type];
+      if (count < 0 || count > (double)(end - s) / itemSize) {
+        return NULL;
+      }
+      if (!fanned) {
+        int corners[PLY_MAX_CORNERS];
+        if (count > PLY_MAX_CORNERS) {
+          return NULL;
+        }
+        for (int k = 0; k < (int)count; k++) {
+          corners[k] = (int)read_binary(
+              property->type, (const unsigned char *)s + k * itemSize);
+        }
+        if (add_fan(chunk, corners, (int)count) != 0) {
+          return NULL;
+        }
+        fanned = 1;
+      }
+      s += (size_t)count * itemSize;
+    }
+    if (s > end) {
+      return NULL;
+    }
+  }
+  return s;
+}
+
+/**
+ * Parses one element body starting at s. Vertex records are converted in
+ * parallel: text lines in chunks cut at line breaks, binary records by
+ * index once their size is known. Returns the end of the element or NULL.
+ */
+static const char *parse_ply_element(Mesh *mesh, const PlyElement *element,
+                                     int binary, const char *s,
+                                     const char *end) {
+  int isVertex = strcmp(element->name, "vertex") == 0;
+  int isFace = strcmp(element->name, "face") == 0;
+  /* Records have a fixed size unless the element has lists. */
+  int stride = 0;
+  for (int i = 0; i < element->propertyCount; i++) {
+    if (element->properties[i].isList) {
+      stride = 0;
+      break;
+    }
+    stride += plyTypeSizes[element->properties[i].type];
+  }
+
+  if (binary && isVertex && stride > 0) {
+    if ((size_t)(end - s) / stride < (size_t)element->count) {
+      return NULL;
+    }
+    mesh->vertices =
+        malloc(((size_t)element->count + 1) * sizeof(MeshVertex));
+    if (!mesh->vertices) {
+      return NULL;
+    }
+    PlyChunk chunk = {.begin = s,
+                      .element = element,
+                      .stride = stride,
+                      .vertices = mesh->vertices};
+    jobs_parallel_for(element->count, 4096, convert_ply_vertices, &chunk);
+    mesh->vertexCount = element->count;
+    return s + (size_t)element->count * stride;
+  }
+  if (binary) {
+    if (isVertex) {
+      return NULL;
+    }
+    PlyChunk chunk = {.element = element};
+    s = walk_ply_binary(&chunk, element, s, end);
+    if (s && isFace) {
+      mesh->indices = chunk.indices;
+      mesh->indexCount = chunk.indexCount;
+    } else {
+      free(chunk.indices);
+    }
+    return s;
+  }
+
+  /* Finding the end of the element is a serial scan for line breaks; the
+   * numbers are parsed in parallel. */
+  const char *elementEnd = s;
+  for (int i = 0; i < element->count; i++) {
+    if (elementEnd == end) {
+      return NULL;
+    }
+    elementEnd = next_line(elementEnd, end);
+  }
+  if (!isVertex && !isFace) {
+    return elementEnd;
+  }
+  const char **bounds;
+  int chunkCount = split_lines(s, elementEnd, &bounds);
+  PlyChunk *chunks =
+      chunkCount < 0 ? NULL : calloc(chunkCount + 1, sizeof(PlyChunk));
+  if (!chunks) {
+    free(chunkCount < 0 ? NULL : bounds);
+    return NULL;
+  }
+  for (int i = 0; i < chunkCount; i++) {
+    chunks[i].begin = bounds[i];
+    chunks[i].end = bounds[i + 1];
+    chunks[i].element = element;
+  }
+  free(bounds);
+  jobs_parallel_for(chunkCount, 1, parse_ply_text_chunks, chunks);
+
+  int vertexCount = 0, indexCount = 0, failed = 0;
+  for (int i = 0; i < chunkCount; i++) {
+    vertexCount += chunks[i].vertexCount;
+    indexCount += chunks[i].indexCount;
+    failed |= chunks[i].failed;
+  }
+  void **target = isVertex ? (void **)&mesh->vertices : (void **)&mesh->indices;
+  size_t itemSize = isVertex ? sizeof(MeshVertex) : sizeof(uint32_t);
+  int count = isVertex ? vertexCount : indexCount;
+  *target = failed ? NULL : malloc(((size_t)count + 1) * itemSize);
+  unsigned char *joined = *target;
+  for (int i = 0; i < chunkCount; i++) {
+    void *items = isVertex ? (void *)chunks[i].vertices
+                           : (void *)chunks[i].indices;
+    size_t bytes = (isVertex ? chunks[i].vertexCount : chunks[i].indexCount) *
+                   itemSize;
+    if (joined) {
+      memcpy(joined, items, bytes);
+      joined += bytes;
+    }
+    free(chunks[i].vertices);
+    free(chunks[i].indices);
+  }
+  free(chunks);
+  if (!*target) {
+    return NULL;
+  }
+  if (isVertex) {
+    mesh->vertexCount = vertexCount;
+  } else {
+    mesh->indexCount = indexCount;
+  }
+  return elementEnd;
+}
+
+static int parse_ply(Mesh *mesh, const char *data, size_t size) {
+  PlyElement elements[PLY_MAX_ELEMENTS];
+  int elementCount, binary;
+  unsigned int flags = 0;
+  long offset =
+      parse_ply_header(data, size, &binary, elements, &elementCount, &flags);
+  if (offset < 0) {
+    return -1;
+  }
+  const char *s = data + offset;
+  for (int i = 0; i < elementCount && s; i++) {
+    s = parse_ply_element(mesh, &elements[i], binary, s, data + size);
+  }
+  if (!s || !mesh->vertices || !mesh->indices) {
+    return -1;
+  }
+  for (int i = 0; i < mesh->indexCount; i++) {
+    if (mesh->indices[i] >= (uint32_t)mesh->vertexCount) {
+      return -1;
+    }
+  }
+  mesh->flags = flags;
+  return 0;
+}
+
+static void *map_file(const char *path, size_t *size, struct stat *info) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  void *mapping = MAP_FAILED;
+  if (fstat(fd, info) == 0 && info->st_size > 0) {
+    mapping = mmap(NULL, info->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+  *size = info->st_size;
+  return mapping;
+}
+
+static int has_extension(const char *path, const char *extension) {
+  size_t length = strlen(path), extensionLength = strlen(extension);
+  return length >= extensionLength &&
+         strcasecmp(path + length - extensionLength, extension) == 0;
+}
+
+/**
+ * Parses the OBJ or PLY file at path, picked by extension, into mesh. The
+ * file is mapped rather than read, and its text is parsed in chunks of
+ * lines on the job threads. OBJ polygons and PLY faces are split into
+ * triangle fans. Free mesh with meshfile_free. Returns 0 on success and -1
+ * on failure.
+ */
+int meshfile_parse(Mesh *mesh, const char *path) {
+  memset(mesh, 0, sizeof(Mesh));
+  int isObj = has_extension(path, ".obj");
+  if (!isObj && !has_extension(path, ".ply")) {
+    fprintf(stderr, "Mesh %s: not an OBJ or PLY file\n", path);
+    return -1;
+  }
+  size_t size;
+  struct stat info;
+  void *data = map_file(path, &size, &info);
+  if (!data) {
+    return -1;
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+  int result =
+      isObj ? parse_obj(mesh, data, size) : parse_ply(mesh, data, size);
+  munmap(data, size);
+  if (result != 0) {
+    fprintf(stderr, "Mesh %s: malformed or unsupported\n", path);
+    meshfile_free(mesh);
+  }
+  return result;
+}
+
+static int64_t modified_ns(const struct stat *info) {
+  return (int64_t)info->st_mtim.tv_sec * 1000000000 + info->st_mtim.tv_nsec;
+}
+
+/**
+ * Writes mesh to a cache at cachePath, stamped with the size and
+ * modification time of sourcePath. The cache is written next to cachePath
+ * first and renamed into place, so readers never see a partial file.
+ * Returns 0 on success and -1 on failure.
+ */
+int meshfile_write_cache(const Mesh *mesh, const char *sourcePath,
+                         const char *cachePath) {
+  struct stat info;
+  if (stat(sourcePath, &info) != 0) {
+    return -1;
+  }
+  MeshFileHeader header = {.version = MESHFILE_VERSION,
+                           .vertexCount = mesh->vertexCount,
+                           .indexCount = mesh->indexCount,
+                           .flags = mesh->flags,
+                           .sourceSize = info.st_size,
+                           .sourceModified = modified_ns(&info)};
+  memcpy(header.magic, MESHFILE_MAGIC, 4);
+
+  char temporary[4096];
+  if (snprintf(temporary, sizeof(temporary), "%s.tmp", cachePath) >=
+      (int)sizeof(temporary)) {
+    return -1;
+  }
+  FILE *file = fopen(temporary, "wb");
+  if (!file) {
+    return -1;
+  }
+  int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(mesh->vertices, sizeof(MeshVertex), mesh->vertexCount,
+                  file) == (size_t)mesh->vertexCount &&
+           fwrite(mesh->indices, sizeof(uint32_t), mesh->indexCount, file) ==
+               (size_t)mesh->indexCount;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temporary, cachePath) != 0) {
+    remove(temporary);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Maps the cache at cachePath into mesh, without copying it. The cache is
+ * rejected if sourcePath exists and changed since the cache was written.
+ * Returns 0 on success and -1 on failure.
+ */
+int meshfile_open_cache(Mesh *mesh, const char *sourcePath,
+                        const char *cachePath) {
+  memset(mesh, 0, sizeof(Mesh));
+  size_t size;
+  struct stat info;
+  void *mapping = map_file(cachePath, &size, &info);
+  if (!mapping) {
+    return -1;
+  }
+  const MeshFileHeader *header = mapping;
+  struct stat source;
+  int stale = stat(sourcePath, &source) == 0 &&
+              (size < sizeof(MeshFileHeader) ||
+               header->sourceSize != (uint64_t)source.st_size ||
+               header->sourceModified != modified_ns(&source));
+  if (stale || size < sizeof(MeshFileHeader) ||
+      memcmp(header->magic, MESHFILE_MAGIC, 4) != 0 ||
+      header->version != MESHFILE_VERSION ||
+      size != sizeof(MeshFileHeader) +
+                  (size_t)header->vertexCount * sizeof(MeshVertex) +
+                  (size_t)header->indexCount * sizeof(uint32_t)) {
+    munmap(mapping, size);
+    return -1;
+  }
+  mesh->mapping = mapping;
+  mesh->mappingSize = size;
+  mesh->vertices = (MeshVertex *)(header + 1);
+  mesh->indices = (uint32_t *)(mesh->vertices + header->vertexCount);
+  mesh->vertexCount = header->vertexCount;
+  mesh->indexCount = header->indexCount;
+  mesh->flags = header->flags;
+  return 0;
+}
+
+/* Cache growth tolerated when ordering triangles against overdraw. */
+#define MESHFILE_OVERDRAW_THRESHOLD 1.05f
+
+/**
+ * Reorders a parsed mesh for drawing: triangles for the post-transform
+ * cache and then against overdraw, and vertices in the order the triangles
+ * first use them, dropping unused ones. before and after receive the cache
+ * statistics around it. A mesh mapped from its cache is read-only and
+ * already optimized. Returns 0 on success and -1 on failure.
+ */
+int meshfile_optimize(Mesh *mesh, MeshoptStats *before, MeshoptStats *after) {
+  if (mesh->mapping) {
+    return -1;
+  }
+  meshopt_analyze(mesh->indices, mesh->indexCount, mesh->vertexCount,
+                  MESHOPT_CACHE_SIZE, before);
+  int triangleCount = mesh->indexCount / 3;
+  int *clusters = malloc((triangleCount ? triangleCount : 1) * sizeof(int));
+  int clusterCount;
+  if (!clusters ||
+      meshopt_reorder_triangles(mesh->indices, mesh->indexCount,
+                                mesh->vertexCount, MESHOPT_CACHE_SIZE,
+                                clusters, &clusterCount) != 0 ||
+      meshopt_sort_clusters(mesh->indices, mesh->indexCount,
+                            mesh->vertices[0].position,
+                            sizeof(MeshVertex) / sizeof(float),
+                            mesh->vertexCount, MESHOPT_CACHE_SIZE,
+                            MESHFILE_OVERDRAW_THRESHOLD, clusters,
+                            clusterCount) != 0) {
+    free(clusters);
+    return -1;
+  }
+  free(clusters);
+  int vertexCount =
+      meshopt_reorder_vertices(mesh->indices, mesh->indexCount,
+                               mesh->vertices, mesh->vertexCount,
+                               sizeof(MeshVertex));
+  if (vertexCount < 0) {
+    return -1;
+  }
+  mesh->vertexCount = vertexCount;
+  meshopt_analyze(mesh->indices, mesh->indexCount, mesh->vertexCount,
+                  MESHOPT_CACHE_SIZE, after);
+  return 0;
+}
+
+/**
+ * Loads the mesh at path from its cache, path with .cache appended, or
+ * parses and optimizes it and writes the cache when that is missing or
+ * stale. Returns 0 on success and -1 on failure.
+ */
+int meshfile_load(Mesh *mesh, const char *path) {
+  char cachePath[4096];
+  if (snprintf(cachePath, sizeof(cachePath), "%s.cache", path) >=
+      (int)sizeof(cachePath)) {
+    return -1;
+  }
+  if (meshfile_open_cache(mesh, path, cachePath) == 0) {
+    return 0;
+  }
+  if (meshfile_parse(mesh, path) != 0) {
+    return -1;
+  }
+  MeshoptStats before, after;
+  if (meshfile_optimize(mesh, &before, &after) == 0) {
+    fprintf(stdout, "Mesh %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", path,
+            before.acmr, after.acmr, before.atvr, after.atvr);
+  } else {
+    fprintf(stderr, "Mesh %s: not optimized\n", path);
+  }
+  if (meshfile_write_cache(mesh, path, cachePath) != 0) {
+    fprintf(stderr, "Mesh %s: cache not written\n", path);
+  }
+  return 0;
+}
+
+void meshfile_free(Mesh *mesh) {
+  if (mesh->mapping) {
+    munmap(mesh->mapping, mesh->mappingSize);
+  } else {
+    free(mesh->vertices);
+    free(mesh->indices);
+  }
+  memset(mesh, 0, sizeof(Mesh));
+}
+
+/**
+ * Creates a vertex buffer of MeshVertex and an index buffer of 32-bit
+ * indices from mesh. A mesh mapped from its cache goes to the GL straight
+ * from the mapping.
+ */
+void meshfile_upload(const Mesh *mesh, unsigned int *vertexBuffer,
+                     unsigned int *indexBuffer) {
+  *vertexBuffer = resource_buffer(
+      (size_t)mesh->vertexCount * sizeof(MeshVertex), mesh->vertices, 0);
+  *indexBuffer = resource_buffer((size_t)mesh->indexCount * sizeof(uint32_t),
+                                 mesh->indices, 0);
+}
@@ -0,0 +1,73 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "meshopt.h"
+
+#define MESHFILE_MAGIC "MESH"
+#define MESHFILE_VERSION 2
+
+/* Attributes a mesh file provided. Missing normals and texture coordinates
+ * are zero and missing colors white. */
+enum {
+  MESHFILE_NORMALS = 1,
+  MESHFILE_TEX_COORDS = 2,
+  MESHFILE_COLORS = 4
+};
+
+/**
+ * Vertex of a loaded mesh, with colors as RGB in [0, 1].
+ */
+typedef struct {
+  float position[3];
+  float normal[3];
+  float texCoord[2];
+  float color[3];
+} MeshVertex;
+
+/**
+ * On-disk layout of a mesh cache: a header, vertexCount vertices and
+ * indexCount 32-bit triangle indices, in the byte order of the machine that
+ * wrote it. sourceSize and sourceModified (in nanoseconds) identify the
+ * file the cache was built from.
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t sourceSize;
+  int64_t sourceModified;
+} MeshFileHeader;
+
+/**
+ * Indexed triangle mesh. vertices and indices point into the mapped cache
+ * when the mesh came from one, and into allocations otherwise.
+ */
+typedef struct {
+  MeshVertex *vertices;
+  uint32_t *indices;
+  int vertexCount;
+  int indexCount;
+  unsigned int flags;
+  void *mapping;
+  size_t mappingSize;
+} Mesh;
+
+int meshfile_parse(Mesh *mesh, const char *path);
+int meshfile_write_cache(const Mesh *mesh, const char *sourcePath,
+                         const char *cachePath);
+int meshfile_open_cache(Mesh *mesh, const char *sourcePath,
+                        const char *cachePath);
+int meshfile_optimize(Mesh *mesh, MeshoptStats *before, MeshoptStats *after);
+int meshfile_load(Mesh *mesh, const char *path);
+void meshfile_free(Mesh *mesh);
+
+void meshfile_upload(const Mesh *mesh, unsigned int *vertexBuffer,
+                     unsigned int *indexBuffer);
+
+#endif
@@ -0,0 +1,386 @@
+#include "meshopt.h"
+
+#include <cglm/cglm.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The post-transform cache is simulated as a FIFO with timestamps: a vertex
+ * is cached while fewer than cacheSize vertices were transformed after it,
+ * so a lookup is a subtraction instead of a search. Timestamps start past
+ * cacheSize so that every vertex misses on first use.
+ */
+
+/**
+ * Triangles around each vertex in compressed rows: those using vertex v
+ * are triangles[offsets[v]] up to triangles[offsets[v + 1]].
+ */
+typedef struct {
+  int *offsets;
+  int *triangles;
+  int maxValence;
+} Adjacency;
+
+static int build_adjacency(const uint32_t *indices, int indexCount,
+                           int vertexCount, Adjacency *adjacency) {
+  adjacency->offsets = calloc(vertexCount + 1, sizeof(int));
+  adjacency->triangles = malloc((indexCount ? indexCount : 1) * sizeof(int));
+  if (!adjacency->offsets || !adjacency->triangles) {
+    free(adjacency->offsets);
+    free(adjacency->triangles);
+    return -1;
+  }
+  int *offsets = adjacency->offsets;
+  for (int i = 0; i < indexCount; i++) {
+    offsets[indices[i] + 1]++;
+  }
+  adjacency->maxValence = 0;
+  for (int v = 0; v < vertexCount; v++) {
+    if (offsets[v + 1] > adjacency->maxValence) {
+      adjacency->maxValence = offsets[v + 1];
+    }
+    offsets[v + 1] += offsets[v];
+  }
+  /* Filling advances each row start to the next row's, so shift back. */
+  for (int i = 0; i < indexCount; i++) {
+    adjacency->triangles[offsets[indices[i]]++] = i / 3;
+  }
+  memmove(offsets + 1, offsets, vertexCount * sizeof(int));
+  offsets[0] = 0;
+  return 0;
+}
+
+static void free_adjacency(Adjacency *adjacency) {
+  free(adjacency->offsets);
+  free(adjacency->triangles);
+}
+
+/**
+ * Counts the cache misses of triangles begin up to end. Advancing *time by
+ * more than cacheSize first starts from an empty cache.
+ */
+static int count_misses(const uint32_t *indices, int begin, int end,
+                        int cacheSize, int *cacheTime, int *time) {
+  int misses = 0;
+  for (int i = begin * 3; i < end * 3; i++) {
+    uint32_t v = indices[i];
+    if (*time - cacheTime[v] > cacheSize) {
+      cacheTime[v] = (*time)++;
+      misses++;
+    }
+  }
+  return misses;
+}
+
+/**
+ * Fills stats with the cache efficiency of drawing indices with a FIFO
+ * post-transform cache of cacheSize entries. Both are 0 on failure.
+ */
+void meshopt_analyze(const uint32_t *indices, int indexCount, int vertexCount,
+                     int cacheSize, MeshoptStats *stats) {
+  stats->acmr = 0.0f;
+  stats->atvr = 0.0f;
+  int *cacheTime = calloc(vertexCount ? vertexCount : 1, sizeof(int));
+  if (!cacheTime) {
+    return;
+  }
+  int time = cacheSize + 1;
+  int triangleCount = indexCount / 3;
+  int misses =
+      count_misses(indices, 0, triangleCount, cacheSize, cacheTime, &time);
+  int referenced = 0;
+  for (int v = 0; v < vertexCount; v++) {
+    referenced += cacheTime[v] != 0;
+  }
+  free(cacheTime);
+  if (triangleCount > 0) {
+    stats->acmr = (float)misses / triangleCount;
+  }
+  if (referenced > 0) {
+    stats->atvr = (float)misses / referenced;
+  }
+}
+
+/* Next vertex to fan around when the cache holds no live one: the latest
+ * emitted vertex with triangles left, or else the first such vertex. */
+static int skip_dead_end(const int *live, const int *deadEnd,
+                         int *deadEndCount, int vertexCount, int *cursor) {
+  while (*deadEndCount > 0) {
+    int v = deadEnd[--*deadEndCount];
+    if (live[v] > 0) {
+      return v;
+    }
+  }
+  for (; *cursor < vertexCount; (*cursor)++) {
+    if (live[*cursor] > 0) {
+      return *cursor;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Reorders the triangles of indices for a post-transform cache of
+ * cacheSize entries with Tipsify (Sander et al. 2007): triangles are
+ * emitted as fans around one vertex at a time, and the next vertex is the
+ * oldest cached one whose remaining triangles still fit in the cache. The
+ * run is linear in the triangle count.
+ *
+ * When clusters is not NULL it receives the first triangle of every run
+ * that had to restart away from the cache, at most indexCount / 3 of them,
+ * and clusterCount their number. Returns 0 on success and -1 on failure.
+ */
+int meshopt_reorder_triangles(uint32_t *indices, int indexCount,
+                              int vertexCount, int cacheSize,
+                              int *clusters, int *clusterCount) {
+  int triangleCount = indexCount / 3;
+  Adjacency adjacency;
+  if (build_adjacency(indices, indexCount, vertexCount, &adjacency) != 0) {
+    return -1;
+  }
+  int *live = malloc((vertexCount ? vertexCount : 1) * sizeof(int));
+  int *cacheTime = calloc(vertexCount ? vertexCount : 1, sizeof(int));
+  int *deadEnd = malloc((indexCount ? indexCount : 1) * sizeof(int));
+  int *candidates = malloc((adjacency.maxValence * 3 + 1) * sizeof(int));
+  unsigned char *emitted = calloc(triangleCount ? triangleCount : 1, 1);
+  uint32_t *output = malloc((indexCount ? indexCount : 1) * sizeof(uint32_t));
+  int result = -1;
+  if (live && cacheTime && deadEnd && candidates && emitted && output) {
+    for (int v = 0; v < vertexCount; v++) {
+      live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+    int time = cacheSize + 1;
+    int deadEndCount = 0, cursor = 0, written = 0, count = 0;
+    int fan = skip_dead_end(live, deadEnd, &deadEndCount, vertexCount, &cursor);
+    int restarted = 1;
+    while (fan >= 0) {
+      if (restarted && clusters) {
+        clusters[count] = written / 3;
+      }
+      count += restarted;
+
+      int candidateCount = 0;
+      for (int k = adjacency.offsets[fan]; k < adjacency.offsets[fan + 1];
+           k++) {
+        int triangle = adjacency.triangles[k];
+        if (emitted[triangle]) {
+          continue;
+        }
+        emitted[triangle] = 1;
+        for (int corner = 0; corner < 3; corner++) {
+          uint32_t v = indices[triangle * 3 + corner];
+          output[written++] = v;
+          deadEnd[deadEndCount++] = v;
+          candidates[candidateCount++] = v;
+          live[v]--;
+          if (time - cacheTime[v] > cacheSize) {
+            cacheTime[v] = time++;
+          }
+        }
+      }
+
+      /* Prefer the oldest candidate that stays cached while its remaining
+       * triangles are emitted; any live one beats none. */
+      int best = -1, bestPriority = -1;
+      for (int i = 0; i < candidateCount; i++) {
+        int v = candidates[i];
+        if (live[v] <= 0) {
+          continue;
+        }
+        int age = time - cacheTime[v];
+        int priority = age + 2 * live[v] <= cacheSize ? age : 0;
+        if (priority > bestPriority) {
+          bestPriority = priority;
+          best = v;
+        }
+      }
+      restarted = best < 0;
+      fan = restarted ? skip_dead_end(live, deadEnd, &deadEndCount,
+                                      vertexCount, &cursor)
+                      : best;
+    }
+
+    memcpy(indices, output, (size_t)written * sizeof(uint32_t));
+    if (clusterCount) {
+      *clusterCount = count;
+    }
+    result = 0;
+  }
+
+  free(live);
+  free(cacheTime);
+  free(deadEnd);
+  free(candidates);
+  free(emitted);
+  free(output);
+  free_adjacency(&adjacency);
+  return result;
+}
+
+/* Triangles begin up to end, with their area-weighted centroid and the sum
+ * of their normals scaled by twice their area. */
+typedef struct {
+  float key;
+  int begin;
+  int end;
+  float area;
+  vec3 centroid;
+  vec3 normal;
+} Cluster;
+
+static int compare_clusters(const void *a, const void *b) {
+  const Cluster *first = a, *second = b;
+  if (first->key != second->key) {
+    return first->key > second->key ? -1 : 1;
+  }
+  return first->begin - second->begin;
+}
+
+/**
+ * Splits the clusters from meshopt_reorder_triangles further, at the first
+ * point where a piece drawn from an empty cache is within threshold of the
+ * whole cluster's ACMR. Returns the number of pieces written to bounds.
+ */
+static int split_clusters(const uint32_t *indices, int triangleCount,
+                          int cacheSize, float threshold, const int *clusters,
+                          int clusterCount, int *cacheTime, Cluster *bounds) {
+  int time = cacheSize + 1;
+  int count = 0;
+  for (int c = 0; c < clusterCount; c++) {
+    int begin = clusters[c];
+    int end = c + 1 < clusterCount ? clusters[c + 1] : triangleCount;
+    time += cacheSize + 1;
+    float target = threshold *
+                   count_misses(indices, begin, end, cacheSize, cacheTime,
+                                &time) /
+                   (end - begin);
+
+    time += cacheSize + 1;
+    int pieceBegin = begin, misses = 0;
+    for (int t = begin; t < end; t++) {
+      misses += count_misses(indices, t, t + 1, cacheSize, cacheTime, &time);
+      if (t + 1 == end || misses <= target * (t + 1 - pieceBegin)) {
+        bounds[count++] = (Cluster){.begin = pieceBegin, .end = t + 1};
+        pieceBegin = t + 1;
+        misses = 0;
+        time += cacheSize + 1;
+      }
+    }
+  }
+  return count;
+}
+
+/**
+ * Reorders the clusters of an index buffer from meshopt_reorder_triangles
+ * to reduce overdraw (Sander et al. 2007): clusters are first split into
+ * pieces that cost at most threshold times their cluster's ACMR, 1.05
+ * allowing 5% more transforms, then drawn in order of how far they face
+ * away from the mesh centroid, so outer surfaces that occlude others come
+ * first regardless of the view. positions holds stride floats per vertex.
+ * Returns 0 on success and -1 on failure.
+ */
+int meshopt_sort_clusters(uint32_t *indices, int indexCount,
+                          const float *positions, int stride,
+                          int vertexCount, int cacheSize, float threshold,
+                          const int *clusters, int clusterCount) {
+  int triangleCount = indexCount / 3;
+  Cluster *pieces = malloc((triangleCount ? triangleCount : 1) *
+                           sizeof(Cluster));
+  int *cacheTime = calloc(vertexCount ? vertexCount : 1, sizeof(int));
+  uint32_t *output = malloc((indexCount ? indexCount : 1) * sizeof(uint32_t));
+  if (!pieces || !cacheTime || !output) {
+    free(pieces);
+    free(cacheTime);
+    free(output);
+    return -1;
+  }
+  int pieceCount =
+      split_clusters(indices, triangleCount, cacheSize, threshold, clusters,
+                     clusterCount, cacheTime, pieces);
+  free(cacheTime);
+
+  vec3 meshCentroid = GLM_VEC3_ZERO_INIT;
+  float meshArea = 0.0f;
+  for (int p = 0; p < pieceCount; p++) {
+    Cluster *piece = &pieces[p];
+    for (int t = piece->begin; t < piece->end; t++) {
+      const float *a = positions + indices[t * 3] * stride;
+      const float *b = positions + indices[t * 3 + 1] * stride;
+      const float *c = positions + indices[t * 3 + 2] * stride;
+      vec3 ab = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      vec3 ac = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+      vec3 normal;
+      glm_vec3_cross(ab, ac, normal);
+      /* The cross product is as long as twice the triangle's area. */
+      float area = glm_vec3_norm(normal);
+      vec3 center = {a[0] + b[0] + c[0], a[1] + b[1] + c[1],
+                     a[2] + b[2] + c[2]};
+      glm_vec3_muladds(center, area / 3.0f, piece->centroid);
+      glm_vec3_add(piece->normal, normal, piece->normal);
+      piece->area += area;
+    }
+    glm_vec3_add(meshCentroid, piece->centroid, meshCentroid);
+    meshArea += piece->area;
+    if (piece->area > 0.0f) {
+      glm_vec3_divs(piece->centroid, piece->area, piece->centroid);
+    }
+  }
+  if (meshArea > 0.0f) {
+    glm_vec3_divs(meshCentroid, meshArea, meshCentroid);
+  }
+  /* Pieces without area keep their place among the ones facing sideways. */
+  for (int p = 0; p < pieceCount; p++) {
+    vec3 offset, direction;
+    glm_vec3_sub(pieces[p].centroid, meshCentroid, offset);
+    glm_vec3_normalize_to(pieces[p].normal, direction);
+    pieces[p].key = pieces[p].area > 0.0f ? glm_vec3_dot(offset, direction)
+                                          : 0.0f;
+  }
+
+  qsort(pieces, pieceCount, sizeof(Cluster), compare_clusters);
+  int written = 0;
+  for (int p = 0; p < pieceCount; p++) {
+    int length = (pieces[p].end - pieces[p].begin) * 3;
+    memcpy(output + written, indices + pieces[p].begin * 3,
+           length * sizeof(uint32_t));
+    written += length;
+  }
+  memcpy(indices, output, (size_t)written * sizeof(uint32_t));
+  free(pieces);
+  free(output);
+  return 0;
+}
+
+/**
+ * Reorders the vertexCount vertices of vertexSize bytes so that they are
+ * stored in the order indices first reference them, and rewrites indices
+ * to match. Vertices no index references are dropped. Returns the number
+ * of vertices kept, or -1 on failure.
+ */
+int meshopt_reorder_vertices(uint32_t *indices, int indexCount,
+                             void *vertices, int vertexCount,
+                             size_t vertexSize) {
+  int *remap = malloc((vertexCount ? vertexCount : 1) * sizeof(int));
+  unsigned char *reordered = malloc((vertexCount ? vertexCount : 1) *
+                                    vertexSize);
+  if (!remap || !reordered) {
+    free(remap);
+    free(reordered);
+    return -1;
+  }
+  memset(remap, 0xff, vertexCount * sizeof(int));
+  int count = 0;
+  for (int i = 0; i < indexCount; i++) {
+    uint32_t v = indices[i];
+    if (remap[v] < 0) {
+      memcpy(reordered + count * vertexSize,
+             (unsigned char *)vertices + v * vertexSize, vertexSize);
+      remap[v] = count++;
+    }
+    indices[i] = remap[v];
+  }
+  memcpy(vertices, reordered, count * vertexSize);
+  free(remap);
+  free(reordered);
+  return count;
+}
@@ -0,0 +1,34 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Post-transform cache entries assumed when reordering and analyzing. */
+#define MESHOPT_CACHE_SIZE 16
+
+/**
+ * Vertex cache efficiency of an index buffer under a FIFO cache: acmr is
+ * the average number of vertices transformed per triangle, between 0.5 and
+ * 3, and atvr the number transformed per referenced vertex, 1 at best.
+ */
+typedef struct {
+  float acmr;
+  float atvr;
+} MeshoptStats;
+
+void meshopt_analyze(const uint32_t *indices, int indexCount, int vertexCount,
+                     int cacheSize, MeshoptStats *stats);
+
+int meshopt_reorder_triangles(uint32_t *indices, int indexCount,
+                              int vertexCount, int cacheSize,
+                              int *clusters, int *clusterCount);
+int meshopt_sort_clusters(uint32_t *indices, int indexCount,
+                          const float *positions, int stride,
+                          int vertexCount, int cacheSize, float threshold,
+                          const int *clusters, int clusterCount);
+int meshopt_reorder_vertices(uint32_t *indices, int indexCount,
+                             void *vertices, int vertexCount,
+                             size_t vertexSize);
+
+#endif
@@ -0,0 +1,176 @@
+#include "meshpack.h"
+
+#include <cglm/cglm.h>
+#include <glad/gl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hdr.h"
+
+/*
+ * Packed vertex layout, every attribute 4-byte aligned:
+ *   position  3 x GL_UNSIGNED_SHORT normalized, 8 bytes with padding
+ *   color     4 x GL_UNSIGNED_BYTE normalized, alpha 1
+ *   texCoord  2 x GL_HALF_FLOAT
+ *   normal    2 x GL_SHORT normalized, octahedral
+ * 20 bytes with every attribute against 44 as floats, 16 against 32 without
+ * normals.
+ */
+
+/**
+ * Decoding the normal in GLSL, e from the normal attribute:
+ *   vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+ *   if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * sign(n.xy);
+ *   n = normalize(n);
+ * The decode matrix must not be applied to normals, only the model matrix.
+ * GL 4.2 maps 0 to exactly 0.0; earlier versions are off by 1/65535.
+ */
+static void octahedral_encode(const float *normal, short *encoded) {
+  float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+  float x = 0.0f, y = 0.0f;
+  if (length > 0.0f) {
+    x = normal[0] / length;
+    y = normal[1] / length;
+  }
+  if (normal[2] < 0.0f) {
+    /* Fold the lower hemisphere over the diagonals of the square. */
+    float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = foldedX;
+    y = foldedY;
+  }
+  encoded[0] = (short)lroundf(glm_clamp(x, -1.0f, 1.0f) * 32767.0f);
+  encoded[1] = (short)lroundf(glm_clamp(y, -1.0f, 1.0f) * 32767.0f);
+}
+
+static unsigned short quantize_unorm16(float value, float min, float extent) {
+  if (extent <= 0.0f) {
+    return 0;
+  }
+  return (unsigned short)lroundf(
+      glm_clamp((value - min) / extent, 0.0f, 1.0f) * 65535.0f);
+}
+
+static unsigned char quantize_unorm8(float value) {
+  return (unsigned char)lroundf(glm_clamp(value, 0.0f, 1.0f) * 255.0f);
+}
+
+static int add_attrib(PackedMesh *mesh, unsigned int index, int size,
+                      unsigned int type, int normalized, int bytes) {
+  int offset = mesh->stride;
+  mesh->attribs[mesh->attribCount++] =
+      (VertexAttrib){index, size, type, normalized, offset};
+  mesh->stride += bytes;
+  return offset;
+}
+
+/**
+ * Half floats of the texture coordinates, converted in one batch.
+ */
+static unsigned short *pack_tex_coords(const MeshSource *source) {
+  int count = source->vertexCount;
+  float *gathered = malloc(count * 2 * sizeof(float));
+  unsigned short *packed = malloc(count * 2 * sizeof(unsigned short));
+  if (!gathered || !packed) {
+    free(gathered);
+    free(packed);
+    return NULL;
+  }
+  for (int i = 0; i < count; i++) {
+    memcpy(gathered + i * 2, source->texCoords + i * source->stride,
+           2 * sizeof(float));
+  }
+  hdr_to_half(gathered, packed, count * 2);
+  free(gathered);
+  return packed;
+}
+
+/**
+ * Quantizes the attributes of source into mesh: positions to 16 bits per
+ * axis across the bounding box, colors to 8 bits, texture coordinates to
+ * half floats and normals to 16-bit octahedral pairs. Free mesh with
+ * meshpack_free. Returns 0 on success and -1 on failure.
+ */
+int meshpack_pack(const MeshSource *source, PackedMesh *mesh) {
+  int count = source->vertexCount;
+  memset(mesh, 0, sizeof(*mesh));
+
+  glm_aabb_invalidate(mesh->bounds);
+  for (int i = 0; i < count; i++) {
+    const float *p = source->positions + i * source->stride;
+    vec3 position = {p[0], p[1], p[2]};
+    glm_vec3_minv(mesh->bounds[0], position, mesh->bounds[0]);
+    glm_vec3_maxv(mesh->bounds[1], position, mesh->bounds[1]);
+  }
+  if (count == 0) {
+    glm_vec3_zero(mesh->bounds[0]);
+    glm_vec3_zero(mesh->bounds[1]);
+  }
+  vec3 extent;
+  glm_vec3_sub(mesh->bounds[1], mesh->bounds[0], extent);
+  glm_translate_make(mesh->decode, mesh->bounds[0]);
+  glm_scale(mesh->decode, extent);
+
+  int positionOffset =
+      add_attrib(mesh, MESHPACK_POSITION, 3, GL_UNSIGNED_SHORT, GL_TRUE, 8);
+  int colorOffset = -1, texCoordOffset = -1, normalOffset = -1;
+  if (source->colors) {
+    colorOffset =
+        add_attrib(mesh, MESHPACK_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4);
+  }
+  if (source->texCoords) {
+    texCoordOffset =
+        add_attrib(mesh, MESHPACK_TEX_COORD, 2, GL_HALF_FLOAT, GL_FALSE, 4);
+  }
+  if (source->normals) {
+    normalOffset = add_attrib(mesh, MESHPACK_NORMAL, 2, GL_SHORT, GL_TRUE, 4);
+  }
+
+  mesh->size = (size_t)count * mesh->stride;
+  mesh->data = calloc(count ? count : 1, mesh->stride);
+  unsigned short *texCoords = NULL;
+  if (source->texCoords && count) {
+    texCoords = pack_tex_coords(source);
+  }
+  if (!mesh->data || (source->texCoords && count && !texCoords)) {
+    free(texCoords);
+    meshpack_free(mesh);
+    return -1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    unsigned char *vertex = (unsigned char *)mesh->data + i * mesh->stride;
+    const float *p = source->positions + i * source->stride;
+    unsigned short position[4] = {0, 0, 0, 0};
+    for (int axis = 0; axis < 3; axis++) {
+      position[axis] =
+          quantize_unorm16(p[axis], mesh->bounds[0][axis], extent[axis]);
+    }
+    memcpy(vertex + positionOffset, position, sizeof(position));
+
+    if (colorOffset >= 0) {
+      const float *c = source->colors + i * source->stride;
+      unsigned char color[4] = {quantize_unorm8(c[0]), quantize_unorm8(c[1]),
+                                quantize_unorm8(c[2]), 255};
+      memcpy(vertex + colorOffset, color, sizeof(color));
+    }
+    if (texCoordOffset >= 0) {
+      memcpy(vertex + texCoordOffset, texCoords + i * 2,
+             2 * sizeof(unsigned short));
+    }
+    if (normalOffset >= 0) {
+      short normal[2];
+      octahedral_encode(source->normals + i * source->stride, normal);
+      memcpy(vertex + normalOffset, normal, sizeof(normal));
+    }
+  }
+  free(texCoords);
+  return 0;
+}
+
+void meshpack_free(PackedMesh *mesh) {
+  free(mesh->data);
+  mesh->data = NULL;
+  mesh->size = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef MESHPACK_H
+#define MESHPACK_H
+
+#include <cglm/types.h>
+#include <stddef.h>
+
+#include "resource.h"
+
+/* Attribute locations of packed meshes. */
+enum {
+  MESHPACK_POSITION,
+  MESHPACK_COLOR,
+  MESHPACK_TEX_COORD,
+  MESHPACK_NORMAL
+};
+
+/**
+ * Float vertex attributes to pack. Every array holds one element per
+ * vertex, stride floats apart; all but positions may be NULL. Colors are
+ * RGB in [0, 1] and normals have unit length.
+ */
+typedef struct {
+  const float *positions;
+  const float *colors;
+  const float *texCoords;
+  const float *normals;
+  int stride;
+  int vertexCount;
+} MeshSource;
+
+/**
+ * Interleaved vertices of stride bytes, described by attribs for
+ * resource_vertex_array. Positions are stored relative to the bounding box
+ * of the mesh; decode maps them back and goes in front of the model matrix.
+ */
+typedef struct {
+  mat4 decode;
+  vec3 bounds[2];
+  void *data;
+  size_t size;
+  int stride;
+  VertexAttrib attribs[4];
+  int attribCount;
+} PackedMesh;
+
+int meshpack_pack(const MeshSource *source, PackedMesh *mesh);
+void meshpack_free(PackedMesh *mesh);
+
+#endif
@@ -0,0 +1,366 @@
+#include "noisefield.h"
+
+#include <glad/gl.h>
+#include <stddef.h>
+
+#include "jobs.h"
+#include "simd.h"
+
+/* Rows per parallel chunk. */
+#define NOISE_GRAIN 4
+
+#ifdef SIMD_DISPATCH
+/* 8-lane builds of the kernels below, from noisefield_avx2.c. */
+void noise_perlin2_batch_avx2(const float *x, const float *y, float *dest,
+                              int count);
+void noise_perlin3_batch_avx2(const float *x, const float *y, const float *z,
+                              float *dest, int count);
+void noise_fill_rows_avx2(void *context, int begin, int end);
+#endif
+
+/*
+ * The helpers below mirror the glm__noiseDetail_* macros of cglm's noise.h
+ * one lane per sample, so the batch results match glm_perlin_vec2/vec3.
+ */
+
+static inline lanef mod289(lanef x) {
+  lanef scaled = lanef_mul(x, lanef_set1(1.0f / 289.0f));
+  return lanef_sub(x, lanef_mul(lanef_floor(scaled), lanef_set1(289.0f)));
+}
+
+/* fmodf(x, 289.0f) as used by glm_vec*_mods, exact for integral x. */
+static inline lanef fmod289(lanef x) {
+  lanef quotient = lanef_trunc(lanef_div(x, lanef_set1(289.0f)));
+  return lanef_sub(x, lanef_mul(quotient, lanef_set1(289.0f)));
+}
+
+static inline lanef permute(lanef x) {
+  lanef t = lanef_add(lanef_mul(x, lanef_set1(34.0f)), lanef_set1(1.0f));
+  return mod289(lanef_mul(t, x));
+}
+
+static inline lanef fract(lanef x) {
+  return lanef_min(lanef_sub(x, lanef_floor(x)),
+                   lanef_set1(0.999999940395355224609375f));
+}
+
+static inline lanef fade(lanef t) {
+  lanef cube = lanef_mul(lanef_mul(t, t), t);
+  lanef poly = lanef_sub(lanef_mul(t, lanef_set1(6.0f)), lanef_set1(15.0f));
+  poly = lanef_add(lanef_mul(t, poly), lanef_set1(10.0f));
+  return lanef_mul(cube, poly);
+}
+
+static inline lanef lerp(lanef from, lanef to, lanef t) {
+  return lanef_add(from, lanef_mul(t, lanef_sub(to, from)));
+}
+
+static inline lanef taylor_inv_sqrt(lanef x) {
+  return lanef_sub(lanef_set1(1.79284291400159f),
+                   lanef_mul(x, lanef_set1(0.85373472095314f)));
+}
+
+/**
+ * Gradient of a 2D corner from its hash, dotted with the offset (fx, fy).
+ */
+static inline lanef grad2(lanef i, lanef fx, lanef fy) {
+  lanef gx = lanef_sub(
+      lanef_mul(fract(lanef_div(i, lanef_set1(41.0f))), lanef_set1(2.0f)),
+      lanef_set1(1.0f));
+  lanef gy = lanef_sub(lanef_abs(gx), lanef_set1(0.5f));
+  gx = lanef_sub(gx, lanef_floor(lanef_add(gx, lanef_set1(0.5f))));
+
+  lanef norm =
+      taylor_inv_sqrt(lanef_add(lanef_mul(gx, gx), lanef_mul(gy, gy)));
+  return lanef_add(lanef_mul(lanef_mul(gx, norm), fx),
+                   lanef_mul(lanef_mul(gy, norm), fy));
+}
+
+/**
+ * Gradient of a 3D corner from its hash, dotted with the offset (px, py, pz).
+ */
+static inline lanef grad3(lanef i, lanef px, lanef py, lanef pz) {
+  lanef zero = lanef_set1(0.0f);
+  lanef one = lanef_set1(1.0f);
+  lanef half = lanef_set1(0.5f);
+
+  lanef gx = lanef_mul(i, lanef_set1(1.0f / 7.0f));
+  lanef gy = lanef_sub(
+      fract(lanef_mul(lanef_floor(gx), lanef_set1(1.0f / 7.0f))), half);
+  gx = fract(gx);
+  lanef gz = lanef_sub(lanef_sub(half, lanef_abs(gx)), lanef_abs(gy));
+
+  lanef sz = lanef_select(lanef_gt(gz, zero), zero, one);
+  gx = lanef_sub(
+      gx, lanef_mul(sz, lanef_sub(lanef_select(lanef_ge(gx, zero), one, zero),
+                                  half)));
+  gy = lanef_sub(
+      gy, lanef_mul(sz, lanef_sub(lanef_select(lanef_ge(gy, zero), one, zero),
+                                  half)));
+
+  lanef norm = taylor_inv_sqrt(lanef_add(
+      lanef_add(lanef_mul(gx, gx), lanef_mul(gy, gy)), lanef_mul(gz, gz)));
+  return lanef_add(lanef_add(lanef_mul(lanef_mul(gx, norm), px),
+                             lanef_mul(lanef_mul(gy, norm), py)),
+                   lanef_mul(lanef_mul(gz, norm), pz));
+}
+
+static lanef perlin2(lanef x, lanef y) {
+  lanef one = lanef_set1(1.0f);
+  lanef ix0 = lanef_floor(x);
+  lanef iy0 = lanef_floor(y);
+  lanef ix1 = fmod289(lanef_add(ix0, one));
+  lanef iy1 = fmod289(lanef_add(iy0, one));
+  ix0 = fmod289(ix0);
+  iy0 = fmod289(iy0);
+
+  lanef fx0 = fract(x);
+  lanef fy0 = fract(y);
+  lanef fx1 = lanef_sub(fx0, one);
+  lanef fy1 = lanef_sub(fy0, one);
+
+  lanef px0 = permute(ix0);
+  lanef px1 = permute(ix1);
+  lanef n00 = grad2(permute(lanef_add(px0, iy0)), fx0, fy0);
+  lanef n10 = grad2(permute(lanef_add(px1, iy0)), fx1, fy0);
+  lanef n01 = grad2(permute(lanef_add(px0, iy1)), fx0, fy1);
+  lanef n11 = grad2(permute(lanef_add(px1, iy1)), fx1, fy1);
+
+  lanef fadeX = fade(fx0);
+  lanef fadeY = fade(fy0);
+  lanef n = lerp(lerp(n00, n10, fadeX), lerp(n01, n11, fadeX), fadeY);
+  return lanef_mul(n, lanef_set1(2.3f));
+}
+
+static lanef perlin3(lanef x, lanef y, lanef z) {
+  lanef one = lanef_set1(1.0f);
+  lanef ix0 = lanef_floor(x);
+  lanef iy0 = lanef_floor(y);
+  lanef iz0 = lanef_floor(z);
+  lanef ix1 = fmod289(lanef_add(ix0, one));
+  lanef iy1 = fmod289(lanef_add(iy0, one));
+  lanef iz1 = fmod289(lanef_add(iz0, one));
+  ix0 = fmod289(ix0);
+  iy0 = fmod289(iy0);
+  iz0 = fmod289(iz0);
+
+  lanef fx0 = fract(x);
+  lanef fy0 = fract(y);
+  lanef fz0 = fract(z);
+  lanef fx1 = lanef_sub(fx0, one);
+  lanef fy1 = lanef_sub(fy0, one);
+  lanef fz1 = lanef_sub(fz0, one);
+
+  lanef px0 = permute(ix0);
+  lanef px1 = permute(ix1);
+  lanef ixy0 = permute(lanef_add(px0, iy0));
+  lanef ixy1 = permute(lanef_add(px1, iy0));
+  lanef ixy2 = permute(lanef_add(px0, iy1));
+  lanef ixy3 = permute(lanef_add(px1, iy1));
+
+  lanef n000 = grad3(permute(lanef_add(ixy0, iz0)), fx0, fy0, fz0);
+  lanef n100 = grad3(permute(lanef_add(ixy1, iz0)), fx1, fy0, fz0);
+  lanef n010 = grad3(permute(lanef_add(ixy2, iz0)), fx0, fy1, fz0);
+  lanef n110 = grad3(permute(lanef_add(ixy3, iz0)), fx1, fy1, fz0);
+  lanef n001 = grad3(permute(lanef_add(ixy0, iz1)), fx0, fy0, fz1);
+  lanef n101 = grad3(permute(lanef_add(ixy1, iz1)), fx1, fy0, fz1);
+  lanef n011 = grad3(permute(lanef_add(ixy2, iz1)), fx0, fy1, fz1);
+  lanef n111 = grad3(permute(lanef_add(ixy3, iz1)), fx1, fy1, fz1);
+
+  lanef fadeX = fade(fx0);
+  lanef fadeY = fade(fy0);
+  lanef fadeZ = fade(fz0);
+  lanef nz0 = lerp(n000, n001, fadeZ);
+  lanef nz1 = lerp(n100, n101, fadeZ);
+  lanef nz2 = lerp(n010, n011, fadeZ);
+  lanef nz3 = lerp(n110, n111, fadeZ);
+  lanef n = lerp(lerp(nz0, nz2, fadeY), lerp(nz1, nz3, fadeY), fadeX);
+  return lanef_mul(n, lanef_set1(2.2f));
+}
+
+/**
+ * Batch version of glm_perlin_vec2 over SoA coordinates.
+ */
+void SIMD_NAME(noise_perlin2_batch)(const float *x, const float *y,
+                                    float *dest, int count) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    noise_perlin2_batch_avx2(x, y, dest, count);
+    return;
+  }
+#endif
+  int i = 0;
+
+  for (; i + SIMD_LANES <= count; i += SIMD_LANES) {
+    lanef_store(dest + i, perlin2(lanef_load(x + i), lanef_load(y + i)));
+  }
+  if (i < count) {
+    float px[SIMD_LANES] = {0}, py[SIMD_LANES] = {0}, out[SIMD_LANES];
+    for (int j = 0; j < count - i; j++) {
+      px[j] = x[i + j];
+      py[j] = y[i + j];
+    }
+    lanef_store(out, perlin2(lanef_load(px), lanef_load(py)));
+    for (int j = 0; j < count - i; j++) {
+      dest[i + j] = out[j];
+    }
+  }
+}
+
+/**
+ * Batch version of glm_perlin_vec3 over SoA coordinates.
+ */
+void SIMD_NAME(noise_perlin3_batch)(const float *x, const float *y,
+                                    const float *z, float *dest, int count) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    noise_perlin3_batch_avx2(x, y, z, dest, count);
+    return;
+  }
+#endif
+  int i = 0;
+
+  for (; i + SIMD_LANES <= count; i += SIMD_LANES) {
+    lanef_store(dest + i, perlin3(lanef_load(x + i), lanef_load(y + i),
+                                  lanef_load(z + i)));
+  }
+  if (i < count) {
+    float px[SIMD_LANES] = {0}, py[SIMD_LANES] = {0}, pz[SIMD_LANES] = {0};
+    float out[SIMD_LANES];
+    for (int j = 0; j < count - i; j++) {
+      px[j] = x[i + j];
+      py[j] = y[i + j];
+      pz[j] = z[i + j];
+    }
+    lanef_store(out, perlin3(lanef_load(px), lanef_load(py), lanef_load(pz)));
+    for (int j = 0; j < count - i; j++) {
+      dest[i + j] = out[j];
+    }
+  }
+}
+
+typedef struct {
+  float *dest;
+  int width, height;
+  float origin[3];
+  float step;
+  NoiseFbm fbm;
+  int dimensions;
+} FieldJob;
+
+/**
+ * Fills whole rows of a field. Lanes walk along x, the offsets of the lanes
+ * within a step are precomputed once per row.
+ */
+void SIMD_NAME(noise_fill_rows)(void *context, int begin, int end) {
+  FieldJob *job = context;
+  float offsets[SIMD_LANES];
+  float out[SIMD_LANES];
+
+  for (int l = 0; l < SIMD_LANES; l++) {
+    offsets[l] = (float)l;
+  }
+  lanef laneOffset = lanef_load(offsets);
+
+  for (int row = begin; row < end; row++) {
+    float *dest = job->dest + (size_t)row * job->width;
+    float y = job->origin[1] + (row % job->height) * job->step;
+    float z = job->origin[2] + (row / job->height) * job->step;
+
+    for (int x = 0; x < job->width; x += SIMD_LANES) {
+      lanef px = lanef_add(
+          lanef_set1(job->origin[0]),
+          lanef_mul(lanef_add(lanef_set1((float)x), laneOffset),
+                    lanef_set1(job->step)));
+      lanef sum = lanef_set1(0.0f);
+      float frequency = job->fbm.frequency;
+      float amplitude = job->fbm.amplitude;
+
+      for (int o = 0; o < job->fbm.octaves; o++) {
+        lanef f = lanef_set1(frequency);
+        lanef n = job->dimensions == 2
+                      ? perlin2(lanef_mul(px, f), lanef_set1(y * frequency))
+                      : perlin3(lanef_mul(px, f), lanef_set1(y * frequency),
+                                lanef_set1(z * frequency));
+        sum = lanef_add(sum, lanef_mul(n, lanef_set1(amplitude)));
+        frequency *= job->fbm.lacunarity;
+        amplitude *= job->fbm.gain;
+      }
+
+      if (x + SIMD_LANES <= job->width) {
+        lanef_store(dest + x, sum);
+      } else {
+        lanef_store(out, sum);
+        for (int l = 0; x + l < job->width; l++) {
+          dest[x + l] = out[l];
+        }
+      }
+    }
+  }
+}
+
+#ifndef SIMD_WIDE
+static const NoiseFbm defaultFbm = {1, 1.0f, 1.0f, 2.0f, 0.5f};
+
+static JobFunc fill_rows(void) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    return noise_fill_rows_avx2;
+  }
+#endif
+  return noise_fill_rows;
+}
+
+/**
+ * Fills a width x height grid with fBm Perlin noise. Sample (x, y) is taken
+ * at origin + (x, y) * step and stored at dest[y * width + x]. fbm may be
+ * NULL for a single octave. Rows are spread across the job threads.
+ */
+void noise_field2(float *dest, int width, int height, vec2 origin, float step,
+                  const NoiseFbm *fbm) {
+  FieldJob job = {dest, width, height, {origin[0], origin[1], 0.0f}, step,
+                  fbm ? *fbm : defaultFbm, 2};
+  jobs_parallel_for(height, NOISE_GRAIN, fill_rows(), &job);
+}
+
+/**
+ * 3D counterpart of noise_field2, storing sample (x, y, z) at
+ * dest[(z * height + y) * width + x].
+ */
+void noise_field3(float *dest, int width, int height, int depth, vec3 origin,
+                  float step, const NoiseFbm *fbm) {
+  FieldJob job = {dest, width, height, {origin[0], origin[1], origin[2]},
+                  step, fbm ? *fbm : defaultFbm, 3};
+  jobs_parallel_for(height * depth, NOISE_GRAIN, fill_rows(), &job);
+}
+
+/**
+ * GPU equivalent of noise_field2: runs shaders/noise.comp to fill a GL_R32F
+ * texture of width x height. computeProgram is built from it with
+ * buildSpecializedComputeShader. Requires OpenGL 4.3 for compute shaders.
+ */
+void noise_field2_dispatch(unsigned int computeProgram, unsigned int texture,
+                           int width, int height, vec2 origin, float step,
+                           const NoiseFbm *fbm) {
+  const NoiseFbm *params = fbm ? fbm : &defaultFbm;
+
+  glUseProgram(computeProgram);
+  glUniform2f(glGetUniformLocation(computeProgram, "origin"), origin[0],
+              origin[1]);
+  glUniform1f(glGetUniformLocation(computeProgram, "step"), step);
+  glUniform1i(glGetUniformLocation(computeProgram, "octaves"),
+              params->octaves);
+  glUniform1f(glGetUniformLocation(computeProgram, "frequency"),
+              params->frequency);
+  glUniform1f(glGetUniformLocation(computeProgram, "amplitude"),
+              params->amplitude);
+  glUniform1f(glGetUniformLocation(computeProgram, "lacunarity"),
+              params->lacunarity);
+  glUniform1f(glGetUniformLocation(computeProgram, "gain"), params->gain);
+
+  glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+  glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                  GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+#endif
@@ -0,0 +1,33 @@
+#ifndef NOISEFIELD_H
+#define NOISEFIELD_H
+
+#include <cglm/types.h>
+
+/**
+ * Fractal Brownian motion parameters. Octave i samples the noise at
+ * frequency * lacunarity^i and weighs it with amplitude * gain^i. A single
+ * octave with frequency and amplitude 1 reproduces glm_perlin_vec2/vec3.
+ */
+typedef struct {
+  int octaves;
+  float frequency;
+  float amplitude;
+  float lacunarity;
+  float gain;
+} NoiseFbm;
+
+void noise_perlin2_batch(const float *x, const float *y, float *dest,
+                         int count);
+void noise_perlin3_batch(const float *x, const float *y, const float *z,
+                         float *dest, int count);
+
+void noise_field2(float *dest, int width, int height, vec2 origin, float step,
+                  const NoiseFbm *fbm);
+void noise_field3(float *dest, int width, int height, int depth, vec3 origin,
+                  float step, const NoiseFbm *fbm);
+
+void noise_field2_dispatch(unsigned int computeProgram, unsigned int texture,
+                           int width, int height, vec2 origin, float step,
+                           const NoiseFbm *fbm);
+
+#endif
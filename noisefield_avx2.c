@@ -0,0 +1,10 @@
+/* noisefield.c compiled again with 8 AVX2 lanes, see simd.h. */
+#define SIMD_WIDE
+#include "simd.h"
+
+#ifdef SIMD_HAS_WIDE
+#include "noisefield.c"
+#ifdef __clang__
+#pragma clang attribute pop
+#endif
+#endif
@@ -0,0 +1,224 @@
+#include "raycast.h"
+
+#include <float.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd.h"
+
+/* Same tolerance as glm_ray_triangle so both paths agree on edge cases. */
+#define RAYCAST_EPSILON 0.000001f
+
+#ifdef SIMD_DISPATCH
+/* 8-lane build of ray_packet_intersect, from raycast_avx2.c. */
+void ray_packet_intersect_avx2(const RayPacket *packet,
+                               const TriangleSoup *soup, RayHit *hits);
+#endif
+
+#ifndef SIMD_WIDE
+
+/**
+ * Builds 8-wide SoA triangle batches from an indexed triangle list. Positions
+ * are read from the first three floats of every vertex, which allows passing
+ * interleaved vertex buffers directly.
+ * Returns 0 on success and -1 if the allocation fails or triangleCount
+ * does not fit the int ids of RayHit.
+ */
+int triangle_soup_build(TriangleSoup *soup, const float *positions,
+                        size_t strideInFloats, const unsigned int *indices,
+                        size_t triangleCount) {
+  size_t batchCount =
+      (triangleCount + RAYCAST_BATCH_WIDTH - 1) / RAYCAST_BATCH_WIDTH;
+
+  soup->batches = NULL;
+  soup->batchCount = 0;
+  soup->triangleCount = 0;
+  if (batchCount == 0) {
+    return 0;
+  }
+  if (triangleCount > INT_MAX) {
+    return -1;
+  }
+
+  soup->batches = aligned_alloc(32, batchCount * sizeof(TriangleBatch));
+  if (!soup->batches) {
+    return -1;
+  }
+  memset(soup->batches, 0, batchCount * sizeof(TriangleBatch));
+
+  for (size_t i = 0; i < triangleCount; i++) {
+    TriangleBatch *batch = &soup->batches[i / RAYCAST_BATCH_WIDTH];
+    size_t lane = i % RAYCAST_BATCH_WIDTH;
+    const float *a = positions + indices[i * 3 + 0] * strideInFloats;
+    const float *b = positions + indices[i * 3 + 1] * strideInFloats;
+    const float *c = positions + indices[i * 3 + 2] * strideInFloats;
+
+    for (int axis = 0; axis < 3; axis++) {
+      batch->v0[axis][lane] = a[axis];
+      batch->e1[axis][lane] = b[axis] - a[axis];
+      batch->e2[axis][lane] = c[axis] - a[axis];
+    }
+  }
+
+  soup->batchCount = batchCount;
+  soup->triangleCount = triangleCount;
+  return 0;
+}
+
+void triangle_soup_free(TriangleSoup *soup) {
+  free(soup->batches);
+  soup->batches = NULL;
+  soup->batchCount = 0;
+  soup->triangleCount = 0;
+}
+
+void ray_packet_set(RayPacket *packet, int index, vec3 origin, vec3 direction) {
+  for (int axis = 0; axis < 3; axis++) {
+    packet->origin[axis][index] = origin[axis];
+    packet->direction[axis][index] = direction[axis];
+  }
+}
+
+#endif
+
+/**
+ * Vectorized Möller–Trumbore: each ray of the packet is broadcast and tested
+ * against SIMD_LANES triangles at once. Every lane keeps its own nearest
+ * hit, lanes are only reduced once all batches have been visited.
+ */
+void SIMD_NAME(ray_packet_intersect)(const RayPacket *packet,
+                                     const TriangleSoup *soup, RayHit *hits) {
+#ifdef SIMD_DISPATCH
+  if (simd_wide_available()) {
+    ray_packet_intersect_avx2(packet, soup, hits);
+    return;
+  }
+#endif
+  enum { CHUNKS = RAYCAST_BATCH_WIDTH / SIMD_LANES };
+  lanef bestDistance[RAYCAST_PACKET_MAX][CHUNKS];
+  lanef bestTriangle[RAYCAST_PACKET_MAX][CHUNKS];
+  const lanef zero = lanef_set1(0.0f);
+  const lanef one = lanef_set1(1.0f);
+  const lanef epsilon = lanef_set1(RAYCAST_EPSILON);
+  const lanef negEpsilon = lanef_set1(-RAYCAST_EPSILON);
+  int count = packet->count;
+
+  /* Triangle ids travel through float lanes as raw int32 bits. Lanes only
+   * ever select them, so every id survives, not just those below 2^24. */
+  float noTriangle;
+  memcpy(&noTriangle, &(int32_t){-1}, sizeof(float));
+  for (int r = 0; r < count; r++) {
+    for (int c = 0; c < CHUNKS; c++) {
+      bestDistance[r][c] = lanef_set1(FLT_MAX);
+      bestTriangle[r][c] = lanef_set1(noTriangle);
+    }
+  }
+
+  for (size_t b = 0; b < soup->batchCount; b++) {
+    const TriangleBatch *batch = &soup->batches[b];
+
+    for (int c = 0; c < CHUNKS; c++) {
+      int lane = c * SIMD_LANES;
+      lanef v0x = lanef_load(&batch->v0[0][lane]);
+      lanef v0y = lanef_load(&batch->v0[1][lane]);
+      lanef v0z = lanef_load(&batch->v0[2][lane]);
+      lanef e1x = lanef_load(&batch->e1[0][lane]);
+      lanef e1y = lanef_load(&batch->e1[1][lane]);
+      lanef e1z = lanef_load(&batch->e1[2][lane]);
+      lanef e2x = lanef_load(&batch->e2[0][lane]);
+      lanef e2y = lanef_load(&batch->e2[1][lane]);
+      lanef e2z = lanef_load(&batch->e2[2][lane]);
+
+      int32_t idBits[SIMD_LANES];
+      for (int l = 0; l < SIMD_LANES; l++) {
+        idBits[l] = (int32_t)(b * RAYCAST_BATCH_WIDTH + lane + l);
+      }
+      float ids[SIMD_LANES];
+      memcpy(ids, idBits, sizeof(ids));
+      lanef id = lanef_load(ids);
+
+      for (int r = 0; r < count; r++) {
+        lanef ox = lanef_set1(packet->origin[0][r]);
+        lanef oy = lanef_set1(packet->origin[1][r]);
+        lanef oz = lanef_set1(packet->origin[2][r]);
+        lanef dx = lanef_set1(packet->direction[0][r]);
+        lanef dy = lanef_set1(packet->direction[1][r]);
+        lanef dz = lanef_set1(packet->direction[2][r]);
+
+        /* p = direction x edge2 */
+        lanef px = lanef_sub(lanef_mul(dy, e2z), lanef_mul(dz, e2y));
+        lanef py = lanef_sub(lanef_mul(dz, e2x), lanef_mul(dx, e2z));
+        lanef pz = lanef_sub(lanef_mul(dx, e2y), lanef_mul(dy, e2x));
+
+        lanef det = lanef_add(lanef_add(lanef_mul(e1x, px), lanef_mul(e1y, py)),
+                              lanef_mul(e1z, pz));
+        lanef mask =
+            lanef_or(lanef_le(det, negEpsilon), lanef_ge(det, epsilon));
+        if (!lanef_any(mask)) {
+          continue;
+        }
+        lanef invDet = lanef_div(one, det);
+
+        lanef tx = lanef_sub(ox, v0x);
+        lanef ty = lanef_sub(oy, v0y);
+        lanef tz = lanef_sub(oz, v0z);
+
+        lanef u = lanef_mul(
+            lanef_add(lanef_add(lanef_mul(tx, px), lanef_mul(ty, py)),
+                      lanef_mul(tz, pz)),
+            invDet);
+        mask = lanef_and(mask, lanef_and(lanef_ge(u, zero), lanef_le(u, one)));
+
+        /* q = t x edge1 */
+        lanef qx = lanef_sub(lanef_mul(ty, e1z), lanef_mul(tz, e1y));
+        lanef qy = lanef_sub(lanef_mul(tz, e1x), lanef_mul(tx, e1z));
+        lanef qz = lanef_sub(lanef_mul(tx, e1y), lanef_mul(ty, e1x));
+
+        lanef v = lanef_mul(
+            lanef_add(lanef_add(lanef_mul(dx, qx), lanef_mul(dy, qy)),
+                      lanef_mul(dz, qz)),
+            invDet);
+        mask = lanef_and(mask, lanef_and(lanef_ge(v, zero),
+                                         lanef_le(lanef_add(u, v), one)));
+
+        lanef dist = lanef_mul(
+            lanef_add(lanef_add(lanef_mul(e2x, qx), lanef_mul(e2y, qy)),
+                      lanef_mul(e2z, qz)),
+            invDet);
+        mask = lanef_and(mask, lanef_and(lanef_gt(dist, epsilon),
+                                         lanef_lt(dist, bestDistance[r][c])));
+
+        bestDistance[r][c] = lanef_select(mask, dist, bestDistance[r][c]);
+        bestTriangle[r][c] = lanef_select(mask, id, bestTriangle[r][c]);
+      }
+    }
+  }
+
+  for (int r = 0; r < count; r++) {
+    float distances[RAYCAST_BATCH_WIDTH];
+    float triangleBits[RAYCAST_BATCH_WIDTH];
+    for (int c = 0; c < CHUNKS; c++) {
+      lanef_store(&distances[c * SIMD_LANES], bestDistance[r][c]);
+      lanef_store(&triangleBits[c * SIMD_LANES], bestTriangle[r][c]);
+    }
+    int32_t triangles[RAYCAST_BATCH_WIDTH];
+    memcpy(triangles, triangleBits, sizeof(triangles));
+
+    hits[r].distance = FLT_MAX;
+    hits[r].triangle = -1;
+    for (int l = 0; l < RAYCAST_BATCH_WIDTH; l++) {
+      int triangle = triangles[l];
+      if (triangle < 0) {
+        continue;
+      }
+      /* Lower triangle ids win ties, matching a linear scan. */
+      if (distances[l] < hits[r].distance ||
+          (distances[l] == hits[r].distance && triangle < hits[r].triangle)) {
+        hits[r].distance = distances[l];
+        hits[r].triangle = triangle;
+      }
+    }
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include <stddef.h>
+
+#include <cglm/types.h>
+
+#define RAYCAST_BATCH_WIDTH 8
+#define RAYCAST_PACKET_MAX 8
+
+/**
+ * Eight triangles stored as structure of arrays. Edges are precomputed so the
+ * intersection kernel only has to load them.
+ */
+typedef struct {
+  CGLM_ALIGN(32) float v0[3][RAYCAST_BATCH_WIDTH];
+  CGLM_ALIGN(32) float e1[3][RAYCAST_BATCH_WIDTH];
+  CGLM_ALIGN(32) float e2[3][RAYCAST_BATCH_WIDTH];
+} TriangleBatch;
+
+/**
+ * Triangle soup split into 8-wide batches. The last batch is padded with
+ * degenerate triangles which never report a hit.
+ */
+typedef struct {
+  TriangleBatch *batches;
+  size_t batchCount;
+  size_t triangleCount;
+} TriangleSoup;
+
+/**
+ * Up to RAYCAST_PACKET_MAX rays, typically 4 or 8, traced together so every
+ * triangle batch is loaded once per packet instead of once per ray.
+ */
+typedef struct {
+  float origin[3][RAYCAST_PACKET_MAX];
+  float direction[3][RAYCAST_PACKET_MAX];
+  int count;
+} RayPacket;
+
+/**
+ * Nearest hit of a single ray. triangle is -1 if nothing was hit.
+ */
+typedef struct {
+  float distance;
+  int triangle;
+} RayHit;
+
+int triangle_soup_build(TriangleSoup *soup, const float *positions,
+                        size_t strideInFloats, const unsigned int *indices,
+                        size_t triangleCount);
+void triangle_soup_free(TriangleSoup *soup);
+
+void ray_packet_set(RayPacket *packet, int index, vec3 origin, vec3 direction);
+void ray_packet_intersect(const RayPacket *packet, const TriangleSoup *soup,
+                          RayHit *hits);
+
+#endif
@@ -0,0 +1,233 @@
+#include "resource.h"
+
+#include <glad/gl.h>
+
+/*
+ * GL objects created and edited without binding them. GL 4.5 contexts use
+ * direct state access; older ones bind the object, edit it and restore the
+ * previous binding, so either way the caller's bound state is left alone.
+ * Buffers are edited through GL_COPY_WRITE_BUFFER in that case, as binding
+ * GL_ELEMENT_ARRAY_BUFFER would change the bound vertex array.
+ */
+
+/**
+ * Creates a buffer of size bytes holding data, which may be NULL. flags are
+ * glBufferStorage flags; GL_DYNAMIC_STORAGE_BIT allows
+ * resource_buffer_update. Returns the buffer name.
+ */
+unsigned int resource_buffer(size_t size, const void *data,
+                             unsigned int flags) {
+  unsigned int buffer;
+  if (GLAD_GL_VERSION_4_5) {
+    glCreateBuffers(1, &buffer);
+    glNamedBufferStorage(buffer, size, data, flags);
+    return buffer;
+  }
+
+  GLint previous;
+  glGetIntegerv(GL_COPY_WRITE_BUFFER_BINDING, &previous);
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferData(GL_COPY_WRITE_BUFFER, size, data,
+               flags & GL_DYNAMIC_STORAGE_BIT ? GL_DYNAMIC_DRAW
+                                              : GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, previous);
+  return buffer;
+}
+
+/**
+ * Replaces size bytes of buffer at offset with data.
+ */
+void resource_buffer_update(unsigned int buffer, size_t offset, size_t size,
+                            const void *data) {
+  if (GLAD_GL_VERSION_4_5) {
+    glNamedBufferSubData(buffer, offset, size, data);
+    return;
+  }
+
+  GLint previous;
+  glGetIntegerv(GL_COPY_WRITE_BUFFER_BINDING, &previous);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, previous);
+}
+
+/**
+ * Allocates levels mip levels of the texture bound to target, immutably
+ * where GL 4.2 allows it. Before that every level is specified in turn,
+ * which works for color formats. layers is 0 for 2D textures.
+ */
+static void allocate_levels(GLenum target, int width, int height, int layers,
+                            int levels, GLenum internalFormat) {
+  if (GLAD_GL_VERSION_4_2) {
+    if (layers) {
+      glTexStorage3D(target, levels, internalFormat, width, height, layers);
+    } else {
+      glTexStorage2D(target, levels, internalFormat, width, height);
+    }
+    return;
+  }
+  for (int level = 0; level < levels; level++) {
+    int levelWidth = width >> level > 0 ? width >> level : 1;
+    int levelHeight = height >> level > 0 ? height >> level : 1;
+    if (layers) {
+      glTexImage3D(target, level, internalFormat, levelWidth, levelHeight,
+                   layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    } else {
+      glTexImage2D(target, level, internalFormat, levelWidth, levelHeight, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+  }
+  glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+}
+
+/**
+ * Creates a 2D texture with immutable storage for levels mip levels of
+ * internalFormat. It repeats and filters linearly, between mip levels too
+ * when it has more than one. Returns the texture name.
+ */
+unsigned int resource_texture_2d(int width, int height, int levels,
+                                 unsigned int internalFormat) {
+  unsigned int texture;
+  GLint minFilter = levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+  if (GLAD_GL_VERSION_4_5) {
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    glTextureStorage2D(texture, levels, internalFormat, width, height);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+  }
+
+  GLint previous;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  allocate_levels(GL_TEXTURE_2D, width, height, 0, levels, internalFormat);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, previous);
+  return texture;
+}
+
+/**
+ * resource_texture_2d for a 2D array texture of layers layers.
+ */
+unsigned int resource_texture_array(int width, int height, int layers,
+                                    int levels, unsigned int internalFormat) {
+  unsigned int texture;
+  GLint minFilter = levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+  if (GLAD_GL_VERSION_4_5) {
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+    glTextureStorage3D(texture, levels, internalFormat, width, height,
+                       layers);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+  }
+
+  GLint previous;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &previous);
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  allocate_levels(GL_TEXTURE_2D_ARRAY, width, height, layers, levels,
+                  internalFormat);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, minFilter);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, previous);
+  return texture;
+}
+
+void resource_texture_parameter(unsigned int texture, unsigned int name,
+                                int value) {
+  if (GLAD_GL_VERSION_4_5) {
+    glTextureParameteri(texture, name, value);
+    return;
+  }
+
+  GLint previous;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, name, value);
+  glBindTexture(GL_TEXTURE_2D, previous);
+}
+
+/**
+ * Writes a width x height region at x, y of a level of the 2D texture.
+ * Rows of pixels are read with the current unpack state.
+ */
+void resource_texture_upload(unsigned int texture, int level, int x, int y,
+                             int width, int height, unsigned int format,
+                             unsigned int type, const void *pixels) {
+  if (GLAD_GL_VERSION_4_5) {
+    glTextureSubImage2D(texture, level, x, y, width, height, format, type,
+                        pixels);
+    return;
+  }
+
+  GLint previous;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, format, type,
+                  pixels);
+  glBindTexture(GL_TEXTURE_2D, previous);
+}
+
+/**
+ * Fills the mip levels of the 2D texture below level 0 from level 0.
+ */
+void resource_texture_mipmaps(unsigned int texture) {
+  if (GLAD_GL_VERSION_4_5) {
+    glGenerateTextureMipmap(texture);
+    return;
+  }
+
+  GLint previous;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, previous);
+}
+
+/**
+ * Creates a vertex array reading interleaved vertices of stride bytes from
+ * vertexBuffer and indices from elementBuffer, which may be 0. Returns the
+ * vertex array name.
+ */
+unsigned int resource_vertex_array(unsigned int vertexBuffer, int stride,
+                                   const VertexAttrib *attribs,
+                                   int attribCount,
+                                   unsigned int elementBuffer) {
+  unsigned int vertexArray;
+  if (GLAD_GL_VERSION_4_5) {
+    glCreateVertexArrays(1, &vertexArray);
+    glVertexArrayVertexBuffer(vertexArray, 0, vertexBuffer, 0, stride);
+    for (int i = 0; i < attribCount; i++) {
+      const VertexAttrib *attrib = &attribs[i];
+      glEnableVertexArrayAttrib(vertexArray, attrib->index);
+      glVertexArrayAttribFormat(vertexArray, attrib->index, attrib->size,
+                                attrib->type, attrib->normalized,
+                                attrib->offset);
+      glVertexArrayAttribBinding(vertexArray, attrib->index, 0);
+    }
+    glVertexArrayElementBuffer(vertexArray, elementBuffer);
+    return vertexArray;
+  }
+
+  GLint previousArray, previousBuffer;
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousArray);
+  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previousBuffer);
+  glGenVertexArrays(1, &vertexArray);
+  glBindVertexArray(vertexArray);
+  glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+  for (int i = 0; i < attribCount; i++) {
+    const VertexAttrib *attrib = &attribs[i];
+    glVertexAttribPointer(attrib->index, attrib->size, attrib->type,
+                          attrib->normalized, stride,
+                          (void *)(size_t)attrib->offset);
+    glEnableVertexAttribArray(attrib->index);
+  }
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+  glBindVertexArray(previousArray);
+  glBindBuffer(GL_ARRAY_BUFFER, previousBuffer);
+  return vertexArray;
+}
@@ -0,0 +1,39 @@
+#ifndef RESOURCE_H
+#define RESOURCE_H
+
+#include <stddef.h>
+
+/**
+ * One attribute of an interleaved vertex: location index reads size
+ * components of type at offset bytes into each vertex.
+ */
+typedef struct {
+  unsigned int index;
+  int size;
+  unsigned int type;
+  int normalized;
+  unsigned int offset;
+} VertexAttrib;
+
+unsigned int resource_buffer(size_t size, const void *data,
+                             unsigned int flags);
+void resource_buffer_update(unsigned int buffer, size_t offset, size_t size,
+                            const void *data);
+
+unsigned int resource_texture_2d(int width, int height, int levels,
+                                 unsigned int internalFormat);
+unsigned int resource_texture_array(int width, int height, int layers,
+                                    int levels, unsigned int internalFormat);
+void resource_texture_parameter(unsigned int texture, unsigned int name,
+                                int value);
+void resource_texture_upload(unsigned int texture, int level, int x, int y,
+                             int width, int height, unsigned int format,
+                             unsigned int type, const void *pixels);
+void resource_texture_mipmaps(unsigned int texture);
+
+unsigned int resource_vertex_array(unsigned int vertexBuffer, int stride,
+                                   const VertexAttrib *attribs,
+                                   int attribCount,
+                                   unsigned int elementBuffer);
+
+#endif
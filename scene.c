@@ -0,0 +1,275 @@
+#include "scene.h"
+
+#include <cglm/cglm.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobs.h"
+
+/* Nodes per parallel chunk, large enough to amortize the scheduling cost. */
+#define SCENE_GRAIN 2048
+
+/**
+ * Allocates memory suitably aligned for the SIMD paths of cglm.
+ */
+static void *alloc_aligned(size_t size) {
+  size = (size + 31) & ~(size_t)31;
+  return aligned_alloc(32, size ? size : 32);
+}
+
+static int reserve(Scene *scene, int capacity) {
+  Scene grown = *scene;
+
+  grown.position = alloc_aligned(capacity * sizeof(vec3));
+  grown.rotation = alloc_aligned(capacity * sizeof(versor));
+  grown.scale = alloc_aligned(capacity * sizeof(vec3));
+  grown.world = alloc_aligned(capacity * sizeof(mat4));
+  grown.parent = malloc(capacity * sizeof(int));
+  grown.depth = malloc(capacity * sizeof(int));
+  grown.dirty = malloc(capacity);
+  grown.changed = malloc(capacity);
+  grown.handleToIndex = malloc(capacity * sizeof(int));
+  grown.indexToHandle = malloc(capacity * sizeof(int));
+  grown.capacity = capacity;
+
+  if (!grown.position || !grown.rotation || !grown.scale || !grown.world ||
+      !grown.parent || !grown.depth || !grown.dirty || !grown.changed ||
+      !grown.handleToIndex || !grown.indexToHandle) {
+    grown.levelStart = NULL;
+    scene_free(&grown);
+    return -1;
+  }
+
+  if (scene->count > 0) {
+    int n = scene->count;
+    memcpy(grown.position, scene->position, n * sizeof(vec3));
+    memcpy(grown.rotation, scene->rotation, n * sizeof(versor));
+    memcpy(grown.scale, scene->scale, n * sizeof(vec3));
+    memcpy(grown.world, scene->world, n * sizeof(mat4));
+    memcpy(grown.parent, scene->parent, n * sizeof(int));
+    memcpy(grown.depth, scene->depth, n * sizeof(int));
+    memcpy(grown.dirty, scene->dirty, n);
+    memcpy(grown.changed, scene->changed, n);
+    memcpy(grown.handleToIndex, scene->handleToIndex, n * sizeof(int));
+    memcpy(grown.indexToHandle, scene->indexToHandle, n * sizeof(int));
+  }
+
+  int *levelStart = scene->levelStart;
+  scene->levelStart = NULL;
+  scene_free(scene);
+  *scene = grown;
+  scene->levelStart = levelStart;
+  return 0;
+}
+
+/**
+ * Initializes an empty scene with room for capacity nodes.
+ * Returns 0 on success and -1 if an allocation fails.
+ */
+int scene_init(Scene *scene, int capacity) {
+  memset(scene, 0, sizeof(*scene));
+  return reserve(scene, capacity > 0 ? capacity : 16);
+}
+
+void scene_free(Scene *scene) {
+  free(scene->position);
+  free(scene->rotation);
+  free(scene->scale);
+  free(scene->world);
+  free(scene->parent);
+  free(scene->depth);
+  free(scene->dirty);
+  free(scene->changed);
+  free(scene->handleToIndex);
+  free(scene->indexToHandle);
+  free(scene->levelStart);
+  memset(scene, 0, sizeof(*scene));
+}
+
+/**
+ * Adds a node with an identity transform below parentHandle, or as a root if
+ * parentHandle is -1. Returns the handle of the new node or -1 on failure.
+ */
+int scene_add_node(Scene *scene, int parentHandle) {
+  if (scene->count == scene->capacity &&
+      reserve(scene, scene->capacity * 2) != 0) {
+    return -1;
+  }
+
+  int handle = scene->count++;
+  int index = handle;
+  int parent = parentHandle >= 0 ? scene->handleToIndex[parentHandle] : -1;
+
+  glm_vec3_zero(scene->position[index]);
+  glm_quat_identity(scene->rotation[index]);
+  glm_vec3_one(scene->scale[index]);
+  glm_mat4_identity(scene->world[index]);
+  scene->parent[index] = parent;
+  scene->depth[index] = parent >= 0 ? scene->depth[parent] + 1 : 0;
+  scene->dirty[index] = 1;
+  scene->changed[index] = 0;
+  scene->handleToIndex[handle] = index;
+  scene->indexToHandle[index] = handle;
+  scene->needsSort = 1;
+  return handle;
+}
+
+void scene_set_position(Scene *scene, int handle, vec3 position) {
+  int index = scene->handleToIndex[handle];
+  glm_vec3_copy(position, scene->position[index]);
+  scene->dirty[index] = 1;
+}
+
+void scene_set_rotation(Scene *scene, int handle, versor rotation) {
+  int index = scene->handleToIndex[handle];
+  glm_quat_copy(rotation, scene->rotation[index]);
+  scene->dirty[index] = 1;
+}
+
+void scene_set_scale(Scene *scene, int handle, vec3 scale) {
+  int index = scene->handleToIndex[handle];
+  glm_vec3_copy(scale, scene->scale[index]);
+  scene->dirty[index] = 1;
+}
+
+/**
+ * Returns the world matrix of a node as computed by the last scene_update.
+ */
+vec4 *scene_world(const Scene *scene, int handle) {
+  return scene->world[scene->handleToIndex[handle]];
+}
+
+/**
+ * Moves element i of array to position newIndex[i].
+ */
+static void permute(void *array, void *scratch, size_t size,
+                    const int *newIndex, int count) {
+  for (int i = 0; i < count; i++) {
+    memcpy((char *)scratch + newIndex[i] * size, (char *)array + i * size,
+           size);
+  }
+  memcpy(array, scratch, count * size);
+}
+
+/**
+ * Stable counting sort of all nodes by depth. Only runs after the topology
+ * changed, so the per-frame update can walk the levels front to back.
+ */
+static int sort_by_depth(Scene *scene) {
+  int count = scene->count;
+  int levels = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (scene->depth[i] + 1 > levels) {
+      levels = scene->depth[i] + 1;
+    }
+  }
+
+  int *levelStart = calloc(levels + 1, sizeof(int));
+  int *newIndex = malloc(count * sizeof(int));
+  void *scratch = alloc_aligned(count * sizeof(mat4));
+  if (!levelStart || !newIndex || !scratch) {
+    free(levelStart);
+    free(newIndex);
+    free(scratch);
+    return -1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    levelStart[scene->depth[i] + 1]++;
+  }
+  for (int l = 0; l < levels; l++) {
+    levelStart[l + 1] += levelStart[l];
+  }
+
+  /* Uses the level array as fill cursors, then shifts it back into place. */
+  for (int i = 0; i < count; i++) {
+    newIndex[i] = levelStart[scene->depth[i]]++;
+  }
+  memmove(levelStart + 1, levelStart, levels * sizeof(int));
+  levelStart[0] = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (scene->parent[i] >= 0) {
+      scene->parent[i] = newIndex[scene->parent[i]];
+    }
+  }
+
+  permute(scene->position, scratch, sizeof(vec3), newIndex, count);
+  permute(scene->rotation, scratch, sizeof(versor), newIndex, count);
+  permute(scene->scale, scratch, sizeof(vec3), newIndex, count);
+  permute(scene->world, scratch, sizeof(mat4), newIndex, count);
+  permute(scene->parent, scratch, sizeof(int), newIndex, count);
+  permute(scene->depth, scratch, sizeof(int), newIndex, count);
+  permute(scene->dirty, scratch, 1, newIndex, count);
+  permute(scene->changed, scratch, 1, newIndex, count);
+  permute(scene->indexToHandle, scratch, sizeof(int), newIndex, count);
+  for (int i = 0; i < count; i++) {
+    scene->handleToIndex[scene->indexToHandle[i]] = i;
+  }
+
+  free(newIndex);
+  free(scratch);
+  free(scene->levelStart);
+  scene->levelStart = levelStart;
+  scene->levelCount = levels;
+  scene->needsSort = 0;
+  return 0;
+}
+
+typedef struct {
+  Scene *scene;
+  int offset;
+} LevelJob;
+
+/**
+ * Recomputes the world matrix of every node in the range whose local
+ * transform or parent changed. Parents belong to the previous level and are
+ * therefore already final.
+ */
+static void update_range(void *context, int begin, int end) {
+  LevelJob *job = context;
+  Scene *scene = job->scene;
+
+  for (int i = job->offset + begin; i < job->offset + end; i++) {
+    int parent = scene->parent[i];
+    if (!scene->dirty[i] && (parent < 0 || !scene->changed[parent])) {
+      scene->changed[i] = 0;
+      continue;
+    }
+
+    CGLM_ALIGN_MAT mat4 local;
+    glm_quat_mat4(scene->rotation[i], local);
+    glm_vec4_scale(local[0], scene->scale[i][0], local[0]);
+    glm_vec4_scale(local[1], scene->scale[i][1], local[1]);
+    glm_vec4_scale(local[2], scene->scale[i][2], local[2]);
+    glm_vec4(scene->position[i], 1.0f, local[3]);
+
+    if (parent >= 0) {
+      glm_mat4_mul(scene->world[parent], local, scene->world[i]);
+    } else {
+      glm_mat4_copy(local, scene->world[i]);
+    }
+    scene->dirty[i] = 0;
+    scene->changed[i] = 1;
+  }
+}
+
+/**
+ * Brings all world matrices up to date. Levels are processed in order and the
+ * nodes of each level are split across the job threads.
+ * Returns 0 on success and -1 if sorting the nodes by depth cannot allocate,
+ * in which case no world matrix is updated.
+ */
+int scene_update(Scene *scene) {
+  if (scene->needsSort && sort_by_depth(scene) != 0) {
+    return -1;
+  }
+
+  for (int l = 0; l < scene->levelCount; l++) {
+    LevelJob job = {scene, scene->levelStart[l]};
+    int count = scene->levelStart[l + 1] - scene->levelStart[l];
+    jobs_parallel_for(count, SCENE_GRAIN, update_range, &job);
+  }
+  return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cglm/types.h>
+
+/**
+ * Transform hierarchy stored as structure of arrays sorted by depth, so that
+ * world matrices can be computed one level at a time with every parent
+ * finished before its children.
+ *
+ * Nodes are addressed through stable handles; the internal index of a node
+ * changes whenever the arrays are re-sorted.
+ */
+typedef struct {
+  int count;
+  int capacity;
+
+  vec3 *position;
+  versor *rotation;
+  vec3 *scale;
+  mat4 *world;
+  int *parent;
+  int *depth;
+  unsigned char *dirty;
+  unsigned char *changed;
+
+  int *handleToIndex;
+  int *indexToHandle;
+
+  int *levelStart;
+  int levelCount;
+  int needsSort;
+} Scene;
+
+int scene_init(Scene *scene, int capacity);
+void scene_free(Scene *scene);
+
+int scene_add_node(Scene *scene, int parentHandle);
+
+void scene_set_position(Scene *scene, int handle, vec3 position);
+void scene_set_rotation(Scene *scene, int handle, versor rotation);
+void scene_set_scale(Scene *scene, int handle, vec3 scale);
+
+int scene_update(Scene *scene);
+vec4 *scene_world(const Scene *scene, int handle);
+
+#endif
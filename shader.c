@@ -1,15 +1,25 @@
 #include "shader.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <glad/gl.h>
 
+/* First word of every SPIR-V module, in the byte order of the module. */
+#define SPIRV_MAGIC 0x07230203u
+/* Magic, version, generator, ID bound and schema precede the instructions. */
+#define SPIRV_HEADER_WORDS 5
+/* OpDecorate and its SpecId decoration, which assigns constant IDs. */
+#define SPIRV_OP_DECORATE 71
+#define SPIRV_DECORATION_SPEC_ID 1
+
 /**
- * Reads the entire contents of a file into a dynamically allocated string.
+ * Reads the entire contents of a file into a dynamically allocated buffer
+ * with a terminating zero byte, and stores its length in size.
  */
-char *read_file_to_string(const char *file_path) {
+static char *read_file(const char *file_path, long *size_out) {
   FILE *file = fopen(file_path, "rb");
   if (!file) {
     printf("Failed to open file: %s\n", file_path);
@@ -43,13 +53,23 @@ char *read_file_to_string(const char *file_path) {
     return NULL;
   }
 
+  *size_out = size;
   return buffer;
 }
 
+/**
+ * Reads the entire contents of a file into a dynamically allocated string.
+ */
+char *read_file_to_string(const char *file_path) {
+  long size;
+  return read_file(file_path, &size);
+}
+
 /**
  * Checks for shader compilation and linking errors.
+ * Returns 1 if the shader compiled or the program linked, 0 otherwise.
  */
-void check_compile_errors(unsigned int shader, char *type) {
+int check_compile_errors(unsigned int shader, char *type) {
   int success;
   char infoLog[1024];
   if (strcmp("PROGRAM", type) != 0) {
@@ -71,6 +91,7 @@ void check_compile_errors(unsigned int shader, char *type) {
               type, infoLog);
     }
   }
+  return success;
 }
 
 /**
@@ -115,3 +136,198 @@ unsigned int generateShader(const char *vertexShaderPath,
 
   return shaderProgramId;
 }
+
+static int is_spirv(const char *data, long size) {
+  uint32_t magic;
+  if (size < SPIRV_HEADER_WORDS * 4 || size % 4 != 0) {
+    return 0;
+  }
+  memcpy(&magic, data, sizeof(magic));
+  return magic == SPIRV_MAGIC;
+}
+
+/**
+ * Copies the constants whose ID the SPIR-V module declares with a SpecId
+ * decoration into ids and values, and returns how many there are.
+ * glSpecializeShader fails for IDs a module does not declare, so stages that
+ * share one list of constants each get their own part of it.
+ */
+static int spirv_filter_constants(const char *binary, long size,
+                                  const unsigned int *constantIds,
+                                  const unsigned int *constantValues,
+                                  int constantCount, unsigned int *ids,
+                                  unsigned int *values) {
+  long wordCount = size / 4;
+  long i = SPIRV_HEADER_WORDS;
+  int count = 0;
+
+  while (i < wordCount) {
+    uint32_t word[4];
+    memcpy(word, binary + i * 4, sizeof(uint32_t));
+    uint32_t length = word[0] >> 16;
+    if (length == 0 || length > wordCount - i) {
+      break;
+    }
+    if ((word[0] & 0xffff) != SPIRV_OP_DECORATE || length < 4) {
+      i += length;
+      continue;
+    }
+    /* OpDecorate target, decoration, constant ID. */
+    memcpy(word, binary + i * 4, sizeof(word));
+    for (int c = 0; c < constantCount; c++) {
+      if (word[2] == SPIRV_DECORATION_SPEC_ID && constantIds[c] == word[3]) {
+        ids[count] = constantIds[c];
+        values[count++] = constantValues[c];
+        break;
+      }
+    }
+    i += length;
+  }
+  return count;
+}
+
+/**
+ * Reads the file at path if it holds a SPIR-V module for OpenGL, e.g. from
+ * glslangValidator -G, telling it apart from GLSL source by the magic
+ * number, and stores its length in size. Returns NULL for anything else,
+ * including files that cannot be opened, without reporting it, so callers
+ * fall back to their GLSL path.
+ */
+char *read_spirv_file(const char *file_path, long *size) {
+  FILE *file = fopen(file_path, "rb");
+  if (!file) {
+    return NULL;
+  }
+  uint32_t magic = 0;
+  size_t read_size = fread(&magic, 1, sizeof(magic), file);
+  fclose(file);
+  if (read_size != sizeof(magic) || magic != SPIRV_MAGIC) {
+    return NULL;
+  }
+
+  char *binary = read_file(file_path, size);
+  if (binary && !is_spirv(binary, *size)) {
+    free(binary);
+    return NULL;
+  }
+  return binary;
+}
+
+/**
+ * Creates a shader from the SPIR-V module binary read from path and
+ * specializes its main entry point, which takes the place of compiling.
+ * constantIds and constantValues set its specialization constants, with
+ * floats passed by their bit pattern; only those the module declares are
+ * passed on, so several stages can share one list. Returns the shader, or 0
+ * on failure.
+ *
+ * Experimental: no SPIR-V module ships with this tree yet, so this has only
+ * been exercised up to the OpenGL 4.6 check.
+ */
+unsigned int specializeShader(unsigned int stage, const char *binary,
+                              long size, const char *path,
+                              const unsigned int *constantIds,
+                              const unsigned int *constantValues,
+                              int constantCount) {
+  if (!GLAD_GL_VERSION_4_6) {
+    fprintf(stderr, "SPIR-V shaders need OpenGL 4.6: %s\n", path);
+    return 0;
+  }
+
+  unsigned int *ids = malloc((constantCount + 1) * sizeof(unsigned int));
+  unsigned int *values = malloc((constantCount + 1) * sizeof(unsigned int));
+  if (!ids || !values) {
+    free(ids);
+    free(values);
+    return 0;
+  }
+  int count = spirv_filter_constants(binary, size, constantIds, constantValues,
+                                     constantCount, ids, values);
+
+  unsigned int shader = glCreateShader(stage);
+  glShaderBinary(1, &shader, GL_SHADER_BINARY_FORMAT_SPIR_V, binary,
+                 (GLsizei)size);
+  glSpecializeShader(shader, "main", count, ids, values);
+  free(ids);
+  free(values);
+  if (!check_compile_errors(shader, "SPIR-V")) {
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+/**
+ * Creates a shader from the file at path, which holds either GLSL source or
+ * a SPIR-V module, told apart by the SPIR-V magic number. The
+ * specialization constants only apply to SPIR-V.
+ */
+static unsigned int compile_stage(GLenum stage, const char *path, char *type,
+                                  const unsigned int *constantIds,
+                                  const unsigned int *constantValues,
+                                  int constantCount) {
+  long size;
+  char *source = read_file(path, &size);
+  if (source == NULL) {
+    return 0;
+  }
+  if (is_spirv(source, size)) {
+    unsigned int shader = specializeShader(
+        stage, source, size, path, constantIds, constantValues, constantCount);
+    free(source);
+    return shader;
+  }
+
+  unsigned int shader = glCreateShader(stage);
+  glShaderSource(shader, 1, (const char **)&source, NULL);
+  glCompileShader(shader);
+  free(source);
+  if (!check_compile_errors(shader, type)) {
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+/**
+ * Builds a program from a compute shader file holding GLSL source or a
+ * SPIR-V module, see specializeShader for the constants, which only apply
+ * to SPIR-V. Returns the shader program ID, or 0 on failure.
+ */
+unsigned int buildSpecializedComputeShader(const char *computeShaderPath,
+                                           const unsigned int *constantIds,
+                                           const unsigned int *constantValues,
+                                           int constantCount) {
+  unsigned int compute =
+      compile_stage(GL_COMPUTE_SHADER, computeShaderPath, "COMPUTE",
+                    constantIds, constantValues, constantCount);
+  if (!compute) {
+    return 0;
+  }
+
+  unsigned int shaderProgramId = glCreateProgram();
+  glAttachShader(shaderProgramId, compute);
+  glLinkProgram(shaderProgramId);
+  glDeleteShader(compute);
+  if (!check_compile_errors(shaderProgramId, "PROGRAM")) {
+    glDeleteProgram(shaderProgramId);
+    return 0;
+  }
+  return shaderProgramId;
+}
+
+/**
+ * Creates a program pipeline running the separable programs vertexProgram
+ * and fragmentProgram, which are combined when the pipeline is bound with
+ * glBindProgramPipeline instead of being linked together. Uniforms are set
+ * with glProgramUniform* on the stage program that declares them.
+ * Returns the pipeline ID.
+ */
+unsigned int buildPipeline(unsigned int vertexProgram,
+                           unsigned int fragmentProgram) {
+  unsigned int pipeline;
+  glGenProgramPipelines(1, &pipeline);
+  glUseProgramStages(pipeline, GL_VERTEX_SHADER_BIT, vertexProgram);
+  glUseProgramStages(pipeline, GL_FRAGMENT_SHADER_BIT, fragmentProgram);
+  return pipeline;
+}
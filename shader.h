@@ -1,7 +1,22 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+char *read_file_to_string(const char *file_path);
+char *read_spirv_file(const char *file_path, long *size);
+int check_compile_errors(unsigned int shader, char *type);
+
 unsigned int generateShader(const char *vertexShaderPath,
                             const char *fragmentShaderPath);
+unsigned int specializeShader(unsigned int stage, const char *binary,
+                              long size, const char *path,
+                              const unsigned int *constantIds,
+                              const unsigned int *constantValues,
+                              int constantCount);
+unsigned int buildSpecializedComputeShader(const char *computeShaderPath,
+                                           const unsigned int *constantIds,
+                                           const unsigned int *constantValues,
+                                           int constantCount);
+unsigned int buildPipeline(unsigned int vertexProgram,
+                           unsigned int fragmentProgram);
 
 #endif
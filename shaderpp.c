@@ -0,0 +1,728 @@
+#include "shaderpp.h"
+
+#include <glad/gl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shader.h"
+
+#define SHADERPP_MAX_DEPTH 16
+/* SPIR-V modules have no preprocessor. They take their specialization
+ * constants from the defines SPEC_<constant ID>=<value> instead. */
+#define SHADERPP_SPEC_PREFIX "SPEC_"
+
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+} Text;
+
+/**
+ * Open addressing hash table from 64-bit keys to GL object names. Key 0
+ * marks an empty slot; value 0 records a variant that failed to build, so
+ * it is not compiled again until its source changes.
+ */
+typedef struct {
+  uint64_t key;
+  unsigned int value;
+} CacheSlot;
+
+typedef struct {
+  CacheSlot *slots;
+  size_t count;
+  size_t capacity;
+} Cache;
+
+/* Stages are keyed by type and preprocessed source, programs and pipelines
+ * by the names of their stages. Separable stages are programs of their own,
+ * so they are cached apart from the shader objects linked into programs. */
+static Cache stageCache = {NULL, 0, 0};
+static Cache separableCache = {NULL, 0, 0};
+static Cache programCache = {NULL, 0, 0};
+static Cache pipelineCache = {NULL, 0, 0};
+static ShaderppStats stats = {0, 0, 0, 0, 0, 0};
+
+static uint64_t hash_text(const char *text) {
+  uint64_t hash = 14695981039346656037ull;
+  for (; *text; text++) {
+    hash ^= (unsigned char)*text;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const char *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static int text_append(Text *text, const char *data, size_t length) {
+  if (text->length + length + 1 > text->capacity) {
+    size_t capacity = text->capacity ? text->capacity : 1024;
+    while (text->length + length + 1 > capacity) {
+      capacity *= 2;
+    }
+    char *grown = realloc(text->data, capacity);
+    if (!grown) {
+      return -1;
+    }
+    text->data = grown;
+    text->capacity = capacity;
+  }
+  memcpy(text->data + text->length, data, length);
+  text->length += length;
+  text->data[text->length] = '\0';
+  return 0;
+}
+
+static int text_printf(Text *text, const char *format, ...) {
+  char line[1024];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (length < 0 || (size_t)length >= sizeof(line)) {
+    return -1;
+  }
+  return text_append(text, line, length);
+}
+
+static const char *skip_blanks(const char *p) {
+  while (*p == ' ' || *p == '\t') {
+    p++;
+  }
+  return p;
+}
+
+/**
+ * Returns whether p starts with the directive word followed by a blank or
+ * the end of the line.
+ */
+static int is_directive(const char *p, const char *word) {
+  size_t length = strlen(word);
+  return strncmp(p, word, length) == 0 &&
+         (p[length] == ' ' || p[length] == '\t' || p[length] == '\r' ||
+          p[length] == '\n' || p[length] == '\0');
+}
+
+/**
+ * Appends the file at path to out, replacing #include directives by the
+ * files they name, relative to the including file. Each file is included
+ * once, as if it had #pragma once, which also stops include cycles.
+ * versionEnd is set to the end of the top-level #version line in out and
+ * versionLine to the line that follows it.
+ * Returns 0 on success and -1 on failure.
+ */
+static int expand(const char *path, int depth, ShaderppFiles *files,
+                  Text *out, size_t *versionEnd, int *versionLine) {
+  char *resolved = realpath(path, NULL);
+  if (!resolved) {
+    fprintf(stderr, "Failed to open file: %s\n", path);
+    return -1;
+  }
+  for (int i = 0; i < files->count; i++) {
+    if (strcmp(files->paths[i], resolved) == 0) {
+      free(resolved);
+      return 0;
+    }
+  }
+  if (files->count == SHADERPP_MAX_FILES || depth > SHADERPP_MAX_DEPTH) {
+    fprintf(stderr, "Too many nested includes in %s\n", path);
+    free(resolved);
+    return -1;
+  }
+  int index = files->count++;
+  files->paths[index] = resolved;
+
+  char *source = read_file_to_string(path);
+  if (!source) {
+    return -1;
+  }
+  if (depth > 0 && text_printf(out, "#line 1 %d\n", index) != 0) {
+    free(source);
+    return -1;
+  }
+
+  int result = 0;
+  int lineNumber = 1;
+  for (const char *line = source; *line && result == 0; lineNumber++) {
+    const char *end = strchr(line, '\n');
+    const char *next = end ? end + 1 : line + strlen(line);
+    const char *p = skip_blanks(line);
+    int directive = *p == '#';
+    if (directive) {
+      p = skip_blanks(p + 1);
+    }
+
+    if (directive && is_directive(p, "include")) {
+      p = skip_blanks(p + strlen("include"));
+      char close = *p == '<' ? '>' : '"';
+      const char *name = p + 1;
+      const char *nameEnd = strchr(name, close);
+      if ((*p != '"' && *p != '<') || !nameEnd || (end && nameEnd > end)) {
+        fprintf(stderr, "%s:%d: malformed #include\n", path, lineNumber);
+        result = -1;
+        break;
+      }
+      const char *slash = strrchr(path, '/');
+      int directoryLength = slash ? (int)(slash - path) + 1 : 0;
+      char includePath[1024];
+      snprintf(includePath, sizeof(includePath), "%.*s%.*s", directoryLength,
+               path, (int)(nameEnd - name), name);
+      result = expand(includePath, depth + 1, files, out, versionEnd,
+                      versionLine);
+      if (result == 0) {
+        result = text_printf(out, "#line %d %d\n", lineNumber + 1, index);
+      }
+    } else if (directive && is_directive(p, "pragma") &&
+               is_directive(skip_blanks(p + strlen("pragma")), "once")) {
+      result = text_append(out, "\n", 1);
+    } else {
+      result = text_append(out, line, next - line);
+      if (result == 0 && !end) {
+        result = text_append(out, "\n", 1);
+      }
+      if (directive && depth == 0 && *versionEnd == 0 &&
+          is_directive(p, "version")) {
+        *versionEnd = out->length;
+        *versionLine = lineNumber + 1;
+      }
+    }
+    line = next;
+  }
+  free(source);
+  return result;
+}
+
+static int compare_defines(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static int is_identifier(char c) {
+  return c == '_' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+         (c >= 'A' && c <= 'Z');
+}
+
+/**
+ * Returns whether the identifier name occurs in text. Mentions in comments
+ * count too, which only costs some sharing between variants.
+ */
+static int mentions(const char *text, const char *name, size_t length) {
+  for (const char *p = strstr(text, name); p; p = strstr(p + 1, name)) {
+    if ((p == text || !is_identifier(p[-1])) && !is_identifier(p[length])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Expands the includes of the shader at path and injects defines after its
+ * #version line. defines are NAME or NAME=VALUE. Only the defines the
+ * shader mentions are injected, in sorted order, so the result depends on
+ * nothing but the code it compiles: stages that ignore a define come out
+ * the same with and without it.
+ */
+static char *preprocess(const char *path, const char *const *defines,
+                        int defineCount, ShaderppFiles *files) {
+  Text body = {NULL, 0, 0};
+  size_t versionEnd = 0;
+  int versionLine = 1;
+  if (expand(path, 0, files, &body, &versionEnd, &versionLine) != 0 ||
+      text_append(&body, "", 0) != 0) {
+    free(body.data);
+    return NULL;
+  }
+
+  const char **sorted = malloc((defineCount + 1) * sizeof(char *));
+  if (!sorted) {
+    free(body.data);
+    return NULL;
+  }
+  if (defineCount > 0) {
+    memcpy(sorted, defines, defineCount * sizeof(char *));
+  }
+  qsort(sorted, defineCount, sizeof(char *), compare_defines);
+
+  Text out = {NULL, 0, 0};
+  int result = text_append(&out, body.data, versionEnd);
+  int injected = 0;
+  for (int i = 0; i < defineCount && result == 0; i++) {
+    if (i > 0 && strcmp(sorted[i], sorted[i - 1]) == 0) {
+      continue;
+    }
+    const char *value = strchr(sorted[i], '=');
+    int nameLength = value ? (int)(value - sorted[i]) : (int)strlen(sorted[i]);
+    char name[256];
+    snprintf(name, sizeof(name), "%.*s", nameLength, sorted[i]);
+    if (!mentions(body.data + versionEnd, name, nameLength)) {
+      continue;
+    }
+    result = value ? text_printf(&out, "#define %s %s\n", name, value + 1)
+                   : text_printf(&out, "#define %s\n", name);
+    injected++;
+  }
+  if (result == 0 && injected) {
+    result = text_printf(&out, "#line %d 0\n", versionLine);
+  }
+  if (result == 0) {
+    result = text_append(&out, body.data + versionEnd,
+                         body.length - versionEnd);
+  }
+  free(sorted);
+  free(body.data);
+  if (result != 0) {
+    free(out.data);
+    return NULL;
+  }
+  return out.data;
+}
+
+/**
+ * Releases the paths in files and empties it.
+ */
+void shaderpp_files_free(ShaderppFiles *files) {
+  for (int i = 0; i < files->count; i++) {
+    free(files->paths[i]);
+  }
+  files->count = 0;
+}
+
+/**
+ * Returns the source of the shader at path with its includes expanded and
+ * defines injected, to be released with free. Returns NULL on failure.
+ */
+char *shaderpp_preprocess(const char *path, const char *const *defines,
+                          int defineCount) {
+  ShaderppFiles files = {{NULL}, 0};
+  char *source = preprocess(path, defines, defineCount, &files);
+  shaderpp_files_free(&files);
+  return source;
+}
+
+static CacheSlot *cache_find(const Cache *cache, uint64_t key) {
+  if (!cache->capacity) {
+    return NULL;
+  }
+  size_t mask = cache->capacity - 1;
+  for (size_t i = key & mask;; i = (i + 1) & mask) {
+    if (cache->slots[i].key == key) {
+      return &cache->slots[i];
+    }
+    if (!cache->slots[i].key) {
+      return NULL;
+    }
+  }
+}
+
+static int cache_insert(Cache *cache, uint64_t key, unsigned int value) {
+  if (2 * (cache->count + 1) > cache->capacity) {
+    size_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+    CacheSlot *slots = calloc(capacity, sizeof(CacheSlot));
+    if (!slots) {
+      return -1;
+    }
+    for (size_t i = 0; i < cache->capacity; i++) {
+      if (cache->slots[i].key) {
+        size_t j = cache->slots[i].key & (capacity - 1);
+        while (slots[j].key) {
+          j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = cache->slots[i];
+      }
+    }
+    free(cache->slots);
+    cache->slots = slots;
+    cache->capacity = capacity;
+  }
+  size_t i = key & (cache->capacity - 1);
+  while (cache->slots[i].key) {
+    i = (i + 1) & (cache->capacity - 1);
+  }
+  cache->slots[i].key = key;
+  cache->slots[i].value = value;
+  cache->count++;
+  return 0;
+}
+
+static char *stage_name(unsigned int stage) {
+  switch (stage) {
+  case GL_VERTEX_SHADER:
+    return "VERTEX";
+  case GL_FRAGMENT_SHADER:
+    return "FRAGMENT";
+  case GL_GEOMETRY_SHADER:
+    return "GEOMETRY";
+  case GL_COMPUTE_SHADER:
+    return "COMPUTE";
+  default:
+    return "SHADER";
+  }
+}
+
+/**
+ * Compiles source as a shader object, or as a separable program if
+ * separable is set. Returns 0 if it does not build.
+ */
+static unsigned int compile_source(unsigned int stage, const char *source,
+                                   int separable) {
+  if (separable) {
+    unsigned int program = glCreateShaderProgramv(stage, 1, &source);
+    if (!check_compile_errors(program, "PROGRAM")) {
+      glDeleteProgram(program);
+      return 0;
+    }
+    return program;
+  }
+
+  unsigned int shader = glCreateShader(stage);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  if (!check_compile_errors(shader, stage_name(stage))) {
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+/**
+ * Collects the specialization constants among defines into ids and values.
+ * Values are unsigned integers in C notation; floats are passed by their
+ * bit pattern. Returns the number of constants.
+ */
+static int spec_constants(const char *const *defines, int defineCount,
+                          unsigned int *ids, unsigned int *values) {
+  size_t prefixLength = strlen(SHADERPP_SPEC_PREFIX);
+  int count = 0;
+  for (int i = 0; i < defineCount; i++) {
+    if (strncmp(defines[i], SHADERPP_SPEC_PREFIX, prefixLength) != 0) {
+      continue;
+    }
+    const char *id = defines[i] + prefixLength;
+    char *end;
+    unsigned long value = strtoul(id, &end, 10);
+    if (end == id || *end != '=') {
+      continue;
+    }
+    ids[count] = (unsigned int)value;
+    values[count++] = (unsigned int)strtoul(end + 1, NULL, 0);
+  }
+  return count;
+}
+
+/**
+ * Hashes the SPIR-V module binary with the specialization constants among
+ * defines, in any order.
+ */
+static uint64_t hash_spirv(const char *binary, long size,
+                           const char *const *defines, int defineCount) {
+  uint64_t key = hash_bytes(14695981039346656037ull, binary, size);
+  for (int i = 0; i < defineCount; i++) {
+    if (strncmp(defines[i], SHADERPP_SPEC_PREFIX,
+                strlen(SHADERPP_SPEC_PREFIX)) == 0) {
+      key += hash_text(defines[i]);
+    }
+  }
+  return key;
+}
+
+/**
+ * Specializes the SPIR-V module binary read from path with the constants
+ * among defines, as a shader object or as a separable program if separable
+ * is set. Returns 0 if it does not build.
+ */
+static unsigned int specialize_source(unsigned int stage, const char *binary,
+                                      long size, const char *path,
+                                      const char *const *defines,
+                                      int defineCount, int separable) {
+  unsigned int *ids = malloc((defineCount + 1) * sizeof(unsigned int));
+  unsigned int *values = malloc((defineCount + 1) * sizeof(unsigned int));
+  unsigned int shader = 0;
+  if (ids && values) {
+    int count = spec_constants(defines, defineCount, ids, values);
+    shader = specializeShader(stage, binary, size, path, ids, values, count);
+  }
+  free(ids);
+  free(values);
+  if (!shader || !separable) {
+    return shader;
+  }
+
+  unsigned int program = glCreateProgram();
+  glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+  glAttachShader(program, shader);
+  glLinkProgram(program);
+  glDeleteShader(shader);
+  if (!check_compile_errors(program, "PROGRAM")) {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+static void delete_stage(unsigned int name, int separable) {
+  if (separable) {
+    glDeleteProgram(name);
+  } else {
+    glDeleteShader(name);
+  }
+}
+
+/**
+ * Prints the file behind each source number after a failed compile, as line
+ * numbers in the log are prefixed with these.
+ */
+static void report_files(const ShaderppFiles *files) {
+  for (int i = 0; i < files->count; i++) {
+    fprintf(stderr, "source %d: %s\n", i, files->paths[i]);
+  }
+}
+
+static unsigned int cached_stage(unsigned int stage, const char *path,
+                                 const char *const *defines, int defineCount,
+                                 int separable) {
+  Cache *cache = separable ? &separableCache : &stageCache;
+  ShaderppFiles files = {{NULL}, 0};
+  long size = 0;
+  char *binary = read_spirv_file(path, &size);
+  char *source =
+      binary ? NULL : preprocess(path, defines, defineCount, &files);
+  if (!binary && !source) {
+    shaderpp_files_free(&files);
+    return 0;
+  }
+
+  uint64_t key = binary ? hash_spirv(binary, size, defines, defineCount)
+                        : hash_text(source);
+  key ^= stage * 0x9e3779b97f4a7c15ull;
+  key = key ? key : 1;
+  CacheSlot *slot = cache_find(cache, key);
+  if (slot) {
+    stats.stageHits++;
+    free(binary);
+    free(source);
+    shaderpp_files_free(&files);
+    return slot->value;
+  }
+
+  stats.stageCompiles++;
+  unsigned int name =
+      binary ? specialize_source(stage, binary, size, path, defines,
+                                 defineCount, separable)
+             : compile_source(stage, source, separable);
+  free(binary);
+  free(source);
+  if (!name) {
+    report_files(&files);
+  }
+  shaderpp_files_free(&files);
+
+  if (cache_insert(cache, key, name) != 0) {
+    delete_stage(name, separable);
+    return 0;
+  }
+  return name;
+}
+
+/**
+ * Returns the shader object for the stage built from the file at path with
+ * defines, compiling it only if no stage with the same preprocessed source
+ * was compiled before. The file may also hold a SPIR-V module, which is
+ * specialized with the SPEC_<id> defines rather than preprocessed. The
+ * cache owns the shader; it lives until shaderpp_clear. Returns 0 if the
+ * stage does not compile.
+ */
+unsigned int shaderpp_stage(unsigned int stage, const char *path,
+                            const char *const *defines, int defineCount) {
+  return cached_stage(stage, path, defines, defineCount, 0);
+}
+
+/**
+ * Links a program from the vertex and fragment shader objects.
+ * Returns 0 if it does not link.
+ */
+static unsigned int link_stages(unsigned int vertex, unsigned int fragment) {
+  unsigned int program = glCreateProgram();
+  glAttachShader(program, vertex);
+  glAttachShader(program, fragment);
+  glLinkProgram(program);
+  if (!check_compile_errors(program, "PROGRAM")) {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+/**
+ * Returns the program linking the vertex and fragment shaders at the given
+ * paths, both built with defines. Stages are shared with every other program
+ * using the same variant, and the program is linked once per pair of
+ * stages. The cache owns the program. Returns 0 if it does not build.
+ */
+unsigned int shaderpp_program(const char *vertexShaderPath,
+                              const char *fragmentShaderPath,
+                              const char *const *defines, int defineCount) {
+  unsigned int vertex =
+      shaderpp_stage(GL_VERTEX_SHADER, vertexShaderPath, defines, defineCount);
+  unsigned int fragment = shaderpp_stage(GL_FRAGMENT_SHADER, fragmentShaderPath,
+                                         defines, defineCount);
+  if (!vertex || !fragment) {
+    return 0;
+  }
+
+  uint64_t key = (uint64_t)vertex << 32 | fragment;
+  CacheSlot *slot = cache_find(&programCache, key);
+  if (slot) {
+    stats.programHits++;
+    return slot->value;
+  }
+
+  stats.programLinks++;
+  unsigned int program = link_stages(vertex, fragment);
+  if (cache_insert(&programCache, key, program) != 0) {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+/**
+ * Builds a program from the vertex and fragment shaders at the given paths
+ * with defines, like shaderpp_program but bypassing the cache, so the caller
+ * owns the program and deletes it when done. Either file may be a SPIR-V
+ * module, as for shaderpp_stage. The files both stages read, includes too,
+ * are appended to files unless it lists them already; that happens also
+ * when the build fails, so a caller watching them sees the fix.
+ * Returns 0 if it does not build.
+ */
+unsigned int shaderpp_build(const char *vertexShaderPath,
+                            const char *fragmentShaderPath,
+                            const char *const *defines, int defineCount,
+                            ShaderppFiles *files) {
+  const char *paths[2] = {vertexShaderPath, fragmentShaderPath};
+  const unsigned int stages[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+  unsigned int shaders[2] = {0, 0};
+  for (int i = 0; i < 2; i++) {
+    ShaderppFiles read = {{NULL}, 0};
+    long size;
+    char *binary = read_spirv_file(paths[i], &size);
+    if (binary) {
+      shaders[i] = specialize_source(stages[i], binary, size, paths[i],
+                                     defines, defineCount, 0);
+      free(binary);
+      read.paths[0] = realpath(paths[i], NULL);
+      read.count = read.paths[0] != NULL;
+    }
+    char *source =
+        binary ? NULL : preprocess(paths[i], defines, defineCount, &read);
+    if (source) {
+      shaders[i] = compile_source(stages[i], source, 0);
+      free(source);
+      if (!shaders[i]) {
+        report_files(&read);
+      }
+    }
+
+    for (int j = 0; j < read.count; j++) {
+      int listed = 0;
+      for (int k = 0; k < files->count && !listed; k++) {
+        listed = strcmp(files->paths[k], read.paths[j]) == 0;
+      }
+      if (!listed && files->count < SHADERPP_MAX_FILES) {
+        files->paths[files->count++] = read.paths[j];
+        read.paths[j] = NULL;
+      }
+    }
+    shaderpp_files_free(&read);
+  }
+
+  unsigned int program = 0;
+  if (shaders[0] && shaders[1]) {
+    program = link_stages(shaders[0], shaders[1]);
+  }
+  glDeleteShader(shaders[0]);
+  glDeleteShader(shaders[1]);
+  return program;
+}
+
+/**
+ * Returns a program pipeline combining separable programs built from the
+ * vertex and fragment shaders at the given paths with defines. Each stage
+ * variant is compiled and linked once however many pipelines use it, and
+ * combining two stages costs no link at all. Draw with glUseProgram(0) and
+ * glBindProgramPipeline. The cache owns the pipeline and its programs.
+ * Returns 0 if a stage does not build or the context is older than 4.1.
+ */
+unsigned int shaderpp_pipeline(const char *vertexShaderPath,
+                               const char *fragmentShaderPath,
+                               const char *const *defines, int defineCount) {
+  if (!GLAD_GL_VERSION_4_1) {
+    fprintf(stderr, "Program pipelines need OpenGL 4.1\n");
+    return 0;
+  }
+  unsigned int vertex = cached_stage(GL_VERTEX_SHADER, vertexShaderPath,
+                                     defines, defineCount, 1);
+  unsigned int fragment = cached_stage(GL_FRAGMENT_SHADER, fragmentShaderPath,
+                                       defines, defineCount, 1);
+  if (!vertex || !fragment) {
+    return 0;
+  }
+
+  uint64_t key = (uint64_t)vertex << 32 | fragment;
+  CacheSlot *slot = cache_find(&pipelineCache, key);
+  if (slot) {
+    stats.pipelineHits++;
+    return slot->value;
+  }
+
+  stats.pipelineBuilds++;
+  unsigned int pipeline = buildPipeline(vertex, fragment);
+  if (cache_insert(&pipelineCache, key, pipeline) != 0) {
+    glDeleteProgramPipelines(1, &pipeline);
+    return 0;
+  }
+  return pipeline;
+}
+
+/**
+ * Deletes every cached pipeline, program and stage. Names returned before
+ * are invalid afterwards.
+ */
+void shaderpp_clear(void) {
+  for (size_t i = 0; i < programCache.capacity; i++) {
+    if (programCache.slots[i].value) {
+      glDeleteProgram(programCache.slots[i].value);
+    }
+  }
+  for (size_t i = 0; i < stageCache.capacity; i++) {
+    if (stageCache.slots[i].value) {
+      glDeleteShader(stageCache.slots[i].value);
+    }
+  }
+  for (size_t i = 0; i < pipelineCache.capacity; i++) {
+    if (pipelineCache.slots[i].key) {
+      glDeleteProgramPipelines(1, &pipelineCache.slots[i].value);
+    }
+  }
+  for (size_t i = 0; i < separableCache.capacity; i++) {
+    if (separableCache.slots[i].value) {
+      glDeleteProgram(separableCache.slots[i].value);
+    }
+  }
+  free(programCache.slots);
+  free(stageCache.slots);
+  free(pipelineCache.slots);
+  free(separableCache.slots);
+  memset(&programCache, 0, sizeof(Cache));
+  memset(&stageCache, 0, sizeof(Cache));
+  memset(&pipelineCache, 0, sizeof(Cache));
+  memset(&separableCache, 0, sizeof(Cache));
+}
+
+void shaderpp_stats(ShaderppStats *dest) { *dest = stats; }
@@ -0,0 +1,50 @@
+#ifndef SHADERPP_H
+#define SHADERPP_H
+
+#define SHADERPP_MAX_FILES 64
+
+/**
+ * Files read while expanding a shader, by absolute path. A file's index is
+ * its GLSL source string number, which compilers print in front of line
+ * numbers.
+ */
+typedef struct {
+  char *paths[SHADERPP_MAX_FILES];
+  int count;
+} ShaderppFiles;
+
+/**
+ * Counters of the variant cache. Requests for a variant that was built
+ * before are hits; compiles and links count the GL work actually done.
+ * Separable stages count as stages; each is compiled and linked once.
+ */
+typedef struct {
+  unsigned long stageHits;
+  unsigned long stageCompiles;
+  unsigned long programHits;
+  unsigned long programLinks;
+  unsigned long pipelineHits;
+  unsigned long pipelineBuilds;
+} ShaderppStats;
+
+char *shaderpp_preprocess(const char *path, const char *const *defines,
+                          int defineCount);
+
+unsigned int shaderpp_stage(unsigned int stage, const char *path,
+                            const char *const *defines, int defineCount);
+unsigned int shaderpp_program(const char *vertexShaderPath,
+                              const char *fragmentShaderPath,
+                              const char *const *defines, int defineCount);
+unsigned int shaderpp_pipeline(const char *vertexShaderPath,
+                               const char *fragmentShaderPath,
+                               const char *const *defines, int defineCount);
+unsigned int shaderpp_build(const char *vertexShaderPath,
+                            const char *fragmentShaderPath,
+                            const char *const *defines, int defineCount,
+                            ShaderppFiles *files);
+void shaderpp_files_free(ShaderppFiles *files);
+void shaderpp_clear(void);
+
+void shaderpp_stats(ShaderppStats *stats);
+
+#endif
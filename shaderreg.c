@@ -0,0 +1,372 @@
+#include "shaderreg.h"
+
+#include <glad/gl.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "shaderpp.h"
+
+/* Editors save in several steps, e.g. truncate and write or write a copy and
+ * rename it. Rebuilding waits until the files have been quiet this long. */
+#define SHADERREG_SETTLE_MS 50
+
+/**
+ * Files a program is built from, includes too, with the watch on the
+ * directory of each. Watching directories rather than the files sees saves
+ * that replace the file. Once the program is added only the compiler thread
+ * touches them, and the list only grows, so an include dropped from a shader
+ * at most causes a needless rebuild.
+ */
+typedef struct {
+  ShaderppFiles files;
+  int watches[SHADERPP_MAX_FILES];
+} SourceWatch;
+
+/**
+ * A program built with shaderpp from a vertex and a fragment shader file and
+ * the defines injected into both.
+ */
+typedef struct {
+  char *paths[2];
+  char **defines;
+  int defineCount;
+  SourceWatch *sources;
+  /* In use by draws, only touched by the thread owning the main context. */
+  unsigned int program;
+  /* Rebuilt program waiting for its fence, guarded by mutex. */
+  unsigned int pending;
+  GLsync fence;
+  int dirty;
+} ShaderEntry;
+
+static ShaderEntry *entries = NULL;
+static int entryCount = 0;
+static int entryCapacity = 0;
+
+static GLFWwindow *context = NULL;
+static int notifyFd = -1;
+static int wakePipe[2] = {-1, -1};
+static pthread_t compiler;
+static int compilerRunning = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *base_name(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+static int add_watch(const char *path) {
+  const char *name = base_name(path);
+  if (name == path) {
+    return inotify_add_watch(notifyFd, ".", IN_CLOSE_WRITE | IN_MOVED_TO);
+  }
+  char directory[1024];
+  snprintf(directory, sizeof(directory), "%.*s", (int)(name - path), path);
+  return inotify_add_watch(notifyFd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+}
+
+/**
+ * Watches the files of sources from index first on, which the last build
+ * added.
+ */
+static void watch_sources(SourceWatch *sources, int first) {
+  for (int i = first; i < sources->files.count; i++) {
+    sources->watches[i] =
+        notifyFd >= 0 ? add_watch(sources->files.paths[i]) : -1;
+  }
+}
+
+/**
+ * Builds the program of entry and watches any file it reads for the first
+ * time. Returns 0 if it does not build.
+ */
+static unsigned int build_entry(const char *vertexPath,
+                                const char *fragmentPath,
+                                char *const *defines, int defineCount,
+                                SourceWatch *sources) {
+  int first = sources->files.count;
+  unsigned int program =
+      shaderpp_build(vertexPath, fragmentPath, (const char *const *)defines,
+                     defineCount, &sources->files);
+  watch_sources(sources, first);
+  return program;
+}
+
+static void entry_free(ShaderEntry *entry) {
+  free(entry->paths[0]);
+  free(entry->paths[1]);
+  for (int i = 0; i < entry->defineCount; i++) {
+    free(entry->defines[i]);
+  }
+  free(entry->defines);
+  if (entry->sources) {
+    shaderpp_files_free(&entry->sources->files);
+    free(entry->sources);
+  }
+}
+
+/**
+ * Drains the inotify queue and marks the programs using a changed file.
+ * Returns the number of programs marked.
+ */
+static int read_events(void) {
+  char buffer[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  int marked = 0;
+  ssize_t length;
+  while ((length = read(notifyFd, buffer, sizeof(buffer))) > 0) {
+    pthread_mutex_lock(&mutex);
+    for (char *p = buffer; p < buffer + length;) {
+      const struct inotify_event *event = (const struct inotify_event *)p;
+      p += sizeof(struct inotify_event) + event->len;
+      if (!event->len) {
+        continue;
+      }
+      for (int i = 0; i < entryCount; i++) {
+        const SourceWatch *sources = entries[i].sources;
+        for (int f = 0; f < sources->files.count; f++) {
+          if (sources->watches[f] == event->wd &&
+              strcmp(base_name(sources->files.paths[f]), event->name) == 0) {
+            marked += !entries[i].dirty;
+            entries[i].dirty = 1;
+          }
+        }
+      }
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+  return marked;
+}
+
+/**
+ * Rebuilds the marked programs on the compiler's context. A program that
+ * fails to build is dropped, so the one in use stays until the files are
+ * fixed. The fence tells the main context when the new program is complete.
+ */
+static void rebuild_dirty(void) {
+  for (int i = 0;; i++) {
+    pthread_mutex_lock(&mutex);
+    if (i >= entryCount) {
+      pthread_mutex_unlock(&mutex);
+      break;
+    }
+    ShaderEntry entry = entries[i];
+    entries[i].dirty = 0;
+    pthread_mutex_unlock(&mutex);
+    if (!entry.dirty) {
+      continue;
+    }
+
+    const char *vertexPath = entry.paths[0];
+    const char *fragmentPath = entry.paths[1];
+    unsigned int program = build_entry(vertexPath, fragmentPath, entry.defines,
+                                       entry.defineCount, entry.sources);
+    if (!program) {
+      fprintf(stderr, "Keeping previous program for %s and %s\n", vertexPath,
+              fragmentPath);
+      continue;
+    }
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    pthread_mutex_lock(&mutex);
+    if (entries[i].pending) {
+      /* Superseded before the main thread picked it up. */
+      glDeleteSync(entries[i].fence);
+      glDeleteProgram(entries[i].pending);
+    }
+    entries[i].pending = program;
+    entries[i].fence = fence;
+    pthread_mutex_unlock(&mutex);
+  }
+}
+
+static void *compiler_main(void *arg) {
+  (void)arg;
+  glfwMakeContextCurrent(context);
+  struct pollfd fds[2] = {{notifyFd, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[1].revents) {
+      break;
+    }
+    if (!read_events()) {
+      continue;
+    }
+    while (poll(fds, 1, SHADERREG_SETTLE_MS) > 0) {
+      read_events();
+    }
+    rebuild_dirty();
+  }
+  glfwMakeContextCurrent(NULL);
+  return NULL;
+}
+
+/**
+ * Starts watching shader files for changes. Changed programs are rebuilt on a
+ * hidden context sharing objects with window's, so the render loop never
+ * waits for the compiler. Must be called on the main thread with window's
+ * context current. Returns 0 on success and -1 if files cannot be watched;
+ * programs can still be added then, but are not reloaded.
+ */
+int shaderreg_init(GLFWwindow *window) {
+  notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (notifyFd < 0) {
+    return -1;
+  }
+  if (pipe(wakePipe) != 0) {
+    shaderreg_shutdown();
+    return -1;
+  }
+
+  /* The window hints still hold the context version of window. */
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  context = glfwCreateWindow(1, 1, "", NULL, window);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+  if (!context) {
+    shaderreg_shutdown();
+    return -1;
+  }
+
+  if (pthread_create(&compiler, NULL, compiler_main, NULL) != 0) {
+    shaderreg_shutdown();
+    return -1;
+  }
+  compilerRunning = 1;
+  return 0;
+}
+
+/**
+ * Stops watching and deletes every program. Must be called on the main
+ * thread with the main context current.
+ */
+void shaderreg_shutdown(void) {
+  if (compilerRunning) {
+    char stop = 0;
+    if (write(wakePipe[1], &stop, 1) != 1) {
+      perror("shaderreg_shutdown");
+    }
+    pthread_join(compiler, NULL);
+    compilerRunning = 0;
+  }
+  if (context) {
+    glfwDestroyWindow(context);
+    context = NULL;
+  }
+  for (int i = 0; i < 2; i++) {
+    if (wakePipe[i] >= 0) {
+      close(wakePipe[i]);
+      wakePipe[i] = -1;
+    }
+  }
+  if (notifyFd >= 0) {
+    close(notifyFd);
+    notifyFd = -1;
+  }
+
+  for (int i = 0; i < entryCount; i++) {
+    if (entries[i].pending) {
+      glDeleteSync(entries[i].fence);
+      glDeleteProgram(entries[i].pending);
+    }
+    glDeleteProgram(entries[i].program);
+    entry_free(&entries[i]);
+  }
+  free(entries);
+  entries = NULL;
+  entryCount = 0;
+  entryCapacity = 0;
+}
+
+/**
+ * Builds a program from a vertex and a fragment shader file with shaderpp,
+ * injecting defines into both, and returns its handle, or -1 if out of
+ * memory. Editing either file or anything they include rebuilds it with the
+ * same defines. The program is 0 until the files build without errors.
+ */
+int shaderreg_add(const char *vertexShaderPath,
+                  const char *fragmentShaderPath, const char *const *defines,
+                  int defineCount) {
+  ShaderEntry entry = {0};
+  entry.paths[0] = strdup(vertexShaderPath);
+  entry.paths[1] = strdup(fragmentShaderPath);
+  entry.defines = calloc(defineCount > 0 ? defineCount : 1, sizeof(char *));
+  entry.sources = calloc(1, sizeof(SourceWatch));
+  int failed = !entry.paths[0] || !entry.paths[1] || !entry.defines ||
+               !entry.sources;
+  for (int i = 0; i < defineCount && !failed; i++) {
+    entry.defines[i] = strdup(defines[i]);
+    failed = !entry.defines[i];
+    entry.defineCount++;
+  }
+  if (failed) {
+    entry_free(&entry);
+    return -1;
+  }
+  entry.program = build_entry(vertexShaderPath, fragmentShaderPath,
+                              entry.defines, entry.defineCount, entry.sources);
+
+  pthread_mutex_lock(&mutex);
+  if (entryCount == entryCapacity) {
+    int capacity = entryCapacity ? entryCapacity * 2 : 8;
+    ShaderEntry *grown = realloc(entries, capacity * sizeof(ShaderEntry));
+    if (!grown) {
+      pthread_mutex_unlock(&mutex);
+      glDeleteProgram(entry.program);
+      entry_free(&entry);
+      return -1;
+    }
+    entries = grown;
+    entryCapacity = capacity;
+  }
+  int handle = entryCount++;
+  entries[handle] = entry;
+  pthread_mutex_unlock(&mutex);
+  return handle;
+}
+
+/**
+ * Swaps in rebuilt programs whose fences have signalled. Call once per
+ * frame, between draws; it never waits for the compiler.
+ */
+void shaderreg_update(void) {
+  if (!compilerRunning) {
+    return;
+  }
+  pthread_mutex_lock(&mutex);
+  for (int i = 0; i < entryCount; i++) {
+    ShaderEntry *entry = &entries[i];
+    if (!entry->pending) {
+      continue;
+    }
+    GLenum status = glClientWaitSync(entry->fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      continue;
+    }
+    glDeleteSync(entry->fence);
+    glDeleteProgram(entry->program);
+    entry->program = entry->pending;
+    entry->pending = 0;
+    fprintf(stdout, "Reloaded %s and %s\n", entry->paths[0], entry->paths[1]);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Returns the program to draw with. It changes when the files are edited,
+ * so look it up, and its uniform locations, every frame.
+ */
+unsigned int shaderreg_program(int handle) { return entries[handle].program; }
@@ -0,0 +1,16 @@
+#ifndef SHADERREG_H
+#define SHADERREG_H
+
+typedef struct GLFWwindow GLFWwindow;
+
+int shaderreg_init(GLFWwindow *window);
+void shaderreg_shutdown(void);
+
+int shaderreg_add(const char *vertexShaderPath,
+                  const char *fragmentShaderPath, const char *const *defines,
+                  int defineCount);
+void shaderreg_update(void);
+
+unsigned int shaderreg_program(int handle);
+
+#endif
@@ -1,13 +1,42 @@
 #version 330 core
+// Injected by textable.c when the context passes all of its checks.
+#ifdef TEXTABLE_BINDLESS
+#extension GL_ARB_bindless_texture : require
+#extension GL_ARB_shader_storage_buffer_object : require
+#endif
 
 in vec3 ourColor;
 in vec2 TexCoord;
+flat in uint TextureSlot;
 
-uniform sampler2D ourTexture;
+#ifdef TEXTABLE_BINDLESS
+layout(std430) readonly buffer TextureTable
+{
+    uvec2 textureHandles[];
+};
+
+vec4 sampleTable(uint slot, vec2 coords)
+{
+    return texture(sampler2D(textureHandles[slot]), coords);
+}
+#else
+uniform sampler2DArray textureTable;
+
+vec4 sampleTable(uint slot, vec2 coords)
+{
+    return texture(textureTable, vec3(coords, float(slot)));
+}
+#endif
+
+layout(std140) uniform Material
+{
+    vec4 tint;
+};
 
 out vec4 FragColor;
 
 void main()
 {
-    FragColor = texture(ourTexture, TexCoord) * vec4(ourColor, 1.0);
+    FragColor = sampleTable(TextureSlot, TexCoord) * vec4(ourColor, 1.0) *
+                tint;
 };
@@ -1,17 +1,38 @@
 #version 330 core
 
+// Instances drawn at once, matches OBJECT_COUNT in main.c.
+#define OBJECT_COUNT 64
+
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aColor;
 layout(location = 2) in vec2 aTexCoord;
 
 out vec3 ourColor;
 out vec2 TexCoord;
+flat out uint TextureSlot;
 
-uniform mat4 transform;
+layout(std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+};
+
+struct ObjectData
+{
+    mat4 transform;
+    uint textureSlot;
+};
+
+layout(std140) uniform Object
+{
+    ObjectData objects[OBJECT_COUNT];
+};
 
 void main()
 {
-    gl_Position = transform * vec4(aPos, 1.0f);
+    ObjectData object = objects[gl_InstanceID];
+    gl_Position = projection * view * object.transform * vec4(aPos, 1.0f);
     ourColor = aColor;
     TexCoord = aTexCoord;
+    TextureSlot = object.textureSlot;
 };
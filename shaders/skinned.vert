@@ -0,0 +1,43 @@
+#version 430 core
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aColor;
+layout(location = 2) in vec2 aTexCoord;
+layout(location = 3) in uvec4 aBoneIndices;
+layout(location = 4) in vec4 aBoneWeights;
+
+// Same layout as the Frame block of simple.vert.
+layout(std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+};
+
+// Binding 1 is SKIN_PALETTE_BINDING of skin.h; binding 0 holds the
+// bindless texture table.
+layout(std430, binding = 1) readonly buffer Palettes
+{
+    mat4 palette[];
+};
+
+out vec3 ourColor;
+out vec2 TexCoord;
+flat out uint TextureSlot;
+
+uniform int bonesPerInstance;
+// Slot of the texture table simple.frag samples, shared by all instances.
+uniform uint textureSlot;
+
+void main()
+{
+    uint base = uint(gl_InstanceID * bonesPerInstance);
+    mat4 skin = palette[base + aBoneIndices.x] * aBoneWeights.x
+              + palette[base + aBoneIndices.y] * aBoneWeights.y
+              + palette[base + aBoneIndices.z] * aBoneWeights.z
+              + palette[base + aBoneIndices.w] * aBoneWeights.w;
+
+    gl_Position = projection * view * skin * vec4(aPos, 1.0f);
+    ourColor = aColor;
+    TexCoord = aTexCoord;
+    TextureSlot = textureSlot;
+};
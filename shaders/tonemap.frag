@@ -0,0 +1,21 @@
+#version 330 core
+
+in vec2 TexCoord;
+
+uniform sampler2D hdrTexture;
+uniform float exposure;
+
+out vec4 FragColor;
+
+// Krzysztof Narkowicz's fit of the ACES filmic curve.
+vec3 aces(vec3 x)
+{
+    return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14),
+                 0.0, 1.0);
+}
+
+void main()
+{
+    vec3 color = aces(texture(hdrTexture, TexCoord).rgb * exposure);
+    FragColor = vec4(pow(color, vec3(1.0 / 2.2)), 1.0);
+}
@@ -0,0 +1,139 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/**
+ * Minimal float lane abstraction shared by the batch kernels. Picks AVX (8
+ * lanes), SSE2 (4 lanes) or plain floats (1 lane) at compile time, so every
+ * kernel is written once and processes SIMD_LANES elements per step.
+ *
+ * Comparisons return masks which may only be combined with lanef_and,
+ * lanef_or and consumed by lanef_select or lanef_any.
+ *
+ * Builds without -mavx on x86 still reach 8 lanes at run time: a module is
+ * compiled a second time by a <module>_avx2.c unit that defines SIMD_WIDE
+ * before including simd.h and the module. That unit is compiled for AVX2,
+ * SIMD_NAME appends _avx2 to its entry points, and the baseline entry
+ * points call those when simd_wide_available() reports the CPU has AVX2.
+ * F16C comes with every AVX2 CPU and is part of the wide level too; units
+ * that use AVX2 or F16C intrinsics directly test SIMD_AVX2.
+ */
+
+#if !defined(__AVX__) && (defined(__x86_64__) || defined(__i386__)) &&       \
+    (defined(__GNUC__) || defined(__clang__))
+#define SIMD_HAS_WIDE
+static inline int simd_wide_available(void) {
+  /* Also checks that the OS saves the ymm registers. */
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+}
+#endif
+
+#if defined(SIMD_WIDE) && defined(SIMD_HAS_WIDE)
+/* No FMA, so the wide kernels round exactly like the baseline ones. */
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,f16c"))),          \
+                             apply_to = function)
+#else
+#pragma GCC target("avx2,f16c")
+#endif
+#define SIMD_NAME(name) name##_avx2
+#else
+#define SIMD_NAME(name) name
+#endif
+
+/* Units compiled for AVX2 and F16C, by the build or as the wide unit. */
+#if (defined(__AVX2__) && defined(__F16C__)) ||                               \
+    (defined(SIMD_WIDE) && defined(SIMD_HAS_WIDE))
+#define SIMD_AVX2
+#endif
+
+/* Baseline units that have an _avx2 counterpart to call. */
+#if defined(SIMD_HAS_WIDE) && !defined(SIMD_WIDE)
+#define SIMD_DISPATCH
+#endif
+
+#if defined(__AVX__) || (defined(SIMD_WIDE) && defined(SIMD_HAS_WIDE))
+#include <immintrin.h>
+#define SIMD_LANES 8
+typedef __m256 lanef;
+#define lanef_set1(x) _mm256_set1_ps(x)
+#define lanef_load(p) _mm256_loadu_ps(p)
+#define lanef_store(p, a) _mm256_storeu_ps(p, a)
+#define lanef_add(a, b) _mm256_add_ps(a, b)
+#define lanef_sub(a, b) _mm256_sub_ps(a, b)
+#define lanef_mul(a, b) _mm256_mul_ps(a, b)
+#define lanef_div(a, b) _mm256_div_ps(a, b)
+#define lanef_min(a, b) _mm256_min_ps(a, b)
+#define lanef_max(a, b) _mm256_max_ps(a, b)
+#define lanef_sqrt(a) _mm256_sqrt_ps(a)
+#define lanef_floor(a) _mm256_floor_ps(a)
+#define lanef_trunc(a)                                                         \
+  _mm256_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)
+#define lanef_and(a, b) _mm256_and_ps(a, b)
+#define lanef_or(a, b) _mm256_or_ps(a, b)
+#define lanef_ge(a, b) _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define lanef_le(a, b) _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define lanef_gt(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define lanef_lt(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define lanef_select(mask, a, b) _mm256_blendv_ps(b, a, mask)
+#define lanef_any(mask) _mm256_movemask_ps(mask)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_LANES 4
+typedef __m128 lanef;
+#define lanef_set1(x) _mm_set1_ps(x)
+#define lanef_load(p) _mm_loadu_ps(p)
+#define lanef_store(p, a) _mm_storeu_ps(p, a)
+#define lanef_add(a, b) _mm_add_ps(a, b)
+#define lanef_sub(a, b) _mm_sub_ps(a, b)
+#define lanef_mul(a, b) _mm_mul_ps(a, b)
+#define lanef_div(a, b) _mm_div_ps(a, b)
+#define lanef_min(a, b) _mm_min_ps(a, b)
+#define lanef_max(a, b) _mm_max_ps(a, b)
+#define lanef_sqrt(a) _mm_sqrt_ps(a)
+#define lanef_and(a, b) _mm_and_ps(a, b)
+#define lanef_or(a, b) _mm_or_ps(a, b)
+#define lanef_ge(a, b) _mm_cmpge_ps(a, b)
+#define lanef_le(a, b) _mm_cmple_ps(a, b)
+#define lanef_gt(a, b) _mm_cmpgt_ps(a, b)
+#define lanef_lt(a, b) _mm_cmplt_ps(a, b)
+#define lanef_select(mask, a, b)                                               \
+  _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b))
+#define lanef_any(mask) _mm_movemask_ps(mask)
+/* SSE2 has no rounding instruction, both helpers assume |a| < 2^31. */
+#define lanef_trunc(a) _mm_cvtepi32_ps(_mm_cvttps_epi32(a))
+static inline __m128 lanef_floor(__m128 a) {
+  __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+  return _mm_sub_ps(truncated,
+                    _mm_and_ps(_mm_cmpgt_ps(truncated, a), _mm_set1_ps(1.0f)));
+}
+#else
+#include <math.h>
+#define SIMD_LANES 1
+typedef float lanef;
+#define lanef_set1(x) ((float)(x))
+#define lanef_load(p) (*(p))
+#define lanef_store(p, a) (*(p) = (a))
+#define lanef_add(a, b) ((a) + (b))
+#define lanef_sub(a, b) ((a) - (b))
+#define lanef_mul(a, b) ((a) * (b))
+#define lanef_div(a, b) ((a) / (b))
+#define lanef_min(a, b) fminf(a, b)
+#define lanef_max(a, b) fmaxf(a, b)
+#define lanef_sqrt(a) sqrtf(a)
+#define lanef_floor(a) floorf(a)
+#define lanef_trunc(a) truncf(a)
+/* Scalar masks are 0.0f or 1.0f. */
+#define lanef_and(a, b) ((a) * (b))
+#define lanef_or(a, b) fmaxf(a, b)
+#define lanef_ge(a, b) ((float)((a) >= (b)))
+#define lanef_le(a, b) ((float)((a) <= (b)))
+#define lanef_gt(a, b) ((float)((a) > (b)))
+#define lanef_lt(a, b) ((float)((a) < (b)))
+#define lanef_select(mask, a, b) ((mask) != 0.0f ? (a) : (b))
+#define lanef_any(mask) ((mask) != 0.0f)
+#endif
+
+#define lanef_neg(a) lanef_sub(lanef_set1(0.0f), a)
+#define lanef_abs(a) lanef_max(a, lanef_neg(a))
+
+#endif
@@ -0,0 +1,283 @@
+#include "skin.h"
+
+#include <cglm/cglm.h>
+#include <glad/gl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobs.h"
+
+/* Instances per parallel chunk. */
+#define SKIN_GRAIN 32
+
+/**
+ * Per-thread working memory for sampling and composing one instance. Grown
+ * on demand, so it is allocated once per thread rather than once per frame.
+ * Job pool workers free theirs when they exit, other threads call
+ * skin_release_thread.
+ */
+typedef struct {
+  int boneCount;
+  AnimSampler sampler;
+  AnimPose pose;
+  AnimPose blendPose;
+  mat4 *model;
+} SkinScratch;
+
+static _Thread_local SkinScratch scratch;
+static pthread_key_t scratchKey;
+static pthread_once_t scratchKeyOnce = PTHREAD_ONCE_INIT;
+
+static void scratch_free(void *context) {
+  SkinScratch *s = context;
+  anim_sampler_free(&s->sampler);
+  anim_pose_free(&s->pose);
+  anim_pose_free(&s->blendPose);
+  free(s->model);
+  memset(s, 0, sizeof(*s));
+}
+
+static void scratch_key_create(void) {
+  pthread_key_create(&scratchKey, scratch_free);
+}
+
+static int scratch_reserve(int boneCount) {
+  if (scratch.boneCount >= boneCount) {
+    return 0;
+  }
+  scratch_free(&scratch);
+
+  if (anim_sampler_init(&scratch.sampler, boneCount) != 0) {
+    memset(&scratch.sampler, 0, sizeof(scratch.sampler));
+    return -1;
+  }
+  scratch.model = aligned_alloc(32, boneCount * sizeof(mat4));
+  if (anim_pose_init(&scratch.pose, boneCount) != 0 ||
+      anim_pose_init(&scratch.blendPose, boneCount) != 0 || !scratch.model) {
+    scratch_free(&scratch);
+    return -1;
+  }
+  scratch.boneCount = boneCount;
+
+  /* Registers the scratch for freeing when the thread exits. */
+  pthread_once(&scratchKeyOnce, scratch_key_create);
+  pthread_setspecific(scratchKey, &scratch);
+  return 0;
+}
+
+/**
+ * Frees the calling thread's scratch memory, e.g. on the main thread before
+ * shutdown. The next update on the thread allocates it again.
+ */
+void skin_release_thread(void) { scratch_free(&scratch); }
+
+/**
+ * Resets bones [begin, end) of pose to the identity transform. Clips may
+ * animate fewer bones than the skeleton has, and the scratch pose would
+ * otherwise keep the previous instance's values for the rest.
+ */
+static void pose_reset(AnimPose *pose, int begin, int end) {
+  for (int b = begin; b < end; b++) {
+    for (int c = 0; c < 3; c++) {
+      pose->translation[c][b] = 0.0f;
+      pose->scale[c][b] = 1.0f;
+    }
+    pose->rotation.x[b] = 0.0f;
+    pose->rotation.y[b] = 0.0f;
+    pose->rotation.z[b] = 0.0f;
+    pose->rotation.w[b] = 1.0f;
+  }
+}
+
+static float wrap_time(float time, const AnimClip *clip) {
+  if (clip->duration <= 0.0f) {
+    return 0.0f;
+  }
+  time = fmodf(time, clip->duration);
+  return time < 0.0f ? time + clip->duration : time;
+}
+
+/**
+ * Initializes a runtime for up to capacity instances of skeleton. Requires an
+ * OpenGL 4.3 context for the shader storage buffer.
+ * Returns 0 on success and -1 on failure.
+ */
+int skin_runtime_init(SkinRuntime *runtime, const Skeleton *skeleton,
+                      int capacity) {
+  memset(runtime, 0, sizeof(*runtime));
+  if (!GLAD_GL_VERSION_4_3) {
+    return -1;
+  }
+
+  runtime->skeleton = skeleton;
+  runtime->capacity = capacity;
+  runtime->instances = malloc(capacity * sizeof(SkinInstance));
+  runtime->palettes =
+      aligned_alloc(32, (size_t)capacity * skeleton->boneCount * sizeof(mat4));
+  if (!runtime->instances || !runtime->palettes) {
+    skin_runtime_free(runtime);
+    return -1;
+  }
+
+  glGenBuffers(1, &runtime->paletteBuffer);
+  return 0;
+}
+
+void skin_runtime_free(SkinRuntime *runtime) {
+  if (runtime->paletteBuffer) {
+    glDeleteBuffers(1, &runtime->paletteBuffer);
+  }
+  free(runtime->instances);
+  free(runtime->palettes);
+  memset(runtime, 0, sizeof(*runtime));
+}
+
+/**
+ * Adds an instance playing clip from the start, placed by world.
+ * Returns its index or -1 if the runtime is full.
+ */
+int skin_add_instance(SkinRuntime *runtime, const AnimClip *clip, mat4 world) {
+  if (runtime->instanceCount == runtime->capacity) {
+    return -1;
+  }
+
+  SkinInstance *instance = &runtime->instances[runtime->instanceCount];
+  memset(instance, 0, sizeof(*instance));
+  instance->clip = clip;
+  instance->speed = 1.0f;
+  glm_mat4_copy(world, instance->world);
+  return runtime->instanceCount++;
+}
+
+typedef struct {
+  SkinRuntime *runtime;
+  atomic_int failed;
+} UpdateJob;
+
+/**
+ * Samples, blends and composes the palette of a range of instances. The root
+ * bones include the instance's world matrix, so the vertex shader only needs
+ * the palette and the view-projection.
+ */
+static void update_instances(void *context, int begin, int end) {
+  UpdateJob *job = context;
+  SkinRuntime *runtime = job->runtime;
+  const Skeleton *skeleton = runtime->skeleton;
+  int boneCount = skeleton->boneCount;
+
+  for (int i = begin; i < end; i++) {
+    SkinInstance *instance = &runtime->instances[i];
+    const AnimClip *clip = instance->clip;
+    const AnimClip *blendClip = instance->blendClip;
+    mat4 *palette = runtime->palettes + (size_t)i * boneCount;
+    AnimPose *pose = &scratch.pose;
+    int sampled = clip->trackCount;
+
+    if (blendClip && blendClip->trackCount > sampled) {
+      sampled = blendClip->trackCount;
+    }
+    if (scratch_reserve(sampled > boneCount ? sampled : boneCount) != 0) {
+      atomic_store(&job->failed, 1);
+      return;
+    }
+
+    anim_clip_sample(clip, instance->time, &scratch.sampler, pose);
+    pose_reset(pose, clip->trackCount, boneCount);
+    if (blendClip && instance->blendWeight > 0.0f) {
+      anim_clip_sample(blendClip, instance->blendTime, &scratch.sampler,
+                       &scratch.blendPose);
+      pose_reset(&scratch.blendPose, blendClip->trackCount, boneCount);
+      anim_pose_blend(pose, &scratch.blendPose, instance->blendWeight, pose);
+    }
+
+    for (int b = 0; b < boneCount; b++) {
+      CGLM_ALIGN_MAT mat4 local;
+      versor rotation = {pose->rotation.x[b], pose->rotation.y[b],
+                         pose->rotation.z[b], pose->rotation.w[b]};
+
+      glm_quat_mat4(rotation, local);
+      glm_vec4_scale(local[0], pose->scale[0][b], local[0]);
+      glm_vec4_scale(local[1], pose->scale[1][b], local[1]);
+      glm_vec4_scale(local[2], pose->scale[2][b], local[2]);
+      local[3][0] = pose->translation[0][b];
+      local[3][1] = pose->translation[1][b];
+      local[3][2] = pose->translation[2][b];
+
+      int parent = skeleton->parent[b];
+      glm_mat4_mul(parent >= 0 ? scratch.model[parent] : instance->world, local,
+                   scratch.model[b]);
+      glm_mat4_mul(scratch.model[b], skeleton->inverseBind[b], palette[b]);
+    }
+  }
+}
+
+/**
+ * Advances every instance by deltaTime and recomputes all skinning palettes,
+ * spread across the job threads.
+ * Returns 0 on success and -1 if a thread could not grow its scratch memory,
+ * in which case some palettes keep their previous frame.
+ */
+int skin_runtime_update(SkinRuntime *runtime, float deltaTime) {
+  UpdateJob job = {.runtime = runtime};
+
+  for (int i = 0; i < runtime->instanceCount; i++) {
+    SkinInstance *instance = &runtime->instances[i];
+    instance->time =
+        wrap_time(instance->time + deltaTime * instance->speed, instance->clip);
+    if (instance->blendClip) {
+      instance->blendTime =
+          wrap_time(instance->blendTime + deltaTime * instance->speed,
+                    instance->blendClip);
+    }
+  }
+
+  atomic_init(&job.failed, 0);
+  jobs_parallel_for(runtime->instanceCount, SKIN_GRAIN, update_instances, &job);
+  return atomic_load(&job.failed) ? -1 : 0;
+}
+
+/**
+ * Uploads the palettes of all instances with one call and binds them to
+ * storage block binding SKIN_PALETTE_BINDING. The buffer is orphaned every
+ * frame, so the driver never waits for the previous frame's draws, and
+ * reallocated larger when the palettes no longer fit.
+ */
+void skin_runtime_upload(SkinRuntime *runtime) {
+  size_t size = (size_t)runtime->instanceCount *
+                runtime->skeleton->boneCount * sizeof(mat4);
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, runtime->paletteBuffer);
+  if (size > runtime->paletteBufferSize) {
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, runtime->palettes,
+                 GL_STREAM_DRAW);
+    runtime->paletteBufferSize = size;
+  } else {
+    glBufferData(GL_SHADER_STORAGE_BUFFER, runtime->paletteBufferSize, NULL,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, runtime->palettes);
+  }
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKIN_PALETTE_BINDING,
+                   runtime->paletteBuffer);
+}
+
+/**
+ * Draws every instance with a single instanced draw call. shaderProgram is
+ * expected to be built from shaders/skinned.vert and shaders/simple.frag,
+ * with its Frame block assigned to the binding the caller keeps the view and
+ * projection in. Every instance samples textureSlot of the texture table.
+ */
+void skin_runtime_draw(const SkinRuntime *runtime, unsigned int shaderProgram,
+                       unsigned int vertexArray, int indexCount,
+                       unsigned int textureSlot) {
+  glUseProgram(shaderProgram);
+  glUniform1i(glGetUniformLocation(shaderProgram, "bonesPerInstance"),
+              runtime->skeleton->boneCount);
+  glUniform1ui(glGetUniformLocation(shaderProgram, "textureSlot"),
+               textureSlot);
+  glBindVertexArray(vertexArray);
+  glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0,
+                          runtime->instanceCount);
+}
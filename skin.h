@@ -0,0 +1,64 @@
+#ifndef SKIN_H
+#define SKIN_H
+
+#include <cglm/types.h>
+#include <stddef.h>
+
+#include "anim.h"
+
+/* Storage block binding of the palettes in shaders/skinned.vert. Binding 0
+ * holds the bindless texture table of main.c. */
+#define SKIN_PALETTE_BINDING 1
+
+/**
+ * Bone hierarchy of a skinned mesh. Bones are ordered so that every parent
+ * comes before its children; roots have a parent of -1.
+ */
+typedef struct {
+  int boneCount;
+  int *parent;
+  mat4 *inverseBind;
+} Skeleton;
+
+/**
+ * One animated character. blendClip, if set, is mixed over clip with
+ * blendWeight.
+ */
+typedef struct {
+  const AnimClip *clip;
+  float time;
+  const AnimClip *blendClip;
+  float blendTime;
+  float blendWeight;
+  float speed;
+  mat4 world;
+} SkinInstance;
+
+/**
+ * Animates any number of instances of one skeleton and uploads all of their
+ * skinning palettes into a single shader storage buffer per frame.
+ */
+typedef struct {
+  const Skeleton *skeleton;
+  SkinInstance *instances;
+  int instanceCount;
+  int capacity;
+  mat4 *palettes;
+  unsigned int paletteBuffer;
+  size_t paletteBufferSize;
+} SkinRuntime;
+
+int skin_runtime_init(SkinRuntime *runtime, const Skeleton *skeleton,
+                      int capacity);
+void skin_runtime_free(SkinRuntime *runtime);
+
+int skin_add_instance(SkinRuntime *runtime, const AnimClip *clip, mat4 world);
+
+int skin_runtime_update(SkinRuntime *runtime, float deltaTime);
+void skin_release_thread(void);
+void skin_runtime_upload(SkinRuntime *runtime);
+void skin_runtime_draw(const SkinRuntime *runtime, unsigned int shaderProgram,
+                       unsigned int vertexArray, int indexCount,
+                       unsigned int textureSlot);
+
+#endif
@@ -0,0 +1,432 @@
+#include "spatial.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define SPATIAL_NONE -1
+#define SPATIAL_FREE -2
+
+/* Shapes spatial_grid_move_batch rewrites before relinking those that left. */
+#define SPATIAL_MOVE_WINDOW 1024
+/* How many relinks ahead spatial_grid_move_batch prefetches list entries. */
+#define SPATIAL_PREFETCH 8
+
+/**
+ * Index of the extra bucket holding shapes larger than one cell.
+ */
+static int oversized_bucket(const SpatialGrid *grid) {
+  return grid->bucketMask + 1;
+}
+
+static int cell_coord(const SpatialGrid *grid, float x) {
+  return (int)floorf(x * grid->invCellSize);
+}
+
+static int cell_bucket(const SpatialGrid *grid, int x, int y) {
+  unsigned int h = (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u;
+  return (int)(h & (unsigned int)grid->bucketMask);
+}
+
+static int next_power_of_two(int value) {
+  int result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+static void link_entry(SpatialGrid *grid, int id) {
+  SpatialEntry *entry = &grid->entries[id];
+  float width = entry->max[0] - entry->min[0];
+  float height = entry->max[1] - entry->min[1];
+
+  entry->cellX = cell_coord(grid, (entry->min[0] + entry->max[0]) * 0.5f);
+  entry->cellY = cell_coord(grid, (entry->min[1] + entry->max[1]) * 0.5f);
+  if (width > grid->cellSize || height > grid->cellSize) {
+    entry->bucket = oversized_bucket(grid);
+  } else {
+    entry->bucket = cell_bucket(grid, entry->cellX, entry->cellY);
+  }
+
+  entry->prev = SPATIAL_NONE;
+  entry->next = grid->buckets[entry->bucket];
+  if (entry->next != SPATIAL_NONE) {
+    grid->entries[entry->next].prev = id;
+  }
+  grid->buckets[entry->bucket] = id;
+}
+
+static void unlink_entry(SpatialGrid *grid, int id) {
+  SpatialEntry *entry = &grid->entries[id];
+
+  if (entry->prev != SPATIAL_NONE) {
+    grid->entries[entry->prev].next = entry->next;
+  } else {
+    grid->buckets[entry->bucket] = entry->next;
+  }
+  if (entry->next != SPATIAL_NONE) {
+    grid->entries[entry->next].prev = entry->prev;
+  }
+}
+
+/**
+ * Reallocates the bucket table so it stays at least twice the pool size and
+ * relinks every live shape. Runs only when the pool grows.
+ */
+static int rehash(SpatialGrid *grid, int bucketCount) {
+  int *buckets = malloc((bucketCount + 1) * sizeof(int));
+  if (!buckets) {
+    return -1;
+  }
+  for (int i = 0; i <= bucketCount; i++) {
+    buckets[i] = SPATIAL_NONE;
+  }
+
+  free(grid->buckets);
+  grid->buckets = buckets;
+  grid->bucketMask = bucketCount - 1;
+
+  for (int id = 0; id < grid->capacity; id++) {
+    if (grid->entries[id].bucket != SPATIAL_FREE) {
+      link_entry(grid, id);
+    }
+  }
+  return 0;
+}
+
+/**
+ * Initializes an empty grid. capacity is a hint for the number of shapes, the
+ * pool grows by doubling when it is exceeded.
+ * Returns 0 on success and -1 if an allocation fails.
+ */
+int spatial_grid_init(SpatialGrid *grid, float cellSize, int capacity) {
+  grid->cellSize = cellSize;
+  grid->invCellSize = 1.0f / cellSize;
+  grid->capacity = 0;
+  grid->count = 0;
+  grid->freeList = SPATIAL_NONE;
+  grid->entries = NULL;
+  grid->buckets = NULL;
+
+  if (capacity < 16) {
+    capacity = 16;
+  }
+  grid->entries = malloc(capacity * sizeof(SpatialEntry));
+  if (!grid->entries) {
+    return -1;
+  }
+  grid->capacity = capacity;
+
+  /* Free slots are chained through next, lowest ids are handed out first. */
+  for (int i = 0; i < capacity; i++) {
+    grid->entries[i].bucket = SPATIAL_FREE;
+    grid->entries[i].next = i + 1 < capacity ? i + 1 : SPATIAL_NONE;
+  }
+  grid->freeList = 0;
+
+  if (rehash(grid, next_power_of_two(capacity * 2)) != 0) {
+    spatial_grid_free(grid);
+    return -1;
+  }
+  return 0;
+}
+
+void spatial_grid_free(SpatialGrid *grid) {
+  free(grid->entries);
+  free(grid->buckets);
+  grid->entries = NULL;
+  grid->buckets = NULL;
+  grid->capacity = 0;
+  grid->count = 0;
+  grid->freeList = SPATIAL_NONE;
+}
+
+static int grow(SpatialGrid *grid) {
+  int capacity = grid->capacity * 2;
+  SpatialEntry *entries =
+      realloc(grid->entries, capacity * sizeof(SpatialEntry));
+  if (!entries) {
+    return -1;
+  }
+  grid->entries = entries;
+
+  for (int i = grid->capacity; i < capacity; i++) {
+    entries[i].bucket = SPATIAL_FREE;
+    entries[i].next = i + 1 < capacity ? i + 1 : grid->freeList;
+  }
+  grid->freeList = grid->capacity;
+  grid->capacity = capacity;
+
+  return rehash(grid, next_power_of_two(capacity * 2));
+}
+
+/**
+ * Adds a shape and returns its id, which stays valid until it is removed.
+ * Returns -1 if the pool cannot grow.
+ */
+int spatial_grid_insert(SpatialGrid *grid, vec2 aabb[2]) {
+  if (grid->freeList == SPATIAL_NONE && grow(grid) != 0) {
+    return -1;
+  }
+
+  int id = grid->freeList;
+  SpatialEntry *entry = &grid->entries[id];
+  grid->freeList = entry->next;
+
+  entry->min[0] = aabb[0][0];
+  entry->min[1] = aabb[0][1];
+  entry->max[0] = aabb[1][0];
+  entry->max[1] = aabb[1][1];
+  link_entry(grid, id);
+  grid->count++;
+  return id;
+}
+
+/**
+ * Rewrites the bounds of a shape and returns whether it left its bucket.
+ */
+static int set_bounds(SpatialGrid *grid, int id, vec2 aabb[2]) {
+  SpatialEntry *entry = &grid->entries[id];
+  float width = aabb[1][0] - aabb[0][0];
+  float height = aabb[1][1] - aabb[0][1];
+  int oversized = width > grid->cellSize || height > grid->cellSize;
+  int cellX = cell_coord(grid, (aabb[0][0] + aabb[1][0]) * 0.5f);
+  int cellY = cell_coord(grid, (aabb[0][1] + aabb[1][1]) * 0.5f);
+
+  entry->min[0] = aabb[0][0];
+  entry->min[1] = aabb[0][1];
+  entry->max[0] = aabb[1][0];
+  entry->max[1] = aabb[1][1];
+
+  return oversized != (entry->bucket == oversized_bucket(grid)) ||
+         cellX != entry->cellX || cellY != entry->cellY;
+}
+
+/**
+ * Updates the bounds of a shape. Shapes which stay in the same cell only have
+ * their bounds rewritten, which is the common case for per-frame motion.
+ */
+void spatial_grid_move(SpatialGrid *grid, int id, vec2 aabb[2]) {
+  if (set_bounds(grid, id, aabb)) {
+    unlink_entry(grid, id);
+    link_entry(grid, id);
+  }
+}
+
+/**
+ * Prefetches what relinking a shape writes: its list neighbours, or the head
+ * of its old bucket, and the head of its new bucket.
+ */
+static void prefetch_relink(const SpatialGrid *grid, int id) {
+  const SpatialEntry *entry = &grid->entries[id];
+  int x = cell_coord(grid, (entry->min[0] + entry->max[0]) * 0.5f);
+  int y = cell_coord(grid, (entry->min[1] + entry->max[1]) * 0.5f);
+
+  if (entry->prev != SPATIAL_NONE) {
+    __builtin_prefetch(&grid->entries[entry->prev], 1);
+  } else {
+    __builtin_prefetch(&grid->buckets[entry->bucket], 1);
+  }
+  if (entry->next != SPATIAL_NONE) {
+    __builtin_prefetch(&grid->entries[entry->next], 1);
+  }
+  __builtin_prefetch(&grid->buckets[cell_bucket(grid, x, y)], 1);
+}
+
+/**
+ * Prefetches the entry heading the new bucket of a shape, once the bucket
+ * itself has been prefetched by prefetch_relink.
+ */
+static void prefetch_head(const SpatialGrid *grid, int id) {
+  const SpatialEntry *entry = &grid->entries[id];
+  int x = cell_coord(grid, (entry->min[0] + entry->max[0]) * 0.5f);
+  int y = cell_coord(grid, (entry->min[1] + entry->max[1]) * 0.5f);
+  int head = grid->buckets[cell_bucket(grid, x, y)];
+
+  if (head != SPATIAL_NONE) {
+    __builtin_prefetch(&grid->entries[head], 1);
+  }
+}
+
+/**
+ * Moves shapes ids[0] to ids[count - 1] to the matching aabbs. Bounds are
+ * written in windows of SPATIAL_MOVE_WINDOW shapes first, then the shapes
+ * which changed cell are relinked while the list neighbours and bucket heads
+ * of later ones are prefetched, since those are scattered across the pool.
+ */
+void spatial_grid_move_batch(SpatialGrid *grid, const int *ids,
+                             vec2 (*aabbs)[2], int count) {
+  int moved[SPATIAL_MOVE_WINDOW];
+
+  for (int begin = 0; begin < count; begin += SPATIAL_MOVE_WINDOW) {
+    int end = begin + SPATIAL_MOVE_WINDOW < count ? begin + SPATIAL_MOVE_WINDOW
+                                                  : count;
+    int movedCount = 0;
+    for (int i = begin; i < end; i++) {
+      if (set_bounds(grid, ids[i], aabbs[i])) {
+        moved[movedCount++] = ids[i];
+      }
+    }
+
+    for (int i = 0; i < movedCount; i++) {
+      if (i + 2 * SPATIAL_PREFETCH < movedCount) {
+        prefetch_relink(grid, moved[i + 2 * SPATIAL_PREFETCH]);
+      }
+      if (i + SPATIAL_PREFETCH < movedCount) {
+        prefetch_head(grid, moved[i + SPATIAL_PREFETCH]);
+      }
+      unlink_entry(grid, moved[i]);
+      link_entry(grid, moved[i]);
+    }
+  }
+}
+
+void spatial_grid_remove(SpatialGrid *grid, int id) {
+  SpatialEntry *entry = &grid->entries[id];
+
+  unlink_entry(grid, id);
+  entry->bucket = SPATIAL_FREE;
+  entry->next = grid->freeList;
+  grid->freeList = id;
+  grid->count--;
+}
+
+static int overlaps(const SpatialEntry *entry, const float *min,
+                    const float *max) {
+  return entry->min[0] <= max[0] && entry->max[0] >= min[0] &&
+         entry->min[1] <= max[1] && entry->max[1] >= min[1];
+}
+
+/**
+ * Visits every shape overlapping [min, max] with an id greater than minId.
+ * Cells are widened by half a cell because shapes are binned by center only.
+ */
+static int collect(const SpatialGrid *grid, const float *min, const float *max,
+                   int minId, int *results, int maxResults, int found) {
+  float margin = grid->cellSize * 0.5f;
+  int x0 = cell_coord(grid, min[0] - margin);
+  int y0 = cell_coord(grid, min[1] - margin);
+  int x1 = cell_coord(grid, max[0] + margin);
+  int y1 = cell_coord(grid, max[1] + margin);
+  long long cells = (long long)(x1 - x0 + 1) * (y1 - y0 + 1);
+
+  if (cells > grid->bucketMask + 1) {
+    /* Region covers more cells than buckets, scanning the pool is cheaper. */
+    for (int id = minId + 1; id < grid->capacity; id++) {
+      const SpatialEntry *entry = &grid->entries[id];
+      if (entry->bucket != SPATIAL_FREE && overlaps(entry, min, max)) {
+        if (found < maxResults) {
+          results[found] = id;
+        }
+        found++;
+      }
+    }
+    return found;
+  }
+
+  for (int y = y0; y <= y1; y++) {
+    for (int x = x0; x <= x1; x++) {
+      int id = grid->buckets[cell_bucket(grid, x, y)];
+      for (; id != SPATIAL_NONE; id = grid->entries[id].next) {
+        const SpatialEntry *entry = &grid->entries[id];
+        /* Buckets are shared between cells, skip the other cells' shapes. */
+        if (id <= minId || entry->cellX != x || entry->cellY != y ||
+            !overlaps(entry, min, max)) {
+          continue;
+        }
+        if (found < maxResults) {
+          results[found] = id;
+        }
+        found++;
+      }
+    }
+  }
+
+  int id = grid->buckets[oversized_bucket(grid)];
+  for (; id != SPATIAL_NONE; id = grid->entries[id].next) {
+    if (id > minId && overlaps(&grid->entries[id], min, max)) {
+      if (found < maxResults) {
+        results[found] = id;
+      }
+      found++;
+    }
+  }
+  return found;
+}
+
+/**
+ * Writes the ids of all shapes overlapping region into results.
+ * Returns the total number of overlapping shapes, which may exceed maxResults.
+ */
+int spatial_grid_query(const SpatialGrid *grid, vec2 region[2], int *results,
+                       int maxResults) {
+  return collect(grid, region[0], region[1], SPATIAL_NONE, results, maxResults,
+                 0);
+}
+
+/**
+ * Runs several region queries into one result array. The hits of region i are
+ * stored in results[offsets[i]] to results[offsets[i + 1] - 1], so offsets
+ * must hold regionCount + 1 elements.
+ * Returns the number of ids written; results past maxResults are dropped.
+ */
+int spatial_grid_query_batch(const SpatialGrid *grid, vec2 (*regions)[2],
+                             int regionCount, int *results, int maxResults,
+                             int *offsets) {
+  int written = 0;
+
+  for (int i = 0; i < regionCount; i++) {
+    offsets[i] = written;
+    int found = collect(grid, regions[i][0], regions[i][1], SPATIAL_NONE,
+                        results + written, maxResults - written, 0);
+    written += found < maxResults - written ? found : maxResults - written;
+  }
+  offsets[regionCount] = written;
+  return written;
+}
+
+/**
+ * Finds every pair of overlapping shapes, each pair reported once with a < b.
+ * Returns the total number of pairs, which may exceed maxPairs, or -1 if the
+ * candidate buffer cannot grow.
+ */
+int spatial_grid_pairs(const SpatialGrid *grid, SpatialPair *pairs,
+                       int maxPairs) {
+  int capacity = 256;
+  int *candidates = malloc(capacity * sizeof(int));
+  if (!candidates) {
+    return -1;
+  }
+  int found = 0;
+
+  for (int a = 0; a < grid->capacity; a++) {
+    const SpatialEntry *entry = &grid->entries[a];
+    if (entry->bucket == SPATIAL_FREE) {
+      continue;
+    }
+
+    int count =
+        collect(grid, entry->min, entry->max, a, candidates, capacity, 0);
+    if (count > capacity) {
+      /* Dense cluster, grow the buffer to fit and collect again. */
+      int *grown = realloc(candidates, count * sizeof(int));
+      if (!grown) {
+        free(candidates);
+        return -1;
+      }
+      candidates = grown;
+      capacity = count;
+      collect(grid, entry->min, entry->max, a, candidates, capacity, 0);
+    }
+
+    for (int i = 0; i < count; i++) {
+      if (found < maxPairs) {
+        pairs[found].a = a;
+        pairs[found].b = candidates[i];
+      }
+      found++;
+    }
+  }
+  free(candidates);
+  return found;
+}
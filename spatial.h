@@ -0,0 +1,55 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include <cglm/types.h>
+
+/**
+ * Shape stored in the grid. Shapes live in one contiguous pool and are linked
+ * into the bucket of the cell containing their center.
+ */
+typedef struct {
+  vec2 min;
+  vec2 max;
+  int cellX, cellY;
+  int bucket;
+  int next, prev;
+} SpatialEntry;
+
+/**
+ * Loose uniform grid hashed into a fixed power-of-two bucket table. Shapes up
+ * to one cell in size are stored by their center, larger ones are kept in a
+ * separate list that every query scans.
+ */
+typedef struct {
+  float cellSize;
+  float invCellSize;
+  SpatialEntry *entries;
+  int capacity;
+  int count;
+  int freeList;
+  int *buckets;
+  int bucketMask;
+} SpatialGrid;
+
+typedef struct {
+  int a, b;
+} SpatialPair;
+
+int spatial_grid_init(SpatialGrid *grid, float cellSize, int capacity);
+void spatial_grid_free(SpatialGrid *grid);
+
+int spatial_grid_insert(SpatialGrid *grid, vec2 aabb[2]);
+void spatial_grid_move(SpatialGrid *grid, int id, vec2 aabb[2]);
+void spatial_grid_move_batch(SpatialGrid *grid, const int *ids,
+                             vec2 (*aabbs)[2], int count);
+void spatial_grid_remove(SpatialGrid *grid, int id);
+
+int spatial_grid_query(const SpatialGrid *grid, vec2 region[2], int *results,
+                       int maxResults);
+int spatial_grid_query_batch(const SpatialGrid *grid, vec2 (*regions)[2],
+                             int regionCount, int *results, int maxResults,
+                             int *offsets);
+int spatial_grid_pairs(const SpatialGrid *grid, SpatialPair *pairs,
+                       int maxPairs);
+
+#endif
@@ -1,2 +1,17 @@
+#include "image.h"
+#include "jobs.h"
+
+/* Decodes large JPEGs and interlaced PNGs on the job pool; images must
+ * therefore not be loaded from inside a parallel loop. */
+#define STBI_PARALLEL_FOR(count, func, context)                                \
+  jobs_parallel_for(count, 1, func, context)
+
+/* Decoder memory comes from the per-thread arena of image.c while an image
+ * is loaded through it, and from the heap otherwise. */
+#define STBI_MALLOC(size) image_arena_alloc(size)
+#define STBI_REALLOC_SIZED(p, oldSize, newSize)                                \
+  image_arena_realloc(p, oldSize, newSize)
+#define STBI_FREE(p) image_arena_free(p)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -257,9 +257,9 @@ at the end of the credits.
 //
 // SIMD support
 //
-// The JPEG decoder will try to automatically use SIMD kernels on x86 when
-// supported by the compiler. For ARM Neon support, you must explicitly
-// request it.
+// The JPEG decoder and PNG unfiltering will try to automatically use SIMD
+// kernels on x86 when supported by the compiler. For ARM Neon support, you
+// must explicitly request it (JPEG only).
 //
 // (The old do-it-yourself SIMD API is no longer supported in the current
 // code.)
@@ -270,12 +270,36 @@ at the end of the credits.
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// On x86 the JPEG IDCT, YCbCr conversion and 2x2 upsampling, and the PNG Up
+// and Sub filters additionally have AVX2 versions that are selected at run
+// time when the CPU supports them. They produce bit-identical results to the
+// SSE2 kernels; define STBI_NO_AVX2 to leave them out.
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
 // ===========================================================================
 //
+// Multithreaded decoding
+//
+// stb_image does not create threads itself, but it can spread JPEG and
+// interlaced PNG decoding over a thread pool you provide. Before including
+// the implementation, define
+//
+//     STBI_PARALLEL_FOR(count, func, context)
+//
+// to call func(context, begin, end) for disjoint ranges covering [0, count),
+// in any order and on any threads, and to return once all calls finished,
+// where func is a `void (*)(void *context, int begin, int end)`. Baseline
+// scans with restart markers are then decoded one restart segment per task;
+// scans without them overlap huffman decoding with the IDCT. The IDCT of
+// progressive images and the final upsampling and color conversion are
+// split into row bands. The seven passes of large interlaced PNGs are
+// unfiltered in parallel. The output is identical to the serial decoder.
+//
+// ===========================================================================
+//
 // HDR image support   (disable by defining STBI_NO_HDR)
 //
 // stb_image supports loading HDR images in general, and currently the Radiance
@@ -440,10 +464,39 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y,
 // image
 #endif
 
+#ifndef STBI_NO_JPEG
+// decodes a jpeg at 1/8 scale (rounded up) from the dc coefficients alone,
+// which skips the idct and most of the color conversion, and for progressive
+// jpegs the ac scans entirely. meant for previews while the full image loads
+STBIDEF stbi_uc *stbi_load_jpeg_preview_from_memory(stbi_uc const *buffer,
+                                                    int len, int *x, int *y,
+                                                    int *channels_in_file,
+                                                    int desired_channels);
+#endif
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len,
                                            int **delays, int *x, int *y, int *z,
                                            int *comp, int req_comp);
+
+// incremental decoding of animated gifs: frames are decoded one at a time
+// into buffers owned by the stream, so memory use does not depend on the
+// number of frames. a stream opened on a file reads it as it goes; the file
+// must stay open until the stream is closed
+typedef struct stbi_gif_stream stbi_gif_stream;
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_memory(stbi_uc const *buffer,
+                                                     int len, int *x, int *y);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_file(FILE *f, int *x, int *y);
+#endif
+// decodes the next frame as rgba into *frame, which stays valid until the
+// next call. returns 1 for a frame, 0 after the last one and -1 on error.
+// frames are the decoder's working canvas, so they are never flipped
+STBIDEF int stbi_gif_stream_next(stbi_gif_stream *gif, stbi_uc **frame,
+                                 int *delay_ms);
+// restarts the animation at its first frame
+STBIDEF void stbi_gif_stream_rewind(stbi_gif_stream *gif);
+STBIDEF void stbi_gif_stream_close(stbi_gif_stream *gif);
 #endif
 
 #ifdef STBI_WINDOWS_UTF8
@@ -687,12 +740,14 @@ typedef unsigned short stbi__uint16;
 typedef signed short stbi__int16;
 typedef unsigned int stbi__uint32;
 typedef signed int stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -800,7 +855,7 @@ static int stbi__cpuid3(void) {
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if !(defined(STBI_NO_JPEG) && defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void) {
   int info3 = stbi__cpuid3();
   return ((info3 >> 26) & 1) != 0;
@@ -810,7 +865,7 @@ static int stbi__sse2_available(void) {
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if !(defined(STBI_NO_JPEG) && defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void) {
   // If we're even attempting to compile this on GCC/Clang, that means
   // -msse2 is on, which means the compiler is allowed to use SSE2
@@ -819,6 +874,35 @@ static int stbi__sse2_available(void) {
 }
 #endif
 
+#endif
+
+// AVX2 kernels are compiled with a per-function target attribute and only
+// called after a run-time check, so the rest of the file needs no -mavx2.
+#if !defined(STBI_NO_AVX2) &&                                                  \
+    !(defined(STBI_NO_JPEG) && defined(STBI_NO_PNG)) &&                        \
+    ((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) ||          \
+     (defined(__GNUC__) && __GNUC__ >= 5))
+#define STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+static int stbi__avx2_available(void) {
+  int info[4];
+  __cpuid(info, 1);
+  // OSXSAVE and AVX, then make sure the OS saves the ymm registers
+  if ((info[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6)
+    return 0;
+  __cpuidex(info, 7, 0);
+  return ((info[1] >> 5) & 1) != 0;
+}
+#else
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+static int stbi__avx2_available(void) {
+  // also checks OS support for the ymm state
+  return __builtin_cpu_supports("avx2");
+}
+#endif
 #endif
 #endif
 
@@ -1025,6 +1109,15 @@ static int stbi__err(const char *str) {
 
 static void *stbi__malloc(size_t size) { return STBI_MALLOC(size); }
 
+#ifdef STBI_PARALLEL_FOR
+// failure reasons are per thread, so errors on workers are handed back to
+// the decoding thread explicitly
+static const char *stbi__worker_failure(void) {
+  const char *reason = stbi_failure_reason();
+  return reason ? reason : "corrupt";
+}
+#endif
+
 // stb_image uses ints pervasively, including for offset calculations.
 // therefore the largest decoded image size we can support with the
 // current code, even on 64-bit targets, is INT_MAX. this is not a
@@ -2188,6 +2281,7 @@ typedef struct {
 
   int scan_n, order[4];
   int restart_interval, todo;
+  int dc_only; // 1/8 scale preview, see stbi_load_jpeg_preview_from_memory
 
   // kernels
   void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
@@ -2753,6 +2847,13 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64]) {
   }
 }
 
+// "idct" of a dc-only preview: one sample per block, the block mean. this is
+// exactly what stbi__idct_block produces for a block without ac terms
+static void stbi__idct_dc(stbi_uc *out, int out_stride, short data[64]) {
+  STBI_NOTUSED(out_stride);
+  out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2955,6 +3056,191 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64]) {
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 integer IDCT. same structure as the sse2 version, but the 32-bit
+// intermediates of a row fit in a single register, which halves the work in
+// the widened parts of each pass. bit-identical to the generic C version.
+STBI__AVX2_TARGET
+static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64]) {
+  __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+  __m128i tmp;
+
+// dot product constant: even elems=x, odd elems=y
+#define dct_const(x, y)                                                        \
+  _mm256_setr_epi16((x), (y), (x), (y), (x), (y), (x), (y), (x), (y), (x),     \
+                    (y), (x), (y), (x), (y))
+
+// out0 = c0[even]*x + c0[odd]*y, out1 likewise with c1 (x, y 16-bit, out
+// 32-bit)
+#define dct_rot(out0, out1, x, y, c0, c1)                                      \
+  __m256i c0##xy = _mm256_inserti128_si256(                                    \
+      _mm256_castsi128_si256(_mm_unpacklo_epi16((x), (y))),                    \
+      _mm_unpackhi_epi16((x), (y)), 1);                                        \
+  __m256i out0 = _mm256_madd_epi16(c0##xy, c0);                                \
+  __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+// out = in << 12  (in 16-bit, out 32-bit)
+#define dct_widen(out, in)                                                     \
+  __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+// butterfly a/b, add bias, then shift by "s" and pack
+#define dct_bfly32o(out0, out1, a, b, bias, s)                                 \
+  {                                                                            \
+    __m256i abiased = _mm256_add_epi32(a, bias);                               \
+    __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s);          \
+    __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s);          \
+    __m256i packed =                                                           \
+        _mm256_permute4x64_epi64(_mm256_packs_epi32(sum, dif), 0xd8);          \
+    out0 = _mm256_castsi256_si128(packed);                                     \
+    out1 = _mm256_extracti128_si256(packed, 1);                                \
+  }
+
+// 8-bit interleave step (for transposes)
+#define dct_interleave8(a, b)                                                  \
+  tmp = a;                                                                     \
+  a = _mm_unpacklo_epi8(a, b);                                                 \
+  b = _mm_unpackhi_epi8(tmp, b)
+
+// 16-bit interleave step (for transposes)
+#define dct_interleave16(a, b)                                                 \
+  tmp = a;                                                                     \
+  a = _mm_unpacklo_epi16(a, b);                                                \
+  b = _mm_unpackhi_epi16(tmp, b)
+
+#define dct_pass(bias, shift)                                                  \
+  {                                                                            \
+    /* even part */                                                            \
+    dct_rot(t2e, t3e, row2, row6, rot0_0, rot0_1);                             \
+    dct_widen(t0e, _mm_add_epi16(row0, row4));                                 \
+    dct_widen(t1e, _mm_sub_epi16(row0, row4));                                 \
+    __m256i x0 = _mm256_add_epi32(t0e, t3e);                                   \
+    __m256i x3 = _mm256_sub_epi32(t0e, t3e);                                   \
+    __m256i x1 = _mm256_add_epi32(t1e, t2e);                                   \
+    __m256i x2 = _mm256_sub_epi32(t1e, t2e);                                   \
+    /* odd part */                                                             \
+    dct_rot(y0o, y2o, row7, row3, rot2_0, rot2_1);                             \
+    dct_rot(y1o, y3o, row5, row1, rot3_0, rot3_1);                             \
+    __m128i sum17 = _mm_add_epi16(row1, row7);                                 \
+    __m128i sum35 = _mm_add_epi16(row3, row5);                                 \
+    dct_rot(y4o, y5o, sum17, sum35, rot1_0, rot1_1);                           \
+    __m256i x4 = _mm256_add_epi32(y0o, y4o);                                   \
+    __m256i x5 = _mm256_add_epi32(y1o, y5o);                                   \
+    __m256i x6 = _mm256_add_epi32(y2o, y5o);                                   \
+    __m256i x7 = _mm256_add_epi32(y3o, y4o);                                   \
+    dct_bfly32o(row0, row7, x0, x7, bias, shift);                              \
+    dct_bfly32o(row1, row6, x1, x6, bias, shift);                              \
+    dct_bfly32o(row2, row5, x2, x5, bias, shift);                              \
+    dct_bfly32o(row3, row4, x3, x4, bias, shift);                              \
+  }
+
+  __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f),
+                             stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+  __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f(0.765366865f),
+                             stbi__f2f(0.5411961f));
+  __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f),
+                             stbi__f2f(1.175875602f));
+  __m256i rot1_1 =
+      dct_const(stbi__f2f(1.175875602f),
+                stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+  __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f(0.298631336f),
+                             stbi__f2f(-1.961570560f));
+  __m256i rot2_1 =
+      dct_const(stbi__f2f(-1.961570560f),
+                stbi__f2f(-1.961570560f) + stbi__f2f(3.072711026f));
+  __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f(2.053119869f),
+                             stbi__f2f(-0.390180644f));
+  __m256i rot3_1 =
+      dct_const(stbi__f2f(-0.390180644f),
+                stbi__f2f(-0.390180644f) + stbi__f2f(1.501321110f));
+
+  // rounding biases in column/row passes, see stbi__idct_block for explanation.
+  __m256i bias_0 = _mm256_set1_epi32(512);
+  __m256i bias_1 = _mm256_set1_epi32(65536 + (128 << 17));
+
+  // load
+  row0 = _mm_load_si128((const __m128i *)(data + 0 * 8));
+  row1 = _mm_load_si128((const __m128i *)(data + 1 * 8));
+  row2 = _mm_load_si128((const __m128i *)(data + 2 * 8));
+  row3 = _mm_load_si128((const __m128i *)(data + 3 * 8));
+  row4 = _mm_load_si128((const __m128i *)(data + 4 * 8));
+  row5 = _mm_load_si128((const __m128i *)(data + 5 * 8));
+  row6 = _mm_load_si128((const __m128i *)(data + 6 * 8));
+  row7 = _mm_load_si128((const __m128i *)(data + 7 * 8));
+
+  // column pass
+  dct_pass(bias_0, 10);
+
+  {
+    // 16bit 8x8 transpose pass 1
+    dct_interleave16(row0, row4);
+    dct_interleave16(row1, row5);
+    dct_interleave16(row2, row6);
+    dct_interleave16(row3, row7);
+
+    // transpose pass 2
+    dct_interleave16(row0, row2);
+    dct_interleave16(row1, row3);
+    dct_interleave16(row4, row6);
+    dct_interleave16(row5, row7);
+
+    // transpose pass 3
+    dct_interleave16(row0, row1);
+    dct_interleave16(row2, row3);
+    dct_interleave16(row4, row5);
+    dct_interleave16(row6, row7);
+  }
+
+  // row pass
+  dct_pass(bias_1, 17);
+
+  {
+    // pack
+    __m128i p0 = _mm_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+    __m128i p1 = _mm_packus_epi16(row2, row3);
+    __m128i p2 = _mm_packus_epi16(row4, row5);
+    __m128i p3 = _mm_packus_epi16(row6, row7);
+
+    // 8bit 8x8 transpose pass 1
+    dct_interleave8(p0, p2); // a0e0a1e1...
+    dct_interleave8(p1, p3); // c0g0c1g1...
+
+    // transpose pass 2
+    dct_interleave8(p0, p1); // a0c0e0g0...
+    dct_interleave8(p2, p3); // b0d0f0h0...
+
+    // transpose pass 3
+    dct_interleave8(p0, p2); // a0b0c0d0...
+    dct_interleave8(p1, p3); // a4b4c4d4...
+
+    // store
+    _mm_storel_epi64((__m128i *)out, p0);
+    out += out_stride;
+    _mm_storel_epi64((__m128i *)out, _mm_shuffle_epi32(p0, 0x4e));
+    out += out_stride;
+    _mm_storel_epi64((__m128i *)out, p2);
+    out += out_stride;
+    _mm_storel_epi64((__m128i *)out, _mm_shuffle_epi32(p2, 0x4e));
+    out += out_stride;
+    _mm_storel_epi64((__m128i *)out, p1);
+    out += out_stride;
+    _mm_storel_epi64((__m128i *)out, _mm_shuffle_epi32(p1, 0x4e));
+    out += out_stride;
+    _mm_storel_epi64((__m128i *)out, p3);
+    out += out_stride;
+    _mm_storel_epi64((__m128i *)out, _mm_shuffle_epi32(p3, 0x4e));
+  }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -3386,33 +3672,404 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z) {
   }
 }
 
+#ifdef STBI_PARALLEL_FOR
+// parallel baseline decoding, see STBI_PARALLEL_FOR at the top of the file.
+// scans with restart markers are split into their restart segments, which
+// are huffman-decoded and transformed independently. other scans are decoded
+// in bands of rows, and the IDCT of one band runs while the next band is
+// being huffman-decoded.
+
+// scans with fewer 8x8 blocks than this are decoded serially
+#define STBI__PARALLEL_MIN_BLOCKS 4096
+// number of blocks a pipeline band or an IDCT slice should cover
+#define STBI__PIPELINE_BAND_BLOCKS 4096
+#define STBI__PIPELINE_SLICE_BLOCKS 512
+
+typedef struct {
+  stbi_uc *out;
+  int out_stride;
+} stbi__jpeg_block_dest;
+
+// a scan is made of "units", which are MCUs in an interleaved scan and
+// single blocks otherwise, laid out in rows of per_row units
+static void stbi__jpeg_scan_units(stbi__jpeg *z, int *per_row, int *rows,
+                                  int *unit_blocks) {
+  int k;
+  if (z->scan_n == 1) {
+    int n = z->order[0];
+    *per_row = (z->img_comp[n].x + 7) >> 3;
+    *rows = (z->img_comp[n].y + 7) >> 3;
+    *unit_blocks = 1;
+  } else {
+    *per_row = z->img_mcu_x;
+    *rows = z->img_mcu_y;
+    *unit_blocks = 0;
+    for (k = 0; k < z->scan_n; ++k)
+      *unit_blocks += z->img_comp[z->order[k]].h * z->img_comp[z->order[k]].v;
+  }
+}
+
+// decode count units starting at unit first, ignoring restart intervals.
+// without a coefficient buffer the blocks are transformed right away,
+// otherwise their coefficients and destinations are stored for later.
+static int stbi__jpeg_decode_units(stbi__jpeg *z, int first, int count,
+                                   short *coeff, stbi__jpeg_block_dest *dest) {
+  int per_row, rows, unit_blocks, u, k, x, y;
+  STBI_SIMD_ALIGN(short, block[64]);
+  stbi__jpeg_scan_units(z, &per_row, &rows, &unit_blocks);
+  for (u = first; u < first + count; ++u) {
+    int i = u % per_row, j = u / per_row;
+    for (k = 0; k < z->scan_n; ++k) {
+      int n = z->order[k];
+      int bh = z->scan_n == 1 ? 1 : z->img_comp[n].h;
+      int bv = z->scan_n == 1 ? 1 : z->img_comp[n].v;
+      int ha = z->img_comp[n].ha;
+      for (y = 0; y < bv; ++y) {
+        for (x = 0; x < bh; ++x) {
+          int x2 = (i * bh + x) * 8;
+          int y2 = (j * bv + y) * 8;
+          stbi_uc *out = z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2;
+          short *data = coeff ? coeff : block;
+          if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd,
+                                       z->huff_ac + ha, z->fast_ac[ha], n,
+                                       z->dequant[z->img_comp[n].tq]))
+            return 0;
+          if (coeff) {
+            dest->out = out;
+            dest->out_stride = z->img_comp[n].w2;
+            ++dest;
+            coeff += 64;
+          } else {
+            z->idct_block_kernel(out, z->img_comp[n].w2, data);
+          }
+        }
+      }
+    }
+  }
+  return 1;
+}
+
+// copy the rest of a scan from a callback stream, up to and including the
+// marker that ends it
+static stbi_uc *stbi__jpeg_read_scan(stbi__context *s, int *len) {
+  int size = 0, cap = 1 << 16, done = 0;
+  stbi_uc prev = 0;
+  stbi_uc *buf = (stbi_uc *)stbi__malloc(cap);
+  if (!buf)
+    return NULL;
+  while (!done) {
+    stbi_uc *p = s->img_buffer, *e = s->img_buffer_end;
+    if (p >= e) {
+      if (!s->read_from_callbacks)
+        break;
+      stbi__refill_buffer(s);
+      continue;
+    }
+    // look for a byte after 0xff that is neither a stuffed zero, a fill
+    // byte nor a restart marker
+    while (p < e && !done) {
+      if (prev == 0xff) {
+        prev = *p++;
+        done = prev != 0x00 && prev != 0xff && !STBI__RESTART(prev);
+      } else {
+        stbi_uc *ff = (stbi_uc *)memchr(p, 0xff, e - p);
+        prev = ff ? 0xff : 0;
+        p = ff ? ff + 1 : e;
+      }
+    }
+    while (size + (p - s->img_buffer) > cap) {
+      stbi_uc *grown;
+      if (cap > (1 << 29) ||
+          !(grown = (stbi_uc *)STBI_REALLOC_SIZED(buf, cap, cap * 2))) {
+        STBI_FREE(buf);
+        return NULL;
+      }
+      buf = grown;
+      cap *= 2;
+    }
+    memcpy(buf + size, s->img_buffer, p - s->img_buffer);
+    size += (int)(p - s->img_buffer);
+    s->img_buffer = p;
+  }
+  *len = size;
+  return buf;
+}
+
+// split entropy-coded data into restart segments. segment[i] receives the
+// start of segment i for i < max and segment[max] the end of the scan, where
+// *marker is set to the marker that follows it, if any. returns the number
+// of segments found, which may exceed max.
+static int stbi__jpeg_find_segments(const stbi_uc *p, const stbi_uc *end,
+                                    const stbi_uc **segment, int max,
+                                    stbi_uc *marker) {
+  int count = 1;
+  segment[0] = p;
+  *marker = STBI__MARKER_none;
+  while (p + 1 < end) {
+    if (p[0] != 0xff || p[1] == 0xff) { // data or fill byte
+      ++p;
+    } else if (p[1] == 0x00) { // stuffed zero
+      p += 2;
+    } else if (STBI__RESTART(p[1])) {
+      p += 2;
+      if (count < max)
+        segment[count] = p;
+      ++count;
+    } else {
+      *marker = p[1];
+      break;
+    }
+  }
+  if (*marker == STBI__MARKER_none)
+    p = end;
+  segment[max] = p;
+  return count;
+}
+
+typedef struct {
+  stbi__jpeg *z;
+  const stbi_uc **segment;
+  const char **failure;
+  int total;
+} stbi__jpeg_segments;
+
+static void stbi__jpeg_decode_segments(void *context, int begin, int end) {
+  stbi__jpeg_segments *p = (stbi__jpeg_segments *)context;
+  stbi__jpeg *z = (stbi__jpeg *)stbi__malloc(sizeof(stbi__jpeg));
+  stbi__context s;
+  int i;
+  if (!z) {
+    p->failure[begin] = "outofmem";
+    return;
+  }
+  // every segment starts from a fresh entropy decoder, so one private copy
+  // of the decoder state serves the whole range
+  memcpy(z, p->z, sizeof(stbi__jpeg));
+  z->s = &s;
+  for (i = begin; i < end; ++i) {
+    int first = i * z->restart_interval;
+    int count = p->total - first < z->restart_interval ? p->total - first
+                                                       : z->restart_interval;
+    stbi__start_mem(&s, p->segment[i],
+                    (int)(p->segment[i + 1] - p->segment[i]));
+    stbi__jpeg_reset(z);
+    if (!stbi__jpeg_decode_units(z, first, count, NULL, NULL)) {
+      p->failure[i] = stbi__worker_failure();
+      break;
+    }
+  }
+  STBI_FREE(z);
+}
+
+static int stbi__jpeg_parse_restart_segments(stbi__jpeg *z, int total) {
+  stbi__context *s = z->s;
+  stbi__jpeg_segments p;
+  const stbi_uc *start, *end;
+  stbi_uc *copy = NULL;
+  stbi_uc marker;
+  int i, len = 0, ok = 1;
+  int expected = (total - 1) / z->restart_interval + 1;
+
+  if (s->read_from_callbacks) {
+    copy = stbi__jpeg_read_scan(s, &len);
+    if (!copy)
+      return stbi__err("outofmem", "Out of memory");
+    start = copy;
+    end = copy + len;
+  } else {
+    start = s->img_buffer;
+    end = s->img_buffer_end;
+  }
+
+  p.z = z;
+  p.total = total;
+  p.segment = (const stbi_uc **)stbi__malloc_mad2(
+      expected + 1, sizeof(*p.segment) + sizeof(*p.failure), 0);
+  if (!p.segment) {
+    STBI_FREE(copy);
+    return stbi__err("outofmem", "Out of memory");
+  }
+  p.failure = (const char **)(p.segment + expected + 1);
+
+  if (stbi__jpeg_find_segments(start, end, p.segment, expected, &marker) !=
+      expected) {
+    // damaged or unusual restart markers, let the serial decoder deal with
+    // them the way it always does
+    STBI_FREE(p.segment);
+    if (!copy)
+      return stbi__parse_entropy_coded_data(z);
+    {
+      stbi__context mem;
+      stbi__start_mem(&mem, copy, len);
+      z->s = &mem;
+      ok = stbi__parse_entropy_coded_data(z);
+      z->s = s;
+      z->marker = marker;
+      STBI_FREE(copy);
+      return ok;
+    }
+  }
+
+  for (i = 0; i < expected; ++i)
+    p.failure[i] = NULL;
+  STBI_PARALLEL_FOR(expected, stbi__jpeg_decode_segments, &p);
+  for (i = 0; i < expected; ++i) {
+    if (p.failure[i]) {
+      ok = stbi__err(p.failure[i], "Corrupt JPEG");
+      break;
+    }
+  }
+
+  // leave the stream just past the end of the scan, as the serial decoder
+  // would after reading the marker into its bit buffer
+  if (!copy)
+    s->img_buffer = (stbi_uc *)p.segment[expected] +
+                    (marker != STBI__MARKER_none ? 2 : 0);
+  z->marker = marker;
+  STBI_FREE(p.segment);
+  STBI_FREE(copy);
+  return ok;
+}
+
+typedef struct {
+  stbi__jpeg *z;
+  short *coeff[2];
+  stbi__jpeg_block_dest *dest[2];
+  int blocks[2];
+  int band, band_units, total, slices;
+  const char *failure;
+} stbi__jpeg_pipeline;
+
+// job 0 huffman-decodes the current band into one half of the buffers,
+// jobs 1..slices transform the previous band from the other half
+static void stbi__jpeg_pipeline_step(void *context, int begin, int end) {
+  stbi__jpeg_pipeline *p = (stbi__jpeg_pipeline *)context;
+  int t, b;
+  for (t = begin; t < end; ++t) {
+    if (t == 0) {
+      int half = p->band & 1;
+      int first = p->band * p->band_units;
+      int count = p->total - first < p->band_units ? p->total - first
+                                                   : p->band_units;
+      if (count > 0 && !stbi__jpeg_decode_units(p->z, first, count,
+                                                p->coeff[half], p->dest[half]))
+        p->failure = stbi__worker_failure();
+    } else {
+      int half = (p->band - 1) & 1;
+      int b0 = (t - 1) * STBI__PIPELINE_SLICE_BLOCKS;
+      int b1 = b0 + STBI__PIPELINE_SLICE_BLOCKS < p->blocks[half]
+                   ? b0 + STBI__PIPELINE_SLICE_BLOCKS
+                   : p->blocks[half];
+      for (b = b0; b < b1; ++b)
+        p->z->idct_block_kernel(p->dest[half][b].out,
+                                p->dest[half][b].out_stride,
+                                p->coeff[half] + 64 * b);
+    }
+  }
+}
+
+static int stbi__jpeg_parse_pipelined(stbi__jpeg *z, int per_row, int total,
+                                      int unit_blocks) {
+  stbi__jpeg_pipeline p;
+  void *buffer;
+  int rows, band_blocks, bands, band;
+
+  rows = STBI__PIPELINE_BAND_BLOCKS / (per_row * unit_blocks);
+  if (rows < 1)
+    rows = 1;
+  p.z = z;
+  p.band_units = per_row * rows;
+  p.total = total;
+  p.failure = NULL;
+  band_blocks = p.band_units * unit_blocks;
+  p.slices = (band_blocks + STBI__PIPELINE_SLICE_BLOCKS - 1) /
+             STBI__PIPELINE_SLICE_BLOCKS;
+  bands = (total + p.band_units - 1) / p.band_units;
+
+  // two halves of coefficients, 16-byte aligned for the SIMD IDCTs, and
+  // their destinations
+  buffer = stbi__malloc_mad2(
+      band_blocks, 2 * (64 * sizeof(short) + sizeof(stbi__jpeg_block_dest)),
+      15);
+  if (!buffer)
+    return stbi__err("outofmem", "Out of memory");
+  p.coeff[0] = (short *)(((size_t)buffer + 15) & ~(size_t)15);
+  p.coeff[1] = p.coeff[0] + 64 * band_blocks;
+  p.dest[0] = (stbi__jpeg_block_dest *)(p.coeff[1] + 64 * band_blocks);
+  p.dest[1] = p.dest[0] + band_blocks;
+
+  stbi__jpeg_reset(z);
+  for (band = 0; band <= bands && !p.failure; ++band) {
+    int left = total - band * p.band_units;
+    p.band = band;
+    if (band < bands)
+      p.blocks[band & 1] =
+          (left < p.band_units ? left : p.band_units) * unit_blocks;
+    STBI_PARALLEL_FOR(band > 0 ? 1 + p.slices : 1, stbi__jpeg_pipeline_step,
+                      &p);
+  }
+  STBI_FREE(buffer);
+  if (p.failure)
+    return stbi__err(p.failure, "Corrupt JPEG");
+  return 1;
+}
+
+static int stbi__parse_entropy_coded_data_parallel(stbi__jpeg *z) {
+  int per_row, rows, unit_blocks, total;
+  if (z->progressive)
+    return stbi__parse_entropy_coded_data(z);
+  stbi__jpeg_scan_units(z, &per_row, &rows, &unit_blocks);
+  total = per_row * rows;
+  if (total * unit_blocks < STBI__PARALLEL_MIN_BLOCKS)
+    return stbi__parse_entropy_coded_data(z);
+  if (z->restart_interval)
+    return stbi__jpeg_parse_restart_segments(z, total);
+  return stbi__jpeg_parse_pipelined(z, per_row, total, unit_blocks);
+}
+#endif // STBI_PARALLEL_FOR
+
 static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant) {
   int i;
   for (i = 0; i < 64; ++i)
     data[i] *= dequant[i];
 }
 
-static void stbi__jpeg_finish(stbi__jpeg *z) {
-  if (z->progressive) {
-    // dequantize and idct the data
-    int i, j, n;
-    for (n = 0; n < z->s->img_n; ++n) {
-      int w = (z->img_comp[n].x + 7) >> 3;
-      int h = (z->img_comp[n].y + 7) >> 3;
-      for (j = 0; j < h; ++j) {
-        for (i = 0; i < w; ++i) {
-          short *data =
-              z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-          stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-          z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 +
-                                   i * 8,
-                               z->img_comp[n].w2, data);
-        }
+// dequantize and idct the block rows [begin, end), counting the rows of all
+// components one after another
+static void stbi__jpeg_finish_rows(void *context, int begin, int end) {
+  stbi__jpeg *z = (stbi__jpeg *)context;
+  int i, j, n, row = 0;
+  for (n = 0; n < z->s->img_n; ++n) {
+    int w = (z->img_comp[n].x + 7) >> 3;
+    int h = (z->img_comp[n].y + 7) >> 3;
+    for (j = 0; j < h; ++j, ++row) {
+      if (row < begin || row >= end)
+        continue;
+      for (i = 0; i < w; ++i) {
+        short *data =
+            z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+        stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+        z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 +
+                                 i * 8,
+                             z->img_comp[n].w2, data);
       }
     }
   }
 }
 
+static void stbi__jpeg_finish(stbi__jpeg *z) {
+  if (z->progressive) {
+    int n, rows = 0;
+    for (n = 0; n < z->s->img_n; ++n)
+      rows += (z->img_comp[n].y + 7) >> 3;
+#ifdef STBI_PARALLEL_FOR
+    STBI_PARALLEL_FOR(rows, stbi__jpeg_finish_rows, z);
+#else
+    stbi__jpeg_finish_rows(z, 0, rows);
+#endif
+  }
+}
+
 static int stbi__process_marker(stbi__jpeg *z, int m) {
   int L;
   switch (m) {
@@ -3781,6 +4438,21 @@ static stbi_uc stbi__skip_jpeg_junk_at_end(stbi__jpeg *j) {
   return STBI__MARKER_none;
 }
 
+// skip the entropy-coded data of a scan up to the next marker other than a
+// restart marker, leaving it in j->marker
+static void stbi__jpeg_skip_scan(stbi__jpeg *j) {
+  while (!stbi__at_eof(j->s)) {
+    int x = stbi__get8(j->s);
+    while (x == 0xff) {
+      x = stbi__get8(j->s);
+      if (x != 0 && x != 0xff && !STBI__RESTART(x)) {
+        j->marker = (unsigned char)x;
+        return;
+      }
+    }
+  }
+}
+
 // decode image to YCbCr format
 static int stbi__decode_jpeg_image(stbi__jpeg *j) {
   int m;
@@ -3796,8 +4468,19 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j) {
     if (stbi__SOS(m)) {
       if (!stbi__process_scan_header(j))
         return 0;
+      if (j->dc_only && j->progressive && j->spec_start != 0) {
+        // a preview only needs the dc scans
+        stbi__jpeg_skip_scan(j);
+        m = stbi__get_marker(j);
+        continue;
+      }
+#ifdef STBI_PARALLEL_FOR
+      if (!stbi__parse_entropy_coded_data_parallel(j))
+        return 0;
+#else
       if (!stbi__parse_entropy_coded_data(j))
         return 0;
+#endif
       if (j->marker == STBI__MARKER_none) {
         j->marker = stbi__skip_jpeg_junk_at_end(j);
         // if we reach eof without hitting a marker, stbi__get_marker() below
@@ -3825,6 +4508,26 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j) {
   return 1;
 }
 
+// shrink the component planes of a dc-only decode, which hold one sample at
+// the top left of every 8x8 block, to 1/8 scale in place
+static void stbi__jpeg_compact_dc(stbi__jpeg *z) {
+  int n, i, j;
+  for (n = 0; n < z->s->img_n; ++n) {
+    stbi_uc *data = z->img_comp[n].data;
+    int w2 = z->img_comp[n].w2;
+    int w = w2 >> 3, h = z->img_comp[n].h2 >> 3;
+    for (j = 0; j < h; ++j)
+      for (i = 0; i < w; ++i)
+        data[j * w + i] = data[j * 8 * w2 + i * 8];
+    z->img_comp[n].w2 = w;
+    z->img_comp[n].h2 = h;
+    z->img_comp[n].x = (z->img_comp[n].x + 7) >> 3;
+    z->img_comp[n].y = (z->img_comp[n].y + 7) >> 3;
+  }
+  z->s->img_x = (z->s->img_x + 7) >> 3;
+  z->s->img_y = (z->s->img_y + 7) >> 3;
+}
+
 // static jfif-centered resampling (across block boundaries)
 
 typedef stbi_uc *(*resample_row_func)(stbi_uc *out, stbi_uc *in0, stbi_uc *in1,
@@ -4024,6 +4727,84 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near,
 }
 #endif
 
+#ifdef STBI_AVX2
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near,
+                                             stbi_uc *in_far, int w, int hs) {
+  // same filter as stbi__resample_row_hv_2_simd, 16 pixels at a time
+  int i = 0, t0, t1;
+
+  if (w == 1) {
+    out[0] = out[1] = stbi__div4(3 * in_near[0] + in_far[0] + 2);
+    return out;
+  }
+
+  t1 = 3 * in_near[0] + in_far[0];
+  for (; i < ((w - 1) & ~15); i += 16) {
+    // vertical pass: 3*x + y = 4*x + (y - x)
+    __m256i farw =
+        _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)(in_far + i)));
+    __m256i nearw =
+        _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)(in_near + i)));
+    __m256i diff = _mm256_sub_epi16(farw, nearw);
+    __m256i nears = _mm256_slli_epi16(nearw, 2);
+    __m256i curr = _mm256_add_epi16(nears, diff); // current row
+
+    // shift the current row by one pixel across the 128-bit lane boundary;
+    // the low half of "prv0" and the high half of "nxt0" pull in zeroes,
+    // which get replaced by the neighbouring pixels outside this block.
+    __m256i prv0 = _mm256_alignr_epi8(
+        curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+    __m256i nxt0 = _mm256_alignr_epi8(
+        _mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+    __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+    __m256i next =
+        _mm256_insert_epi16(nxt0, 3 * in_near[i + 16] + in_far[i + 16], 15);
+
+    // horizontal pass, polyphase:
+    // even pixels = cur*4 + (prev - cur), odd pixels = cur*4 + (next - cur)
+    __m256i bias = _mm256_set1_epi16(8);
+    __m256i curs = _mm256_slli_epi16(curr, 2);
+    __m256i prvd = _mm256_sub_epi16(prev, curr);
+    __m256i nxtd = _mm256_sub_epi16(next, curr);
+    __m256i curb = _mm256_add_epi16(curs, bias);
+    __m256i even = _mm256_add_epi16(prvd, curb);
+    __m256i odd = _mm256_add_epi16(nxtd, curb);
+
+    // interleave even and odd pixels, then undo scaling. the in-lane
+    // unpacks and pack leave pixels 0..7 in the low lane and 8..15 in the
+    // high lane, which is already the output order.
+    __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+    __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+    __m256i de0 = _mm256_srli_epi16(int0, 4);
+    __m256i de1 = _mm256_srli_epi16(int1, 4);
+
+    // pack and write output
+    __m256i outv = _mm256_packus_epi16(de0, de1);
+    _mm256_storeu_si256((__m256i *)(out + i * 2), outv);
+
+    // "previous" value for next iter
+    t1 = 3 * in_near[i + 15] + in_far[i + 15];
+  }
+
+  t0 = t1;
+  t1 = 3 * in_near[i] + in_far[i];
+  out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+
+  for (++i; i < w; ++i) {
+    t0 = t1;
+    t1 = 3 * in_near[i] + in_far[i];
+    out[i * 2 - 1] = stbi__div16(3 * t0 + t1 + 8);
+    out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+  }
+  out[w * 2 - 1] = stbi__div4(t1 + 2);
+
+  STBI_NOTUSED(hs);
+
+  return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near,
                                            stbi_uc *in_far, int w, int hs) {
   // resample with nearest-neighbor
@@ -4232,6 +5013,79 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y,
 }
 #endif
 
+#ifdef STBI_AVX2
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y,
+                                    stbi_uc const *pcb, stbi_uc const *pcr,
+                                    int count, int step) {
+  int i = 0;
+
+  // same arithmetic as the sse2 path, 16 pixels at a time; the remaining
+  // pixels and step == 3 go through stbi__YCbCr_to_RGB_simd.
+  if (step == 4) {
+    __m128i signflip = _mm_set1_epi8(-0x80);
+    __m256i cr_const0 = _mm256_set1_epi16((short)(1.40200f * 4096.0f + 0.5f));
+    __m256i cr_const1 = _mm256_set1_epi16(-(short)(0.71414f * 4096.0f + 0.5f));
+    __m256i cb_const0 = _mm256_set1_epi16(-(short)(0.34414f * 4096.0f + 0.5f));
+    __m256i cb_const1 = _mm256_set1_epi16((short)(1.77200f * 4096.0f + 0.5f));
+    __m256i y_bias = _mm256_set1_epi16(128);
+    __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+    for (; i + 15 < count; i += 16) {
+      // load
+      __m128i y_bytes = _mm_loadu_si128((__m128i *)(y + i));
+      __m128i cr_bytes = _mm_loadu_si128((__m128i *)(pcr + i));
+      __m128i cb_bytes = _mm_loadu_si128((__m128i *)(pcb + i));
+      __m128i cr_biased = _mm_xor_si128(cr_bytes, signflip); // -128
+      __m128i cb_biased = _mm_xor_si128(cb_bytes, signflip); // -128
+
+      // widen to short (and left-shift y, cr, cb by 8)
+      __m256i yw = _mm256_or_si256(
+          _mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+      __m256i crw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cr_biased), 8);
+      __m256i cbw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cb_biased), 8);
+
+      // color transform
+      __m256i yws = _mm256_srli_epi16(yw, 4);
+      __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+      __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+      __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+      __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+      __m256i rws = _mm256_add_epi16(cr0, yws);
+      __m256i gwt = _mm256_add_epi16(cb0, yws);
+      __m256i bws = _mm256_add_epi16(yws, cb1);
+      __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+      // descale
+      __m256i rw = _mm256_srai_epi16(rws, 4);
+      __m256i bw = _mm256_srai_epi16(bws, 4);
+      __m256i gw = _mm256_srai_epi16(gws, 4);
+
+      // back to byte, set up for transpose
+      __m256i brb = _mm256_packus_epi16(rw, bw);
+      __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+      // transpose to interleave channels. every step stays within its
+      // 128-bit lane, so o0/o1 hold pixels 0..3/4..7 in the low lane and
+      // 8..11/12..15 in the high lane.
+      __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+      __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+      __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+      __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+      // store
+      _mm256_storeu_si256((__m256i *)(out + 0),
+                          _mm256_permute2x128_si256(o0, o1, 0x20));
+      _mm256_storeu_si256((__m256i *)(out + 32),
+                          _mm256_permute2x128_si256(o0, o1, 0x31));
+      out += 64;
+    }
+  }
+
+  stbi__YCbCr_to_RGB_simd(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j) {
   j->idct_block_kernel = stbi__idct_block;
@@ -4246,6 +5100,14 @@ static void stbi__setup_jpeg(stbi__jpeg *j) {
   }
 #endif
 
+#ifdef STBI_AVX2
+  if (stbi__avx2_available()) {
+    j->idct_block_kernel = stbi__idct_avx2;
+    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+  }
+#endif
+
 #ifdef STBI_NEON
   j->idct_block_kernel = stbi__idct_simd;
   j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
@@ -4273,6 +5135,155 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y) {
   return (stbi_uc)((t + (t >> 8)) >> 8);
 }
 
+typedef struct {
+  stbi__jpeg *z;
+  stbi__resample res_comp[4]; // resampler state at the first row
+  stbi_uc *output;
+  stbi_uc *scratch; // one row per band, see stbi__jpeg_convert_rows
+  int n, decode_n, is_rgb;
+  int band_rows;
+} stbi__jpeg_convert;
+
+// resample and color-convert the row bands [begin, end). every call starts
+// its own resamplers at its first row and uses that band's line buffers.
+static void stbi__jpeg_convert_rows(void *context, int begin, int end) {
+  stbi__jpeg_convert *c = (stbi__jpeg_convert *)context;
+  stbi__jpeg *z = c->z;
+  int k, n = c->n, decode_n = c->decode_n, is_rgb = c->is_rgb;
+  unsigned int i, j;
+  unsigned int j0 = begin * c->band_rows;
+  unsigned int j1 = end * c->band_rows;
+  stbi_uc *coutput[4] = {NULL, NULL, NULL, NULL};
+  stbi_uc *linebuf[4];
+  stbi__resample res_comp[4];
+
+  if (j1 > z->s->img_y)
+    j1 = z->s->img_y;
+  for (k = 0; k < decode_n; ++k) {
+    stbi__resample *r = &res_comp[k];
+    *r = c->res_comp[k];
+    linebuf[k] = z->img_comp[k].linebuf + begin * (z->s->img_x + 3);
+    for (j = 0; j < j0; ++j) {
+      if (++r->ystep >= r->vs) {
+        r->ystep = 0;
+        r->line0 = r->line1;
+        if (++r->ypos < z->img_comp[k].y)
+          r->line1 += z->img_comp[k].w2;
+      }
+    }
+  }
+
+  for (j = j0; j < j1; ++j) {
+    stbi_uc *row = c->output + n * z->s->img_x * j;
+    stbi_uc *out = row;
+    // the 3-channel paths write a spare byte past the end of each row. the
+    // last row of a band goes through a scratch row, so that byte cannot
+    // land in a row another band has already written.
+    if (j + 1 == j1 && j1 < z->s->img_y)
+      out = c->scratch + begin * (n * z->s->img_x + 1);
+    for (k = 0; k < decode_n; ++k) {
+      stbi__resample *r = &res_comp[k];
+      int y_bot = r->ystep >= (r->vs >> 1);
+      coutput[k] = r->resample(linebuf[k], y_bot ? r->line1 : r->line0,
+                               y_bot ? r->line0 : r->line1, r->w_lores, r->hs);
+      if (++r->ystep >= r->vs) {
+        r->ystep = 0;
+        r->line0 = r->line1;
+        if (++r->ypos < z->img_comp[k].y)
+          r->line1 += z->img_comp[k].w2;
+      }
+    }
+    if (n >= 3) {
+      stbi_uc *y = coutput[0];
+      if (z->s->img_n == 3) {
+        if (is_rgb) {
+          for (i = 0; i < z->s->img_x; ++i) {
+            out[0] = y[i];
+            out[1] = coutput[1][i];
+            out[2] = coutput[2][i];
+            out[3] = 255;
+            out += n;
+          }
+        } else {
+          z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x,
+                                 n);
+        }
+      } else if (z->s->img_n == 4) {
+        if (z->app14_color_transform == 0) { // CMYK
+          for (i = 0; i < z->s->img_x; ++i) {
+            stbi_uc m = coutput[3][i];
+            out[0] = stbi__blinn_8x8(coutput[0][i], m);
+            out[1] = stbi__blinn_8x8(coutput[1][i], m);
+            out[2] = stbi__blinn_8x8(coutput[2][i], m);
+            out[3] = 255;
+            out += n;
+          }
+        } else if (z->app14_color_transform == 2) { // YCCK
+          z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x,
+                                 n);
+          for (i = 0; i < z->s->img_x; ++i) {
+            stbi_uc m = coutput[3][i];
+            out[0] = stbi__blinn_8x8(255 - out[0], m);
+            out[1] = stbi__blinn_8x8(255 - out[1], m);
+            out[2] = stbi__blinn_8x8(255 - out[2], m);
+            out += n;
+          }
+        } else { // YCbCr + alpha?  Ignore the fourth channel for now
+          z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x,
+                                 n);
+        }
+      } else
+        for (i = 0; i < z->s->img_x; ++i) {
+          out[0] = out[1] = out[2] = y[i];
+          out[3] = 255; // not used if n==3
+          out += n;
+        }
+    } else {
+      if (is_rgb) {
+        if (n == 1)
+          for (i = 0; i < z->s->img_x; ++i)
+            *out++ =
+                stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+        else {
+          for (i = 0; i < z->s->img_x; ++i, out += 2) {
+            out[0] =
+                stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            out[1] = 255;
+          }
+        }
+      } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+        for (i = 0; i < z->s->img_x; ++i) {
+          stbi_uc m = coutput[3][i];
+          stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+          stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+          stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+          out[0] = stbi__compute_y(r, g, b);
+          out[1] = 255;
+          out += n;
+        }
+      } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+        for (i = 0; i < z->s->img_x; ++i) {
+          out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+          out[1] = 255;
+          out += n;
+        }
+      } else {
+        stbi_uc *y = coutput[0];
+        if (n == 1)
+          for (i = 0; i < z->s->img_x; ++i)
+            out[i] = y[i];
+        else
+          for (i = 0; i < z->s->img_x; ++i) {
+            *out++ = y[i];
+            *out++ = 255;
+          }
+      }
+    }
+    if (j + 1 == j1 && j1 < z->s->img_y)
+      memcpy(row, c->scratch + begin * (n * z->s->img_x + 1), n * z->s->img_x);
+  }
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y,
                                 int *comp, int req_comp) {
   int n, decode_n, is_rgb;
@@ -4287,6 +5298,8 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y,
     stbi__cleanup_jpeg(z);
     return NULL;
   }
+  if (z->dc_only)
+    stbi__jpeg_compact_dc(z);
 
   // determine actual number of components to generate
   n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
@@ -4309,18 +5322,31 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y,
   // resample and color-convert
   {
     int k;
-    unsigned int i, j;
     stbi_uc *output;
-    stbi_uc *coutput[4] = {NULL, NULL, NULL, NULL};
-
-    stbi__resample res_comp[4];
+    stbi__jpeg_convert c;
+    int bands = 1;
+
+    c.z = z;
+    c.n = n;
+    c.decode_n = decode_n;
+    c.is_rgb = is_rgb;
+    c.band_rows = z->s->img_y;
+    c.scratch = NULL;
+#ifdef STBI_PARALLEL_FOR
+    // at most 64 bands of at least 32 rows, each with its own line buffers
+    c.band_rows = (z->s->img_y + 63) / 64;
+    if (c.band_rows < 32)
+      c.band_rows = 32;
+    bands = (z->s->img_y + c.band_rows - 1) / c.band_rows;
+#endif
 
     for (k = 0; k < decode_n; ++k) {
-      stbi__resample *r = &res_comp[k];
+      stbi__resample *r = &c.res_comp[k];
 
-      // allocate line buffer big enough for upsampling off the edges
+      // allocate line buffers big enough for upsampling off the edges
       // with upsample factor of 4
-      z->img_comp[k].linebuf = (stbi_uc *)stbi__malloc(z->s->img_x + 3);
+      z->img_comp[k].linebuf =
+          (stbi_uc *)stbi__malloc_mad2(bands, z->s->img_x + 3, 0);
       if (!z->img_comp[k].linebuf) {
         stbi__cleanup_jpeg(z);
         return stbi__errpuc("outofmem", "Out of memory");
@@ -4345,116 +5371,30 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y,
         r->resample = stbi__resample_row_generic;
     }
 
+    if (bands > 1) {
+      c.scratch = (stbi_uc *)stbi__malloc_mad2(bands, n * z->s->img_x + 1, 0);
+      if (!c.scratch) {
+        stbi__cleanup_jpeg(z);
+        return stbi__errpuc("outofmem", "Out of memory");
+      }
+    }
+
     // can't error after this so, this is safe
     output = (stbi_uc *)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
     if (!output) {
+      STBI_FREE(c.scratch);
       stbi__cleanup_jpeg(z);
       return stbi__errpuc("outofmem", "Out of memory");
     }
 
     // now go ahead and resample
-    for (j = 0; j < z->s->img_y; ++j) {
-      stbi_uc *out = output + n * z->s->img_x * j;
-      for (k = 0; k < decode_n; ++k) {
-        stbi__resample *r = &res_comp[k];
-        int y_bot = r->ystep >= (r->vs >> 1);
-        coutput[k] =
-            r->resample(z->img_comp[k].linebuf, y_bot ? r->line1 : r->line0,
-                        y_bot ? r->line0 : r->line1, r->w_lores, r->hs);
-        if (++r->ystep >= r->vs) {
-          r->ystep = 0;
-          r->line0 = r->line1;
-          if (++r->ypos < z->img_comp[k].y)
-            r->line1 += z->img_comp[k].w2;
-        }
-      }
-      if (n >= 3) {
-        stbi_uc *y = coutput[0];
-        if (z->s->img_n == 3) {
-          if (is_rgb) {
-            for (i = 0; i < z->s->img_x; ++i) {
-              out[0] = y[i];
-              out[1] = coutput[1][i];
-              out[2] = coutput[2][i];
-              out[3] = 255;
-              out += n;
-            }
-          } else {
-            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x,
-                                   n);
-          }
-        } else if (z->s->img_n == 4) {
-          if (z->app14_color_transform == 0) { // CMYK
-            for (i = 0; i < z->s->img_x; ++i) {
-              stbi_uc m = coutput[3][i];
-              out[0] = stbi__blinn_8x8(coutput[0][i], m);
-              out[1] = stbi__blinn_8x8(coutput[1][i], m);
-              out[2] = stbi__blinn_8x8(coutput[2][i], m);
-              out[3] = 255;
-              out += n;
-            }
-          } else if (z->app14_color_transform == 2) { // YCCK
-            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x,
-                                   n);
-            for (i = 0; i < z->s->img_x; ++i) {
-              stbi_uc m = coutput[3][i];
-              out[0] = stbi__blinn_8x8(255 - out[0], m);
-              out[1] = stbi__blinn_8x8(255 - out[1], m);
-              out[2] = stbi__blinn_8x8(255 - out[2], m);
-              out += n;
-            }
-          } else { // YCbCr + alpha?  Ignore the fourth channel for now
-            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x,
-                                   n);
-          }
-        } else
-          for (i = 0; i < z->s->img_x; ++i) {
-            out[0] = out[1] = out[2] = y[i];
-            out[3] = 255; // not used if n==3
-            out += n;
-          }
-      } else {
-        if (is_rgb) {
-          if (n == 1)
-            for (i = 0; i < z->s->img_x; ++i)
-              *out++ =
-                  stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-          else {
-            for (i = 0; i < z->s->img_x; ++i, out += 2) {
-              out[0] =
-                  stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-              out[1] = 255;
-            }
-          }
-        } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-          for (i = 0; i < z->s->img_x; ++i) {
-            stbi_uc m = coutput[3][i];
-            stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-            stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-            stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-            out[0] = stbi__compute_y(r, g, b);
-            out[1] = 255;
-            out += n;
-          }
-        } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-          for (i = 0; i < z->s->img_x; ++i) {
-            out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-            out[1] = 255;
-            out += n;
-          }
-        } else {
-          stbi_uc *y = coutput[0];
-          if (n == 1)
-            for (i = 0; i < z->s->img_x; ++i)
-              out[i] = y[i];
-          else
-            for (i = 0; i < z->s->img_x; ++i) {
-              *out++ = y[i];
-              *out++ = 255;
-            }
-        }
-      }
-    }
+    c.output = output;
+#ifdef STBI_PARALLEL_FOR
+    STBI_PARALLEL_FOR(bands, stbi__jpeg_convert_rows, &c);
+#else
+    stbi__jpeg_convert_rows(&c, 0, bands);
+#endif
+    STBI_FREE(c.scratch);
     stbi__cleanup_jpeg(z);
     *out_x = z->s->img_x;
     *out_y = z->s->img_y;
@@ -4480,6 +5420,33 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp,
   return result;
 }
 
+STBIDEF stbi_uc *stbi_load_jpeg_preview_from_memory(stbi_uc const *buffer,
+                                                    int len, int *x, int *y,
+                                                    int *comp, int req_comp) {
+  unsigned char *result;
+  int channels;
+  stbi__jpeg *j;
+  stbi__context s;
+  stbi__start_mem(&s, buffer, len);
+  if (!stbi__jpeg_test(&s))
+    return stbi__errpuc("not jpeg", "Image not a JPEG");
+  j = (stbi__jpeg *)stbi__malloc(sizeof(stbi__jpeg));
+  if (!j)
+    return stbi__errpuc("outofmem", "Out of memory");
+  memset(j, 0, sizeof(stbi__jpeg));
+  j->s = &s;
+  stbi__setup_jpeg(j);
+  j->dc_only = 1;
+  j->idct_block_kernel = stbi__idct_dc;
+  result = load_jpeg_image(j, x, y, &channels, req_comp);
+  STBI_FREE(j);
+  if (result && comp)
+    *comp = channels;
+  if (result && stbi__vertically_flip_on_load)
+    stbi__vertical_flip(result, *x, *y, req_comp ? req_comp : channels);
+  return result;
+}
+
 static int stbi__jpeg_test(stbi__context *s) {
   int r;
   stbi__jpeg *j = (stbi__jpeg *)stbi__malloc(sizeof(stbi__jpeg));
@@ -4534,6 +5501,7 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp) {
 #define STBI__ZFAST_BITS 9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
+#define STBI__ZMULTI_BITS 11 // literal pairs are looked up with this many bits
 
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
@@ -4627,6 +5595,7 @@ typedef struct {
   int z_expandable;
 
   stbi__zhuffman z_length, z_distance;
+  stbi__uint32 z_multi[1 << STBI__ZMULTI_BITS];
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z) {
@@ -4752,8 +5721,195 @@ static const int stbi__zdist_extra[32] = {0, 0, 0,  0,  1,  1,  2,  2,  3,  3,
                                           4, 4, 5,  5,  6,  6,  7,  7,  8,  8,
                                           9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
 
+// two-symbol lookup for the literal/length code. an entry holds two
+// literals, one symbol whose code fits the fast table, or 0 for longer
+// codes. bits 0-8 are the first symbol, 9-16 the second literal, 24-28 the
+// number of bits used and 29-30 the symbol count.
+static void stbi__zbuild_multi(stbi__uint32 *multi, const stbi__zhuffman *z) {
+  int i;
+  for (i = 0; i < (1 << STBI__ZMULTI_BITS); ++i) {
+    int b = z->fast[i & STBI__ZFAST_MASK];
+    stbi__uint32 entry = 0;
+    if (b) {
+      int s = b >> 9, sym = b & 511;
+      entry = (1u << 29) | ((stbi__uint32)s << 24) | (stbi__uint32)sym;
+      if (sym < 256) {
+        // the fast table repeats every code over all of its unused high
+        // bits, so the second code is valid if it fits the remaining bits
+        int b2 = z->fast[(i >> s) & STBI__ZFAST_MASK];
+        int s2 = b2 >> 9;
+        if (b2 && (b2 & 511) < 256 && s + s2 <= STBI__ZMULTI_BITS)
+          entry = (2u << 29) | ((stbi__uint32)(s + s2) << 24) |
+                  ((stbi__uint32)(b2 & 511) << 9) | (stbi__uint32)sym;
+      }
+    }
+    multi[i] = entry;
+  }
+}
+
+// same as stbi__zhuffman_decode_slowpath, but on the low 16 bits of a
+// caller-held bit buffer. stores the code length in *len.
+static int stbi__zhuffman_decode_long(const stbi__zhuffman *z,
+                                      stbi__uint32 bits, int *len) {
+  int b, s, k = stbi__bit_reverse(bits & 0xffff, 16);
+  for (s = STBI__ZFAST_BITS + 1;; ++s)
+    if (k < z->maxcode[s])
+      break;
+  if (s >= 16)
+    return -1;
+  b = (k >> (16 - s)) - z->firstcode[s] + z->firstsymbol[s];
+  if (b >= STBI__ZNSYMS || z->size[b] != s)
+    return -1;
+  *len = s;
+  return z->value[b];
+}
+
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p) {
+  // compilers turn this into a single load on little-endian targets
+  return (stbi__uint64)p[0] | ((stbi__uint64)p[1] << 8) |
+         ((stbi__uint64)p[2] << 16) | ((stbi__uint64)p[3] << 24) |
+         ((stbi__uint64)p[4] << 32) | ((stbi__uint64)p[5] << 40) |
+         ((stbi__uint64)p[6] << 48) | ((stbi__uint64)p[7] << 56);
+}
+
+// the fast loop refills its bit buffer with unchecked 8-byte loads, and
+// copies matches in 16-byte steps that may overshoot the match by 15 bytes
+#define STBI__ZFAST_IN 8
+#define STBI__ZFAST_OUT (258 + 16)
+
+// decode the bulk of a huffman block with a 64-bit bit buffer, which holds
+// enough bits for a whole length/distance pair after every refill. stops
+// when fewer than STBI__ZFAST_IN input bytes or STBI__ZFAST_OUT output bytes
+// are left. the output is never grown here: near the end of an exactly
+// sized buffer the careful loop finishes, and expands only if the data
+// really is larger. returns 1 at the end of the block, 0 on errors and -1
+// if the rest of the block needs stbi__parse_huffman_block.
+static int stbi__parse_huffman_block_fast(stbi__zbuf *a) {
+  const stbi_uc *in = a->zbuffer;
+  stbi_uc *out = (stbi_uc *)a->zout;
+  stbi__uint64 bits = a->code_buffer;
+  int nbits = a->num_bits;
+  int result = -1;
+
+  if (a->hit_zeof_once)
+    return -1;
+
+  while (a->zbuffer_end - in >= STBI__ZFAST_IN) {
+    stbi__uint32 e;
+    int sym, len, dist, s;
+    stbi_uc *src;
+
+    if ((stbi_uc *)a->zout_end - out < STBI__ZFAST_OUT)
+      break;
+
+    // top up to 56..63 bits. bits above nbits may already hold part of the
+    // next byte, which the load writes again unchanged.
+    bits |= stbi__zload64(in) << nbits;
+    in += (63 - nbits) >> 3;
+    nbits |= 56;
+
+    e = a->z_multi[bits & ((1 << STBI__ZMULTI_BITS) - 1)];
+    s = (e >> 24) & 31;
+    if ((e >> 29) == 2) {
+      out[0] = (stbi_uc)e;
+      out[1] = (stbi_uc)(e >> 9);
+      out += 2;
+      bits >>= s;
+      nbits -= s;
+      continue;
+    }
+    if (e) {
+      sym = e & 511;
+    } else {
+      sym = stbi__zhuffman_decode_long(&a->z_length, (stbi__uint32)bits, &s);
+      if (sym < 0)
+        return stbi__err("bad huffman code", "Corrupt PNG");
+    }
+    bits >>= s;
+    nbits -= s;
+    if (sym < 256) {
+      *out++ = (stbi_uc)sym;
+      continue;
+    }
+    if (sym == 256) {
+      result = 1;
+      break;
+    }
+    if (sym >= 286)
+      return stbi__err("bad huffman code", "Corrupt PNG");
+
+    sym -= 257;
+    len = stbi__zlength_base[sym];
+    s = stbi__zlength_extra[sym];
+    len += (int)(bits & ((1u << s) - 1));
+    bits >>= s;
+    nbits -= s;
+
+    sym = a->z_distance.fast[bits & STBI__ZFAST_MASK];
+    if (sym) {
+      s = sym >> 9;
+      sym &= 511;
+    } else {
+      sym = stbi__zhuffman_decode_long(&a->z_distance, (stbi__uint32)bits, &s);
+      if (sym < 0)
+        return stbi__err("bad huffman code", "Corrupt PNG");
+    }
+    bits >>= s;
+    nbits -= s;
+    if (sym >= 30)
+      return stbi__err("bad huffman code", "Corrupt PNG");
+    dist = stbi__zdist_base[sym];
+    s = stbi__zdist_extra[sym];
+    dist += (int)(bits & ((1u << s) - 1));
+    bits >>= s;
+    nbits -= s;
+    if ((char *)out - a->zout_start < dist)
+      return stbi__err("bad dist", "Corrupt PNG");
+
+    // every wide step only reads bytes written by earlier steps
+    src = out - dist;
+    if (dist >= 16) {
+      stbi_uc *end = out + len;
+      do {
+        memcpy(out, src, 16);
+        out += 16;
+        src += 16;
+      } while (out < end);
+      out = end;
+    } else if (dist >= 8) {
+      stbi_uc *end = out + len;
+      do {
+        memcpy(out, src, 8);
+        out += 8;
+        src += 8;
+      } while (out < end);
+      out = end;
+    } else if (dist == 1) {
+      memset(out, *src, len);
+      out += len;
+    } else {
+      do
+        *out++ = *src++;
+      while (--len);
+    }
+  }
+
+  // hand the whole bytes still in the bit buffer back to the input
+  in -= nbits >> 3;
+  nbits &= 7;
+  a->zbuffer = (stbi_uc *)in;
+  a->code_buffer = (stbi__uint32)(bits & ((1u << nbits) - 1));
+  a->num_bits = nbits;
+  a->zout = (char *)out;
+  return result;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a) {
-  char *zout = a->zout;
+  char *zout;
+  int fast = stbi__parse_huffman_block_fast(a);
+  if (fast >= 0)
+    return fast;
+  zout = a->zout;
   for (;;) {
     int z = stbi__zhuffman_decode(a, &a->z_length);
     if (z < 256) {
@@ -4991,6 +6147,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header) {
         if (!stbi__compute_huffman_codes(a))
           return 0;
       }
+      stbi__zbuild_multi(a->z_multi, &a->z_length);
       if (!stbi__parse_huffman_block(a))
         return 0;
     }
@@ -5159,6 +6316,248 @@ static int stbi__paeth(int a, int b, int c) {
   return t1;
 }
 
+#ifdef STBI_SSE2
+// simd unfiltering. up adds whole vectors; sub is a prefix sum within each
+// vector when pixels are 1, 2, 4 or 8 bytes. avg, paeth and the other sub
+// cases depend on the finished pixel to the left, so they decode one 3 to 8
+// byte pixel per step with all of its channels side by side.
+
+// pixels are moved through general registers, a pixel copied through
+// memory would stall every step on store forwarding
+stbi_inline static __m128i stbi__png_load_pixel(const stbi_uc *p, int n) {
+  int lo;
+  if (n == 8)
+    return _mm_loadl_epi64((const __m128i *)p);
+  if (n == 3)
+    return _mm_cvtsi32_si128(p[0] | (p[1] << 8) | (p[2] << 16));
+  memcpy(&lo, p, 4);
+  if (n == 4)
+    return _mm_cvtsi32_si128(lo);
+  return _mm_unpacklo_epi32(_mm_cvtsi32_si128(lo),
+                            _mm_cvtsi32_si128(p[4] | (p[5] << 8)));
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int n) {
+  int lo;
+  if (n == 8) {
+    _mm_storel_epi64((__m128i *)p, v);
+    return;
+  }
+  lo = _mm_cvtsi128_si32(v);
+  if (n == 3) {
+    p[0] = (stbi_uc)lo;
+    p[1] = (stbi_uc)(lo >> 8);
+    p[2] = (stbi_uc)(lo >> 16);
+    return;
+  }
+  memcpy(p, &lo, 4);
+  if (n == 6) {
+    int hi = _mm_cvtsi128_si32(_mm_srli_si128(v, 4));
+    p[4] = (stbi_uc)hi;
+    p[5] = (stbi_uc)(hi >> 8);
+  }
+}
+
+// copies the last pixel of v into every pixel
+stbi_inline static __m128i stbi__png_last_pixel(__m128i v, int n) {
+  if (n == 1)
+    v = _mm_shufflehi_epi16(_mm_unpackhi_epi8(v, v), 0xff);
+  else if (n == 2)
+    v = _mm_shufflehi_epi16(v, 0xff);
+  return n == 8 ? _mm_unpackhi_epi64(v, v) : _mm_shuffle_epi32(v, 0xff);
+}
+
+stbi_inline static int stbi__png_unfilter_sub_sse2(stbi_uc *cur, const stbi_uc *raw,
+                                       int n, int nk) {
+  __m128i a = _mm_setzero_si128();
+  int k = 0;
+  if (n == 3 || n == 6) {
+    for (; k < nk; k += n) {
+      a = _mm_add_epi8(stbi__png_load_pixel(raw + k, n), a);
+      stbi__png_store_pixel(cur + k, a, n);
+    }
+    return nk;
+  }
+  for (; k + 16 <= nk; k += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(raw + k));
+    if (n <= 1)
+      v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+    if (n <= 2)
+      v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+    if (n <= 4)
+      v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi8(_mm_add_epi8(v, _mm_slli_si128(v, 8)), a);
+    _mm_storeu_si128((__m128i *)(cur + k), v);
+    a = stbi__png_last_pixel(v, n);
+  }
+  return k;
+}
+
+static int stbi__png_unfilter_up_sse2(stbi_uc *cur, const stbi_uc *prior,
+                                      const stbi_uc *raw, int nk) {
+  int k;
+  for (k = 0; k + 16 <= nk; k += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(raw + k));
+    __m128i b = _mm_loadu_si128((const __m128i *)(prior + k));
+    _mm_storeu_si128((__m128i *)(cur + k), _mm_add_epi8(x, b));
+  }
+  return k;
+}
+
+stbi_inline static void stbi__png_unfilter_avg_sse2(stbi_uc *cur, const stbi_uc *prior,
+                                        const stbi_uc *raw, int n, int nk) {
+  __m128i one = _mm_set1_epi8(1);
+  __m128i a = _mm_setzero_si128();
+  int k;
+  for (k = 0; k < nk; k += n) {
+    __m128i b = stbi__png_load_pixel(prior + k, n);
+    // avg_epu8 rounds up, (a + b) >> 1 rounds down
+    __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b),
+                               _mm_and_si128(_mm_xor_si128(a, b), one));
+    a = _mm_add_epi8(stbi__png_load_pixel(raw + k, n), avg);
+    stbi__png_store_pixel(cur + k, a, n);
+  }
+}
+
+stbi_inline static void stbi__png_unfilter_paeth_sse2(stbi_uc *cur,
+                                                      const stbi_uc *prior,
+                                                      const stbi_uc *raw, int n,
+                                                      int nk) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i mask = _mm_set1_epi16(0xff);
+  __m128i a = zero, c = zero;
+  int k;
+  // stbi__paeth on 16-bit lanes. only the few steps that need the pixel to
+  // the left are serial, so pixels stay 16-bit until they are stored.
+  for (k = 0; k < nk; k += n) {
+    __m128i b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior + k, n), zero);
+    __m128i x = _mm_unpacklo_epi8(stbi__png_load_pixel(raw + k, n), zero);
+    __m128i c3 = _mm_add_epi16(c, _mm_add_epi16(c, c));
+    __m128i thresh = _mm_sub_epi16(c3, _mm_add_epi16(a, b));
+    __m128i lo = _mm_min_epi16(a, b);
+    __m128i hi = _mm_max_epi16(a, b);
+    __m128i use_c = _mm_cmpgt_epi16(hi, thresh);
+    __m128i use_t0 = _mm_cmpgt_epi16(thresh, lo);
+    __m128i t0 =
+        _mm_or_si128(_mm_and_si128(use_c, c), _mm_andnot_si128(use_c, lo));
+    __m128i t1 =
+        _mm_or_si128(_mm_and_si128(use_t0, t0), _mm_andnot_si128(use_t0, hi));
+    a = _mm_and_si128(_mm_add_epi16(x, t1), mask);
+    c = b;
+    stbi__png_store_pixel(cur + k, _mm_packus_epi16(a, a), n);
+  }
+}
+
+#ifdef STBI_AVX2
+STBI__AVX2_TARGET
+static int stbi__png_unfilter_sub_avx2(stbi_uc *cur, const stbi_uc *raw, int n,
+                                       int nk) {
+  __m256i a = _mm256_setzero_si256();
+  int k;
+  for (k = 0; k + 32 <= nk; k += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(raw + k));
+    __m256i last;
+    // prefix sums within each 128-bit lane, then carry lane 0 into lane 1
+    if (n <= 1)
+      v = _mm256_add_epi8(v, _mm256_slli_si256(v, 1));
+    if (n <= 2)
+      v = _mm256_add_epi8(v, _mm256_slli_si256(v, 2));
+    if (n <= 4)
+      v = _mm256_add_epi8(v, _mm256_slli_si256(v, 4));
+    v = _mm256_add_epi8(v, _mm256_slli_si256(v, 8));
+    last = v;
+    if (n == 1)
+      last = _mm256_shufflehi_epi16(_mm256_unpackhi_epi8(v, v), 0xff);
+    else if (n == 2)
+      last = _mm256_shufflehi_epi16(v, 0xff);
+    last = n == 8 ? _mm256_unpackhi_epi64(last, last)
+                  : _mm256_shuffle_epi32(last, 0xff);
+    v = _mm256_add_epi8(v, _mm256_permute2x128_si256(last, last, 0x08));
+    v = _mm256_add_epi8(v, a);
+    _mm256_storeu_si256((__m256i *)(cur + k), v);
+    // the last pixel of lane 1 is lane 1 of last plus that of lane 0
+    a = _mm256_add_epi8(a, _mm256_add_epi8(
+                               _mm256_permute2x128_si256(last, last, 0x00),
+                               _mm256_permute2x128_si256(last, last, 0x11)));
+  }
+  return k;
+}
+
+STBI__AVX2_TARGET
+static int stbi__png_unfilter_up_avx2(stbi_uc *cur, const stbi_uc *prior,
+                                      const stbi_uc *raw, int nk) {
+  int k;
+  for (k = 0; k + 32 <= nk; k += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(raw + k));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(prior + k));
+    _mm256_storeu_si256((__m256i *)(cur + k), _mm256_add_epi8(x, b));
+  }
+  return k;
+}
+#endif
+
+// unfilters the start of a row with simd and returns the number of bytes
+// done, which is 0 if there is no kernel for this filter and pixel size.
+// simd is 2 if the cpu has avx2. the per-pixel kernels are called with a
+// constant size so their loads and stores inline.
+static int stbi__png_unfilter_simd(int simd, int filter, stbi_uc *cur,
+                                   const stbi_uc *prior, const stbi_uc *raw,
+                                   int filter_bytes, int nk) {
+  switch (filter) {
+  case STBI__F_sub:
+    if (filter_bytes == 3)
+      return stbi__png_unfilter_sub_sse2(cur, raw, 3, nk);
+    if (filter_bytes == 6)
+      return stbi__png_unfilter_sub_sse2(cur, raw, 6, nk);
+#ifdef STBI_AVX2
+    if (simd >= 2)
+      return stbi__png_unfilter_sub_avx2(cur, raw, filter_bytes, nk);
+#endif
+    return stbi__png_unfilter_sub_sse2(cur, raw, filter_bytes, nk);
+  case STBI__F_up:
+#ifdef STBI_AVX2
+    if (simd >= 2)
+      return stbi__png_unfilter_up_avx2(cur, prior, raw, nk);
+#endif
+    return stbi__png_unfilter_up_sse2(cur, prior, raw, nk);
+  case STBI__F_avg:
+    switch (filter_bytes) {
+    case 3:
+      stbi__png_unfilter_avg_sse2(cur, prior, raw, 3, nk);
+      return nk;
+    case 4:
+      stbi__png_unfilter_avg_sse2(cur, prior, raw, 4, nk);
+      return nk;
+    case 6:
+      stbi__png_unfilter_avg_sse2(cur, prior, raw, 6, nk);
+      return nk;
+    case 8:
+      stbi__png_unfilter_avg_sse2(cur, prior, raw, 8, nk);
+      return nk;
+    }
+    break;
+  case STBI__F_paeth:
+    switch (filter_bytes) {
+    case 3:
+      stbi__png_unfilter_paeth_sse2(cur, prior, raw, 3, nk);
+      return nk;
+    case 4:
+      stbi__png_unfilter_paeth_sse2(cur, prior, raw, 4, nk);
+      return nk;
+    case 6:
+      stbi__png_unfilter_paeth_sse2(cur, prior, raw, 6, nk);
+      return nk;
+    case 8:
+      stbi__png_unfilter_paeth_sse2(cur, prior, raw, 8, nk);
+      return nk;
+    }
+    break;
+  }
+  STBI_NOTUSED(simd);
+  return 0;
+}
+#endif // STBI_SSE2
+
 static const stbi_uc stbi__depth_scale_table[9] = {0, 0xff, 0x55, 0,   0x11,
                                                    0, 0,    0,    0x01};
 
@@ -5202,6 +6601,9 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw,
   int output_bytes = out_n * bytes;
   int filter_bytes = img_n * bytes;
   int width = x;
+#ifdef STBI_SSE2
+  int simd = stbi__sse2_available();
+#endif
 
   STBI_ASSERT(out_n == s->img_n || out_n == s->img_n + 1);
   a->out = (stbi_uc *)stbi__malloc_mad3(
@@ -5236,6 +6638,11 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw,
     width = img_width_bytes;
   }
 
+#ifdef STBI_AVX2
+  if (simd && stbi__avx2_available())
+    simd = 2;
+#endif
+
   for (j = 0; j < y; ++j) {
     // cur/prior filter buffers alternate
     stbi_uc *cur = filter_buf + (j & 1) * img_width_bytes;
@@ -5255,31 +6662,38 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw,
       filter = first_row_filter[filter];
 
     // perform actual filtering
+    k = 0;
+#ifdef STBI_SSE2
+    if (simd)
+      k = stbi__png_unfilter_simd(simd, filter, cur, prior, raw, filter_bytes,
+                                  nk);
+#endif
     switch (filter) {
     case STBI__F_none:
       memcpy(cur, raw, nk);
       break;
     case STBI__F_sub:
-      memcpy(cur, raw, filter_bytes);
-      for (k = filter_bytes; k < nk; ++k)
+      for (; k < filter_bytes; ++k)
+        cur[k] = raw[k];
+      for (; k < nk; ++k)
         cur[k] = STBI__BYTECAST(raw[k] + cur[k - filter_bytes]);
       break;
     case STBI__F_up:
-      for (k = 0; k < nk; ++k)
+      for (; k < nk; ++k)
         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
       break;
     case STBI__F_avg:
-      for (k = 0; k < filter_bytes; ++k)
+      for (; k < filter_bytes; ++k)
         cur[k] = STBI__BYTECAST(raw[k] + (prior[k] >> 1));
-      for (k = filter_bytes; k < nk; ++k)
+      for (; k < nk; ++k)
         cur[k] =
             STBI__BYTECAST(raw[k] + ((prior[k] + cur[k - filter_bytes]) >> 1));
       break;
     case STBI__F_paeth:
-      for (k = 0; k < filter_bytes; ++k)
+      for (; k < filter_bytes; ++k)
         cur[k] = STBI__BYTECAST(
             raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
-      for (k = filter_bytes; k < nk; ++k)
+      for (; k < nk; ++k)
         cur[k] =
             STBI__BYTECAST(raw[k] + stbi__paeth(cur[k - filter_bytes], prior[k],
                                                 prior[k - filter_bytes]));
@@ -5372,6 +6786,77 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw,
   return 1;
 }
 
+static const int stbi__png_xorig[] = {0, 4, 0, 2, 0, 1, 0};
+static const int stbi__png_yorig[] = {0, 0, 4, 0, 2, 0, 1};
+static const int stbi__png_xspc[] = {8, 8, 4, 4, 2, 2, 1};
+static const int stbi__png_yspc[] = {8, 8, 8, 4, 4, 2, 2};
+
+// unfilters adam7 pass p into a->out and scatters it into final
+static int stbi__png_deinterlace_pass(stbi__png *a, stbi_uc *final,
+                                      stbi_uc *image_data,
+                                      stbi__uint32 image_data_len, int out_n,
+                                      int depth, int color, int p) {
+  int bytes = (depth == 16 ? 2 : 1);
+  int out_bytes = out_n * bytes;
+  int xspc = stbi__png_xspc[p] * out_bytes;
+  int i, j, x, y;
+  // pass1_x[4] = 0, pass1_x[5] = 1, pass1_x[12] = 1
+  x = (a->s->img_x - stbi__png_xorig[p] + stbi__png_xspc[p] - 1) /
+      stbi__png_xspc[p];
+  y = (a->s->img_y - stbi__png_yorig[p] + stbi__png_yspc[p] - 1) /
+      stbi__png_yspc[p];
+  if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y,
+                                  depth, color))
+    return 0;
+  for (j = 0; j < y; ++j) {
+    int out_y = j * stbi__png_yspc[p] + stbi__png_yorig[p];
+    stbi_uc *dest = final + out_y * a->s->img_x * out_bytes +
+                    stbi__png_xorig[p] * out_bytes;
+    stbi_uc *src = a->out + j * x * out_bytes;
+    if (stbi__png_xspc[p] == 1) {
+      memcpy(dest, src, x * out_bytes);
+      continue;
+    }
+    for (i = 0; i < x; ++i, dest += xspc, src += out_bytes)
+      memcpy(dest, src, out_bytes);
+  }
+  STBI_FREE(a->out);
+  a->out = NULL;
+  return 1;
+}
+
+#ifdef STBI_PARALLEL_FOR
+// interlaced images smaller than this are deinterlaced on the calling thread
+#define STBI__PNG_PARALLEL_MIN_PIXELS (1 << 16)
+
+typedef struct {
+  stbi__png *a;
+  stbi_uc *final, *image_data;
+  stbi__uint32 image_data_len, offset[7];
+  int out_n, depth, color;
+  const char *failure[7];
+} stbi__png_passes;
+
+static void stbi__png_deinterlace_passes(void *context, int begin, int end) {
+  stbi__png_passes *c = (stbi__png_passes *)context;
+  int p;
+  for (p = begin; p < end; ++p) {
+    // every pass gets its own a->out
+    stbi__png a = *c->a;
+    stbi__uint32 len = c->offset[p] <= c->image_data_len
+                           ? c->image_data_len - c->offset[p]
+                           : 0;
+    a.out = NULL;
+    if (!stbi__png_deinterlace_pass(&a, c->final, c->image_data + c->offset[p],
+                                    len, c->out_n, c->depth, c->color, p)) {
+      c->failure[p] = stbi__worker_failure();
+      if (a.out)
+        STBI_FREE(a.out);
+    }
+  }
+}
+#endif
+
 static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data,
                                   stbi__uint32 image_data_len, int out_n,
                                   int depth, int color, int interlaced) {
@@ -5387,31 +6872,55 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data,
   final = (stbi_uc *)stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
   if (!final)
     return stbi__err("outofmem", "Out of memory");
+
+#ifdef STBI_PARALLEL_FOR
+  if (a->s->img_x * a->s->img_y >= STBI__PNG_PARALLEL_MIN_PIXELS) {
+    // the passes are stored back to back, so every pass can start as soon
+    // as the sizes of the ones before it are known
+    stbi__png_passes c;
+    stbi__uint32 offset = 0;
+    c.a = a;
+    c.final = final;
+    c.image_data = image_data;
+    c.image_data_len = image_data_len;
+    c.out_n = out_n;
+    c.depth = depth;
+    c.color = color;
+    for (p = 0; p < 7; ++p) {
+      stbi__uint32 x = (a->s->img_x - stbi__png_xorig[p] +
+                        stbi__png_xspc[p] - 1) / stbi__png_xspc[p];
+      stbi__uint32 y = (a->s->img_y - stbi__png_yorig[p] +
+                        stbi__png_yspc[p] - 1) / stbi__png_yspc[p];
+      c.offset[p] = offset;
+      c.failure[p] = NULL;
+      if (x && y)
+        offset += ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
+    }
+    STBI_PARALLEL_FOR(7, stbi__png_deinterlace_passes, &c);
+    // report the first failing pass, like the serial loop
+    for (p = 0; p < 7; ++p) {
+      if (c.failure[p]) {
+        STBI_FREE(final);
+        return stbi__err(c.failure[p], "Corrupt PNG");
+      }
+    }
+    a->out = final;
+    return 1;
+  }
+#endif
+
   for (p = 0; p < 7; ++p) {
-    int xorig[] = {0, 4, 0, 2, 0, 1, 0};
-    int yorig[] = {0, 0, 4, 0, 2, 0, 1};
-    int xspc[] = {8, 8, 4, 4, 2, 2, 1};
-    int yspc[] = {8, 8, 8, 4, 4, 2, 2};
-    int i, j, x, y;
-    // pass1_x[4] = 0, pass1_x[5] = 1, pass1_x[12] = 1
-    x = (a->s->img_x - xorig[p] + xspc[p] - 1) / xspc[p];
-    y = (a->s->img_y - yorig[p] + yspc[p] - 1) / yspc[p];
+    int x = (a->s->img_x - stbi__png_xorig[p] + stbi__png_xspc[p] - 1) /
+            stbi__png_xspc[p];
+    int y = (a->s->img_y - stbi__png_yorig[p] + stbi__png_yspc[p] - 1) /
+            stbi__png_yspc[p];
     if (x && y) {
       stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-      if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x,
-                                      y, depth, color)) {
+      if (!stbi__png_deinterlace_pass(a, final, image_data, image_data_len,
+                                      out_n, depth, color, p)) {
         STBI_FREE(final);
         return 0;
       }
-      for (j = 0; j < y; ++j) {
-        for (i = 0; i < x; ++i) {
-          int out_y = j * yspc[p] + yorig[p];
-          int out_x = i * xspc[p] + xorig[p];
-          memcpy(final + out_y * a->s->img_x * out_bytes + out_x * out_bytes,
-                 a->out + (j * x + i) * out_bytes, out_bytes);
-        }
-      }
-      STBI_FREE(a->out);
       image_data += img_len;
       image_data_len -= img_len;
     }
@@ -5781,6 +7290,21 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp) {
       bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
       raw_len = bpl * s->img_y * s->img_n /* pixels */ +
                 s->img_y /* filter mode per row */;
+      if (interlace) {
+        // size of the seven passes, so the output never has to grow
+        static const int xorig[] = {0, 4, 0, 2, 0, 1, 0};
+        static const int yorig[] = {0, 0, 4, 0, 2, 0, 1};
+        static const int xspc[] = {8, 8, 4, 4, 2, 2, 1};
+        static const int yspc[] = {8, 8, 8, 4, 4, 2, 2};
+        int p;
+        raw_len = 0;
+        for (p = 0; p < 7; ++p) {
+          stbi__uint32 x = (s->img_x - xorig[p] + xspc[p] - 1) / xspc[p];
+          stbi__uint32 y = (s->img_y - yorig[p] + yspc[p] - 1) / yspc[p];
+          if (x && y)
+            raw_len += (((s->img_n * x * z->depth) + 7) >> 3) * y + y;
+        }
+      }
       z->expanded = (stbi_uc *)stbi_zlib_decode_malloc_guesssize_headerflag(
           (char *)z->idata, ioff, raw_len, (int *)&raw_len, !is_iphone);
       if (z->expanded == NULL)
@@ -7759,7 +9283,7 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
         }
         memcpy(out + ((layers - 1) * stride), u, stride);
         if (layers >= 2) {
-          two_back = out - 2 * stride;
+          two_back = out + (layers - 2) * stride;
         }
 
         if (delays) {
@@ -7817,6 +9341,130 @@ static void *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp,
 static int stbi__gif_info(stbi__context *s, int *x, int *y, int *comp) {
   return stbi__gif_info_raw(s, x, y, comp);
 }
+
+struct stbi_gif_stream {
+  stbi__context s;
+  stbi__gif g;
+  stbi_uc const *buffer;
+  int len;
+#ifndef STBI_NO_STDIO
+  FILE *f;
+  long start;
+#endif
+  stbi_uc *two_back; // frame before the current one, for dispose mode 3
+  stbi_uc *spare;
+  int frames;
+};
+
+static void stbi__gif_stream_start(stbi_gif_stream *gif) {
+#ifndef STBI_NO_STDIO
+  if (gif->f) {
+    fseek(gif->f, gif->start, SEEK_SET);
+    stbi__start_file(&gif->s, gif->f);
+    return;
+  }
+#endif
+  stbi__start_mem(&gif->s, gif->buffer, gif->len);
+}
+
+static stbi_gif_stream *stbi__gif_stream_open(stbi_gif_stream *gif, int *x,
+                                              int *y) {
+  int comp;
+  stbi__gif_stream_start(gif);
+  if (!stbi__gif_test(&gif->s) ||
+      !stbi__gif_header(&gif->s, &gif->g, &comp, 1)) {
+    stbi__err("not GIF", "Image was not as a gif type.");
+    STBI_FREE(gif);
+    return NULL;
+  }
+  // the header lies within the first buffer, so a rewind is enough
+  stbi__rewind(&gif->s);
+  *x = gif->g.w;
+  *y = gif->g.h;
+  return gif;
+}
+
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_memory(stbi_uc const *buffer,
+                                                     int len, int *x, int *y) {
+  stbi_gif_stream *gif =
+      (stbi_gif_stream *)stbi__malloc(sizeof(stbi_gif_stream));
+  if (!gif)
+    return (stbi_gif_stream *)stbi__errpuc("outofmem", "Out of memory");
+  memset(gif, 0, sizeof(*gif));
+  gif->buffer = buffer;
+  gif->len = len;
+  return stbi__gif_stream_open(gif, x, y);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_file(FILE *f, int *x, int *y) {
+  stbi_gif_stream *gif =
+      (stbi_gif_stream *)stbi__malloc(sizeof(stbi_gif_stream));
+  if (!gif)
+    return (stbi_gif_stream *)stbi__errpuc("outofmem", "Out of memory");
+  memset(gif, 0, sizeof(*gif));
+  gif->f = f;
+  gif->start = ftell(f);
+  return stbi__gif_stream_open(gif, x, y);
+}
+#endif
+
+STBIDEF int stbi_gif_stream_next(stbi_gif_stream *gif, stbi_uc **frame,
+                                 int *delay_ms) {
+  int comp, stride = gif->g.w * gif->g.h * 4;
+  stbi_uc *u, *swap;
+  if (gif->g.out) {
+    // keep the current frame, it is "two back" when the next but one is
+    // decoded
+    if (!gif->spare) {
+      gif->spare = (stbi_uc *)stbi__malloc(stride);
+      gif->two_back = (stbi_uc *)stbi__malloc(stride);
+      if (!gif->spare || !gif->two_back)
+        return stbi__err("outofmem", "Out of memory") - 1;
+    }
+    memcpy(gif->spare, gif->g.out, stride);
+  }
+  u = stbi__gif_load_next(&gif->s, &gif->g, &comp, 4,
+                          gif->frames >= 2 ? gif->two_back : 0);
+  if (u == (stbi_uc *)&gif->s)
+    return 0; // end of animated gif marker
+  if (!u)
+    return -1;
+  if (gif->frames >= 1) {
+    swap = gif->two_back;
+    gif->two_back = gif->spare;
+    gif->spare = swap;
+  }
+  ++gif->frames;
+  *frame = u;
+  if (delay_ms)
+    *delay_ms = gif->g.delay;
+  return 1;
+}
+
+static void stbi__gif_stream_free_frames(stbi_gif_stream *gif) {
+  STBI_FREE(gif->g.out);
+  STBI_FREE(gif->g.history);
+  STBI_FREE(gif->g.background);
+  STBI_FREE(gif->two_back);
+  STBI_FREE(gif->spare);
+  gif->two_back = gif->spare = NULL;
+}
+
+STBIDEF void stbi_gif_stream_rewind(stbi_gif_stream *gif) {
+  // the frame buffers are set up again by the first frame
+  stbi__gif_stream_free_frames(gif);
+  memset(&gif->g, 0, sizeof(gif->g));
+  gif->frames = 0;
+  stbi__gif_stream_start(gif);
+}
+
+STBIDEF void stbi_gif_stream_close(stbi_gif_stream *gif) {
+  if (gif) {
+    stbi__gif_stream_free_frames(gif);
+    STBI_FREE(gif);
+  }
+}
 #endif
 
 // *************************************************************************************************
@@ -0,0 +1,526 @@
+#include "texstream.h"
+
+#include <glad/gl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+#include "stb_image.h"
+
+/* Mip level filled from a JPEG preview, which is decoded at 1/8 scale. */
+#define STREAM_PREVIEW_LEVEL 3
+#define STREAM_MAX_LEVELS 32
+#define STREAM_CHANNELS 4
+
+/**
+ * Texture handed out by texstream_request. Levels residentLevel to
+ * levels - 1 hold image data and GL_TEXTURE_BASE_LEVEL is kept at
+ * residentLevel, so draws only ever sample what has been uploaded.
+ * residentLevel is levels while the texture still shows its placeholder.
+ */
+typedef struct {
+  unsigned int texture;
+  int width;
+  int height;
+  int levels;
+  int residentLevel;
+  int failed;
+} StreamedTexture;
+
+/**
+ * Image queued for the decoder thread.
+ */
+typedef struct Request {
+  struct Request *next;
+  int handle;
+  char *path;
+} Request;
+
+/**
+ * Mip levels firstLevel to lastLevel of an image decoded by the decoder
+ * thread, waiting to be uploaded. level and row track the upload, which runs
+ * from the coarsest level to the finest. pixels is NULL if decoding failed.
+ */
+typedef struct Upload {
+  struct Upload *next;
+  int handle;
+  int width;
+  int height;
+  int firstLevel;
+  int lastLevel;
+  unsigned char *pixels;
+  size_t size;
+  size_t offset[STREAM_MAX_LEVELS];
+
+  int level;
+  int row;
+} Upload;
+
+static StreamedTexture *textures = NULL;
+static int textureCount = 0;
+static int textureCapacity = 0;
+static size_t budget = 0;
+
+static pthread_t decoder;
+static int decoderRunning = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static int shuttingDown = 0;
+/* Requests and finished uploads are both FIFO lists guarded by mutex. */
+static Request *requestHead = NULL;
+static Request *requestTail = NULL;
+static Upload *readyHead = NULL;
+static Upload *readyTail = NULL;
+/* Uploads in progress, only touched by the thread owning the GL context. */
+static Upload *pendingHead = NULL;
+static Upload *pendingTail = NULL;
+
+static int level_size(int size, int level) {
+  return size >> level > 0 ? size >> level : 1;
+}
+
+static int mip_count(int width, int height) {
+  int levels = 1;
+  int size = width > height ? width : height;
+  while (size > 1 && levels < STREAM_MAX_LEVELS) {
+    size >>= 1;
+    levels++;
+  }
+  return levels;
+}
+
+static unsigned char *read_file(const char *path, int *size) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return NULL;
+  }
+  unsigned char *data = NULL;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    long length = ftell(file);
+    if (length > 0 && length <= 0x7fffffff && fseek(file, 0, SEEK_SET) == 0) {
+      data = malloc(length);
+      if (data && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+      }
+      *size = (int)length;
+    }
+  }
+  fclose(file);
+  return data;
+}
+
+/**
+ * Averages 2 x 2 blocks of the RGBA image src into the next smaller mip level
+ * dest. The last row and column of odd sizes are folded into their
+ * neighbours.
+ */
+static void downsample(const unsigned char *src, int srcWidth, int srcHeight,
+                       unsigned char *dest, int width, int height) {
+  for (int y = 0; y < height; y++) {
+    const unsigned char *row0 = src + (size_t)2 * y * srcWidth * 4;
+    const unsigned char *row1 =
+        2 * y + 1 < srcHeight ? row0 + (size_t)srcWidth * 4 : row0;
+    for (int x = 0; x < width; x++) {
+      int x0 = 2 * x * 4;
+      int x1 = 2 * x + 1 < srcWidth ? x0 + 4 : x0;
+      for (int c = 0; c < 4; c++) {
+        *dest++ = (unsigned char)((row0[x0 + c] + row0[x1 + c] +
+                                   row1[x0 + c] + row1[x1 + c] + 2) >>
+                                  2);
+      }
+    }
+  }
+}
+
+/**
+ * Allocates an upload of levels firstLevel to lastLevel of a width x height
+ * image, with IMAGE_DEST_SLACK spare bytes so that the first level can be
+ * decoded straight into it.
+ */
+static Upload *upload_create(int handle, int width, int height, int firstLevel,
+                             int lastLevel) {
+  Upload *upload = calloc(1, sizeof(Upload));
+  if (!upload) {
+    return NULL;
+  }
+  upload->handle = handle;
+  upload->width = width;
+  upload->height = height;
+  upload->firstLevel = firstLevel;
+  upload->lastLevel = lastLevel;
+  upload->level = lastLevel;
+
+  size_t size = 0;
+  for (int level = firstLevel; level <= lastLevel; level++) {
+    upload->offset[level] = size;
+    size += (size_t)level_size(width, level) * level_size(height, level) *
+            STREAM_CHANNELS;
+  }
+  upload->size = size;
+  upload->pixels = malloc(size + IMAGE_DEST_SLACK);
+  if (!upload->pixels) {
+    free(upload);
+    return NULL;
+  }
+  return upload;
+}
+
+static void upload_free(Upload *upload) {
+  free(upload->pixels);
+  free(upload);
+}
+
+/**
+ * Fills every level after the first of an upload from the one before it.
+ */
+static void upload_build_mips(Upload *upload) {
+  for (int level = upload->firstLevel + 1; level <= upload->lastLevel;
+       level++) {
+    downsample(upload->pixels + upload->offset[level - 1],
+               level_size(upload->width, level - 1),
+               level_size(upload->height, level - 1),
+               upload->pixels + upload->offset[level],
+               level_size(upload->width, level),
+               level_size(upload->height, level));
+  }
+}
+
+static void post(Upload *upload) {
+  pthread_mutex_lock(&mutex);
+  if (readyTail) {
+    readyTail->next = upload;
+  } else {
+    readyHead = upload;
+  }
+  readyTail = upload;
+  pthread_mutex_unlock(&mutex);
+}
+
+static void post_failure(int handle) {
+  Upload *upload = calloc(1, sizeof(Upload));
+  if (upload) {
+    upload->handle = handle;
+    post(upload);
+  }
+}
+
+/**
+ * Posts the coarse levels of a JPEG, decoded from its DC coefficients alone.
+ * Images without a cheap preview are skipped; they show up once decoded.
+ */
+static void decode_preview(int handle, const unsigned char *data, int size,
+                           const ImageInfo *info, int levels) {
+  int width, height, channels;
+  if (levels <= STREAM_PREVIEW_LEVEL) {
+    return;
+  }
+  unsigned char *preview = stbi_load_jpeg_preview_from_memory(
+      data, size, &width, &height, &channels, STREAM_CHANNELS);
+  if (!preview) {
+    return;
+  }
+  Upload *upload = upload_create(handle, info->width, info->height,
+                                 STREAM_PREVIEW_LEVEL, levels - 1);
+  if (upload) {
+    /* The preview is rounded up, the mip level down; crop the extra. */
+    int levelWidth = level_size(info->width, STREAM_PREVIEW_LEVEL);
+    int levelHeight = level_size(info->height, STREAM_PREVIEW_LEVEL);
+    unsigned char *dest = upload->pixels + upload->offset[STREAM_PREVIEW_LEVEL];
+    for (int y = 0; y < levelHeight; y++) {
+      memcpy(dest + (size_t)y * levelWidth * STREAM_CHANNELS,
+             preview + (size_t)y * width * STREAM_CHANNELS,
+             (size_t)levelWidth * STREAM_CHANNELS);
+    }
+    upload_build_mips(upload);
+    post(upload);
+  }
+  stbi_image_free(preview);
+}
+
+static void decode(const Request *request) {
+  int size;
+  unsigned char *data = read_file(request->path, &size);
+  ImageInfo info;
+  if (!data ||
+      image_info_from_memory(data, size, STREAM_CHANNELS, &info) != 0) {
+    free(data);
+    post_failure(request->handle);
+    return;
+  }
+
+  int levels = mip_count(info.width, info.height);
+  decode_preview(request->handle, data, size, &info, levels);
+
+  Upload *upload =
+      upload_create(request->handle, info.width, info.height, 0, levels - 1);
+  if (!upload ||
+      image_load_from_memory_into(data, size, STREAM_CHANNELS, upload->pixels,
+                                  upload->size + IMAGE_DEST_SLACK,
+                                  &info) != 0) {
+    if (upload) {
+      upload_free(upload);
+    }
+    post_failure(request->handle);
+  } else {
+    upload_build_mips(upload);
+    post(upload);
+  }
+  free(data);
+}
+
+static void *decoder_main(void *arg) {
+  pthread_mutex_lock(&mutex);
+  for (;;) {
+    while (!shuttingDown && !requestHead) {
+      pthread_cond_wait(&wake, &mutex);
+    }
+    if (shuttingDown) {
+      break;
+    }
+    Request *request = requestHead;
+    requestHead = request->next;
+    if (!requestHead) {
+      requestTail = NULL;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    decode(request);
+    free(request->path);
+    free(request);
+
+    pthread_mutex_lock(&mutex);
+  }
+  pthread_mutex_unlock(&mutex);
+  image_release_thread();
+  return NULL;
+}
+
+/**
+ * Starts the decoder thread. uploadBudget is the number of bytes
+ * texstream_update uploads per call.
+ * Returns 0 on success and -1 on failure.
+ */
+int texstream_init(size_t uploadBudget) {
+  budget = uploadBudget;
+  shuttingDown = 0;
+  if (pthread_create(&decoder, NULL, decoder_main, NULL) != 0) {
+    return -1;
+  }
+  decoderRunning = 1;
+  return 0;
+}
+
+/**
+ * Stops the decoder thread, dropping outstanding work, and deletes all
+ * streamed textures.
+ */
+void texstream_shutdown(void) {
+  pthread_mutex_lock(&mutex);
+  shuttingDown = 1;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&mutex);
+  if (decoderRunning) {
+    pthread_join(decoder, NULL);
+    decoderRunning = 0;
+  }
+
+  while (requestHead) {
+    Request *next = requestHead->next;
+    free(requestHead->path);
+    free(requestHead);
+    requestHead = next;
+  }
+  requestTail = NULL;
+  Upload *lists[] = {readyHead, pendingHead};
+  for (int i = 0; i < 2; i++) {
+    while (lists[i]) {
+      Upload *next = lists[i]->next;
+      upload_free(lists[i]);
+      lists[i] = next;
+    }
+  }
+  readyHead = readyTail = pendingHead = pendingTail = NULL;
+
+  for (int i = 0; i < textureCount; i++) {
+    glDeleteTextures(1, &textures[i].texture);
+  }
+  free(textures);
+  textures = NULL;
+  textureCount = textureCapacity = 0;
+}
+
+/**
+ * Gives the texture storage for a width x height image with a full mip
+ * chain. Draws sample the coarsest level, which holds mid grey until image
+ * data arrives.
+ */
+static void define_levels(StreamedTexture *texture, int width, int height) {
+  static const unsigned char grey[STREAM_CHANNELS] = {128, 128, 128, 255};
+
+  texture->width = width;
+  texture->height = height;
+  texture->levels = mip_count(width, height);
+  texture->residentLevel = texture->levels;
+
+  int coarsest = texture->levels - 1;
+  glBindTexture(GL_TEXTURE_2D, texture->texture);
+  for (int level = 0; level < texture->levels; level++) {
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, level_size(width, level),
+                 level_size(height, level), 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 NULL);
+  }
+  glTexSubImage2D(GL_TEXTURE_2D, coarsest, 0, 0, 1, 1, GL_RGBA,
+                  GL_UNSIGNED_BYTE, grey);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, coarsest);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, coarsest);
+}
+
+/**
+ * Creates a texture for the image at path and queues the image for
+ * decoding; the texture can be drawn with right away. width and height size
+ * the texture up front when known, e.g. from the asset manifest, and are 0
+ * otherwise. Returns a handle, or -1 on failure.
+ */
+int texstream_request(const char *path, int width, int height) {
+  if (textureCount == textureCapacity) {
+    int capacity = textureCapacity ? textureCapacity * 2 : 16;
+    StreamedTexture *grown =
+        realloc(textures, capacity * sizeof(StreamedTexture));
+    if (!grown) {
+      return -1;
+    }
+    textures = grown;
+    textureCapacity = capacity;
+  }
+  Request *request = malloc(sizeof(Request));
+  if (!request) {
+    return -1;
+  }
+  request->next = NULL;
+  request->path = strdup(path);
+  if (!request->path) {
+    free(request);
+    return -1;
+  }
+
+  int handle = textureCount++;
+  StreamedTexture *texture = &textures[handle];
+  memset(texture, 0, sizeof(StreamedTexture));
+  glGenTextures(1, &texture->texture);
+  glBindTexture(GL_TEXTURE_2D, texture->texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  define_levels(texture, width > 0 ? width : 1, height > 0 ? height : 1);
+
+  request->handle = handle;
+  pthread_mutex_lock(&mutex);
+  if (requestTail) {
+    requestTail->next = request;
+  } else {
+    requestHead = request;
+  }
+  requestTail = request;
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&mutex);
+  return handle;
+}
+
+/**
+ * Uploads rows of the current level of upload until budget bytes are used
+ * or the upload is done. Returns the number of bytes uploaded.
+ */
+static size_t upload_rows(Upload *upload, StreamedTexture *texture,
+                          size_t budget) {
+  size_t used = 0;
+  glBindTexture(GL_TEXTURE_2D, texture->texture);
+  while (upload->level >= upload->firstLevel && used < budget) {
+    int width = level_size(upload->width, upload->level);
+    int height = level_size(upload->height, upload->level);
+    size_t rowBytes = (size_t)width * STREAM_CHANNELS;
+    int rows = (int)((budget - used) / rowBytes);
+    if (rows < 1) {
+      rows = 1;
+    }
+    if (rows > height - upload->row) {
+      rows = height - upload->row;
+    }
+
+    glTexSubImage2D(GL_TEXTURE_2D, upload->level, 0, upload->row, width, rows,
+                    GL_RGBA, GL_UNSIGNED_BYTE,
+                    upload->pixels + upload->offset[upload->level] +
+                        upload->row * rowBytes);
+    used += rows * rowBytes;
+    upload->row += rows;
+
+    if (upload->row == height) {
+      if (upload->level < texture->residentLevel) {
+        texture->residentLevel = upload->level;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, upload->level);
+      }
+      upload->level--;
+      upload->row = 0;
+    }
+  }
+  return used;
+}
+
+/**
+ * Uploads decoded image data, coarse levels first, stopping once the upload
+ * budget is used up; the last row may overshoot it. Call once per frame from
+ * the thread owning the GL context; the GL_TEXTURE_2D binding is changed.
+ */
+void texstream_update(void) {
+  pthread_mutex_lock(&mutex);
+  if (readyHead) {
+    if (pendingTail) {
+      pendingTail->next = readyHead;
+    } else {
+      pendingHead = readyHead;
+    }
+    pendingTail = readyTail;
+    readyHead = readyTail = NULL;
+  }
+  pthread_mutex_unlock(&mutex);
+
+  size_t used = 0;
+  while (pendingHead && used < budget) {
+    Upload *upload = pendingHead;
+    StreamedTexture *texture = &textures[upload->handle];
+    if (!upload->pixels) {
+      texture->failed = 1;
+    } else {
+      if (texture->width != upload->width ||
+          texture->height != upload->height) {
+        define_levels(texture, upload->width, upload->height);
+      }
+      used += upload_rows(upload, texture, budget - used);
+      if (upload->level >= upload->firstLevel) {
+        break;
+      }
+    }
+
+    pendingHead = upload->next;
+    if (!pendingHead) {
+      pendingTail = NULL;
+    }
+    upload_free(upload);
+  }
+}
+
+unsigned int texstream_texture(int handle) { return textures[handle].texture; }
+
+/**
+ * Returns the finest mip level of the texture holding image data; 0 once the
+ * image is fully resident and the mip count while nothing is.
+ */
+int texstream_resident_level(int handle) {
+  return textures[handle].residentLevel;
+}
+
+int texstream_failed(int handle) { return textures[handle].failed; }
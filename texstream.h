@@ -0,0 +1,16 @@
+#ifndef TEXSTREAM_H
+#define TEXSTREAM_H
+
+#include <stddef.h>
+
+int texstream_init(size_t uploadBudget);
+void texstream_shutdown(void);
+
+int texstream_request(const char *path, int width, int height);
+void texstream_update(void);
+
+unsigned int texstream_texture(int handle);
+int texstream_resident_level(int handle);
+int texstream_failed(int handle);
+
+#endif
@@ -0,0 +1,328 @@
+#include "textable.h"
+
+#include <glad/gl.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resource.h"
+
+/*
+ * Table of 2D textures that shaders index by slot, so draws with different
+ * textures need no glBindTexture between them. With GL_ARB_bindless_texture
+ * the table is a storage buffer of texture handles; otherwise it is a 2D
+ * array texture the textures are scaled into. Shaders pick the matching
+ * declaration from the define of textable_define, see simple.frag.
+ */
+
+typedef GLuint64(GLAD_API_PTR *GetTextureHandleProc)(GLuint texture);
+typedef void(GLAD_API_PTR *HandleResidencyProc)(GLuint64 handle);
+
+static GetTextureHandleProc getTextureHandle = NULL;
+static HandleResidencyProc makeHandleResident = NULL;
+static HandleResidencyProc makeHandleNonResident = NULL;
+
+static int bindless = 0;
+static int slotCapacity = 0;
+static int slotCount = 0;
+/* Slot 0, a white texel for draws whose texture is not ready yet. */
+static unsigned int white = 0;
+
+/* Bindless: the resident handle of each slot, mirrored in handleBuffer. */
+static GLuint64 *handles = NULL;
+static unsigned int handleBuffer = 0;
+
+/* Fallback: one layer per slot, mip levels regenerated before binding once
+ * layers were added. */
+static unsigned int array = 0;
+static int arrayWidth = 0;
+static int arrayHeight = 0;
+static int mipmapsDirty = 0;
+static unsigned int framebuffers[2] = {0, 0};
+
+static int has_extension(const char *name) {
+  GLint extensionCount = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+  for (GLint i = 0; i < extensionCount; i++) {
+    if (strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Uses bindless handles if the context has both extensions the shader
+ * table needs, GL 4.3 for glShaderStorageBlockBinding and the entry points.
+ * Shaders learn the outcome from the define of textable_define.
+ */
+static int load_bindless(void) {
+  if (!GLAD_GL_VERSION_4_3 || !has_extension("GL_ARB_bindless_texture") ||
+      !has_extension("GL_ARB_shader_storage_buffer_object")) {
+    return 0;
+  }
+  getTextureHandle =
+      (GetTextureHandleProc)glfwGetProcAddress("glGetTextureHandleARB");
+  makeHandleResident = (HandleResidencyProc)glfwGetProcAddress(
+      "glMakeTextureHandleResidentARB");
+  makeHandleNonResident = (HandleResidencyProc)glfwGetProcAddress(
+      "glMakeTextureHandleNonResidentARB");
+  return getTextureHandle && makeHandleResident && makeHandleNonResident;
+}
+
+/**
+ * Returns GL_TEXTURE_BASE_LEVEL of texture, the finest level draws sample,
+ * and stores the size of that level in width and height.
+ */
+static int base_level(unsigned int texture, int *width, int *height) {
+  GLint level;
+  if (GLAD_GL_VERSION_4_5) {
+    glGetTextureParameteriv(texture, GL_TEXTURE_BASE_LEVEL, &level);
+    glGetTextureLevelParameteriv(texture, level, GL_TEXTURE_WIDTH, width);
+    glGetTextureLevelParameteriv(texture, level, GL_TEXTURE_HEIGHT, height);
+    return level;
+  }
+  GLint previous;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &level);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, width);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, height);
+  glBindTexture(GL_TEXTURE_2D, previous);
+  return level;
+}
+
+/**
+ * Scales the base level of texture into layer of the array with a blit,
+ * leaving the framebuffer bindings and scissor test as they were.
+ */
+static void copy_to_layer(unsigned int texture, int layer) {
+  int width, height;
+  int level = base_level(texture, &width, &height);
+
+  GLint read, draw;
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw);
+  GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+  glDisable(GL_SCISSOR_TEST);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                         GL_TEXTURE_2D, texture, level);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+  glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array,
+                            0, layer);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, arrayWidth, arrayHeight,
+                    GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+  if (scissor) {
+    glEnable(GL_SCISSOR_TEST);
+  }
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, read);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw);
+}
+
+static int mip_levels(int width, int height) {
+  int levels = 1;
+  while ((width | height) >> levels) {
+    levels++;
+  }
+  return levels;
+}
+
+/**
+ * Creates a table of up to capacity textures, slot 0 being white. Without
+ * bindless textures every texture is scaled to width x height, and the
+ * capacity is limited to GL_MAX_ARRAY_TEXTURE_LAYERS. Returns 0 on success
+ * and -1 on failure.
+ */
+int textable_init(int capacity, int width, int height) {
+  bindless = load_bindless();
+  if (bindless) {
+    handles = calloc(capacity, sizeof(GLuint64));
+    handleBuffer = resource_buffer(capacity * sizeof(GLuint64), NULL,
+                                   GL_DYNAMIC_STORAGE_BIT);
+    if (!handles) {
+      textable_shutdown();
+      return -1;
+    }
+  } else {
+    GLint maxLayers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    if (capacity > maxLayers) {
+      capacity = maxLayers;
+    }
+    arrayWidth = width;
+    arrayHeight = height;
+    array = resource_texture_array(width, height, capacity,
+                                   mip_levels(width, height), GL_RGBA8);
+    glGenFramebuffers(2, framebuffers);
+  }
+  slotCapacity = capacity;
+  slotCount = 0;
+
+  const unsigned char texel[4] = {255, 255, 255, 255};
+  white = resource_texture_2d(1, 1, 1, GL_RGBA8);
+  resource_texture_upload(white, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                          texel);
+  if (textable_add(white) != 0) {
+    textable_shutdown();
+    return -1;
+  }
+  return 0;
+}
+
+void textable_shutdown(void) {
+  /* Slots still waiting for their texture share the handle of slot 0. */
+  for (int i = 0; bindless && i < slotCount; i++) {
+    if (i == 0 || handles[i] != handles[0]) {
+      makeHandleNonResident(handles[i]);
+    }
+  }
+  free(handles);
+  handles = NULL;
+  if (handleBuffer) {
+    glDeleteBuffers(1, &handleBuffer);
+    handleBuffer = 0;
+  }
+  if (array) {
+    glDeleteTextures(1, &array);
+    glDeleteFramebuffers(2, framebuffers);
+    array = 0;
+  }
+  if (white) {
+    glDeleteTextures(1, &white);
+    white = 0;
+  }
+  slotCount = slotCapacity = 0;
+}
+
+/**
+ * Shows texture in slot. Without bindless textures its base level is copied.
+ * With them, its handle is made resident once the base level is 0, i.e. the
+ * texture is complete; until then slot keeps the handle of slot 0.
+ */
+static void fill_slot(int slot, unsigned int texture) {
+  int width, height;
+  if (!bindless) {
+    copy_to_layer(texture, slot);
+    mipmapsDirty = 1;
+    return;
+  }
+  if ((slot > 0 && handles[slot] != handles[0]) ||
+      base_level(texture, &width, &height) != 0) {
+    return;
+  }
+  GLuint64 handle = getTextureHandle(texture);
+  makeHandleResident(handle);
+  handles[slot] = handle;
+  resource_buffer_update(handleBuffer, slot * sizeof(GLuint64),
+                         sizeof(GLuint64), &handle);
+}
+
+/**
+ * Adds the 2D texture to the table. A texture still streaming in may be
+ * added right away: the table shows the levels resident now, and
+ * textable_refresh picks up finer ones. Without bindless textures the base
+ * level is copied, so later changes are only seen after a refresh. With
+ * them, draws see white until the texture is complete; its handle is then
+ * made resident, after which the texture must not be changed. Returns the
+ * slot for shaders to index, or -1 if the table is full.
+ */
+int textable_add(unsigned int texture) {
+  if (slotCount == slotCapacity) {
+    fprintf(stderr, "Texture table is full, %d slots\n", slotCapacity);
+    return -1;
+  }
+  int slot = slotCount++;
+  if (bindless && slot > 0) {
+    handles[slot] = handles[0];
+    resource_buffer_update(handleBuffer, slot * sizeof(GLuint64),
+                           sizeof(GLuint64), &handles[0]);
+  }
+  fill_slot(slot, texture);
+  return slot;
+}
+
+/**
+ * Shows the levels of texture in slot again after finer ones became
+ * resident, e.g. when texstream_resident_level changes.
+ */
+void textable_refresh(int slot, unsigned int texture) {
+  fill_slot(slot, texture);
+}
+
+/**
+ * Returns 1 if the table holds bindless handles and 0 if it is an array
+ * texture.
+ */
+int textable_bindless(void) { return bindless; }
+
+/**
+ * Returns the define selecting the bindless table in shaders, to inject
+ * with shaderpp, or NULL if the table is an array texture. Shaders test it
+ * rather than the extension macros, which GLSL compilers also define on
+ * contexts textable_init turns down, e.g. below GL 4.3.
+ */
+const char *textable_define(void) {
+  return bindless ? "TEXTABLE_BINDLESS" : NULL;
+}
+
+/**
+ * Points the table declared by program, the storage block TextureTable or
+ * the sampler2DArray textureTable, at binding. Call once per linked
+ * program.
+ */
+void textable_prepare(unsigned int program, unsigned int binding) {
+  if (bindless) {
+    GLuint index = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK,
+                                             "TextureTable");
+    if (index != GL_INVALID_INDEX) {
+      glShaderStorageBlockBinding(program, index, binding);
+    }
+    return;
+  }
+  GLint location = glGetUniformLocation(program, "textureTable");
+  if (location < 0) {
+    return;
+  }
+  if (GLAD_GL_VERSION_4_1) {
+    glProgramUniform1i(program, location, binding);
+    return;
+  }
+  GLint previous;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+  glUseProgram(program);
+  glUniform1i(location, binding);
+  glUseProgram(previous);
+}
+
+/**
+ * Binds the table to binding, a storage buffer binding or a texture unit.
+ * The active texture unit is left as it was.
+ */
+void textable_bind(unsigned int binding) {
+  if (bindless) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, handleBuffer);
+    return;
+  }
+  if (mipmapsDirty) {
+    if (GLAD_GL_VERSION_4_5) {
+      glGenerateTextureMipmap(array);
+    } else {
+      GLint previous;
+      glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &previous);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+      glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, previous);
+    }
+    mipmapsDirty = 0;
+  }
+  GLint active;
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+  glActiveTexture(GL_TEXTURE0 + binding);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+  glActiveTexture(active);
+}
@@ -0,0 +1,15 @@
+#ifndef TEXTABLE_H
+#define TEXTABLE_H
+
+int textable_init(int capacity, int width, int height);
+void textable_shutdown(void);
+
+int textable_add(unsigned int texture);
+void textable_refresh(int slot, unsigned int texture);
+int textable_bindless(void);
+const char *textable_define(void);
+
+void textable_prepare(unsigned int program, unsigned int binding);
+void textable_bind(unsigned int binding);
+
+#endif
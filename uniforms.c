@@ -0,0 +1,265 @@
+#include "uniforms.h"
+
+#include <glad/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Frames the GPU may still be reading when the CPU writes the next one. The
+ * ring is split into this many parts, each guarded by a fence. */
+#define UNIFORMS_FRAMES 3
+/* Longest wait for a part of the ring per try, in nanoseconds. */
+#define UNIFORMS_WAIT_TIMEOUT 1000000000ull
+
+static unsigned int buffer = 0;
+/* Persistently mapped ring with GL 4.4, written directly. */
+static unsigned char *mapped = NULL;
+/* Otherwise a CPU copy of the ring; uniforms_flush uploads what was written
+ * since the last flush in one call. */
+static unsigned char *staging = NULL;
+static size_t partSize = 0;
+static size_t alignment = 1;
+static size_t head = 0;
+static size_t flushed = 0;
+static int frame = 0;
+static GLsync fences[UNIFORMS_FRAMES];
+
+static size_t align_up(size_t value) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static size_t part_start(void) {
+  return (size_t)(frame % UNIFORMS_FRAMES) * partSize;
+}
+
+/**
+ * Creates a ring buffer of size bytes for uniform and storage block data.
+ * Each frame gets a third of it. Returns 0 on success and -1 on failure.
+ */
+int uniforms_init(size_t size) {
+  GLint uniformAlignment = 1;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+  alignment = uniformAlignment > 0 ? uniformAlignment : 1;
+  if (GLAD_GL_VERSION_4_3) {
+    GLint storageAlignment = 1;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+    /* Both alignments are powers of two, so the larger one satisfies both. */
+    if ((size_t)storageAlignment > alignment) {
+      alignment = storageAlignment;
+    }
+  }
+  partSize = size / UNIFORMS_FRAMES / alignment * alignment;
+  if (partSize == 0) {
+    return -1;
+  }
+  size = partSize * UNIFORMS_FRAMES;
+
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  if (GLAD_GL_VERSION_4_4) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+    mapped = glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+  } else {
+    glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+    staging = malloc(size);
+  }
+  if (!mapped && !staging) {
+    uniforms_shutdown();
+    return -1;
+  }
+  frame = 0;
+  head = flushed = 0;
+  memset(fences, 0, sizeof(fences));
+  return 0;
+}
+
+void uniforms_shutdown(void) {
+  for (int i = 0; i < UNIFORMS_FRAMES; i++) {
+    if (fences[i]) {
+      glDeleteSync(fences[i]);
+      fences[i] = NULL;
+    }
+  }
+  if (mapped) {
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    mapped = NULL;
+  }
+  if (buffer) {
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+  }
+  free(staging);
+  staging = NULL;
+}
+
+/**
+ * Starts writing the next part of the ring. Waits only if the GPU is still
+ * reading the frame that used it last, UNIFORMS_FRAMES frames ago.
+ */
+void uniforms_begin_frame(void) {
+  GLsync *fence = &fences[frame % UNIFORMS_FRAMES];
+  if (*fence) {
+    while (glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                            UNIFORMS_WAIT_TIMEOUT) == GL_TIMEOUT_EXPIRED) {
+    }
+    glDeleteSync(*fence);
+    *fence = NULL;
+  }
+  head = flushed = part_start();
+}
+
+/**
+ * Allocates size bytes for a block in this frame's part of the ring,
+ * aligned for glBindBufferRange. Returns 0 on success and -1 if the part is
+ * full.
+ */
+int uniforms_alloc(size_t size, UniformSlice *slice) {
+  size_t offset = align_up(head);
+  if (offset + size > part_start() + partSize) {
+    fprintf(stderr, "Uniform ring is full, %zu bytes requested\n", size);
+    return -1;
+  }
+  slice->data = (mapped ? mapped : staging) + offset;
+  slice->offset = offset;
+  slice->size = size;
+  head = offset + size;
+  return 0;
+}
+
+/**
+ * Makes the slices written so far visible to the GPU. Call once after
+ * writing a batch of blocks and before the draws reading them.
+ */
+void uniforms_flush(void) {
+  if (staging && head > flushed) {
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, flushed, head - flushed,
+                    staging + flushed);
+  }
+  flushed = head;
+}
+
+/**
+ * Binds slice to binding of target, GL_UNIFORM_BUFFER or
+ * GL_SHADER_STORAGE_BUFFER.
+ */
+void uniforms_bind(unsigned int target, unsigned int binding,
+                   const UniformSlice *slice) {
+  glBindBufferRange(target, binding, buffer, slice->offset, slice->size);
+}
+
+/**
+ * Flushes the frame's slices and fences its part of the ring. Call after
+ * the frame's last draw.
+ */
+void uniforms_end_frame(void) {
+  uniforms_flush();
+  fences[frame % UNIFORMS_FRAMES] =
+      glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frame++;
+}
+
+static int check_size(const char *blockName, GLint blockSize, size_t size) {
+  if (size && (size_t)blockSize > size) {
+    fprintf(stderr, "Block %s: %d bytes in GLSL, %zu in C\n", blockName,
+            blockSize, size);
+    return -1;
+  }
+  return 0;
+}
+
+static int check_offset(const char *blockName, const UniformField *field,
+                        GLint offset) {
+  if (offset < 0 || (size_t)offset != field->offset) {
+    fprintf(stderr, "Block %s: %s at offset %d in GLSL, %zu in C\n", blockName,
+            field->name, offset, field->offset);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Verifies a C struct of size bytes against the uniform block blockName of
+ * the linked program: every field must be an active member at the same
+ * offset, and the block must fit the struct. Call after linking. Mismatches
+ * are printed. Returns 0 if the layouts agree and -1 otherwise.
+ */
+int uniforms_check_block(unsigned int program, const char *blockName,
+                         size_t size, const UniformField *fields,
+                         int fieldCount) {
+  GLuint blockIndex = glGetUniformBlockIndex(program, blockName);
+  if (blockIndex == GL_INVALID_INDEX) {
+    fprintf(stderr, "Block %s is not active\n", blockName);
+    return -1;
+  }
+  GLint blockSize;
+  glGetActiveUniformBlockiv(program, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE,
+                            &blockSize);
+  int result = check_size(blockName, blockSize, size);
+
+  for (int i = 0; i < fieldCount; i++) {
+    GLuint index;
+    glGetUniformIndices(program, 1, &fields[i].name, &index);
+    GLint offset = -1, owner = -1;
+    if (index != GL_INVALID_INDEX) {
+      glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &offset);
+      glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX,
+                            &owner);
+    }
+    if ((GLuint)owner != blockIndex) {
+      fprintf(stderr, "Block %s: %s is not an active member\n", blockName,
+              fields[i].name);
+      result = -1;
+    } else if (check_offset(blockName, &fields[i], offset) != 0) {
+      result = -1;
+    }
+  }
+  return result;
+}
+
+/**
+ * uniforms_check_block for the std430 shader storage block blockName.
+ * A size of 0 skips the size check, e.g. for blocks ending in an unsized
+ * array. Needs GL 4.3; returns -1 on older contexts.
+ */
+int uniforms_check_storage_block(unsigned int program, const char *blockName,
+                                 size_t size, const UniformField *fields,
+                                 int fieldCount) {
+  if (!GLAD_GL_VERSION_4_3) {
+    fprintf(stderr, "Block %s: storage blocks need OpenGL 4.3\n", blockName);
+    return -1;
+  }
+  GLuint blockIndex =
+      glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, blockName);
+  if (blockIndex == GL_INVALID_INDEX) {
+    fprintf(stderr, "Block %s is not active\n", blockName);
+    return -1;
+  }
+  GLenum sizeProperty = GL_BUFFER_DATA_SIZE;
+  GLint blockSize;
+  glGetProgramResourceiv(program, GL_SHADER_STORAGE_BLOCK, blockIndex, 1,
+                         &sizeProperty, 1, NULL, &blockSize);
+  int result = check_size(blockName, blockSize, size);
+
+  GLenum properties[2] = {GL_OFFSET, GL_BLOCK_INDEX};
+  for (int i = 0; i < fieldCount; i++) {
+    GLuint index = glGetProgramResourceIndex(program, GL_BUFFER_VARIABLE,
+                                             fields[i].name);
+    GLint values[2] = {-1, -1};
+    if (index != GL_INVALID_INDEX) {
+      glGetProgramResourceiv(program, GL_BUFFER_VARIABLE, index, 2, properties,
+                             2, NULL, values);
+    }
+    if ((GLuint)values[1] != blockIndex) {
+      fprintf(stderr, "Block %s: %s is not an active member\n", blockName,
+              fields[i].name);
+      result = -1;
+    } else if (check_offset(blockName, &fields[i], values[0]) != 0) {
+      result = -1;
+    }
+  }
+  return result;
+}
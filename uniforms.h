@@ -0,0 +1,44 @@
+#ifndef UNIFORMS_H
+#define UNIFORMS_H
+
+#include <stddef.h>
+
+/**
+ * Part of the uniform ring holding one block's data for the current frame.
+ * data is written by the CPU and stays valid until uniforms_end_frame.
+ */
+typedef struct {
+  void *data;
+  size_t offset;
+  size_t size;
+} UniformSlice;
+
+/**
+ * Block member as laid out by a C struct, compared against the offset the
+ * linked program reports for the member of the same name.
+ */
+typedef struct {
+  const char *name;
+  size_t offset;
+} UniformField;
+
+#define UNIFORM_FIELD(type, member) {#member, offsetof(type, member)}
+
+int uniforms_init(size_t size);
+void uniforms_shutdown(void);
+
+void uniforms_begin_frame(void);
+int uniforms_alloc(size_t size, UniformSlice *slice);
+void uniforms_flush(void);
+void uniforms_bind(unsigned int target, unsigned int binding,
+                   const UniformSlice *slice);
+void uniforms_end_frame(void);
+
+int uniforms_check_block(unsigned int program, const char *blockName,
+                         size_t size, const UniformField *fields,
+                         int fieldCount);
+int uniforms_check_storage_block(unsigned int program, const char *blockName,
+                                 size_t size, const UniformField *fields,
+                                 int fieldCount);
+
+#endif